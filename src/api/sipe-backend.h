@@ -627,6 +627,7 @@ typedef enum {
   SIPE_SETTING_GROUPCHAT_USER,
   SIPE_SETTING_RDP_CLIENT,
   SIPE_SETTING_USER_AGENT,
+  SIPE_SETTING_SCHEDULE_SLACK,
   SIPE_SETTING_LAST
 } sipe_setting;
 const gchar *sipe_backend_setting(struct sipe_core_public *sipe_public,
@@ -51,20 +51,26 @@ extern "C" {
 /**
  * Transport connection (public part)
  *
- * The receiver in the backend fills "buffer". The backend has to zero
- * terminate the buffer before calling the processing function in the core.
+ * The receiver in the backend requests free space in the input buffer with
+ * sipe_core_transport_input_buffer(), fills it and reports the number of
+ * received bytes with sipe_core_transport_input_received() before calling
+ * the processing function in the core. This keeps the buffer zero
+ * terminated.
  *
- * The processing function in the core can remove content from the buffer.
- * It has to update buffer_used accordingly.
+ * "buffer" points to the first unread byte. The processing function in the
+ * core can remove content from the buffer by advancing "buffer". It has to
+ * update buffer_used accordingly. Unread content is only moved back to the
+ * start of the allocated memory when more than half of it has been consumed.
  *
  */
 struct sipe_transport_connection {
 	gpointer user_data;
-	gchar *buffer;
-	gsize buffer_used;        /* 0 < buffer_used < buffer_length */
+	gchar *buffer;            /* first unread byte */
+	gsize buffer_used;        /* unread bytes, 0 <= buffer_used < buffer_length */
 	gsize buffer_length;      /* read-only */
 	guint type;               /* read-only */
 	guint client_port;        /* read-only */
+	gchar *buffer_memory;     /* read-only */
 };
 
 /**
@@ -350,6 +356,37 @@ void sipe_core_transport_sip_connect(struct sipe_core_public *sipe_public,
  */
 const gchar *sipe_core_transport_sip_server_name(struct sipe_core_public *sipe_public);
 
+/**
+ * Get free space in transport input buffer
+ *
+ * The buffer grows geometrically, i.e. filling it is amortized linear in
+ * the amount of data received.
+ *
+ * @param conn   transport connection
+ * @param length (out) number of bytes that can be stored at returned pointer
+ *
+ * @return pointer to free space after the unread data
+ */
+gchar *sipe_core_transport_input_buffer(struct sipe_transport_connection *conn,
+					gsize *length);
+
+/**
+ * Add received data to transport input buffer
+ *
+ * @param conn   transport connection
+ * @param length number of bytes stored in space returned by
+ *               @c sipe_core_transport_input_buffer()
+ */
+void sipe_core_transport_input_received(struct sipe_transport_connection *conn,
+					gsize length);
+
+/**
+ * Release transport input buffer
+ *
+ * @param conn transport connection
+ */
+void sipe_core_transport_input_free(struct sipe_transport_connection *conn);
+
 /**
  * Get chat ID, f.ex. group chat URI
  */
@@ -98,6 +98,89 @@ static void assert_equal_guint32(guint32 expected, guint32 got)
 	}
 }
 
+/* reference: one byte per iteration */
+static guint32 crc32_bytewise(guint32 crc, const guint8 *buf, gsize len)
+{
+	while (len--)
+		crc = (crc >> 8) ^ crc32_table[0][(crc ^ *buf++) & 0xff];
+	return(crc);
+}
+
+static void crc32_benchmark(const guint8 *buf)
+{
+	static const gsize sizes[] = { 1024, 2048, 4096, 8192 };
+	GTimer *timer = g_timer_new();
+	gsize i;
+
+	for (i = 0; i < G_N_ELEMENTS(sizes); i++) {
+		/* 64MB per implementation, chained so no pass can be skipped */
+		guint iterations = (64 * 1024 * 1024) / sizes[i];
+		guint32 crc = 0;
+		gdouble bytewise_time, slice8_time, selected_time;
+		guint j;
+
+		g_timer_start(timer);
+		for (j = 0; j < iterations; j++)
+			crc = crc32_bytewise(crc, buf, sizes[i]);
+		bytewise_time = g_timer_elapsed(timer, NULL);
+
+		g_timer_start(timer);
+		for (j = 0; j < iterations; j++)
+			crc = crc32_slice8(crc, buf, sizes[i]);
+		slice8_time = g_timer_elapsed(timer, NULL);
+
+		g_timer_start(timer);
+		for (j = 0; j < iterations; j++)
+			crc = crc32_update(crc, buf, sizes[i]);
+		selected_time = g_timer_elapsed(timer, NULL);
+
+		printf("CRC32 %5" G_GSIZE_FORMAT " bytes: bytewise %7.1f MB/s, slicing-by-8 %7.1f MB/s, selected (%s) %7.1f MB/s [%08X]\n",
+		       sizes[i],
+		       64 / bytewise_time,
+		       64 / slice8_time,
+#ifdef SIPE_CRC32_PCLMUL
+		       (crc32_update == crc32_pclmul) ? "PCLMUL" : "slicing-by-8",
+#else
+		       "slicing-by-8",
+#endif
+		       64 / selected_time,
+		       crc);
+	}
+
+	g_timer_destroy(timer);
+}
+
+/* throughput comparison only with SIPE_BENCHMARK set in the environment */
+static void crc32_compare(void)
+{
+	guint8 *buf = g_malloc(8192 + 8);
+	guint32 seed = 0x12345678;
+	guint mismatches = 0;
+	gsize offset, len, i;
+
+	/* printable text like a SIP message */
+	for (i = 0; i < 8192 + 8; i++) {
+		seed = seed * 1103515245 + 12345;
+		buf[i] = 0x20 + ((seed >> 16) % 0x5f);
+	}
+
+	/* all lengths around the block boundaries and all alignments */
+	for (offset = 0; offset < 8; offset++)
+		for (len = 0; len <= 8192; len += (len < 512) ? 1 : 61) {
+			guint32 expected = crc32_bytewise(0xffffffff, buf + offset, len);
+			if (crc32_slice8(0xffffffff, buf + offset, len) != expected)
+				mismatches++;
+			if (crc32_update(0xffffffff, buf + offset, len) != expected)
+				mismatches++;
+		}
+	assert_equal_guint32(0, mismatches);
+
+	if (g_getenv("SIPE_BENCHMARK"))
+		crc32_benchmark(buf);
+
+	g_free(buf);
+}
+
 gboolean sip_sec_ntlm_tests(void)
 {
 	const char *password;
@@ -124,10 +207,10 @@ gboolean sip_sec_ntlm_tests(void)
 	guchar server_sign_key [16];
 	guchar server_seal_key [16];
 	guint32 mac [4];
+	struct ntlm_mac_state mac_state;
 	guchar text_enc [18 + 12];
 	struct sipmsg *msg;
-	struct sipmsg_breakdown msgbd;
-	gchar *msg_str;
+	GString *msg_str = g_string_new(NULL);
 	const char *password2;
 	const char *user2;
 	const char *domain2;
@@ -140,6 +223,7 @@ gboolean sip_sec_ntlm_tests(void)
 	const gchar *response_sig;
 
 	printf ("Starting Tests\n");
+	memset(&mac_state, 0, sizeof(mac_state));
 
 	/* Initialization for crypto backend (test mode) */
 	sipe_crypto_init(FALSE);
@@ -233,6 +317,9 @@ gboolean sip_sec_ntlm_tests(void)
 	crc = CRC32((char*)text, 18);
 	assert_equal_guint32(0x93AA847D, crc);
 
+	printf ("\n\nTesting CRC32 implementations\n");
+	crc32_compare();
+
 	printf ("\n\nTesting Encryption\n");
 	{
 	//SEALKEY (flags, exported_session_key, TRUE, client_seal_key);
@@ -500,13 +587,11 @@ Response:
 	msg2 = "SIP/2.0 200 OK\r\nms-keep-alive: UAS; tcp=no; hop-hop=yes; end-end=no; timeout=300\r\nAuthentication-Info: NTLM rspauth=\"0100000000000000BF2E52667DDF6DED\", srand=\"0878F41B\", snum=\"1\", opaque=\"4452DFB0\", qop=\"auth\", targetname=\"ocs1.ocs.provo.novell.com\", realm=\"SIP Communications Service\"\r\nFrom: \"Gabriel Burt\"<sip:gabriel@ocs.provo.novell.com>;tag=2947328781;epid=1234567890\r\nTo: <sip:gabriel@ocs.provo.novell.com>;tag=B816D65C2300A32CFA6D371F2AF537FD\r\nCall-ID: 8592g5DCBa1694i5887m0D0Bt2247b3F38xAE9Fx\r\nCSeq: 3 REGISTER\r\nVia: SIP/2.0/TLS 164.99.194.49:10409;branch=z9hG4bKE0E37DBAF252C3255BAD;received=164.99.195.20;ms-received-port=10409;ms-received-cid=1E00\r\nContact: <sip:164.99.195.20:10409;transport=tls;ms-received-cid=1E00>;expires=900\r\nExpires: 900\r\nAllow-Events: vnd-microsoft-provisioning,vnd-microsoft-roaming-contacts,vnd-microsoft-roaming-ACL,presence,presence.wpending,vnd-microsoft-roaming-self,vnd-microsoft-provisioning-v2\r\nSupported: adhoclist\r\nServer: RTC/3.0\r\nSupported: com.microsoft.msrtc.presence\r\nContent-Length: 0\r\n\r\n";
 	msg = sipmsg_parse_msg(msg2);
 
-	memset(&msgbd, 0, sizeof(struct sipmsg_breakdown));
-	msgbd.msg = msg;
-	sipmsg_breakdown_parse(&msgbd, "SIP Communications Service", "ocs1.ocs.provo.novell.com", NULL);
-	msg_str = sipmsg_breakdown_get_string(2, &msgbd);
+	sipmsg_breakdown_signature_input(msg_str, 2, msg, "SIP Communications Service", "ocs1.ocs.provo.novell.com", NULL, NULL, NULL);
+	mac_state_init(&mac_state, exported_session_key2, 16, exported_session_key2, 16);
 	sip_sec_ntlm_sipe_signature_make (NEGOTIATE_FLAGS_CONNLESS & ~NTLMSSP_NEGOTIATE_EXTENDED_SESSIONSECURITY,
-		msg_str, 0, exported_session_key2, exported_session_key2, mac);
-	sipmsg_breakdown_free(&msgbd);
+		msg_str->str, 0, &mac_state, mac);
+	sipmsg_free(msg);
 	assert_equal ("0100000000000000BF2E52667DDF6DED", mac, 16, TRUE);
 	/* sig = buff_to_hex_str((guint8 *)mac, 16); */
 	}
@@ -758,26 +843,25 @@ Message (length 352):
 
 	printf ("\n\nTesting (NTLMv2 / OC 2007 R2) Message Parsing, Signing, and Verification\nClient request\n(Authentication Protocol version 4)\n");
 	msg = sipmsg_parse_msg(request);
-	memset(&msgbd, 0, sizeof(struct sipmsg_breakdown));
-	msgbd.msg = msg;
-	sipmsg_breakdown_parse(&msgbd, "SIP Communications Service", "cosmo-ocs-r2.cosmo.local", NULL);
-	msg_str = sipmsg_breakdown_get_string(4, &msgbd);
-	assert_equal (request_sig, (guchar *)msg_str, strlen(request_sig), FALSE);
-	sip_sec_ntlm_sipe_signature_make (flags, msg_str, 0, client_sign_key, client_seal_key, mac);
-	sipmsg_breakdown_free(&msgbd);
+	sipmsg_breakdown_signature_input(msg_str, 4, msg, "SIP Communications Service", "cosmo-ocs-r2.cosmo.local", NULL, NULL, NULL);
+	assert_equal (request_sig, (guchar *)msg_str->str, strlen(request_sig), FALSE);
+	mac_state_init(&mac_state, client_sign_key, 16, client_seal_key, 16);
+	sip_sec_ntlm_sipe_signature_make (flags, msg_str->str, 0, &mac_state, mac);
+	assert_equal ("0100000029618e9651b65a7764000000", mac, 16, TRUE);
+	printf ("\n\nTesting (NTLMv2 / OC 2007 R2) Signing with reused keyed state\n");
+	sip_sec_ntlm_sipe_signature_make (flags, msg_str->str, 0, &mac_state, mac);
+	sipmsg_free(msg);
 	assert_equal ("0100000029618e9651b65a7764000000", mac, 16, TRUE);
 	/* sig = buff_to_hex_str((guint8 *)mac, 16); */
 
 	printf ("\n\nTesting (NTLMv2 / OC 2007 R2) Message Parsing, Signing, and Verification\nServer response\n(Authentication Protocol version 4)\n");
 	msg = sipmsg_parse_msg(response);
-	memset(&msgbd, 0, sizeof(struct sipmsg_breakdown));
-	msgbd.msg = msg;
-	sipmsg_breakdown_parse(&msgbd, "SIP Communications Service", "cosmo-ocs-r2.cosmo.local", NULL);
-	msg_str = sipmsg_breakdown_get_string(4, &msgbd);
-	assert_equal (response_sig, (guchar *)msg_str, strlen(response_sig), FALSE);
+	sipmsg_breakdown_signature_input(msg_str, 4, msg, "SIP Communications Service", "cosmo-ocs-r2.cosmo.local", NULL, NULL, NULL);
+	assert_equal (response_sig, (guchar *)msg_str->str, strlen(response_sig), FALSE);
 	// server keys here
-	sip_sec_ntlm_sipe_signature_make (flags, msg_str, 0, server_sign_key, server_seal_key, mac);
-	sipmsg_breakdown_free(&msgbd);
+	mac_state_init(&mac_state, server_sign_key, 16, server_seal_key, 16);
+	sip_sec_ntlm_sipe_signature_make (flags, msg_str->str, 0, &mac_state, mac);
+	sipmsg_free(msg);
 	assert_equal ("01000000E615438A917661BE64000000", mac, 16, TRUE);
 	/* sig = buff_to_hex_str((guint8 *)mac, 16); */
 
@@ -838,6 +922,9 @@ Message (length 352):
 	assert_equal(type3_hex, out_buff.value, out_buff.length, TRUE);
 	}
 
+	mac_state_clear(&mac_state);
+	g_string_free(msg_str, TRUE);
+
 	printf ("\nFinished With Tests; %d successs %d failures\n", successes, failures);
 
 	sip_sec_destroy__ntlm();
@@ -77,6 +77,7 @@
 #include "sipe-nls.h"
 #include "sipe-notify.h"
 #include "sipe-schedule.h"
+#include "sipe-snapshot.h"
 #include "sipe-sign.h"
 #include "sipe-subscriptions.h"
 #include "sipe-utils.h"
@@ -111,7 +112,9 @@ struct sip_transport {
 	gchar *uri_address;   	     /* URI X.X.X.X (IPv4), [X:X:...:X] (IPv6) */
 	const gchar *sdp_marker;     /* SDP address marker: "IP4" or "IP6"     */
 
-	GSList *transactions;
+	GHashTable *transactions;    /* key: transaction->key (case-insensitive) */
+	GString *transaction_key;    /* scratch buffer for transactions_find() */
+	GString *signature_input;    /* scratch buffer for message signatures   */
 
 	struct sip_auth registrar;
 	struct sip_auth proxy;
@@ -122,6 +125,11 @@ struct sip_transport {
 	guint keepalive_timeout;
 	time_t last_message;
 
+	/* incremental input framing */
+	struct sipmsg *input_msg;    /* parsed header, waiting for body        */
+	gsize input_scanned;         /* buffer offset searched for header end  */
+	gsize input_header_length;   /* header length including empty line     */
+
 	gboolean processing_input;   /* whether full header received */
 	gboolean auth_incomplete;    /* whether authentication not completed */
 	gboolean auth_retry;         /* whether next authentication should be tried */
@@ -169,26 +177,29 @@ static void sipe_make_signature(struct sipe_core_private *sipe_private,
 {
 	struct sip_transport *transport = sipe_private->transport;
 	if (sip_sec_context_is_ready(transport->registrar.gssapi_context)) {
-		struct sipmsg_breakdown msgbd;
-		gchar *signature_input_str;
-		msgbd.msg = msg;
-		sipmsg_breakdown_parse(&msgbd, transport->registrar.realm, transport->registrar.target,
-				       transport->registrar.protocol);
-		msgbd.rand = g_strdup_printf("%08x", g_random_int());
-		transport->registrar.ntlm_num++;
-		msgbd.num = g_strdup_printf("%d", transport->registrar.ntlm_num);
-		signature_input_str = sipmsg_breakdown_get_string(transport->registrar.version, &msgbd);
-		if (signature_input_str != NULL) {
-			char *signature_hex = sip_sec_make_signature(transport->registrar.gssapi_context, signature_input_str);
+		gchar *rand = g_strdup_printf("%08x", g_random_int());
+		gchar *num  = g_strdup_printf("%d", ++transport->registrar.ntlm_num);
+
+		if (sipmsg_breakdown_signature_input(transport->signature_input,
+						     transport->registrar.version,
+						     msg,
+						     transport->registrar.realm,
+						     transport->registrar.target,
+						     transport->registrar.protocol,
+						     rand,
+						     num)) {
+			char *signature_hex = sip_sec_make_signature(transport->registrar.gssapi_context,
+								     transport->signature_input->str);
 			g_free(msg->signature);
 			msg->signature = signature_hex;
 			g_free(msg->rand);
-			msg->rand = g_strdup(msgbd.rand);
+			msg->rand = rand;
 			g_free(msg->num);
-			msg->num = g_strdup(msgbd.num);
-			g_free(signature_input_str);
+			msg->num = num;
+		} else {
+			g_free(num);
+			g_free(rand);
 		}
-		sipmsg_breakdown_free(&msgbd);
 	}
 }
 
@@ -592,10 +603,10 @@ static void transactions_remove(struct sipe_core_private *sipe_private,
 				struct transaction *trans)
 {
 	struct sip_transport *transport = sipe_private->transport;
-	if (transport->transactions) {
-		transport->transactions = g_slist_remove(transport->transactions,
-							 trans);
-		SIPE_DEBUG_INFO("SIP transactions count:%d after removal", g_slist_length(transport->transactions));
+	if (g_hash_table_lookup(transport->transactions, trans->key) == trans) {
+		g_hash_table_remove(transport->transactions, trans->key);
+		SIPE_DEBUG_INFO("SIP transactions count:%d after removal",
+				g_hash_table_size(transport->transactions));
 
 		if (trans->msg) sipmsg_free(trans->msg);
 		if (trans->payload) {
@@ -615,28 +626,24 @@ static void transactions_remove(struct sipe_core_private *sipe_private,
 static struct transaction *transactions_find(struct sip_transport *transport,
 					     struct sipmsg *msg)
 {
-	GSList *transactions = transport->transactions;
+	GString *key = transport->transaction_key;
 	const gchar *call_id = sipmsg_find_call_id_header(msg);
 	const gchar *cseq = sipmsg_find_cseq_header(msg);
-	gchar *key;
 
 	if (!call_id || !cseq) {
 		SIPE_DEBUG_ERROR_NOFORMAT("transaction_find: no Call-ID or CSeq!");
 		return NULL;
 	}
 
-	key = g_strdup_printf("<%s><%s>", call_id, cseq);
-	while (transactions) {
-		struct transaction *trans = transactions->data;
-		if (!g_ascii_strcasecmp(trans->key, key)) {
-			g_free(key);
-			return trans;
-		}
-		transactions = transactions->next;
-	}
-	g_free(key);
+	/* reuse buffer to avoid allocation for every response */
+	g_string_truncate(key, 0);
+	g_string_append_c(key, '<');
+	g_string_append(key, call_id);
+	g_string_append(key, "><");
+	g_string_append(key, cseq);
+	g_string_append_c(key, '>');
 
-	return NULL;
+	return(g_hash_table_lookup(transport->transactions, key->str));
 }
 
 static void transaction_timeout_cb(struct sipe_core_private *sipe_private,
@@ -666,24 +673,10 @@ struct transaction *sip_transport_request_timeout(struct sipe_core_private *sipe
 	gchar *theirepid  = dialog && dialog->theirepid ? g_strdup(dialog->theirepid) : NULL;
 	gchar *callid     = dialog && dialog->callid    ? g_strdup(dialog->callid)    : gencallid();
 	gchar *branch     = dialog && dialog->callid    ? NULL : genbranch();
-	gchar *route      = g_strdup("");
 	const gchar *epid = transport->epid;
 	int cseq          = dialog ? ++dialog->cseq : 1 /* as Call-Id is new in this case */;
 	struct transaction *trans = NULL;
 
-	if (dialog && dialog->routes)
-	{
-		GSList *iter = dialog->routes;
-
-		while(iter)
-		{
-			char *tmp = route;
-			route = g_strdup_printf("%sRoute: %s\r\n", route, (char *)iter->data);
-			g_free(tmp);
-			iter = g_slist_next(iter);
-		}
-	}
-
 	if (!ourtag && !dialog) {
 		ourtag = gentag();
 	}
@@ -698,51 +691,61 @@ struct transaction *sip_transport_request_timeout(struct sipe_core_private *sipe
 		cseq = ++transport->cseq;
 	}
 
-	buf = g_strdup_printf("%s %s SIP/2.0\r\n"
-			"Via: SIP/2.0/%s %s:%d%s%s\r\n"
-			"From: <sip:%s>%s%s;epid=%s\r\n"
-			"To: <%s>%s%s%s%s\r\n"
-			"Max-Forwards: 70\r\n"
-			"CSeq: %d %s\r\n"
-			"User-Agent: %s\r\n"
-			"Call-ID: %s\r\n"
-			"%s%s"
-			"Content-Length: %" G_GSIZE_FORMAT "\r\n\r\n%s",
-			method,
-			dialog && dialog->request ? dialog->request : url,
-			TRANSPORT_DESCRIPTOR,
-			transport->uri_address,
-			transport->connection->client_port,
-			branch ? ";branch=" : "",
-			branch ? branch : "",
-			sipe_private->username,
-			ourtag ? ";tag=" : "",
-			ourtag ? ourtag : "",
-			epid,
-			to,
-			theirtag ? ";tag=" : "",
-			theirtag ? theirtag : "",
-			theirepid ? ";epid=" : "",
-			theirepid ? theirepid : "",
-			cseq,
-			method,
-			sipe_core_user_agent(sipe_private),
-			callid,
-			route,
-			addheaders ? addheaders : "",
-			body ? (gsize) strlen(body) : 0,
-			body ? body : "");
-
-
-	//printf ("parsing msg buf:\n%s\n\n", buf);
-	msg = sipmsg_parse_msg(buf);
+	/* build message directly, i.e. no need to parse it */
+	msg = sipmsg_new_request(method,
+				 dialog && dialog->request ? dialog->request : url);
+
+	buf = g_strdup_printf("SIP/2.0/%s %s:%d%s%s",
+			      TRANSPORT_DESCRIPTOR,
+			      transport->uri_address,
+			      transport->connection->client_port,
+			      branch ? ";branch=" : "",
+			      branch ? branch : "");
+	sipmsg_add_header_now(msg, "Via", buf);
+	g_free(buf);
+
+	buf = g_strdup_printf("<sip:%s>%s%s;epid=%s",
+			      sipe_private->username,
+			      ourtag ? ";tag=" : "",
+			      ourtag ? ourtag : "",
+			      epid);
+	sipmsg_add_header_now(msg, "From", buf);
+	g_free(buf);
+
+	buf = g_strdup_printf("<%s>%s%s%s%s",
+			      to,
+			      theirtag ? ";tag=" : "",
+			      theirtag ? theirtag : "",
+			      theirepid ? ";epid=" : "",
+			      theirepid ? theirepid : "");
+	sipmsg_add_header_now(msg, "To", buf);
+	g_free(buf);
+
+	sipmsg_add_header_now(msg, "Max-Forwards", "70");
 
+	buf = g_strdup_printf("%d %s", cseq, method);
+	sipmsg_add_header_now(msg, "CSeq", buf);
 	g_free(buf);
+
+	sipmsg_add_header_now(msg, "User-Agent", sipe_core_user_agent(sipe_private));
+	sipmsg_add_header_now(msg, "Call-ID", callid);
+
+	if (dialog) {
+		GSList *iter;
+		for (iter = dialog->routes; iter; iter = g_slist_next(iter))
+			sipmsg_add_header_now(msg, "Route", iter->data);
+	}
+
+	if (addheaders && !sipmsg_add_headers_now(msg, addheaders))
+		SIPE_DEBUG_ERROR("sip_transport_request_timeout: invalid headers:\n%s",
+				 addheaders);
+
+	sipmsg_set_body(msg, body);
+
 	g_free(ourtag);
 	g_free(theirtag);
 	g_free(theirepid);
 	g_free(branch);
-	g_free(route);
 
 	sign_outgoing_message(sipe_private, msg);
 
@@ -768,9 +771,20 @@ struct transaction *sip_transport_request_timeout(struct sipe_core_private *sipe
 						      transaction_timeout_cb,
 						      NULL);
 			}
-			transport->transactions = g_slist_append(transport->transactions,
-								 trans);
-			SIPE_DEBUG_INFO("SIP transactions count:%d after addition", g_slist_length(transport->transactions));
+			{
+				struct transaction *old = g_hash_table_lookup(transport->transactions,
+									      trans->key);
+				if (old) {
+					SIPE_DEBUG_ERROR("sip_transport_request_timeout: replacing transaction %s",
+							 trans->key);
+					transactions_remove(sipe_private, old);
+				}
+			}
+			g_hash_table_insert(transport->transactions,
+					    trans->key,
+					    trans);
+			SIPE_DEBUG_INFO("SIP transactions count:%d after addition",
+					g_hash_table_size(transport->transactions));
 		}
 
 		send_sip_message(transport, buf);
@@ -981,8 +995,6 @@ static gboolean process_register_response(struct sipe_core_private *sipe_private
 	struct sip_transport *transport = sipe_private->transport;
 	const gchar *expires_header;
 	int expires, i;
-        GSList *hdr = msg->headers;
-        struct sipnameval *elem;
 
 	expires_header = sipmsg_find_expires_header(msg);
 	expires = expires_header != NULL ? strtol(expires_header, NULL, 10) : 0;
@@ -993,6 +1005,9 @@ static gboolean process_register_response(struct sipe_core_private *sipe_private
 			if (expires) {
 				const gchar *contact_hdr;
 				const gchar *auth_hdr;
+				struct sipmsg_header_iter iter;
+				const gchar *name;
+				const gchar *value;
 				gchar *gruu = NULL;
 				gchar *uuid;
 				gchar *timeout;
@@ -1084,21 +1099,20 @@ static gboolean process_register_response(struct sipe_core_private *sipe_private
 				SIPE_CORE_PRIVATE_FLAG_UNSET(BATCHED_SUPPORT);
 				SIPE_CORE_PRIVATE_FLAG_UNSET(SFB);
 
-                                while(hdr)
-                                {
-					elem = hdr->data;
-					if (sipe_strcase_equal(elem->name, "Supported")) {
-						if (sipe_strcase_equal(elem->value, "msrtc-event-categories")) {
+				sipmsg_header_iter_init(&iter, msg);
+				while (sipmsg_header_iter_next(&iter, &name, &value)) {
+					if (sipe_strcase_equal(name, "Supported")) {
+						if (sipe_strcase_equal(value, "msrtc-event-categories")) {
 							/* We interpret this as OCS2007+ indicator */
 							SIPE_CORE_PRIVATE_FLAG_SET(OCS2007);
-							SIPE_LOG_INFO("process_register_response: Supported: %s (indicates OCS2007+)", elem->value);
+							SIPE_LOG_INFO("process_register_response: Supported: %s (indicates OCS2007+)", value);
 						}
-						if (sipe_strcase_equal(elem->value, "adhoclist")) {
+						if (sipe_strcase_equal(value, "adhoclist")) {
 							SIPE_CORE_PRIVATE_FLAG_SET(BATCHED_SUPPORT);
-							SIPE_DEBUG_INFO("process_register_response: Supported: %s", elem->value);
+							SIPE_DEBUG_INFO("process_register_response: Supported: %s", value);
 						}
-					} else if (sipe_strcase_equal(elem->name, "Allow-Events")){
-						gchar **caps = g_strsplit(elem->value,",",0);
+					} else if (sipe_strcase_equal(name, "Allow-Events")){
+						gchar **caps = g_strsplit(value,",",0);
 						i = 0;
 						while (caps[i]) {
 							sipe_private->allowed_events =  g_slist_append(sipe_private->allowed_events, g_strdup(caps[i]));
@@ -1106,16 +1120,16 @@ static gboolean process_register_response(struct sipe_core_private *sipe_private
 							i++;
 						}
 						g_strfreev(caps);
-                                        } else if (sipe_strcase_equal(elem->name, "ms-user-logon-data")) {
-						if (sipe_strcase_equal(elem->value, "RemoteUser")) {
+                                        } else if (sipe_strcase_equal(name, "ms-user-logon-data")) {
+						if (sipe_strcase_equal(value, "RemoteUser")) {
 							SIPE_CORE_PRIVATE_FLAG_SET(REMOTE_USER);
 							SIPE_DEBUG_INFO_NOFORMAT("process_register_response: ms-user-logon-data: RemoteUser (connected "
 										 "via Edge Server)");
 						}
-					} else if (sipe_strcase_equal(elem->name, "Server")) {
+					} else if (sipe_strcase_equal(name, "Server")) {
 						/* Server string has format like 'RTC/6.0'.
 						 * We want to check the first digit. */
-						gchar **parts = g_strsplit_set(elem->value, "/.", 3);
+						gchar **parts = g_strsplit_set(value, "/.", 3);
 						if (g_strv_length(parts) > 1) {
 							guint version = atoi(parts[1]);
 							if (version >= 6) {
@@ -1125,8 +1139,7 @@ static gboolean process_register_response(struct sipe_core_private *sipe_private
 						}
 						g_strfreev(parts);
 					}
-                                        hdr = g_slist_next(hdr);
-                                }
+				}
 
 				sipe_backend_connection_completed(SIPE_CORE_PUBLIC);
 
@@ -1135,6 +1148,8 @@ static gboolean process_register_response(struct sipe_core_private *sipe_private
 
 				/* subscriptions, done only once */
 				if (!transport->subscribed) {
+					/* show buddy list from last session until server sends it */
+					sipe_snapshot_load(sipe_private);
 					sipe_subscription_self_events(sipe_private);
 					transport->subscribed = TRUE;
 				}
@@ -1457,10 +1472,19 @@ void sip_transport_drop(struct sipe_core_private *sipe_private)
 		g_free(transport->ip_address);
 		g_free(transport->epid);
 
-		while (transport->transactions)
-			transactions_remove(sipe_private,
-					    transport->transactions->data);
+		{
+			GList *transactions = g_hash_table_get_values(transport->transactions);
+			GList *entry;
+
+			for (entry = transactions; entry; entry = entry->next)
+				transactions_remove(sipe_private, entry->data);
+			g_list_free(transactions);
+		}
+		g_hash_table_destroy(transport->transactions);
+		g_string_free(transport->transaction_key, TRUE);
+		g_string_free(transport->signature_input, TRUE);
 
+		sipmsg_free(transport->input_msg);
 		g_free(transport);
 	}
 
@@ -1644,7 +1668,7 @@ static void process_input_message(struct sipe_core_private *sipe_private,
 				 * Redirect case: sipe_private->transport is
 				 * the new transport with empty queue
 				 */
-				if (sipe_private->transport->transactions) {
+				if (g_hash_table_size(sipe_private->transport->transactions)) {
 					SIPE_DEBUG_INFO("process_input_message: removing CSeq %d", transport->cseq);
 					transactions_remove(sipe_private, trans);
 				}
@@ -1660,55 +1684,96 @@ static void process_input_message(struct sipe_core_private *sipe_private,
 	}
 }
 
-static void sip_transport_input(struct sipe_transport_connection *conn)
+/*
+ * Extract next complete message from the input buffer
+ *
+ * The search for the end of the header resumes where the previous call
+ * stopped and the header is parsed only once. The parsed header is kept
+ * until the body has been received completely. This keeps the cost for
+ * reassembling a message that arrives in many pieces linear in its size.
+ *
+ * Returns NULL if more data is needed.
+ */
+static struct sipmsg *sip_transport_frame(struct sip_transport *transport)
 {
-	struct sipe_core_private *sipe_private = conn->user_data;
-	struct sip_transport *transport = sipe_private->transport;
-	gchar *cur = conn->buffer;
-
-	/* according to the RFC remove CRLF at the beginning */
-	while (*cur == '\r' || *cur == '\n') {
-		cur++;
-	}
-	if (cur != conn->buffer)
-		sipe_utils_shrink_buffer(conn, cur);
+	struct sipe_transport_connection *conn = transport->connection;
+	struct sipmsg *msg = transport->input_msg;
+	gchar *cur;
+
+	if (!msg) {
+		gsize offset = transport->input_scanned;
+
+		/* according to the RFC remove CRLF at the beginning */
+		if (offset == 0) {
+			cur = conn->buffer;
+			while (*cur == '\r' || *cur == '\n')
+				cur++;
+			if (cur != conn->buffer)
+				sipe_utils_shrink_buffer(conn, cur);
+		}
 
-	/* Received a full Header? */
-	transport->processing_input = TRUE;
-	while (transport->processing_input &&
-	       ((cur = strstr(conn->buffer, "\r\n\r\n")) != NULL)) {
-		struct sipmsg *msg;
-		guint remainder;
+		/* header end might straddle the previously scanned data */
+		offset = offset > 3 ? offset - 3 : 0;
+		if ((cur = strstr(conn->buffer + offset, "\r\n\r\n")) == NULL) {
+			transport->input_scanned = conn->buffer_used;
+			return(NULL);
+		}
 
+		/* Received a full Header */
 		cur += 2;
 		cur[0] = '\0';
-		msg = sipmsg_parse_header(conn->buffer);
-
-		cur += 2;
-		remainder = conn->buffer_used - (cur - conn->buffer);
-		if (msg && remainder >= (guint) msg->bodylen) {
-			char *dummy = g_malloc(msg->bodylen + 1);
-			memcpy(dummy, cur, msg->bodylen);
-			dummy[msg->bodylen] = '\0';
-			msg->body = dummy;
-			cur += msg->bodylen;
-			sipe_utils_message_debug(conn,
-						 "SIP",
-						 conn->buffer,
-						 msg->body,
-						 FALSE);
-			sipe_utils_shrink_buffer(conn, cur);
-		} else {
-			if (msg) {
-				SIPE_DEBUG_INFO("sipe_transport_input: body too short (%d < %d, strlen %d) - ignoring message", remainder, msg->bodylen, (int)strlen(conn->buffer));
-				sipmsg_free(msg);
-                        }
+		msg = sipmsg_parse_header_indexed(conn->buffer);
+		cur[0] = '\r';
 
-			/* restore header for next try */
-			cur[-2] = '\r';
-			return;
+		if (!msg) {
+			/* wait for more data and retry */
+			transport->input_scanned = 0;
+			return(NULL);
 		}
 
+		transport->input_msg           = msg;
+		transport->input_header_length = cur + 2 - conn->buffer;
+	}
+
+	if (conn->buffer_used - transport->input_header_length < (guint) msg->bodylen) {
+		SIPE_DEBUG_INFO("sip_transport_frame: body too short (%" G_GSIZE_FORMAT " < %d) - waiting for more data",
+				conn->buffer_used - transport->input_header_length,
+				msg->bodylen);
+		return(NULL);
+	}
+
+	cur = conn->buffer + transport->input_header_length;
+	msg->body = g_malloc(msg->bodylen + 1);
+	memcpy(msg->body, cur, msg->bodylen);
+	msg->body[msg->bodylen] = '\0';
+
+	/* header string for debugging */
+	cur[-2] = '\0';
+	sipe_utils_message_debug(conn,
+				 "SIP",
+				 conn->buffer,
+				 msg->body,
+				 FALSE);
+	sipe_utils_shrink_buffer(conn, cur + msg->bodylen);
+
+	/* start framing next message */
+	transport->input_msg           = NULL;
+	transport->input_scanned       = 0;
+	transport->input_header_length = 0;
+
+	return(msg);
+}
+
+static void sip_transport_input(struct sipe_transport_connection *conn)
+{
+	struct sipe_core_private *sipe_private = conn->user_data;
+	struct sip_transport *transport = sipe_private->transport;
+	struct sipmsg *msg;
+
+	transport->processing_input = TRUE;
+	while (transport->processing_input &&
+	       ((msg = sip_transport_frame(transport)) != NULL)) {
+
 		/* Fatal header parse error? */
 		if (msg->response == SIPMSG_RESPONSE_FATAL_ERROR) {
 			/* can't proceed -> drop connection */
@@ -1719,18 +1784,38 @@ static void sip_transport_input(struct sipe_transport_connection *conn)
 
 		/* Verify the signature before processing it */
 		} else if (sip_sec_context_is_ready(transport->registrar.gssapi_context)) {
-			struct sipmsg_breakdown msgbd;
-			gchar *signature_input_str;
-			gchar *rspauth;
-			msgbd.msg = msg;
-			sipmsg_breakdown_parse(&msgbd, transport->registrar.realm, transport->registrar.target,
-					       transport->registrar.protocol);
-			signature_input_str = sipmsg_breakdown_get_string(transport->registrar.version, &msgbd);
-
-			rspauth = sipmsg_find_part_of_header(sipmsg_find_header(msg, "Authentication-Info"), "rspauth=\"", "\"", NULL);
+			GString *buffer = transport->signature_input;
+			gboolean has_input = sipmsg_breakdown_signature_input(buffer,
+									      transport->registrar.version,
+									      msg,
+									      transport->registrar.realm,
+									      transport->registrar.target,
+									      transport->registrar.protocol,
+									      NULL,
+									      NULL);
+			gsize input_length = has_input ? buffer->len : 0;
+			const gchar *auth_info = sipmsg_find_known_header(msg,
+									  SIPMSG_HEADER_AUTHENTICATION_INFO);
+			const gchar *rspauth = auth_info ? strstr(auth_info, "rspauth=\"") : NULL;
+
+			/* append signature after the NUL-terminated input */
+			if (rspauth) {
+				const gchar *end;
+
+				rspauth += sizeof("rspauth=\"") - 1;
+				end = strchr(rspauth, '"');
+				g_string_truncate(buffer, input_length);
+				g_string_append_c(buffer, '\0');
+				g_string_append_len(buffer,
+						    rspauth,
+						    end ? end - rspauth : (gssize) strlen(rspauth));
+				rspauth = buffer->str + input_length + 1;
+			}
 
 			if (rspauth != NULL) {
-				if (sip_sec_verify_signature(transport->registrar.gssapi_context, signature_input_str, rspauth)) {
+				if (sip_sec_verify_signature(transport->registrar.gssapi_context,
+							     has_input ? buffer->str : NULL,
+							     rspauth)) {
 					SIPE_DEBUG_INFO_NOFORMAT("sip_transport_input: signature of incoming message validated");
 					process_input_message(sipe_private, msg);
 					/* transport is invalid after redirect */
@@ -1756,19 +1841,14 @@ static void sip_transport_input(struct sipe_transport_connection *conn)
 				}
 				SIPE_DEBUG_INFO_NOFORMAT("sip_transport_input: message without authentication data - ignoring");
 			}
-			g_free(signature_input_str);
-
-			g_free(rspauth);
-			sipmsg_breakdown_free(&msgbd);
 		} else {
 			process_input_message(sipe_private, msg);
 		}
 
 		sipmsg_free(msg);
 
-		/* Redirect: old content of "transport" & "conn" is no longer valid */
+		/* Redirect: old content of "transport" is no longer valid */
 		transport = sipe_private->transport;
-		conn      = transport->connection;
 	}
 }
 
@@ -1856,6 +1936,11 @@ static void sipe_server_register(struct sipe_core_private *sipe_private,
 	struct sip_transport *transport = g_new0(struct sip_transport, 1);
 
 	transport->auth_retry   = TRUE;
+	/* transaction keys are compared case-insensitive */
+	transport->transactions = g_hash_table_new(sipe_utils_strcase_hash,
+						   sipe_utils_strcase_key_equal);
+	transport->transaction_key = g_string_new(NULL);
+	transport->signature_input = g_string_sized_new(512);
 	transport->server_name  = server_name;
 	transport->server_port  = setup.server_port;
 	transport->connection   = sipe_backend_transport_connect(SIPE_CORE_PUBLIC,
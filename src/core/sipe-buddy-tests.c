@@ -0,0 +1,823 @@
+/**
+ * @file sipe-buddy-tests.c
+ *
+ * pidgin-sipe
+ *
+ * Copyright (C) 2020 SIPE Project <http://sipe.sourceforge.net/>
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ * Tests for the buddy updates passed to the backend: coalescing of
+ * property and status changes while a NOTIFY is processed and skipping
+ * of status updates that don't change anything. The backend buddy list
+ * is replaced by a stub that counts the calls.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+
+#include <glib.h>
+
+#include "sipe-buddy.c"
+#include "sipe-crypt.h"
+
+/*
+ * Stubs
+ */
+gboolean sipe_backend_debug_enabled(void)
+{
+	return(FALSE);
+}
+
+void sipe_backend_debug_literal(SIPE_UNUSED_PARAMETER sipe_debug_level level,
+				SIPE_UNUSED_PARAMETER const gchar *msg)
+{
+}
+
+void sipe_backend_debug(SIPE_UNUSED_PARAMETER sipe_debug_level level,
+			SIPE_UNUSED_PARAMETER const gchar *format,
+			...)
+{
+}
+
+const gchar *sip_transport_epid(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+	return(NULL);
+}
+
+gboolean sip_csta_is_idle(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+	return(TRUE);
+}
+
+void sip_soap_directory_search(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+			       SIPE_UNUSED_PARAMETER guint max,
+			       SIPE_UNUSED_PARAMETER const gchar *rows,
+			       SIPE_UNUSED_PARAMETER SoapTransCallback callback,
+			       SIPE_UNUSED_PARAMETER struct transaction_payload *payload)
+{
+}
+
+void sip_soap_request(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+		      SIPE_UNUSED_PARAMETER const gchar *method,
+		      SIPE_UNUSED_PARAMETER const gchar *request)
+{
+}
+
+gchar *sip_tel_uri_denormalize(SIPE_UNUSED_PARAMETER const gchar *tel_uri)
+{
+	return(NULL);
+}
+
+gchar *sip_to_tel_uri(SIPE_UNUSED_PARAMETER const gchar *phone)
+{
+	return(NULL);
+}
+
+struct sipe_backend_buddy_info *sipe_backend_buddy_info_start(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public)
+{
+	return(NULL);
+}
+
+void sipe_backend_buddy_info_add(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+				 SIPE_UNUSED_PARAMETER struct sipe_backend_buddy_info *info,
+				 SIPE_UNUSED_PARAMETER sipe_buddy_info_fields key,
+				 SIPE_UNUSED_PARAMETER const gchar *value)
+{
+}
+
+void sipe_backend_buddy_info_break(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+				   SIPE_UNUSED_PARAMETER struct sipe_backend_buddy_info *info)
+{
+}
+
+void sipe_backend_buddy_info_finalize(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+				      SIPE_UNUSED_PARAMETER struct sipe_backend_buddy_info *info,
+				      SIPE_UNUSED_PARAMETER const gchar *uri)
+{
+}
+
+struct sipe_backend_buddy_menu *sipe_backend_buddy_menu_add(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+							    SIPE_UNUSED_PARAMETER struct sipe_backend_buddy_menu *menu,
+							    SIPE_UNUSED_PARAMETER const gchar *label,
+							    SIPE_UNUSED_PARAMETER enum sipe_buddy_menu_type type,
+							    SIPE_UNUSED_PARAMETER gpointer parameter)
+{
+	return(NULL);
+}
+
+struct sipe_backend_buddy_menu *sipe_backend_buddy_sub_menu_add(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+								SIPE_UNUSED_PARAMETER struct sipe_backend_buddy_menu *menu,
+								SIPE_UNUSED_PARAMETER const gchar *label,
+								SIPE_UNUSED_PARAMETER struct sipe_backend_buddy_menu *sub)
+{
+	return(NULL);
+}
+
+void sipe_backend_buddy_tooltip_add(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+				    SIPE_UNUSED_PARAMETER struct sipe_backend_buddy_tooltip *tooltip,
+				    SIPE_UNUSED_PARAMETER const gchar *description,
+				    SIPE_UNUSED_PARAMETER const gchar *value)
+{
+}
+
+const gchar *sipe_backend_buddy_get_photo_hash(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+					       SIPE_UNUSED_PARAMETER const gchar *who)
+{
+	return(NULL);
+}
+
+void sipe_backend_buddy_set_photo(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+				  SIPE_UNUSED_PARAMETER const gchar *who,
+				  SIPE_UNUSED_PARAMETER gpointer image_data,
+				  SIPE_UNUSED_PARAMETER gsize image_len,
+				  SIPE_UNUSED_PARAMETER const gchar *photo_hash)
+{
+}
+
+gboolean sipe_backend_uses_photo(void)
+{
+	return(FALSE);
+}
+
+struct sipe_backend_chat_session *sipe_backend_chat_create(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+							   SIPE_UNUSED_PARAMETER struct sipe_chat_session *session,
+							   SIPE_UNUSED_PARAMETER const gchar *title,
+							   SIPE_UNUSED_PARAMETER const gchar *nick)
+{
+	return(NULL);
+}
+
+gboolean sipe_backend_chat_find(SIPE_UNUSED_PARAMETER struct sipe_backend_chat_session *backend_session,
+				SIPE_UNUSED_PARAMETER const gchar *uri)
+{
+	return(FALSE);
+}
+
+gboolean sipe_backend_chat_is_operator(SIPE_UNUSED_PARAMETER struct sipe_backend_chat_session *backend_session,
+				       SIPE_UNUSED_PARAMETER const gchar *uri)
+{
+	return(FALSE);
+}
+
+void sipe_backend_search_failed(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+				SIPE_UNUSED_PARAMETER struct sipe_backend_search_token *token,
+				SIPE_UNUSED_PARAMETER const gchar *msg)
+{
+}
+
+struct sipe_backend_search_results *sipe_backend_search_results_start(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+								      SIPE_UNUSED_PARAMETER struct sipe_backend_search_token *token)
+{
+	return(NULL);
+}
+
+void sipe_backend_search_results_add(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+				     SIPE_UNUSED_PARAMETER struct sipe_backend_search_results *results,
+				     SIPE_UNUSED_PARAMETER const gchar *uri,
+				     SIPE_UNUSED_PARAMETER const gchar *name,
+				     SIPE_UNUSED_PARAMETER const gchar *company,
+				     SIPE_UNUSED_PARAMETER const gchar *country,
+				     SIPE_UNUSED_PARAMETER const gchar *email)
+{
+}
+
+void sipe_backend_search_results_finalize(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+					  SIPE_UNUSED_PARAMETER struct sipe_backend_search_results *results,
+					  SIPE_UNUSED_PARAMETER const gchar *description,
+					  SIPE_UNUSED_PARAMETER gboolean more)
+{
+}
+
+void sipe_cal_free_working_hours(SIPE_UNUSED_PARAMETER struct sipe_cal_working_hours *wh)
+{
+}
+
+void sipe_cal_free_free_busy(SIPE_UNUSED_PARAMETER struct sipe_cal_free_busy *fb)
+{
+}
+
+char *sipe_cal_get_description(SIPE_UNUSED_PARAMETER struct sipe_buddy *buddy)
+{
+	return(NULL);
+}
+
+void sipe_conf_add(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+		   SIPE_UNUSED_PARAMETER const gchar* who)
+{
+}
+
+void sipe_core_email_authentication(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+				    SIPE_UNUSED_PARAMETER struct sipe_http_request *request)
+{
+}
+
+void sipe_group_create(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+		       SIPE_UNUSED_PARAMETER struct sipe_ucs_transaction *trans,
+		       SIPE_UNUSED_PARAMETER const gchar *name,
+		       SIPE_UNUSED_PARAMETER const gchar *who)
+{
+}
+
+struct sipe_group *sipe_group_find_by_name(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+					   SIPE_UNUSED_PARAMETER const gchar * name)
+{
+	return(NULL);
+}
+
+void sipe_group_update_buddy(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+			     SIPE_UNUSED_PARAMETER struct sipe_buddy *buddy)
+{
+}
+
+void sipe_http_request_allow_redirect(SIPE_UNUSED_PARAMETER struct sipe_http_request *request)
+{
+}
+
+void sipe_http_request_cancel(SIPE_UNUSED_PARAMETER struct sipe_http_request *request)
+{
+}
+
+struct sipe_http_request *sipe_http_request_get(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+						SIPE_UNUSED_PARAMETER const gchar *uri,
+						SIPE_UNUSED_PARAMETER const gchar *headers,
+						SIPE_UNUSED_PARAMETER sipe_http_response_callback *callback,
+						SIPE_UNUSED_PARAMETER gpointer callback_data)
+{
+	return(NULL);
+}
+
+struct sipe_http_request *sipe_http_request_post(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+						 SIPE_UNUSED_PARAMETER const gchar *uri,
+						 SIPE_UNUSED_PARAMETER const gchar *headers,
+						 SIPE_UNUSED_PARAMETER const gchar *body,
+						 SIPE_UNUSED_PARAMETER const gchar *content_type,
+						 SIPE_UNUSED_PARAMETER sipe_http_response_callback *callback,
+						 SIPE_UNUSED_PARAMETER gpointer callback_data)
+{
+	return(NULL);
+}
+
+void sipe_http_request_ready(SIPE_UNUSED_PARAMETER struct sipe_http_request *request)
+{
+}
+
+void sipe_im_invite(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+		    SIPE_UNUSED_PARAMETER struct sip_session *session,
+		    SIPE_UNUSED_PARAMETER const gchar *who,
+		    SIPE_UNUSED_PARAMETER const gchar *msg_body,
+		    SIPE_UNUSED_PARAMETER const gchar *content_type,
+		    SIPE_UNUSED_PARAMETER const gchar *referred_by,
+		    SIPE_UNUSED_PARAMETER const gboolean is_triggered)
+{
+}
+
+static guint calendar_status_count = 0;
+void sipe_ocs2005_apply_calendar_status(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+					SIPE_UNUSED_PARAMETER struct sipe_buddy *sbuddy,
+					SIPE_UNUSED_PARAMETER const char *status_id)
+{
+	calendar_status_count++;
+}
+
+struct sipe_backend_buddy_menu *sipe_ocs2007_access_control_menu(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+								 SIPE_UNUSED_PARAMETER const gchar *buddy_name)
+{
+	return(NULL);
+}
+
+const gchar *sipe_ocs2007_access_level_name(SIPE_UNUSED_PARAMETER guint id)
+{
+	return(NULL);
+}
+
+int sipe_ocs2007_find_access_level(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+				   SIPE_UNUSED_PARAMETER const gchar *type,
+				   SIPE_UNUSED_PARAMETER const gchar *value,
+				   SIPE_UNUSED_PARAMETER gboolean *is_group_access)
+{
+	return(-1);
+}
+
+void sipe_schedule_cancel(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+			  SIPE_UNUSED_PARAMETER const gchar *name)
+{
+}
+
+struct sip_session *sipe_session_add_chat(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+					  SIPE_UNUSED_PARAMETER struct sipe_chat_session *chat_session,
+					  SIPE_UNUSED_PARAMETER gboolean multiparty,
+					  SIPE_UNUSED_PARAMETER const gchar *id)
+{
+	return(NULL);
+}
+
+const gchar *sipe_status_activity_to_token(SIPE_UNUSED_PARAMETER guint type)
+{
+	return("available");
+}
+
+void sipe_subscribe_presence_single_cb(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+				       SIPE_UNUSED_PARAMETER gpointer uri)
+{
+}
+
+gboolean sipe_svc_ab_entry_request(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+				   SIPE_UNUSED_PARAMETER struct sipe_svc_session *session,
+				   SIPE_UNUSED_PARAMETER const gchar *uri,
+				   SIPE_UNUSED_PARAMETER const gchar *wsse_security,
+				   SIPE_UNUSED_PARAMETER const gchar *search,
+				   SIPE_UNUSED_PARAMETER guint max_returns,
+				   SIPE_UNUSED_PARAMETER sipe_svc_callback *callback,
+				   SIPE_UNUSED_PARAMETER gpointer callback_data)
+{
+	return(FALSE);
+}
+
+void sipe_svc_session_close(SIPE_UNUSED_PARAMETER struct sipe_svc_session *session)
+{
+}
+
+struct sipe_svc_session *sipe_svc_session_start(void)
+{
+	return(NULL);
+}
+
+const gchar *sipe_ucs_ews_url(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+	return(NULL);
+}
+
+void sipe_ucs_group_add_buddy(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+			      SIPE_UNUSED_PARAMETER struct sipe_ucs_transaction *trans,
+			      SIPE_UNUSED_PARAMETER struct sipe_group *group,
+			      SIPE_UNUSED_PARAMETER struct sipe_buddy *buddy,
+			      SIPE_UNUSED_PARAMETER const gchar *who)
+{
+}
+
+void sipe_ucs_group_remove_buddy(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+				 SIPE_UNUSED_PARAMETER struct sipe_ucs_transaction *trans,
+				 SIPE_UNUSED_PARAMETER struct sipe_group *group,
+				 SIPE_UNUSED_PARAMETER struct sipe_buddy *buddy)
+{
+}
+
+gboolean sipe_ucs_is_migrated(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+	return(FALSE);
+}
+
+void sipe_ucs_search(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+		     SIPE_UNUSED_PARAMETER struct sipe_backend_search_token *token,
+		     SIPE_UNUSED_PARAMETER const gchar *given_name,
+		     SIPE_UNUSED_PARAMETER const gchar *surname,
+		     SIPE_UNUSED_PARAMETER const gchar *email,
+		     SIPE_UNUSED_PARAMETER const gchar *sipid,
+		     SIPE_UNUSED_PARAMETER const gchar *company,
+		     SIPE_UNUSED_PARAMETER const gchar *country)
+{
+}
+
+struct sipe_ucs_transaction *sipe_ucs_transaction(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+	return(NULL);
+}
+
+gboolean sipe_webticket_request_with_port(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+					  SIPE_UNUSED_PARAMETER struct sipe_svc_session *session,
+					  SIPE_UNUSED_PARAMETER const gchar *base_uri,
+					  SIPE_UNUSED_PARAMETER const gchar *port_name,
+					  SIPE_UNUSED_PARAMETER sipe_webticket_callback *callback,
+					  SIPE_UNUSED_PARAMETER gpointer callback_data)
+{
+	return(FALSE);
+}
+
+/* needed when linking against NSS */
+void md4sum(const uint8_t *data, uint32_t length, uint8_t *digest);
+void md4sum(SIPE_UNUSED_PARAMETER const uint8_t *data,
+	    SIPE_UNUSED_PARAMETER uint32_t length,
+	    SIPE_UNUSED_PARAMETER uint8_t *digest)
+{
+}
+
+/* backend buddy list: URI -> struct test_buddy, one group only */
+struct test_buddy {
+	gchar *uri;
+	gchar *alias;
+	gchar *server_alias;
+	gchar *strings[BUDDY_UPDATE_PROPERTIES];
+	guint activity;
+};
+
+static GHashTable *backend_buddies = NULL;
+
+/* backend calls */
+static guint find_count    = 0;
+static guint alias_count   = 0;
+static guint string_count  = 0;
+static guint status_count  = 0;
+static guint refresh_count = 0;
+
+static void test_buddy_free(gpointer data)
+{
+	struct test_buddy *buddy = data;
+	guint i;
+
+	for (i = 0; i < BUDDY_UPDATE_PROPERTIES; i++)
+		g_free(buddy->strings[i]);
+	g_free(buddy->server_alias);
+	g_free(buddy->alias);
+	g_free(buddy->uri);
+	g_free(buddy);
+}
+
+sipe_backend_buddy sipe_backend_buddy_find(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+					   const gchar *buddy_name,
+					   SIPE_UNUSED_PARAMETER const gchar *group_name)
+{
+	return(g_hash_table_lookup(backend_buddies, buddy_name));
+}
+
+GSList* sipe_backend_buddy_find_all(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+				    const gchar *buddy_name,
+				    SIPE_UNUSED_PARAMETER const gchar *group_name)
+{
+	struct test_buddy *buddy = g_hash_table_lookup(backend_buddies,
+						       buddy_name);
+	find_count++;
+	return(buddy ? g_slist_append(NULL, buddy) : NULL);
+}
+
+sipe_backend_buddy sipe_backend_buddy_add(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+					  const gchar *name,
+					  const gchar *alias,
+					  SIPE_UNUSED_PARAMETER const gchar *groupname)
+{
+	struct test_buddy *buddy = g_new0(struct test_buddy, 1);
+
+	buddy->uri   = g_strdup(name);
+	buddy->alias = g_strdup(alias);
+	g_hash_table_replace(backend_buddies, buddy->uri, buddy);
+	return(buddy);
+}
+
+void sipe_backend_buddy_remove(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+			       const sipe_backend_buddy who)
+{
+	struct test_buddy *buddy = who;
+	g_hash_table_remove(backend_buddies, buddy->uri);
+}
+
+gchar* sipe_backend_buddy_get_name(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+				   const sipe_backend_buddy who)
+{
+	struct test_buddy *buddy = who;
+	return(g_strdup(buddy->uri));
+}
+
+gchar* sipe_backend_buddy_get_alias(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+				    const sipe_backend_buddy who)
+{
+	struct test_buddy *buddy = who;
+	return(g_strdup(buddy->alias));
+}
+
+gchar *sipe_backend_buddy_get_local_alias(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+					  const sipe_backend_buddy who)
+{
+	struct test_buddy *buddy = who;
+	return(g_strdup(buddy->alias));
+}
+
+gchar* sipe_backend_buddy_get_server_alias(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+					   const sipe_backend_buddy who)
+{
+	struct test_buddy *buddy = who;
+	return(g_strdup(buddy->server_alias));
+}
+
+gchar* sipe_backend_buddy_get_group_name(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+					 SIPE_UNUSED_PARAMETER const sipe_backend_buddy who)
+{
+	return(g_strdup("test"));
+}
+
+void sipe_backend_buddy_set_alias(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+				  const sipe_backend_buddy who,
+				  const gchar *alias)
+{
+	struct test_buddy *buddy = who;
+	g_free(buddy->alias);
+	buddy->alias = g_strdup(alias);
+	alias_count++;
+}
+
+void sipe_backend_buddy_set_server_alias(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+					 const sipe_backend_buddy who,
+					 const gchar *alias)
+{
+	struct test_buddy *buddy = who;
+	g_free(buddy->server_alias);
+	buddy->server_alias = g_strdup(alias);
+	alias_count++;
+}
+
+gchar* sipe_backend_buddy_get_string(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+				     sipe_backend_buddy who,
+				     const sipe_buddy_info_fields key)
+{
+	struct test_buddy *buddy = who;
+	return(g_strdup(buddy->strings[key]));
+}
+
+void sipe_backend_buddy_set_string(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+				   sipe_backend_buddy who,
+				   const sipe_buddy_info_fields key,
+				   const gchar *val)
+{
+	struct test_buddy *buddy = who;
+	g_free(buddy->strings[key]);
+	buddy->strings[key] = g_strdup(val);
+	string_count++;
+}
+
+guint sipe_backend_buddy_get_status(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+				    const gchar *uri)
+{
+	struct test_buddy *buddy = g_hash_table_lookup(backend_buddies, uri);
+	return(buddy ? buddy->activity : SIPE_ACTIVITY_UNSET);
+}
+
+void sipe_backend_buddy_set_status(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+				   const gchar *who,
+				   guint activity,
+				   SIPE_UNUSED_PARAMETER time_t last_active)
+{
+	struct test_buddy *buddy = g_hash_table_lookup(backend_buddies, who);
+	if (buddy)
+		buddy->activity = activity;
+	status_count++;
+}
+
+void sipe_backend_buddy_refresh_properties(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+					   SIPE_UNUSED_PARAMETER const gchar *uri)
+{
+	refresh_count++;
+}
+
+/*
+ * Tester code
+ */
+static guint succeeded = 0;
+static guint failed    = 0;
+
+static void assert_equal(guint expected, guint got, const gchar *what)
+{
+	if (expected == got) {
+		succeeded++;
+	} else {
+		printf("FAILED: %s: %u expected %u\n", what, got, expected);
+		failed++;
+	}
+}
+
+static void assert_string(const gchar *expected, const gchar *got, const gchar *what)
+{
+	if (sipe_strequal(expected, got)) {
+		succeeded++;
+	} else {
+		printf("FAILED: %s: '%s' expected '%s'\n",
+		       what, got ? got : "<NULL>", expected);
+		failed++;
+	}
+}
+
+static void test_reset(void)
+{
+	find_count    = 0;
+	alias_count   = 0;
+	string_count  = 0;
+	status_count  = 0;
+	refresh_count = 0;
+	calendar_status_count = 0;
+}
+
+#define TEST_BUDDIES 200
+
+static struct test_buddy *test_backend_buddy(guint i)
+{
+	gchar *uri = g_strdup_printf("sip:user%u@test.com", i);
+	struct test_buddy *buddy = g_hash_table_lookup(backend_buddies, uri);
+	g_free(uri);
+	return(buddy);
+}
+
+/* same sequence of calls as process_incoming_notify_rlmi() */
+static void test_notify(struct sipe_core_private *sipe_private,
+			guint activity,
+			const gchar *email)
+{
+	guint i;
+
+	sipe_buddy_changes_start(sipe_private);
+	for (i = 0; i < TEST_BUDDIES; i++) {
+		gchar *uri   = g_strdup_printf("sip:user%u@test.com", i);
+		gchar *name  = g_strdup_printf("User %u", i);
+		gchar *mail  = g_strdup(email);
+		gchar *phone = g_strdup("+1 555 0100");
+
+		/* each category sets some of the properties again */
+		sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_DISPLAY_NAME, name);
+		sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_EMAIL, mail);
+		sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_WORK_PHONE, phone);
+		sipe_buddy_got_status(sipe_private, uri, SIPE_ACTIVITY_AWAY, 0);
+		sipe_buddy_refresh_properties(sipe_private, uri);
+
+		sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_DISPLAY_NAME, name);
+		sipe_buddy_got_status(sipe_private, uri, activity, 0);
+		sipe_buddy_refresh_properties(sipe_private, uri);
+
+		g_free(phone);
+		g_free(mail);
+		g_free(name);
+		g_free(uri);
+	}
+	sipe_buddy_changes_finish(sipe_private);
+}
+
+static void tests_coalescing(struct sipe_core_private *sipe_private)
+{
+	gchar *uri;
+	guint i;
+
+	for (i = 0; i < TEST_BUDDIES; i++) {
+		struct sipe_buddy *sbuddy;
+
+		uri = g_strdup_printf("sip:user%u@test.com", i);
+		sbuddy = sipe_buddy_add(sipe_private, uri, NULL, NULL);
+		sipe_backend_buddy_add(SIPE_CORE_PUBLIC, sbuddy->name, uri, "test");
+		g_free(uri);
+	}
+
+	/* first NOTIFY: one update per buddy, last value wins */
+	test_reset();
+	test_notify(sipe_private, SIPE_ACTIVITY_BUSY, "first@test.com");
+	assert_equal(TEST_BUDDIES,     find_count,    "first NOTIFY: one lookup per buddy");
+	assert_equal(2 * TEST_BUDDIES, string_count,  "first NOTIFY: email and phone set once");
+	assert_equal(2 * TEST_BUDDIES, alias_count,   "first NOTIFY: alias and server alias set once");
+	assert_equal(TEST_BUDDIES,     status_count,  "first NOTIFY: status set once per buddy");
+	assert_equal(TEST_BUDDIES,     refresh_count, "first NOTIFY: one refresh per buddy");
+	assert_equal(SIPE_ACTIVITY_BUSY, test_backend_buddy(7)->activity, "first NOTIFY: last status");
+	assert_string("first@test.com",
+		      test_backend_buddy(7)->strings[SIPE_BUDDY_INFO_EMAIL],
+		      "first NOTIFY: email");
+	assert_string("User 7", test_backend_buddy(7)->server_alias, "first NOTIFY: server alias");
+
+	/* same NOTIFY again: nothing changed, backend untouched */
+	test_reset();
+	test_notify(sipe_private, SIPE_ACTIVITY_BUSY, "first@test.com");
+	assert_equal(0, string_count, "repeated NOTIFY: no property set");
+	assert_equal(0, alias_count,  "repeated NOTIFY: no alias set");
+	assert_equal(0, status_count, "repeated NOTIFY: no status set");
+
+	/* only status changed */
+	test_reset();
+	test_notify(sipe_private, SIPE_ACTIVITY_AVAILABLE, "first@test.com");
+	assert_equal(0,            string_count, "status NOTIFY: no property set");
+	assert_equal(TEST_BUDDIES, status_count, "status NOTIFY: status set once per buddy");
+	assert_equal(SIPE_ACTIVITY_AVAILABLE, test_backend_buddy(7)->activity, "status NOTIFY: last status");
+
+	/* only email changed */
+	test_reset();
+	test_notify(sipe_private, SIPE_ACTIVITY_AVAILABLE, "second@test.com");
+	assert_equal(TEST_BUDDIES, string_count, "email NOTIFY: email set once per buddy");
+	assert_equal(0,            status_count, "email NOTIFY: no status set");
+	assert_string("second@test.com",
+		      test_backend_buddy(7)->strings[SIPE_BUDDY_INFO_EMAIL],
+		      "email NOTIFY: email");
+
+	/* nested: nothing reaches the backend before the outer finish */
+	test_reset();
+	uri = g_strdup("sip:user7@test.com");
+	sipe_buddy_changes_start(sipe_private);
+	sipe_buddy_changes_start(sipe_private);
+	sipe_buddy_got_status(sipe_private, uri, SIPE_ACTIVITY_DND, 0);
+	sipe_buddy_changes_finish(sipe_private);
+	assert_equal(0, status_count, "nested: no status after inner finish");
+	assert_equal(SIPE_ACTIVITY_DND, sipe_buddy_get_status(sipe_private, uri),
+		     "nested: pending status");
+	assert_equal(SIPE_ACTIVITY_AVAILABLE, test_backend_buddy(7)->activity,
+		     "nested: backend status unchanged");
+	sipe_buddy_changes_finish(sipe_private);
+	assert_equal(1, status_count, "nested: status after outer finish");
+	assert_equal(SIPE_ACTIVITY_DND, sipe_buddy_get_status(sipe_private, uri),
+		     "nested: backend status");
+	g_free(uri);
+}
+
+static void tests_status_unchanged(struct sipe_core_private *sipe_private)
+{
+	const gchar *uri = "sip:status@test.com";
+	struct sipe_buddy *sbuddy = sipe_buddy_add(sipe_private, uri, NULL, NULL);
+	struct sipe_group group;
+
+	group.name         = (gchar *) "test";
+	group.exchange_key = NULL;
+	group.change_key   = NULL;
+	group.id           = 1;
+	group.is_obsolete  = FALSE;
+	sipe_buddy_add_to_group(sipe_private, sbuddy, &group, NULL);
+
+	test_reset();
+	sipe_buddy_got_status(sipe_private, uri, SIPE_ACTIVITY_AVAILABLE, 0);
+	assert_equal(1, status_count, "first status");
+	sipe_buddy_got_status(sipe_private, uri, SIPE_ACTIVITY_AVAILABLE, 0);
+	assert_equal(1, status_count, "same status skipped");
+	sipe_buddy_got_status(sipe_private, uri, SIPE_ACTIVITY_AWAY, 0);
+	assert_equal(2, status_count, "new activity");
+	sipe_buddy_got_status(sipe_private, uri, SIPE_ACTIVITY_AWAY, 4711);
+	assert_equal(3, status_count, "new idle time");
+
+	/* status text is part of the status */
+	sbuddy->note = g_strdup("note");
+	sipe_buddy_got_status(sipe_private, uri, SIPE_ACTIVITY_AWAY, 4711);
+	assert_equal(4, status_count, "new note");
+	sbuddy->is_mobile = TRUE;
+	sipe_buddy_got_status(sipe_private, uri, SIPE_ACTIVITY_AWAY, 4711);
+	assert_equal(5, status_count, "mobile");
+	sipe_buddy_got_status(sipe_private, uri, SIPE_ACTIVITY_AWAY, 4711);
+	assert_equal(5, status_count, "same status text skipped");
+
+	/* backend requests are never skipped */
+	sipe_core_buddy_got_status(SIPE_CORE_PUBLIC, uri, SIPE_ACTIVITY_AWAY, 4711);
+	assert_equal(6, status_count, "backend request");
+
+	/* new backend buddy needs the status again */
+	sipe_backend_buddy_remove(SIPE_CORE_PUBLIC,
+				  sipe_backend_buddy_find(SIPE_CORE_PUBLIC, uri, NULL));
+	sipe_buddy_add_to_group(sipe_private, sbuddy, &group, NULL);
+	sipe_buddy_got_status(sipe_private, uri, SIPE_ACTIVITY_AWAY, 4711);
+	assert_equal(7, status_count, "new backend buddy");
+
+	/* 2005 systems: calendar decides, no direct status update */
+	SIPE_CORE_PRIVATE_FLAG_UNSET(OCS2007);
+	sipe_buddy_got_status(sipe_private, uri, SIPE_ACTIVITY_BUSY, 0);
+	assert_equal(7, status_count,          "2005: no direct status");
+	assert_equal(1, calendar_status_count, "2005: calendar status");
+	SIPE_CORE_PRIVATE_FLAG_SET(OCS2007);
+
+	/* unknown buddy */
+	sipe_buddy_got_status(sipe_private, "sip:unknown@test.com", SIPE_ACTIVITY_BUSY, 0);
+	assert_equal(7, status_count, "unknown buddy");
+}
+
+int main(SIPE_UNUSED_PARAMETER int argc,
+	 SIPE_UNUSED_PARAMETER char *argv[])
+{
+	struct sipe_core_private *sipe_private = g_new0(struct sipe_core_private, 1);
+
+	/* Initialization for crypto backend (test mode) */
+	sipe_crypto_init(FALSE);
+
+	backend_buddies = g_hash_table_new_full(g_str_hash, g_str_equal,
+						NULL, test_buddy_free);
+	sipe_buddy_init(sipe_private);
+	SIPE_CORE_PRIVATE_FLAG_SET(OCS2007);
+
+	tests_coalescing(sipe_private);
+	tests_status_unchanged(sipe_private);
+
+	sipe_buddy_free(sipe_private);
+	g_hash_table_destroy(backend_buddies);
+	g_free(sipe_private);
+
+	printf("Result: %d PASSED %d FAILED\n", succeeded, failed);
+	return(failed);
+}
+
+/*
+  Local Variables:
+  mode: c
+  c-file-style: "bsd"
+  indent-tabs-mode: t
+  tab-width: 8
+  End:
+*/
@@ -70,13 +70,33 @@ struct sipe_buddies {
 
 	/* Pending photo download HTTP requests */
 	GSList *pending_photo_requests;
+
+	/* Collected backend updates, see sipe_buddy_changes_start() */
+	GHashTable *updates;
+	guint update_depth;
+};
+
+/* Number of properties handled by sipe_buddy_update_property() */
+#define BUDDY_UPDATE_PROPERTIES (SIPE_BUDDY_INFO_CUSTOM1_PHONE_DISPLAY + 1)
+
+struct buddy_update {
+	gchar *uri;
+	gchar *properties[BUDDY_UPDATE_PROPERTIES];
+	time_t last_active;
+	guint activity;
+	gboolean status;
+	gboolean refresh;
 };
 
+/* buddy->groups: array of buddy_group_data sorted by group ID */
 struct buddy_group_data {
 	const struct sipe_group *group;
 	gboolean is_obsolete;
 };
 
+#define BUDDY_GROUP(buddy, index) \
+	(&g_array_index((buddy)->groups, struct buddy_group_data, (index)))
+
 struct photo_response_data {
 	gchar *who;
 	gchar *photo_hash;
@@ -85,6 +105,8 @@ struct photo_response_data {
 
 static void buddy_fetch_photo(struct sipe_core_private *sipe_private,
 			      const gchar *uri);
+static guint sipe_ht_hash_nick(const char *nick);
+static gboolean sipe_ht_equals_nick(const char *nick1, const char *nick2);
 static void photo_response_data_free(struct photo_response_data *data);
 
 void sipe_buddy_add_keys(struct sipe_core_private *sipe_private,
@@ -144,25 +166,40 @@ struct sipe_buddy *sipe_buddy_add(struct sipe_core_private *sipe_private,
 	return(buddy);
 }
 
-static gboolean is_buddy_in_group(struct sipe_buddy *buddy,
-				  const gchar *name)
+/* binary search: index of group ID or where it should be inserted */
+static gboolean buddy_group_index(struct sipe_buddy *buddy,
+				  guint id,
+				  guint *index)
 {
-	if (buddy) {
-		GSList *entry = buddy->groups;
+	guint low  = 0;
+	guint high = buddy->groups ? buddy->groups->len : 0;
 
-		while (entry) {
-			struct buddy_group_data *bgd = entry->data;
-			if (sipe_strequal(bgd->group->name, name)) {
-				bgd->is_obsolete = FALSE;
-				return(TRUE);
-			}
-			entry = entry->next;
-		}
+	while (low < high) {
+		guint middle = low + (high - low) / 2;
+		guint middle_id = BUDDY_GROUP(buddy, middle)->group->id;
+
+		if (middle_id == id) {
+			*index = middle;
+			return(TRUE);
+		} else if (middle_id < id)
+			low = middle + 1;
+		else
+			high = middle;
 	}
 
+	*index = low;
 	return(FALSE);
 }
 
+static struct buddy_group_data *buddy_group_find(struct sipe_buddy *buddy,
+						 const struct sipe_group *group)
+{
+	guint index;
+	return(buddy_group_index(buddy, group->id, &index) ?
+	       BUDDY_GROUP(buddy, index) :
+	       NULL);
+}
+
 void sipe_buddy_add_to_group(struct sipe_core_private *sipe_private,
 			     struct sipe_buddy *buddy,
 			     struct sipe_group *group,
@@ -173,12 +210,15 @@ void sipe_buddy_add_to_group(struct sipe_core_private *sipe_private,
 	sipe_backend_buddy bb = sipe_backend_buddy_find(SIPE_CORE_PUBLIC,
 							uri,
 							group_name);
+	struct buddy_group_data *bgd;
 
 	if (!bb) {
 		bb = sipe_backend_buddy_add(SIPE_CORE_PUBLIC,
 					    uri,
 					    alias,
 					    group_name);
+		/* new backend buddy doesn't have a status yet */
+		buddy->status_pushed = FALSE;
 		SIPE_DEBUG_INFO("sipe_buddy_add_to_group: created backend buddy '%s' with alias '%s'",
 				uri, alias ? alias : "<NONE>");
 	}
@@ -188,6 +228,11 @@ void sipe_buddy_add_to_group(struct sipe_core_private *sipe_private,
 		gchar *old_alias = sipe_backend_buddy_get_alias(SIPE_CORE_PUBLIC,
 								bb);
 
+		if (!sipe_strequal(buddy->alias, alias)) {
+			g_free(buddy->alias);
+			buddy->alias = g_strdup(alias);
+		}
+
 		if (sipe_strcase_equal(sipe_get_no_sip_uri(uri),
 				       old_alias)) {
 			sipe_backend_buddy_set_alias(SIPE_CORE_PUBLIC,
@@ -199,58 +244,42 @@ void sipe_buddy_add_to_group(struct sipe_core_private *sipe_private,
 		g_free(old_alias);
 	}
 
-	if (!is_buddy_in_group(buddy, group_name)) {
+	bgd = buddy_group_find(buddy, group);
+	if (bgd) {
+		bgd->is_obsolete = FALSE;
+	} else {
 		sipe_buddy_insert_group(buddy, group);
 		SIPE_DEBUG_INFO("sipe_buddy_add_to_group: added buddy %s to group %s",
 				uri, group_name);
 	}
 }
 
-static gint buddy_group_compare(gconstpointer a, gconstpointer b)
-{
-	return(((const struct buddy_group_data *)a)->group->id -
-	       ((const struct buddy_group_data *)b)->group->id);
-}
-
 void sipe_buddy_insert_group(struct sipe_buddy *buddy,
 			     struct sipe_group *group)
 {
-	struct buddy_group_data *bgd = g_new0(struct buddy_group_data, 1);
+	guint index;
 
-	bgd->group = group;
+	if (!buddy_group_index(buddy, group->id, &index)) {
+		struct buddy_group_data bgd;
 
-	buddy->groups = sipe_utils_slist_insert_unique_sorted(buddy->groups,
-							      bgd,
-							      buddy_group_compare,
-							      NULL);
-}
+		bgd.group       = group;
+		bgd.is_obsolete = FALSE;
 
-static void buddy_group_free(gpointer data)
-{
-	g_free(data);
-}
-
-static void buddy_group_remove(struct sipe_buddy *buddy,
-			       struct buddy_group_data *bgd)
-{
-	buddy->groups = g_slist_remove(buddy->groups, bgd);
-	buddy_group_free(bgd);
+		if (!buddy->groups)
+			buddy->groups = g_array_new(FALSE,
+						    FALSE,
+						    sizeof(struct buddy_group_data));
+		g_array_insert_val(buddy->groups, index, bgd);
+	}
 }
 
 static void sipe_buddy_remove_group(struct sipe_buddy *buddy,
 				    const struct sipe_group *group)
 {
-	GSList *entry = buddy->groups;
-	struct buddy_group_data *bgd = NULL;
-
-	while (entry) {
-		bgd = entry->data;
-		if (bgd->group == group)
-			break;
-		entry = entry->next;
-	}
+	guint index;
 
-	buddy_group_remove(buddy, bgd);
+	if (buddy_group_index(buddy, group->id, &index))
+		g_array_remove_index(buddy->groups, index);
 }
 
 void sipe_buddy_update_groups(struct sipe_core_private *sipe_private,
@@ -258,14 +287,11 @@ void sipe_buddy_update_groups(struct sipe_core_private *sipe_private,
 			      GSList *new_groups)
 {
 	const gchar *uri = buddy->name;
-	GSList *entry = buddy->groups;
-
-	while (entry) {
-		struct buddy_group_data *bgd = entry->data;
-		const struct sipe_group *group = bgd->group;
+	guint index = sipe_buddy_group_count(buddy);
 
-		/* next buddy group */
-		entry = entry->next;
+	/* backwards, so that removal doesn't change index of next group */
+	while (index-- > 0) {
+		const struct sipe_group *group = BUDDY_GROUP(buddy, index)->group;
 
 		/* old group NOT found in new list? */
 		if (g_slist_find(new_groups, group) == NULL) {
@@ -278,34 +304,71 @@ void sipe_buddy_update_groups(struct sipe_core_private *sipe_private,
 			if (oldb)
 				sipe_backend_buddy_remove(SIPE_CORE_PUBLIC,
 							  oldb);
-			buddy_group_remove(buddy, bgd);
+			g_array_remove_index(buddy->groups, index);
 		}
 	}
 }
 
-gchar *sipe_buddy_groups_string(struct sipe_buddy *buddy)
+static void buddy_mark_obsolete(struct sipe_buddy *buddy,
+				gboolean obsolete)
 {
-	guint i = 0;
-	gchar *string;
-	/* creating array from GList, converting guint to gchar * */
-	gchar **ids_arr = g_new(gchar *, g_slist_length(buddy->groups) + 1);
-	GSList *entry = buddy->groups;
+	guint count = sipe_buddy_group_count(buddy);
+	guint index;
 
-	if (!ids_arr)
-		return(NULL);
+	buddy->is_obsolete = obsolete;
+	for (index = 0; index < count; index++)
+		BUDDY_GROUP(buddy, index)->is_obsolete = obsolete;
+}
 
-	while (entry) {
-		const struct sipe_group *group = ((struct buddy_group_data *) entry->data)->group;
-		ids_arr[i] = g_strdup_printf("%u", group->id);
-		entry = entry->next;
-		i++;
+gboolean sipe_buddy_keep_groups(struct sipe_buddy *buddy,
+				GSList *new_groups)
+{
+	guint count = sipe_buddy_group_count(buddy);
+
+	if (count != g_slist_length(new_groups))
+		return(FALSE);
+
+	/* new_groups has no duplicates, see contact_groups() */
+	while (new_groups) {
+		if (!buddy_group_find(buddy, new_groups->data))
+			return(FALSE);
+		new_groups = new_groups->next;
 	}
-	ids_arr[i] = NULL;
 
-	string = g_strjoinv(" ", ids_arr);
-	g_strfreev(ids_arr);
+	buddy_mark_obsolete(buddy, FALSE);
+
+	return(TRUE);
+}
+
+guint sipe_buddy_group_count(struct sipe_buddy *buddy)
+{
+	return(buddy->groups ? buddy->groups->len : 0);
+}
+
+gchar *sipe_buddy_groups_string(struct sipe_buddy *buddy)
+{
+	guint count = sipe_buddy_group_count(buddy);
+	GString *string = g_string_sized_new(count * 4);
+	guint index;
+
+	for (index = 0; index < count; index++)
+		g_string_append_printf(string,
+				       index ? " %u" : "%u",
+				       BUDDY_GROUP(buddy, index)->group->id);
+
+	return(g_string_free(string, FALSE));
+}
+
+void sipe_buddy_foreach_group(struct sipe_buddy *buddy,
+			      GFunc callback,
+			      gpointer callback_data)
+{
+	guint count = sipe_buddy_group_count(buddy);
+	guint index;
 
-	return(string);
+	for (index = 0; index < count; index++)
+		(*callback)((gpointer) BUDDY_GROUP(buddy, index)->group,
+			    callback_data);
 }
 
 void sipe_buddy_cleanup_local_list(struct sipe_core_private *sipe_private)
@@ -327,8 +390,15 @@ void sipe_buddy_cleanup_local_list(struct sipe_core_private *sipe_private)
 								 bb);
 		struct sipe_buddy *buddy = sipe_buddy_find_by_uri(sipe_private,
 								  bname);
-
-		if (!is_buddy_in_group(buddy, gname)) {
+		struct sipe_group *group = sipe_group_find_by_name(sipe_private,
+								   gname);
+		struct buddy_group_data *bgd = (buddy && group) ?
+			buddy_group_find(buddy, group) :
+			NULL;
+
+		if (bgd) {
+			bgd->is_obsolete = FALSE;
+		} else {
 			SIPE_DEBUG_INFO("sipe_buddy_cleanup_local_list: REMOVING '%s' from local group '%s', as buddy is not in that group on remote contact list",
 					bname, gname);
 			sipe_backend_buddy_remove(SIPE_CORE_PUBLIC, bb);
@@ -386,6 +456,7 @@ static void buddy_free(struct sipe_buddy *buddy)
 #endif
 	g_free(buddy->exchange_key);
 	g_free(buddy->change_key);
+	g_free(buddy->alias);
 	g_free(buddy->activity);
 	g_free(buddy->meeting_subject);
 	g_free(buddy->meeting_location);
@@ -393,13 +464,15 @@ static void buddy_free(struct sipe_buddy *buddy)
 
 	g_free(buddy->cal_start_time);
 	g_free(buddy->cal_free_busy_base64);
-	g_free(buddy->cal_free_busy);
+	sipe_cal_free_free_busy(buddy->cal_free_busy);
 	g_free(buddy->last_non_cal_activity);
 
 	sipe_cal_free_working_hours(buddy->cal_working_hours);
 
 	g_free(buddy->device_name);
-	sipe_utils_slist_free_full(buddy->groups, buddy_group_free);
+	g_free(buddy->pushed_status_text);
+	if (buddy->groups)
+		g_array_free(buddy->groups, TRUE);
 	g_free(buddy);
 }
 
@@ -429,6 +502,8 @@ void sipe_buddy_free(struct sipe_core_private *sipe_private)
 		photo_response_data_free(data);
 	}
 
+	if (buddies->updates)
+		g_hash_table_destroy(buddies->updates);
 	g_hash_table_destroy(buddies->uri);
 	g_hash_table_destroy(buddies->exchange_key);
 	g_free(buddies);
@@ -437,23 +512,23 @@ void sipe_buddy_free(struct sipe_core_private *sipe_private)
 
 static void buddy_set_obsolete_flag(SIPE_UNUSED_PARAMETER gpointer key,
 				    gpointer value,
-				    SIPE_UNUSED_PARAMETER gpointer user_data)
+				    gpointer user_data)
 {
-	struct sipe_buddy *buddy = value;
-	GSList *entry = buddy->groups;
-
-	buddy->is_obsolete = TRUE;
-	while (entry) {
-		((struct buddy_group_data *) entry->data)->is_obsolete = TRUE;
-		entry = entry->next;
-	}
+	buddy_mark_obsolete(value, GPOINTER_TO_INT(user_data));
 }
 
 void sipe_buddy_update_start(struct sipe_core_private *sipe_private)
 {
 	g_hash_table_foreach(sipe_private->buddies->uri,
 			     buddy_set_obsolete_flag,
-			     NULL);
+			     GINT_TO_POINTER(TRUE));
+}
+
+void sipe_buddy_update_cancel(struct sipe_core_private *sipe_private)
+{
+	g_hash_table_foreach(sipe_private->buddies->uri,
+			     buddy_set_obsolete_flag,
+			     GINT_TO_POINTER(FALSE));
 }
 
 static gboolean buddy_check_obsolete_flag(SIPE_UNUSED_PARAMETER gpointer key,
@@ -487,13 +562,11 @@ static gboolean buddy_check_obsolete_flag(SIPE_UNUSED_PARAMETER gpointer key,
 		return(TRUE);
 
 	} else {
-		GSList *entry = buddy->groups;
+		guint index = sipe_buddy_group_count(buddy);
 
-		while (entry) {
-			struct buddy_group_data *bgd = entry->data;
-
-			/* next buddy group */
-			entry = entry->next;
+		/* backwards, so that removal doesn't change index of next group */
+		while (index-- > 0) {
+			struct buddy_group_data *bgd = BUDDY_GROUP(buddy, index);
 
 			if (bgd->is_obsolete) {
 				const struct sipe_group *group = bgd->group;
@@ -506,18 +579,18 @@ static gboolean buddy_check_obsolete_flag(SIPE_UNUSED_PARAMETER gpointer key,
 				if (oldb)
 					sipe_backend_buddy_remove(SIPE_CORE_PUBLIC,
 								  oldb);
-				buddy_group_remove(buddy, bgd);
+				g_array_remove_index(buddy->groups, index);
 			}
 		}
 		return(FALSE);
 	}
 }
 
-void sipe_buddy_update_finish(struct sipe_core_private *sipe_private)
+guint sipe_buddy_update_finish(struct sipe_core_private *sipe_private)
 {
-	g_hash_table_foreach_remove(sipe_private->buddies->uri,
-				    buddy_check_obsolete_flag,
-				    sipe_private);
+	return(g_hash_table_foreach_remove(sipe_private->buddies->uri,
+					   buddy_check_obsolete_flag,
+					   sipe_private));
 }
 
 gchar *sipe_core_buddy_status(struct sipe_core_public *sipe_public,
@@ -629,7 +702,7 @@ void sipe_core_buddy_group(struct sipe_core_public *sipe_public,
 						    ucs_trans,
 						    old_group,
 						    buddy);
-			if (g_slist_length(buddy->groups) < 1)
+			if (sipe_buddy_group_count(buddy) < 1)
 				sipe_buddy_remove(sipe_private,
 						  buddy);
 				/* buddy no longer valid */
@@ -673,23 +746,22 @@ void sipe_buddy_remove(struct sipe_core_private *sipe_private,
 {
 	struct sipe_buddies *buddies = sipe_private->buddies;
 	const gchar *uri = buddy->name;
-	GSList *entry = buddy->groups;
+	guint count = sipe_buddy_group_count(buddy);
+	guint index;
 	gchar *action_name = sipe_utils_presence_key(uri);
 
 	sipe_schedule_cancel(sipe_private, action_name);
 	g_free(action_name);
 
 	/* If the buddy still has groups, we need to delete backend buddies */
-	while (entry) {
-		const struct sipe_group *group = ((struct buddy_group_data *) entry->data)->group;
+	for (index = 0; index < count; index++) {
+		const struct sipe_group *group = BUDDY_GROUP(buddy, index)->group;
 		sipe_backend_buddy oldb = sipe_backend_buddy_find(SIPE_CORE_PUBLIC,
 								  uri,
 								  group->name);
 		/* this should never be NULL */
 		if (oldb)
 			sipe_backend_buddy_remove(SIPE_CORE_PUBLIC, oldb);
-
-		entry = entry->next;
 	}
 
 	g_hash_table_remove(buddies->uri, uri);
@@ -725,7 +797,7 @@ void sipe_core_buddy_remove(struct sipe_core_public *sipe_public,
 		}
 	}
 
-	if (g_slist_length(buddy->groups) < 1) {
+	if (sipe_buddy_group_count(buddy) < 1) {
 
 		if (sipe_ucs_is_migrated(sipe_private)) {
 			sipe_ucs_group_remove_buddy(sipe_private,
@@ -754,12 +826,11 @@ void sipe_core_buddy_remove(struct sipe_core_public *sipe_public,
 	}
 }
 
-void sipe_core_buddy_got_status(struct sipe_core_public *sipe_public,
+static void buddy_update_status(struct sipe_core_private *sipe_private,
 				const gchar *uri,
 				guint activity,
-	                        time_t last_active)
+				time_t last_active)
 {
-	struct sipe_core_private *sipe_private = SIPE_CORE_PRIVATE;
 	struct sipe_buddy *sbuddy = sipe_buddy_find_by_uri(sipe_private,
 							   uri);
 
@@ -769,10 +840,10 @@ void sipe_core_buddy_got_status(struct sipe_core_public *sipe_public,
 	 * then set/preserve it.
 	 */
 	if (SIPE_CORE_PRIVATE_FLAG_IS(OCS2007)) {
-		sipe_backend_buddy_set_status(sipe_public,
-					      uri,
-					      activity,
-			                      last_active);
+		sipe_buddy_set_status(sipe_private,
+				      sbuddy,
+				      activity,
+				      last_active);
 	} else {
 		sipe_ocs2005_apply_calendar_status(sipe_private,
 						   sbuddy,
@@ -780,6 +851,89 @@ void sipe_core_buddy_got_status(struct sipe_core_public *sipe_public,
 	}
 }
 
+static struct buddy_update *buddy_update_find(struct sipe_core_private *sipe_private,
+					      const gchar *uri)
+{
+	struct sipe_buddies *buddies = sipe_private->buddies;
+	struct buddy_update *update;
+
+	if (!buddies->update_depth)
+		return(NULL);
+
+	update = g_hash_table_lookup(buddies->updates, uri);
+	if (!update) {
+		update = g_new0(struct buddy_update, 1);
+		update->uri = g_strdup(uri);
+		g_hash_table_insert(buddies->updates, update->uri, update);
+	}
+	return(update);
+}
+
+void sipe_buddy_set_status(struct sipe_core_private *sipe_private,
+			   struct sipe_buddy *sbuddy,
+			   guint activity,
+			   time_t last_active)
+{
+	gchar *status_text = sipe_core_buddy_status(SIPE_CORE_PUBLIC,
+						    sbuddy->name,
+						    activity,
+						    NULL);
+
+	if (sbuddy->status_pushed &&
+	    (sbuddy->pushed_activity == activity) &&
+	    (sbuddy->pushed_last_active == last_active) &&
+	    sipe_strequal(sbuddy->pushed_status_text, status_text)) {
+		g_free(status_text);
+		return;
+	}
+
+	g_free(sbuddy->pushed_status_text);
+	sbuddy->pushed_status_text = status_text;
+	sbuddy->pushed_last_active = last_active;
+	sbuddy->pushed_activity    = activity;
+	sbuddy->status_pushed      = TRUE;
+
+	sipe_backend_buddy_set_status(SIPE_CORE_PUBLIC,
+				      sbuddy->name,
+				      activity,
+				      last_active);
+}
+
+void sipe_core_buddy_got_status(struct sipe_core_public *sipe_public,
+				const gchar *uri,
+				guint activity,
+	                        time_t last_active)
+{
+	struct sipe_core_private *sipe_private = SIPE_CORE_PRIVATE;
+	struct sipe_buddy *sbuddy = sipe_buddy_find_by_uri(sipe_private,
+							   uri);
+
+	/* backend requested update, e.g. to refresh the display */
+	if (sbuddy)
+		sbuddy->status_pushed = FALSE;
+
+	sipe_buddy_got_status(sipe_private, uri, activity, last_active);
+}
+
+void sipe_buddy_got_status(struct sipe_core_private *sipe_private,
+			   const gchar *uri,
+			   guint activity,
+			   time_t last_active)
+{
+	struct buddy_update *update;
+
+	if (!sipe_buddy_find_by_uri(sipe_private, uri)) return;
+
+	update = buddy_update_find(sipe_private, uri);
+	if (update) {
+		update->status      = TRUE;
+		update->activity    = activity;
+		update->last_active = last_active;
+	} else {
+		buddy_update_status(sipe_private, uri, activity, last_active);
+	}
+}
+
 void sipe_core_buddy_tooltip_info(struct sipe_core_public *sipe_public,
 				  const gchar *uri,
 				  const gchar *status_name,
@@ -859,56 +1013,185 @@ void sipe_core_buddy_tooltip_info(struct sipe_core_public *sipe_public,
 	}
 }
 
+static void buddy_update_backend_property(struct sipe_core_private *sipe_private,
+					  const gchar *uri,
+					  sipe_backend_buddy p_buddy,
+					  sipe_buddy_info_fields propkey,
+					  const gchar *property_value)
+{
+	gchar *prop_str;
+
+	/* for Display Name */
+	if (propkey == SIPE_BUDDY_INFO_DISPLAY_NAME) {
+		gchar *alias;
+		alias = sipe_backend_buddy_get_alias(SIPE_CORE_PUBLIC, p_buddy);
+		if (property_value && sipe_is_bad_alias(uri, alias)) {
+			SIPE_DEBUG_INFO("Replacing alias for %s with %s", uri, property_value);
+			sipe_backend_buddy_set_alias(SIPE_CORE_PUBLIC, p_buddy, property_value);
+		}
+		g_free(alias);
+
+		alias = sipe_backend_buddy_get_server_alias(SIPE_CORE_PUBLIC, p_buddy);
+		if (!is_empty(property_value) &&
+		   (!sipe_strequal(property_value, alias) || is_empty(alias)) )
+		{
+			SIPE_DEBUG_INFO("Replacing service alias for %s with %s", uri, property_value);
+			sipe_backend_buddy_set_server_alias(SIPE_CORE_PUBLIC, p_buddy, property_value);
+		}
+		g_free(alias);
+	}
+	/* for other properties */
+	else {
+		if (!is_empty(property_value)) {
+			prop_str = sipe_backend_buddy_get_string(SIPE_CORE_PUBLIC, p_buddy, propkey);
+			if (!prop_str || !sipe_strcase_equal(prop_str, property_value)) {
+				sipe_backend_buddy_set_string(SIPE_CORE_PUBLIC, p_buddy, propkey, property_value);
+			}
+			g_free(prop_str);
+		}
+	}
+}
+
 void sipe_buddy_update_property(struct sipe_core_private *sipe_private,
 				const char *uri,
 				sipe_buddy_info_fields propkey,
 				char *property_value)
 {
+	struct buddy_update *update;
 	GSList *buddies, *entry;
 
 	if (property_value)
 		property_value = g_strstrip(property_value);
 
-	entry = buddies = sipe_backend_buddy_find_all(SIPE_CORE_PUBLIC, uri, NULL); /* all buddies in different groups */
-	while (entry) {
-		gchar *prop_str;
-		sipe_backend_buddy p_buddy = entry->data;
-
-		/* for Display Name */
-		if (propkey == SIPE_BUDDY_INFO_DISPLAY_NAME) {
-			gchar *alias;
-			alias = sipe_backend_buddy_get_alias(SIPE_CORE_PUBLIC, p_buddy);
-			if (property_value && sipe_is_bad_alias(uri, alias)) {
-				SIPE_DEBUG_INFO("Replacing alias for %s with %s", uri, property_value);
-				sipe_backend_buddy_set_alias(SIPE_CORE_PUBLIC, p_buddy, property_value);
-			}
-			g_free(alias);
+	/* empty value would not change anything */
+	if (is_empty(property_value))
+		return;
 
-			alias = sipe_backend_buddy_get_server_alias(SIPE_CORE_PUBLIC, p_buddy);
-			if (!is_empty(property_value) &&
-			   (!sipe_strequal(property_value, alias) || is_empty(alias)) )
-			{
-				SIPE_DEBUG_INFO("Replacing service alias for %s with %s", uri, property_value);
-				sipe_backend_buddy_set_server_alias(SIPE_CORE_PUBLIC, p_buddy, property_value);
-			}
-			g_free(alias);
-		}
-		/* for other properties */
-		else {
-			if (!is_empty(property_value)) {
-				prop_str = sipe_backend_buddy_get_string(SIPE_CORE_PUBLIC, p_buddy, propkey);
-				if (!prop_str || !sipe_strcase_equal(prop_str, property_value)) {
-					sipe_backend_buddy_set_string(SIPE_CORE_PUBLIC, p_buddy, propkey, property_value);
-				}
-				g_free(prop_str);
-			}
-		}
+	update = buddy_update_find(sipe_private, uri);
+	if (update && ((guint) propkey < BUDDY_UPDATE_PROPERTIES)) {
+		/* last value wins */
+		g_free(update->properties[propkey]);
+		update->properties[propkey] = g_strdup(property_value);
+		return;
+	}
 
+	entry = buddies = sipe_backend_buddy_find_all(SIPE_CORE_PUBLIC, uri, NULL); /* all buddies in different groups */
+	while (entry) {
+		buddy_update_backend_property(sipe_private,
+					      uri,
+					      entry->data,
+					      propkey,
+					      property_value);
 		entry = entry->next;
 	}
 	g_slist_free(buddies);
 }
 
+guint sipe_buddy_get_status(struct sipe_core_private *sipe_private,
+			    const gchar *uri)
+{
+	struct sipe_buddies *buddies = sipe_private->buddies;
+	struct buddy_update *update = buddies->update_depth ?
+		g_hash_table_lookup(buddies->updates, uri) :
+		NULL;
+
+	if (update && update->status)
+		return(update->activity);
+	return(sipe_backend_buddy_get_status(SIPE_CORE_PUBLIC, uri));
+}
+
+void sipe_buddy_refresh_properties(struct sipe_core_private *sipe_private,
+				   const gchar *uri)
+{
+	struct buddy_update *update = buddy_update_find(sipe_private, uri);
+
+	if (update)
+		update->refresh = TRUE;
+	else
+		sipe_backend_buddy_refresh_properties(SIPE_CORE_PUBLIC, uri);
+}
+
+static void buddy_update_free(gpointer data)
+{
+	struct buddy_update *update = data;
+	guint i;
+
+	for (i = 0; i < BUDDY_UPDATE_PROPERTIES; i++)
+		g_free(update->properties[i]);
+	g_free(update->uri);
+	g_free(update);
+}
+
+static void buddy_update_flush(SIPE_UNUSED_PARAMETER gpointer key,
+			       gpointer value,
+			       gpointer user_data)
+{
+	struct sipe_core_private *sipe_private = user_data;
+	struct buddy_update *update = value;
+	const gchar *uri = update->uri;
+	guint i;
+
+	for (i = 0; i < BUDDY_UPDATE_PROPERTIES; i++)
+		if (update->properties[i])
+			break;
+
+	/* one backend lookup for all changed properties */
+	if (i < BUDDY_UPDATE_PROPERTIES) {
+		GSList *buddies = sipe_backend_buddy_find_all(SIPE_CORE_PUBLIC,
+							      uri,
+							      NULL);
+		GSList *entry = buddies;
+
+		while (entry) {
+			for (i = 0; i < BUDDY_UPDATE_PROPERTIES; i++)
+				if (update->properties[i])
+					buddy_update_backend_property(sipe_private,
+								      uri,
+								      entry->data,
+								      i,
+								      update->properties[i]);
+			entry = entry->next;
+		}
+		g_slist_free(buddies);
+	}
+
+	if (update->status)
+		buddy_update_status(sipe_private,
+				    uri,
+				    update->activity,
+				    update->last_active);
+
+	if (update->refresh)
+		sipe_backend_buddy_refresh_properties(SIPE_CORE_PUBLIC, uri);
+}
+
+void sipe_buddy_changes_start(struct sipe_core_private *sipe_private)
+{
+	struct sipe_buddies *buddies = sipe_private->buddies;
+
+	if (!buddies->updates)
+		buddies->updates = g_hash_table_new_full((GHashFunc)  sipe_ht_hash_nick,
+							 (GEqualFunc) sipe_ht_equals_nick,
+							 NULL,
+							 buddy_update_free);
+	buddies->update_depth++;
+}
+
+void sipe_buddy_changes_finish(struct sipe_core_private *sipe_private)
+{
+	struct sipe_buddies *buddies = sipe_private->buddies;
+
+	if (!buddies->update_depth || --buddies->update_depth)
+		return;
+
+	SIPE_DEBUG_INFO("sipe_buddy_changes_finish: %u buddies updated",
+			g_hash_table_size(buddies->updates));
+	g_hash_table_foreach(buddies->updates,
+			     buddy_update_flush,
+			     sipe_private);
+	g_hash_table_remove_all(buddies->updates);
+}
+
 
 struct ms_dlx_data;
 struct ms_dlx_data {
@@ -22,6 +22,7 @@
 
 /* Forward declarations */
 struct sipe_backend_search_results;
+struct sipe_cal_free_busy;
 struct sipe_cal_working_hours;
 struct sipe_core_private;
 struct sipe_group;
@@ -46,7 +47,7 @@ struct sipe_buddy {
 	gchar *cal_start_time;
 	int cal_granularity;
 	gchar *cal_free_busy_base64;
-	gchar *cal_free_busy;
+	struct sipe_cal_free_busy *cal_free_busy;
 	time_t cal_free_busy_published;
 	/* for 2005 systems */
 	int user_avail;
@@ -58,10 +59,18 @@ struct sipe_buddy {
 	struct sipe_cal_working_hours *cal_working_hours;
 
 	gchar *device_name;
-	GSList *groups;
+	/* alias from server contact list (may be NULL) */
+	gchar *alias;
+	GArray *groups;         /* sorted by group ID */
 	 /** flag to control sending 'context' element in 2007 subscriptions */
 	gboolean just_added;
 	gboolean is_obsolete;
+
+	/* last status passed to the backend, see sipe_buddy_set_status() */
+	gchar *pushed_status_text;
+	time_t pushed_last_active;
+	guint pushed_activity;
+	gboolean status_pushed;
 };
 
 /**
@@ -127,6 +136,28 @@ void sipe_buddy_update_groups(struct sipe_core_private *sipe_private,
 			      struct sipe_buddy *buddy,
 			      GSList *new_groups);
 
+/**
+ * Compare group list of a buddy during buddy list update. If the buddy
+ * is a member of exactly these groups it is marked as not obsolete, i.e.
+ * it will be kept unchanged by @c sipe_buddy_update_finish().
+ *
+ * @param buddy      sipe_buddy data structure
+ * @param new_groups list with sipe_group data structures
+ *
+ * @return @c TRUE if group list is unchanged
+ */
+gboolean sipe_buddy_keep_groups(struct sipe_buddy *buddy,
+				GSList *new_groups);
+
+/**
+ * Number of groups the buddy is a member of
+ *
+ * @param buddy sipe_buddy data structure
+ *
+ * @return number of groups
+ */
+guint sipe_buddy_group_count(struct sipe_buddy *buddy);
+
 /**
  * Returns string of group IDs the buddy belongs to, e.g. "2 4 7 8"
  *
@@ -136,6 +167,17 @@ void sipe_buddy_update_groups(struct sipe_core_private *sipe_private,
  */
 gchar *sipe_buddy_groups_string(struct sipe_buddy *buddy);
 
+/**
+ * Call function for each group the buddy is a member of
+ *
+ * @param buddy         sipe_buddy data structure
+ * @param callback      function to call (data is @c struct sipe_group)
+ * @param callback_data user data for callback
+ */
+void sipe_buddy_foreach_group(struct sipe_buddy *buddy,
+			      GFunc callback,
+			      gpointer callback_data);
+
 /**
  * Remove entries from local buddy list that do not have corresponding entries
  * in the ones in the contact list sent by the server
@@ -151,12 +193,21 @@ void sipe_buddy_cleanup_local_list(struct sipe_core_private *sipe_private);
  */
 void sipe_buddy_update_start(struct sipe_core_private *sipe_private);
 
+/**
+ * Abort buddy list update. All buddies are kept.
+ *
+ * @param sipe_private SIPE core data
+ */
+void sipe_buddy_update_cancel(struct sipe_core_private *sipe_private);
+
 /**
  * Finish buddy list update. This will remove obsolete buddies.
  *
  * @param sipe_private SIPE core data
+ *
+ * @return number of removed buddies
  */
-void sipe_buddy_update_finish(struct sipe_core_private *sipe_private);
+guint sipe_buddy_update_finish(struct sipe_core_private *sipe_private);
 
 /**
  * Find buddy by URI
@@ -226,6 +277,72 @@ void sipe_buddy_update_property(struct sipe_core_private *sipe_private,
 				sipe_buddy_info_fields propkey,
 				gchar *property_value);
 
+/**
+ * Received new status for buddy with given SIP URI
+ *
+ * @param sipe_private SIPE core data
+ * @param uri          a SIP URI
+ * @param activity     activity value for buddy
+ * @param last_active  seconds since epoch when buddy entered idle state
+ */
+void sipe_buddy_got_status(struct sipe_core_private *sipe_private,
+			   const gchar *uri,
+			   guint activity,
+			   time_t last_active);
+
+/**
+ * Pass buddy status to the backend. Skipped if activity, idle time
+ * and status text are the same as the last time.
+ *
+ * @param sipe_private SIPE core data
+ * @param sbuddy       SIPE buddy
+ * @param activity     activity value for buddy
+ * @param last_active  seconds since epoch when buddy entered idle state
+ */
+void sipe_buddy_set_status(struct sipe_core_private *sipe_private,
+			   struct sipe_buddy *sbuddy,
+			   guint activity,
+			   time_t last_active);
+
+/**
+ * Current status of the buddy with given SIP URI, including a status
+ * update that hasn't been passed to the backend yet.
+ *
+ * @param sipe_private SIPE core data
+ * @param uri          a SIP URI
+ *
+ * @return activity
+ */
+guint sipe_buddy_get_status(struct sipe_core_private *sipe_private,
+			    const gchar *uri);
+
+/**
+ * Request a backend refresh of the buddy properties with given SIP URI
+ *
+ * @param sipe_private SIPE core data
+ * @param uri          a SIP URI
+ */
+void sipe_buddy_refresh_properties(struct sipe_core_private *sipe_private,
+				   const gchar *uri);
+
+/**
+ * Start collecting buddy property and status updates. Instead of
+ * passing every change to the backend immediately, the last value of
+ * each property and the status are remembered per buddy. Calls can be
+ * nested.
+ *
+ * @param sipe_private SIPE core data
+ */
+void sipe_buddy_changes_start(struct sipe_core_private *sipe_private);
+
+/**
+ * Pass collected updates to the backend, one update per buddy.
+ * Properties that didn't change are skipped.
+ *
+ * @param sipe_private SIPE core data
+ */
+void sipe_buddy_changes_finish(struct sipe_core_private *sipe_private);
+
 /**
  * Update the buddy photo with given SIP URI. If hash is the same
  * as the cached one then the fetching of the photo is skipped.
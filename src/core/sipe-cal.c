@@ -105,7 +105,12 @@ struct sipe_cal_std_dst {
 	gchar *day_of_week; /* Sunday or Monday or Tuesday or Wednesday or Thursday or Friday or Saturday */
 	gchar *year;        /* YYYY */
 
-	time_t switch_time;
+	/* compiled rule */
+	int seconds;        /* time of day converted to seconds */
+	int wday;           /* 0..6 */
+	int fixed_year;     /* 0 = every year */
+
+	time_t switch_time; /* in switch_year, see below */
 };
 
 struct sipe_cal_working_hours {
@@ -116,13 +121,10 @@ struct sipe_cal_working_hours {
 	int start_time;               /* 0...1440 */
 	int end_time;                 /* 0...1440 */
 
-	gchar *tz;                    /* aggregated timezone string as in TZ environment variable.
-	                                 Ex.: TST+8TDT+7,M3.2.0/02:00:00,M11.1.0/02:00:00 */
-	/** separate simple strings for Windows platform as the proper TZ does not work there.
-	 *  anyway, dynamic timezones would't work with just TZ
-	 */
-	gchar *tz_std;                /* Ex.: TST8 */
-	gchar *tz_dst;                /* Ex.: TDT7 */
+	/* offsets to UTC in minutes, i.e. UTC = local time + offset */
+	int std_offset;               /* Ex.: 480 */
+	int dst_offset;               /* Ex.: 420 */
+	int switch_year;              /* year of cached std/dst switch_time */
 };
 
 /* not for translation, a part of XML Schema definitions */
@@ -257,73 +259,6 @@ sipe_cal_event_hash(struct sipe_cal_event* event)
 				event->is_meeting);
 }
 
-#define ENVIRONMENT_TIMEZONE "TZ"
-
-static gchar *
-sipe_switch_tz(const char *tz)
-{
-	gchar *tz_orig;
-
-	tz_orig = g_strdup(g_getenv(ENVIRONMENT_TIMEZONE));
-	g_setenv(ENVIRONMENT_TIMEZONE, tz, TRUE);
-	tzset();
-	return(tz_orig);
-}
-
-static void
-sipe_reset_tz(gchar *tz_orig)
-{
-	if (tz_orig) {
-		g_setenv(ENVIRONMENT_TIMEZONE, tz_orig, TRUE);
-		g_free(tz_orig);
-	} else {
-		g_unsetenv(ENVIRONMENT_TIMEZONE);
-	}
-	tzset();
-}
-
-/**
- * Converts struct tm to Epoch time_t considering timezone.
- *
- * @param tz as defined for TZ environment variable.
- *
- * Reference: see timegm(3) - Linux man page
- */
-time_t
-sipe_mktime_tz(struct tm *tm,
-	       const char* tz)
-{
-	time_t ret;
-	gchar *tz_orig;
-
-	tz_orig = sipe_switch_tz(tz);
-	ret = mktime(tm);
-	sipe_reset_tz(tz_orig);
-
-	return ret;
-}
-
-/**
- * Converts Epoch time_t to struct tm considering timezone.
- *
- * @param tz as defined for TZ environment variable.
- *
- * Reference: see timegm(3) - Linux man page
- */
-static struct tm *
-sipe_localtime_tz(const time_t *time,
-		  const char* tz)
-{
-	struct tm *ret;
-	gchar *tz_orig;
-
-	tz_orig = sipe_switch_tz(tz);
-	ret = localtime(time);
-	sipe_reset_tz(tz_orig);
-
-	return ret;
-}
-
 void
 sipe_cal_free_working_hours(struct sipe_cal_working_hours *wh)
 {
@@ -338,47 +273,38 @@ sipe_cal_free_working_hours(struct sipe_cal_working_hours *wh)
 	g_free(wh->dst.year);
 
 	g_free(wh->days_of_week);
-	g_free(wh->tz);
-	g_free(wh->tz_std);
-	g_free(wh->tz_dst);
 	g_free(wh);
 }
 
 /**
  * Returns time_t of daylight savings time start/end
- * in the provided timezone or otherwise
+ * in the provided timezone and year or otherwise
  * (time_t)-1 if no daylight savings time.
  */
 static time_t
-sipe_cal_get_std_dst_time(time_t now,
+sipe_cal_get_std_dst_time(int year,
 			  int bias,
 			  struct sipe_cal_std_dst* std_dst,
 			  struct sipe_cal_std_dst* dst_std)
 {
 	struct tm switch_tm;
 	time_t res = TIME_NULL;
-	struct tm *gm_now_tm;
-	gchar **time_arr;
 
 	if (std_dst->month == 0) return TIME_NULL;
 
-	gm_now_tm = gmtime(&now);
-	time_arr = g_strsplit(std_dst->time, ":", 0);
-
-	switch_tm.tm_sec  = atoi(time_arr[2]);
-	switch_tm.tm_min  = atoi(time_arr[1]);
-	switch_tm.tm_hour = atoi(time_arr[0]);
-	g_strfreev(time_arr);
-	switch_tm.tm_mday  = std_dst->year ? std_dst->day_order : 1 /* to adjust later */ ;
+	memset(&switch_tm, 0, sizeof(switch_tm));
+	switch_tm.tm_sec   = std_dst->seconds % 60;
+	switch_tm.tm_min   = (std_dst->seconds / 60) % 60;
+	switch_tm.tm_hour  = std_dst->seconds / 3600;
+	switch_tm.tm_mday  = std_dst->fixed_year ? std_dst->day_order : 1 /* to adjust later */ ;
 	switch_tm.tm_mon   = std_dst->month - 1;
-	switch_tm.tm_year  = std_dst->year ? atoi(std_dst->year) - 1900 : gm_now_tm->tm_year;
-	switch_tm.tm_isdst = 0;
+	switch_tm.tm_year  = (std_dst->fixed_year ? std_dst->fixed_year : year) - 1900;
 	/* to set tm_wday */
-	res = sipe_mktime_tz(&switch_tm, "UTC");
+	res = sipe_utils_timegm(&switch_tm);
 
 	/* if not dynamic, calculate right tm_mday */
-	if (!std_dst->year) {
-		int switch_wday = sipe_cal_get_wday(std_dst->day_of_week);
+	if (!std_dst->fixed_year) {
+		int switch_wday = std_dst->wday;
 		int needed_month;
 		/* get first desired wday in the month */
 		int delta = switch_wday >= switch_tm.tm_wday ? (switch_wday - switch_tm.tm_wday) : (switch_wday + 7 - switch_tm.tm_wday);
@@ -387,12 +313,12 @@ sipe_cal_get_std_dst_time(time_t now,
 		switch_tm.tm_mday += (std_dst->day_order - 1) * 7;
 		needed_month = switch_tm.tm_mon;
 		/* to set settle date if ahead of allowed month dates */
-		res = sipe_mktime_tz(&switch_tm, "UTC");
+		res = sipe_utils_timegm(&switch_tm);
 		if (needed_month != switch_tm.tm_mon) {
 			/* moving 1 week back to stay within required month */
 			switch_tm.tm_mday -= 7;
 			/* to fix date again */
-			res = sipe_mktime_tz(&switch_tm, "UTC");
+			res = sipe_utils_timegm(&switch_tm);
 		}
 	}
 	/* note: bias is taken from "switch to" structure */
@@ -445,6 +371,23 @@ sipe_cal_parse_std_dst(const sipe_xml *xn_std_dst_time,
 	if ((node = sipe_xml_child(xn_std_dst_time, "Year"))) {
 		std_dst->year = sipe_xml_data(node);
 	}
+
+	/* compile rule */
+	if (std_dst->time) {
+		gchar **time_arr = g_strsplit(std_dst->time, ":", 3);
+		gchar **entry = time_arr;
+		guint i;
+
+		/* hh:mm:ss */
+		for (i = 0; i < 3; i++) {
+			std_dst->seconds *= 60;
+			if (*entry)
+				std_dst->seconds += atoi(*entry++);
+		}
+		g_strfreev(time_arr);
+	}
+	std_dst->wday       = sipe_cal_get_wday(std_dst->day_of_week);
+	std_dst->fixed_year = std_dst->year ? atoi(std_dst->year) : 0;
 }
 
 void
@@ -457,7 +400,6 @@ sipe_cal_parse_working_hours(const sipe_xml *xn_working_hours,
 	const sipe_xml *xn_standard_time;
 	const sipe_xml *xn_daylight_time;
 	gchar *tmp;
-	time_t now = time(NULL);
 	struct sipe_cal_std_dst* std;
 	struct sipe_cal_std_dst* dst;
 
@@ -510,33 +452,10 @@ sipe_cal_parse_working_hours(const sipe_xml *xn_working_hours,
 		g_free(tmp);
 	}
 
-	std->switch_time = sipe_cal_get_std_dst_time(now, buddy->cal_working_hours->bias, std, dst);
-	dst->switch_time = sipe_cal_get_std_dst_time(now, buddy->cal_working_hours->bias, dst, std);
-
-	/* TST8TDT7,M3.2.0/02:00:00,M11.1.0/02:00:00 */
-	buddy->cal_working_hours->tz =
-		g_strdup_printf("TST%dTDT%d,M%d.%d.%d/%s,M%d.%d.%d/%s",
-				(buddy->cal_working_hours->bias + buddy->cal_working_hours->std.bias) / 60,
-				(buddy->cal_working_hours->bias + buddy->cal_working_hours->dst.bias) / 60,
-
-				buddy->cal_working_hours->dst.month,
-				buddy->cal_working_hours->dst.day_order,
-				sipe_cal_get_wday(buddy->cal_working_hours->dst.day_of_week),
-				buddy->cal_working_hours->dst.time,
-
-				buddy->cal_working_hours->std.month,
-				buddy->cal_working_hours->std.day_order,
-				sipe_cal_get_wday(buddy->cal_working_hours->std.day_of_week),
-				buddy->cal_working_hours->std.time
-				);
-	/* TST8 */
-	buddy->cal_working_hours->tz_std =
-		g_strdup_printf("TST%d",
-				(buddy->cal_working_hours->bias + buddy->cal_working_hours->std.bias) / 60);
-	/* TDT7 */
-	buddy->cal_working_hours->tz_dst =
-		g_strdup_printf("TDT%d",
-				(buddy->cal_working_hours->bias + buddy->cal_working_hours->dst.bias) / 60);
+	buddy->cal_working_hours->std_offset = buddy->cal_working_hours->bias + std->bias;
+	buddy->cal_working_hours->dst_offset = buddy->cal_working_hours->bias + dst->bias;
+	/* switch times are calculated on first use */
+	buddy->cal_working_hours->switch_year = 0;
 }
 
 struct sipe_cal_event*
@@ -573,55 +492,150 @@ sipe_cal_get_event(GSList *cal_events,
 	return res;
 }
 
-static int
-sipe_cal_get_status0(const gchar *free_busy,
-		     time_t cal_start,
-		     int granularity,
-		     time_t time_in_question,
-		     int *index)
-{
-	int res = SIPE_CAL_NO_DATA;
-	int shift;
-	time_t cal_end = cal_start + strlen(free_busy)*granularity*60 - 1;
+/*
+   http://msdn.microsoft.com/en-us/library/dd941537%28office.13%29.aspx
+		00, Free (Fr)
+		01, Tentative (Te)
+		10, Busy (Bu)
+		11, Out of facility (Oo)
 
-	if (!(time_in_question >= cal_start && time_in_question <= cal_end)) return res;
+   http://msdn.microsoft.com/en-us/library/aa566048.aspx
+		0  Free
+		1  Tentative
+		2  Busy
+		3  Out of Office (OOF)
+		4  No data
+
+   The decoded data is kept in its packed form, i.e. 4 slots per byte,
+   lowest two bits first. An index with the first slot of every run of
+   slots with the same status allows to answer "status at time" and
+   "next switch time" with a binary search.
+*/
+struct sipe_cal_free_busy {
+	time_t start;
+	time_t end;       /* first second after the last slot */
+	guint granularity; /* seconds */
+	guint slots;
+	guchar *packed;
+	guint *runs;      /* first slot of each run */
+	guint run_count;
+};
+
+#define TWO_BIT_MASK	0x03
+#define FREE_BUSY_SLOT(fb, slot) \
+	(((fb)->packed[(slot) >> 2] >> (((slot) & 3) << 1)) & TWO_BIT_MASK)
+
+/**
+ * Returns the first slot starting at @c from that doesn't have @c status.
+ * Compares whole 64-bit words and bytes against the replicated status
+ * pattern before falling back to single slots.
+ */
+static guint
+sipe_cal_free_busy_run_end(const struct sipe_cal_free_busy *fb,
+			   guint from,
+			   guint status)
+{
+	guint8 pattern8   = status * 0x55;
+	guint64 pattern64 = status * G_GUINT64_CONSTANT(0x5555555555555555);
+	gsize bytes       = fb->slots >> 2;
+	gsize byte;
+
+	/* finish partial byte */
+	while ((from & 3) && (from < fb->slots)) {
+		if (FREE_BUSY_SLOT(fb, from) != status)
+			return(from);
+		from++;
+	}
 
-	shift = (time_in_question - cal_start) / (granularity*60);
-	if (index) {
-		*index = shift;
+	byte = from >> 2;
+	while (byte + sizeof(guint64) <= bytes) {
+		guint64 word;
+		/* packed data is not aligned */
+		memcpy(&word, fb->packed + byte, sizeof(word));
+		if (word != pattern64)
+			break;
+		byte += sizeof(guint64);
 	}
+	while ((byte < bytes) && (fb->packed[byte] == pattern8))
+		byte++;
 
-	res = free_busy[shift] - '0';
+	for (from = byte << 2; from < fb->slots; from++)
+		if (FREE_BUSY_SLOT(fb, from) != status)
+			break;
 
-	return res;
+	return(from);
+}
+
+static void
+sipe_cal_free_busy_index(struct sipe_cal_free_busy *fb)
+{
+	GArray *runs = g_array_new(FALSE, FALSE, sizeof(guint));
+	guint slot = 0;
+
+	while (slot < fb->slots) {
+		g_array_append_val(runs, slot);
+		slot = sipe_cal_free_busy_run_end(fb,
+						  slot,
+						  FREE_BUSY_SLOT(fb, slot));
+	}
+
+	fb->run_count = runs->len;
+	fb->runs      = (guint *) g_array_free(runs, FALSE);
 }
 
 /**
- * Returns time when current calendar state started
+ * Returns index of the run containing @c slot
  */
-static time_t
-sipe_cal_get_since_time(const gchar *free_busy,
-			time_t calStart,
-			int granularity,
-			int index,
-			int current_state)
+static guint
+sipe_cal_free_busy_find_run(const struct sipe_cal_free_busy *fb,
+			    guint slot)
 {
-	int i;
+	guint low  = 0;
+	guint high = fb->run_count;
+
+	/* runs[0] is always 0 */
+	while (high - low > 1) {
+		guint middle = low + (high - low) / 2;
+		if (fb->runs[middle] <= slot)
+			low = middle;
+		else
+			high = middle;
+	}
+
+	return(low);
+}
 
-	if ((index < 0) || ((size_t)(index + 1) > strlen(free_busy))) return 0;
+static int
+sipe_cal_get_status0(const struct sipe_cal_free_busy *fb,
+		     time_t time_in_question,
+		     int *run)
+{
+	guint slot;
 
-	for (i = index; i >= 0; i--) {
-		int temp_status = free_busy[i] - '0';
+	if (!(time_in_question >= fb->start && time_in_question < fb->end))
+		return(SIPE_CAL_NO_DATA);
 
-		if (current_state != temp_status) {
-			return calStart + (i + 1)*granularity*60;
-		}
+	slot = (time_in_question - fb->start) / fb->granularity;
+	if (run) {
+		*run = sipe_cal_free_busy_find_run(fb, slot);
 	}
 
-	return calStart;
+	return(FREE_BUSY_SLOT(fb, slot));
 }
 
-static char*
+/**
+ * Returns time when current calendar state started
+ */
+static time_t
+sipe_cal_get_since_time(const struct sipe_cal_free_busy *fb,
+			int run)
+{
+	if ((run < 0) || ((guint) run >= fb->run_count)) return 0;
+
+	return(fb->start + (time_t) fb->runs[run] * fb->granularity);
+}
+
+static const struct sipe_cal_free_busy *
 sipe_cal_get_free_busy(struct sipe_buddy *buddy);
 
 int
@@ -629,11 +643,10 @@ sipe_cal_get_status(struct sipe_buddy *buddy,
 		    time_t time_in_question,
 		    time_t *since)
 {
-	time_t cal_start;
-	const char* free_busy;
+	const struct sipe_cal_free_busy *fb;
 	int ret = SIPE_CAL_NO_DATA;
 	time_t state_since;
-	int index = -1;
+	int run = -1;
 
 	if (!buddy || !buddy->cal_start_time || !buddy->cal_granularity) {
 		SIPE_DEBUG_INFO("sipe_cal_get_status: no calendar data1 for %s, exiting",
@@ -641,68 +654,92 @@ sipe_cal_get_status(struct sipe_buddy *buddy,
 		return SIPE_CAL_NO_DATA;
 	}
 
-	if (!(free_busy = sipe_cal_get_free_busy(buddy))) {
+	if (!(fb = sipe_cal_get_free_busy(buddy))) {
 		SIPE_DEBUG_INFO("sipe_cal_get_status: no calendar data2 for %s, exiting", buddy->name);
 		return SIPE_CAL_NO_DATA;
 	}
-	SIPE_DEBUG_INFO("sipe_cal_get_description: buddy->cal_free_busy=\n%s", free_busy);
-
-	cal_start = sipe_utils_str_to_time(buddy->cal_start_time);
 
-	ret = sipe_cal_get_status0(free_busy,
-				   cal_start,
-				   buddy->cal_granularity,
+	ret = sipe_cal_get_status0(fb,
 				   time_in_question,
-				   &index);
-	state_since = sipe_cal_get_since_time(free_busy,
-					      cal_start,
-					      buddy->cal_granularity,
-					      index,
-					      ret);
+				   &run);
+	state_since = sipe_cal_get_since_time(fb, run);
 
 	if (since) *since = state_since;
 	return ret;
 }
 
 static time_t
-sipe_cal_get_switch_time(const gchar *free_busy,
-			 time_t calStart,
-			 int granularity,
-			 int index,
-			 int current_state,
+sipe_cal_get_switch_time(const struct sipe_cal_free_busy *fb,
+			 int run,
 			 int *to_state)
 {
-	size_t i;
-	time_t ret = TIME_NULL;
+	guint next;
 
-	if ((index < 0) || ((size_t) (index + 1) > strlen(free_busy))) {
+	if ((run < 0) || ((guint) run >= fb->run_count)) {
 		*to_state = SIPE_CAL_NO_DATA;
-		return ret;
+		return TIME_NULL;
 	}
 
-	for (i = index + 1; i < strlen(free_busy); i++) {
-		int temp_status = free_busy[i] - '0';
+	next = run + 1;
+	if (next == fb->run_count)
+		return TIME_NULL;
 
-		if (current_state != temp_status) {
-			*to_state = temp_status;
-			return calStart + i*granularity*60;
-		}
-	}
+	*to_state = FREE_BUSY_SLOT(fb, fb->runs[next]);
+	return(fb->start + (time_t) fb->runs[next] * fb->granularity);
+}
 
-	return ret;
+time_t
+sipe_cal_get_next_switch(struct sipe_buddy *buddy,
+			 time_t time_in_question)
+{
+	const struct sipe_cal_free_busy *fb;
+	time_t switch_time;
+	int to_state;
+	int run = -1;
+
+	if (!buddy || !buddy->cal_start_time || !buddy->cal_granularity)
+		return TIME_NULL;
+	if (!(fb = sipe_cal_get_free_busy(buddy)) || (fb->start == fb->end))
+		return TIME_NULL;
+
+	/* calendar data starts in the future or has expired */
+	if (time_in_question < fb->start)
+		return(fb->start);
+	if (time_in_question >= fb->end)
+		return TIME_NULL;
+
+	sipe_cal_get_status0(fb, time_in_question, &run);
+	switch_time = sipe_cal_get_switch_time(fb, run, &to_state);
+
+	/* status changes to SIPE_CAL_NO_DATA after last run */
+	return(IS(switch_time) ? switch_time : fb->end);
 }
 
-static const char*
+/**
+ * Returns offset to UTC in minutes for the time zone of the working hours
+ */
+static int
 sipe_cal_get_tz(struct sipe_cal_working_hours *wh,
                 time_t time_in_question)
 {
-	time_t dst_switch_time = (*wh).dst.switch_time;
-	time_t std_switch_time = (*wh).std.switch_time;
+	time_t dst_switch_time;
+	time_t std_switch_time;
 	gboolean is_dst = FALSE;
+	struct tm tm;
+
+	/* update cached switch times */
+	sipe_utils_gmtime(time_in_question, &tm);
+	if (wh->switch_year != tm.tm_year + 1900) {
+		wh->switch_year     = tm.tm_year + 1900;
+		wh->std.switch_time = sipe_cal_get_std_dst_time(wh->switch_year, wh->bias, &wh->std, &wh->dst);
+		wh->dst.switch_time = sipe_cal_get_std_dst_time(wh->switch_year, wh->bias, &wh->dst, &wh->std);
+	}
+	dst_switch_time = wh->dst.switch_time;
+	std_switch_time = wh->std.switch_time;
 
 	/* No daylight savings */
 	if (dst_switch_time == TIME_NULL) {
-		return wh->tz_std;
+		return wh->std_offset;
 	}
 
 	if (dst_switch_time < std_switch_time) { /* North hemosphere - Europe, US */
@@ -716,22 +753,34 @@ sipe_cal_get_tz(struct sipe_cal_working_hours *wh,
 	}
 
 	if (is_dst) {
-		return wh->tz_dst;
+		return wh->dst_offset;
 	} else {
-		return wh->tz_std;
+		return wh->std_offset;
 	}
 }
 
+/**
+ * Converts Epoch time_t to struct tm in the time zone of the working hours
+ */
+static const struct tm *
+sipe_cal_localtime(struct sipe_cal_working_hours *wh,
+		   time_t timestamp,
+		   struct tm *tm)
+{
+	sipe_utils_gmtime(timestamp - sipe_cal_get_tz(wh, timestamp) * 60, tm);
+	return tm;
+}
+
 static time_t
 sipe_cal_mktime_of_day(struct tm *sample_today_tm,
 		       const int shift_minutes,
-		       const char *tz)
+		       int tz)
 {
 	sample_today_tm->tm_sec  = 0;
 	sample_today_tm->tm_min  = shift_minutes % 60;
 	sample_today_tm->tm_hour = shift_minutes / 60;
 
-	return sipe_mktime_tz(sample_today_tm, tz);
+	return sipe_utils_timegm(sample_today_tm) + tz * 60;
 }
 
 /**
@@ -746,8 +795,11 @@ sipe_cal_get_today_work_hours(struct sipe_cal_working_hours *wh,
 			      time_t *next_start)
 {
 	time_t now = time(NULL);
-	const char *tz = sipe_cal_get_tz(wh, now);
-	struct tm *remote_now_tm = sipe_localtime_tz(&now, tz);
+	int tz = sipe_cal_get_tz(wh, now);
+	struct tm remote_now;
+	struct tm *remote_now_tm = &remote_now;
+
+	sipe_cal_localtime(wh, now, remote_now_tm);
 
 	if (!(wh->days_of_week && strstr(wh->days_of_week, wday_names[remote_now_tm->tm_wday]))) {
 		/* not a work day */
@@ -764,7 +816,10 @@ sipe_cal_get_today_work_hours(struct sipe_cal_working_hours *wh,
 		*next_start = TIME_NULL;
 	} else { /* calculate start of tomorrow's work day if any */
 		time_t tom = now + 24*60*60;
-		struct tm *remote_tom_tm = sipe_localtime_tz(&tom, sipe_cal_get_tz(wh, tom));
+		struct tm remote_tom;
+		struct tm *remote_tom_tm = &remote_tom;
+
+		sipe_cal_localtime(wh, tom, remote_tom_tm);
 
 		if (!(wh->days_of_week && strstr(wh->days_of_week, wday_names[remote_tom_tm->tm_wday]))) {
 			/* not a work day */
@@ -817,48 +872,44 @@ sipe_cal_get_until(const time_t now,
 	return ret;
 }
 
-static char*
+static const struct sipe_cal_free_busy *
 sipe_cal_get_free_busy(struct sipe_buddy *buddy)
 {
 /* do lazy decode if necessary */
 	if (!buddy->cal_free_busy && buddy->cal_free_busy_base64) {
+		struct sipe_cal_free_busy *fb = g_new0(struct sipe_cal_free_busy, 1);
 		gsize cal_dec64_len;
-		guchar *cal_dec64;
-		gsize i;
-		int j = 0;
-
-		cal_dec64 = g_base64_decode(buddy->cal_free_busy_base64, &cal_dec64_len);
 
-		buddy->cal_free_busy = g_malloc0(cal_dec64_len * 4 + 1);
-/*
-   http://msdn.microsoft.com/en-us/library/dd941537%28office.13%29.aspx
-		00, Free (Fr)
-		01, Tentative (Te)
-		10, Busy (Bu)
-		11, Out of facility (Oo)
-
-   http://msdn.microsoft.com/en-us/library/aa566048.aspx
-		0  Free
-		1  Tentative
-		2  Busy
-		3  Out of Office (OOF)
-		4  No data
-*/
-		for (i = 0; i < cal_dec64_len; i++) {
-#define TWO_BIT_MASK	0x03
-			char tmp = cal_dec64[i];
-			buddy->cal_free_busy[j++] = (tmp & TWO_BIT_MASK) + '0';
-			buddy->cal_free_busy[j++] = ((tmp >> 2) & TWO_BIT_MASK) + '0';
-			buddy->cal_free_busy[j++] = ((tmp >> 4) & TWO_BIT_MASK) + '0';
-			buddy->cal_free_busy[j++] = ((tmp >> 6) & TWO_BIT_MASK) + '0';
-		}
-		buddy->cal_free_busy[j++] = '\0';
-		g_free(cal_dec64);
+		fb->packed      = g_base64_decode(buddy->cal_free_busy_base64,
+						  &cal_dec64_len);
+		fb->slots       = cal_dec64_len * 4;
+		fb->granularity = buddy->cal_granularity * 60;
+		fb->start       = sipe_utils_str_to_time(buddy->cal_start_time);
+		fb->end         = fb->start + (time_t) fb->slots * fb->granularity;
+		sipe_cal_free_busy_index(fb);
+
+		SIPE_DEBUG_INFO("sipe_cal_get_free_busy: %s: %u slots, %u runs",
+				buddy->name, fb->slots, fb->run_count);
+
+		/* packed form is all we need from now on */
+		g_free(buddy->cal_free_busy_base64);
+		buddy->cal_free_busy_base64 = NULL;
+		buddy->cal_free_busy = fb;
 	}
 
 	return buddy->cal_free_busy;
 }
 
+void
+sipe_cal_free_free_busy(struct sipe_cal_free_busy *fb)
+{
+	if (!fb) return;
+
+	g_free(fb->packed);
+	g_free(fb->runs);
+	g_free(fb);
+}
+
 char *
 sipe_cal_get_freebusy_base64(const char* freebusy_hex)
 {
@@ -891,7 +942,7 @@ sipe_cal_get_freebusy_base64(const char* freebusy_hex)
 char *
 sipe_cal_get_description(struct sipe_buddy *buddy)
 {
-	time_t cal_start;
+	const struct sipe_cal_free_busy *fb;
 	time_t cal_end;
 	int current_cal_state;
 	time_t now = time(NULL);
@@ -901,9 +952,8 @@ sipe_cal_get_description(struct sipe_buddy *buddy)
 	time_t switch_time;
 	int to_state = SIPE_CAL_NO_DATA;
 	time_t until = TIME_NULL;
-	int index = 0;
+	int run = 0;
 	gboolean has_working_hours = (buddy->cal_working_hours != NULL);
-	const char *free_busy;
 	const char *cal_states[] = {_("Free"),
 				    _("Tentative"),
 				    _("Busy"),
@@ -915,45 +965,48 @@ sipe_cal_get_description(struct sipe_buddy *buddy)
 		return NULL;
 	}
 
-	/* to lazy load if needed */
-	free_busy = sipe_cal_get_free_busy(buddy);
-	SIPE_DEBUG_INFO("sipe_cal_get_description: buddy->cal_free_busy=\n%s", free_busy ? free_busy : "");
+	if (!buddy->cal_start_time) {
+		SIPE_DEBUG_INFO_NOFORMAT("sipe_cal_get_description: no calendar data, exiting");
+		return NULL;
+	}
 
-	if (!buddy->cal_free_busy || !buddy->cal_granularity || !buddy->cal_start_time) {
+	/* to lazy load if needed */
+	if (!(fb = sipe_cal_get_free_busy(buddy))) {
 		SIPE_DEBUG_INFO_NOFORMAT("sipe_cal_get_description: no calendar data, exiting");
 		return NULL;
 	}
 
-	cal_start = sipe_utils_str_to_time(buddy->cal_start_time);
-	cal_end = cal_start + 60 * (buddy->cal_granularity) * strlen(buddy->cal_free_busy);
+	cal_end = fb->end;
 
-	current_cal_state = sipe_cal_get_status0(free_busy, cal_start, buddy->cal_granularity, time(NULL), &index);
+	current_cal_state = sipe_cal_get_status0(fb, now, &run);
 	if (current_cal_state == SIPE_CAL_NO_DATA) {
 		SIPE_DEBUG_INFO_NOFORMAT("sipe_cal_get_description: calendar is undefined for present moment, exiting.");
 		return NULL;
 	}
 
-	switch_time = sipe_cal_get_switch_time(free_busy, cal_start, buddy->cal_granularity, index, current_cal_state, &to_state);
+	switch_time = sipe_cal_get_switch_time(fb, run, &to_state);
 
 	SIPE_DEBUG_INFO_NOFORMAT("\n* Calendar *");
 	if (buddy->cal_working_hours) {
+		struct tm remote_tm;
+
 		sipe_cal_get_today_work_hours(buddy->cal_working_hours, &start, &end, &next_start);
 
-		SIPE_DEBUG_INFO("Remote now timezone : %s", sipe_cal_get_tz(buddy->cal_working_hours, now));
+		SIPE_DEBUG_INFO("Remote now timezone : UTC%+d min", -sipe_cal_get_tz(buddy->cal_working_hours, now));
 		SIPE_DEBUG_INFO("std.switch_time(GMT): %s",
 				IS((*buddy->cal_working_hours).std.switch_time) ? sipe_utils_time_to_debug_str(gmtime(&((*buddy->cal_working_hours).std.switch_time))) : "");
 		SIPE_DEBUG_INFO("dst.switch_time(GMT): %s",
 				IS((*buddy->cal_working_hours).dst.switch_time) ? sipe_utils_time_to_debug_str(gmtime(&((*buddy->cal_working_hours).dst.switch_time))) : "");
 		SIPE_DEBUG_INFO("Remote now time     : %s",
-			sipe_utils_time_to_debug_str(sipe_localtime_tz(&now, sipe_cal_get_tz(buddy->cal_working_hours, now))));
+			sipe_utils_time_to_debug_str(sipe_cal_localtime(buddy->cal_working_hours, now, &remote_tm)));
 		SIPE_DEBUG_INFO("Remote start time   : %s",
-			IS(start) ? sipe_utils_time_to_debug_str(sipe_localtime_tz(&start, sipe_cal_get_tz(buddy->cal_working_hours, start))) : "");
+			IS(start) ? sipe_utils_time_to_debug_str(sipe_cal_localtime(buddy->cal_working_hours, start, &remote_tm)) : "");
 		SIPE_DEBUG_INFO("Remote end time     : %s",
-			IS(end) ? sipe_utils_time_to_debug_str(sipe_localtime_tz(&end, sipe_cal_get_tz(buddy->cal_working_hours, end))) : "");
+			IS(end) ? sipe_utils_time_to_debug_str(sipe_cal_localtime(buddy->cal_working_hours, end, &remote_tm)) : "");
 		SIPE_DEBUG_INFO("Rem. next_start time: %s",
-			IS(next_start) ? sipe_utils_time_to_debug_str(sipe_localtime_tz(&next_start, sipe_cal_get_tz(buddy->cal_working_hours, next_start))) : "");
+			IS(next_start) ? sipe_utils_time_to_debug_str(sipe_cal_localtime(buddy->cal_working_hours, next_start, &remote_tm)) : "");
 		SIPE_DEBUG_INFO("Remote switch time  : %s",
-			IS(switch_time) ? sipe_utils_time_to_debug_str(sipe_localtime_tz(&switch_time, sipe_cal_get_tz(buddy->cal_working_hours, switch_time))) : "");
+			IS(switch_time) ? sipe_utils_time_to_debug_str(sipe_cal_localtime(buddy->cal_working_hours, switch_time, &remote_tm)) : "");
 	} else {
 		SIPE_DEBUG_INFO("Local now time      : %s",
 			sipe_utils_time_to_debug_str(localtime(&now)));
@@ -1102,9 +1155,65 @@ void sipe_core_update_calendar(struct sipe_core_public *sipe_public)
 	SIPE_DEBUG_INFO_NOFORMAT("sipe_core_update_calendar: finished.");
 }
 
+static void sipe_cal_publish_cb(struct sipe_core_private *sipe_private,
+				SIPE_UNUSED_PARAMETER gpointer data)
+{
+	sipe_cal_presence_publish(sipe_private, TRUE);
+}
+
+static void sipe_cal_next_switch(time_t now,
+				 time_t candidate,
+				 time_t *next)
+{
+	if (IS(candidate) && (candidate > now) &&
+	    (!IS(*next) || (candidate < *next)))
+		*next = candidate;
+}
+
+/**
+ * Our published calendar state only changes when an event starts or ends
+ * or when scheduled OOF starts or ends. Republish exactly at that time.
+ */
+static void sipe_cal_schedule_publish(struct sipe_core_private *sipe_private)
+{
+	struct sipe_calendar *cal = sipe_private->calendar;
+	time_t now = time(NULL);
+	time_t next = TIME_NULL;
+	GSList *entry;
+
+	if (!cal)
+		return;
+
+	for (entry = cal->cal_events; entry; entry = entry->next) {
+		struct sipe_cal_event *cal_event = entry->data;
+		sipe_cal_next_switch(now, cal_event->start_time, &next);
+		sipe_cal_next_switch(now, cal_event->end_time,   &next);
+	}
+	if (sipe_strequal("Scheduled", cal->oof_state)) {
+		sipe_cal_next_switch(now, cal->oof_start, &next);
+		sipe_cal_next_switch(now, cal->oof_end,   &next);
+	}
+
+	if (IS(next)) {
+		SIPE_DEBUG_INFO("sipe_cal_schedule_publish: next calendar state change at %s",
+				sipe_utils_time_to_debug_str(localtime(&next)));
+		sipe_schedule_seconds(sipe_private,
+				      "<+cal-publish>",
+				      NULL,
+				      next - now,
+				      sipe_cal_publish_cb,
+				      NULL);
+	} else {
+		sipe_schedule_cancel(sipe_private, "<+cal-publish>");
+	}
+}
+
 void sipe_cal_presence_publish(struct sipe_core_private *sipe_private,
 			       gboolean do_publish_calendar)
 {
+	if (do_publish_calendar)
+		sipe_cal_schedule_publish(sipe_private);
+
 	if (SIPE_CORE_PRIVATE_FLAG_IS(OCS2007)) {
 		if (do_publish_calendar)
 			sipe_ocs2007_presence_publish(sipe_private, NULL);
@@ -113,17 +113,6 @@ void
 sipe_cal_event_debug(const struct sipe_cal_event *cal_event,
 		     const gchar *label);
 
-/**
- * Converts struct tm to Epoch time_t considering timezone.
- *
- * @param tz as defined for TZ environment variable.
- *
- * Reference: see timegm(3) - Linux man page
- */
-time_t
-sipe_mktime_tz(struct tm *tm,
-	       const char* tz);
-
 /**
  * Converts hex representation of freebusy string as
  * returned by Exchange Web Services to
@@ -151,6 +140,15 @@ sipe_cal_parse_working_hours(const struct _sipe_xml *xn_working_hours,
 void
 sipe_cal_free_working_hours(struct sipe_cal_working_hours *wh);
 
+/** Contains buddy's decoded FreeBusy information */
+struct sipe_cal_free_busy;
+
+/**
+ * Frees struct sipe_cal_free_busy
+ */
+void
+sipe_cal_free_free_busy(struct sipe_cal_free_busy *fb);
+
 /**
  * Returns user calendar information in text form.
  * Example: "Currently Busy. Free at 13:00"
@@ -169,6 +167,15 @@ sipe_cal_get_status(struct sipe_buddy *buddy,
 		    time_t time_in_question,
 		    time_t *since);
 
+/**
+ * Returns time of the next calendar status change after the time
+ * specified, i.e. when sipe_cal_get_status() will return a different
+ * value. Returns (time_t)-1 if there is no calendar data or no change.
+ */
+time_t
+sipe_cal_get_next_switch(struct sipe_buddy *buddy,
+			 time_t time_in_question);
+
 /**
  * Returns calendar event at time in question.
  * If conflict, takes last event in the following
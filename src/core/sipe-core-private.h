@@ -35,6 +35,8 @@ struct sipe_http;
 struct sipe_http_request;
 struct sipe_lync_autodiscover;
 struct sipe_media_call_private;
+struct sipe_presence_queue;
+struct sipe_schedule_queue;
 struct sipe_svc;
 struct sipe_ucs;
 struct sipe_webticket;
@@ -88,9 +90,11 @@ struct sipe_core_private {
 	/* [MS-SIP] deltaNum counters */
 	guint deltanum_contacts;
 	guint deltanum_acl;      /* setACE (OCS2005 only) */
+	guint deltanum_snapshot; /* last contact list received from server */
 
 	/* [MS-PRES] */
 	GSList *containers;
+	GHashTable *access_levels; /* cached access level per member */
 	GSList *our_publication_keys;
 	GHashTable *our_publications;
 	GHashTable *user_state_publications;
@@ -122,10 +126,11 @@ struct sipe_core_private {
 	gchar *ocs2005_user_states;
 
 	/* Scheduling system */
-	GSList *timeouts;
+	struct sipe_schedule_queue *timeouts;
 
 	/* Active subscriptions */
 	GHashTable *subscriptions;
+	struct sipe_presence_queue *presence_queue;
 
 	/* Voice call */
 	GHashTable *media_calls;
@@ -220,6 +225,8 @@ struct sipe_core_private {
 #define SIPE_CORE_PRIVATE_FLAG_LYNC2013           0x00400000
 /* server is Skype for Business (RTC/6.0 +) */
 #define SIPE_CORE_PRIVATE_FLAG_SFB                0x00200000
+/* buddy list was loaded from snapshot and not yet updated by server */
+#define SIPE_CORE_PRIVATE_FLAG_SNAPSHOT           0x00100000
 
 #define SIPE_CORE_PUBLIC_FLAG_IS(flag)    \
 	((sipe_private->public.flags & SIPE_CORE_FLAG_ ## flag) == SIPE_CORE_FLAG_ ## flag)
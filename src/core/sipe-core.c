@@ -93,6 +93,7 @@
 #include "sipe-ocs2007.h"
 #include "sipe-schedule.h"
 #include "sipe-session.h"
+#include "sipe-snapshot.h"
 #include "sipe-status.h"
 #include "sipe-subscriptions.h"
 #include "sipe-svc.h"
@@ -446,6 +447,9 @@ void sipe_core_deallocate(struct sipe_core_public *sipe_public)
 		sip_csta_close(sipe_private);
 	}
 
+	/* buddy list & presence for next login */
+	sipe_snapshot_save(sipe_private);
+
 	/* pending service requests must be cancelled first */
 	sipe_svc_free(sipe_private);
 	sipe_webticket_free(sipe_private);
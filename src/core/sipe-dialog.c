@@ -156,7 +156,9 @@ static void sipe_dialog_parse_routes(struct sip_dialog *dialog,
 				     const struct sipmsg *msg,
 				     gboolean outgoing)
 {
-        GSList *hdr = msg->headers;
+	struct sipmsg_header_iter iter;
+	const gchar *name;
+	const gchar *value;
 	gchar *contact = sipmsg_parse_contact_address(msg);
 
 	/* Remove old routes */
@@ -168,10 +170,10 @@ static void sipe_dialog_parse_routes(struct sip_dialog *dialog,
 	g_free(dialog->request);
         dialog->request = NULL;
 
-        while (hdr) {
-                struct sipnameval *elem = hdr->data;
-                if (sipe_strcase_equal(elem->name, "Record-Route")) {
-			gchar **parts = g_strsplit(elem->value, ",", 0);
+	sipmsg_header_iter_init(&iter, msg);
+	while (sipmsg_header_iter_next(&iter, &name, &value)) {
+                if (sipe_strcase_equal(name, "Record-Route")) {
+			gchar **parts = g_strsplit(value, ",", 0);
 			gchar **part = parts;
 
 			while (*part) {
@@ -182,7 +184,6 @@ static void sipe_dialog_parse_routes(struct sip_dialog *dialog,
 			}
 			g_strfreev(parts);
                 }
-                hdr = g_slist_next(hdr);
         }
         if (outgoing) {
 		dialog->routes = g_slist_reverse(dialog->routes);
@@ -213,18 +214,19 @@ sipe_get_supported_header(const struct sipmsg *msg,
 			  struct sip_dialog *dialog,
 			  SIPE_UNUSED_PARAMETER gboolean outgoing)
 {
-	GSList *hdr = msg->headers;
-	struct sipnameval *elem;
-	while(hdr)
+	struct sipmsg_header_iter iter;
+	const gchar *name;
+	const gchar *value;
+
+	sipmsg_header_iter_init(&iter, msg);
+	while (sipmsg_header_iter_next(&iter, &name, &value))
 	{
-		elem = hdr->data;
-		if (sipe_strcase_equal(elem->name, "Supported")
-			&& !g_slist_find_custom(dialog->supported, elem->value, (GCompareFunc)g_ascii_strcasecmp))
+		if (sipe_strcase_equal(name, "Supported")
+			&& !g_slist_find_custom(dialog->supported, value, (GCompareFunc)g_ascii_strcasecmp))
 		{
-			dialog->supported = g_slist_append(dialog->supported, g_strdup(elem->value));
+			dialog->supported = g_slist_append(dialog->supported, g_strdup(value));
 
 		}
-		hdr = g_slist_next(hdr);
 	}
 }
 
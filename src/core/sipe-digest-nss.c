@@ -189,6 +189,54 @@ void sipe_digest_ft_destroy(gpointer context)
 	sipe_digest_ctx_destroy(context);
 }
 
+/* Stream HMAC(MD5/SHA-1) digests with a reusable key, e.g. for NTLM & TLS */
+static void sipe_digest_hmac_ctx_restart(PK11Context* DigestContext, guchar *digest, gsize digest_length)
+{
+	sipe_digest_ctx_digest(DigestContext, digest, digest_length);
+	/* context keeps the symmetric key: restart for the next digest */
+	PK11_DigestBegin(DigestContext);
+}
+
+gpointer sipe_digest_hmac_md5_start(const guchar *key, gsize key_length)
+{
+	return sipe_digest_hmac_ctx_create(CKM_MD5_HMAC, key, key_length);
+}
+
+void sipe_digest_hmac_md5_update(gpointer context, const guchar *data, gsize length)
+{
+	sipe_digest_ctx_append(context, data, length);
+}
+
+void sipe_digest_hmac_md5_end(gpointer context, guchar *digest)
+{
+	sipe_digest_hmac_ctx_restart(context, digest, SIPE_DIGEST_HMAC_MD5_LENGTH);
+}
+
+void sipe_digest_hmac_md5_destroy(gpointer context)
+{
+	sipe_digest_ctx_destroy(context);
+}
+
+gpointer sipe_digest_hmac_sha1_start(const guchar *key, gsize key_length)
+{
+	return sipe_digest_hmac_ctx_create(CKM_SHA_1_HMAC, key, key_length);
+}
+
+void sipe_digest_hmac_sha1_update(gpointer context, const guchar *data, gsize length)
+{
+	sipe_digest_ctx_append(context, data, length);
+}
+
+void sipe_digest_hmac_sha1_end(gpointer context, guchar *digest)
+{
+	sipe_digest_hmac_ctx_restart(context, digest, SIPE_DIGEST_HMAC_SHA1_LENGTH);
+}
+
+void sipe_digest_hmac_sha1_destroy(gpointer context)
+{
+	sipe_digest_ctx_destroy(context);
+}
+
 /* Stream digests, e.g. for TLS */
 gpointer sipe_digest_md5_start(void)
 {
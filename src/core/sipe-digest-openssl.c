@@ -110,6 +110,68 @@ void sipe_digest_ft_destroy(gpointer context)
 #endif
 }
 
+/* Stream HMAC(MD5/SHA-1) digests with a reusable key, e.g. for NTLM & TLS */
+static gpointer openssl_hmac_start(const EVP_MD *md,
+				   const guchar *key, gsize key_length)
+{
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+	HMAC_CTX *ctx = g_malloc(sizeof(HMAC_CTX));
+	HMAC_CTX_init(ctx);
+#else
+	/* OpenSSL 1.1.0 or newer */
+	HMAC_CTX *ctx = HMAC_CTX_new();
+#endif
+	HMAC_Init_ex(ctx, key, key_length, md, NULL);
+	return(ctx);
+}
+
+static void openssl_hmac_end(gpointer context, guchar *digest)
+{
+	HMAC_Final(context, digest, NULL);
+	/* NULL key & digest: restart with the already keyed state */
+	HMAC_Init_ex(context, NULL, 0, NULL, NULL);
+}
+
+gpointer sipe_digest_hmac_md5_start(const guchar *key, gsize key_length)
+{
+	return(openssl_hmac_start(EVP_md5(), key, key_length));
+}
+
+void sipe_digest_hmac_md5_update(gpointer context, const guchar *data, gsize length)
+{
+	HMAC_Update(context, data, length);
+}
+
+void sipe_digest_hmac_md5_end(gpointer context, guchar *digest)
+{
+	openssl_hmac_end(context, digest);
+}
+
+void sipe_digest_hmac_md5_destroy(gpointer context)
+{
+	sipe_digest_ft_destroy(context);
+}
+
+gpointer sipe_digest_hmac_sha1_start(const guchar *key, gsize key_length)
+{
+	return(openssl_hmac_start(EVP_sha1(), key, key_length));
+}
+
+void sipe_digest_hmac_sha1_update(gpointer context, const guchar *data, gsize length)
+{
+	HMAC_Update(context, data, length);
+}
+
+void sipe_digest_hmac_sha1_end(gpointer context, guchar *digest)
+{
+	openssl_hmac_end(context, digest);
+}
+
+void sipe_digest_hmac_sha1_destroy(gpointer context)
+{
+	sipe_digest_ft_destroy(context);
+}
+
 /* Stream digests, e.g. for TLS */
 gpointer sipe_digest_md5_start(void)
 {
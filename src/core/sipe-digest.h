@@ -49,6 +49,17 @@ void sipe_digest_ft_update(gpointer context, const guchar *data, gsize length);
 void sipe_digest_ft_end(gpointer context, guchar *digest);
 void sipe_digest_ft_destroy(gpointer context);
 
+/* Stream HMAC(MD5/SHA-1) digests with a reusable key, e.g. for NTLM & TLS */
+/* _end() resets context: next update starts a new digest with the same key */
+gpointer sipe_digest_hmac_md5_start(const guchar *key, gsize key_length);
+void sipe_digest_hmac_md5_update(gpointer context, const guchar *data, gsize length);
+void sipe_digest_hmac_md5_end(gpointer context, guchar *digest);
+void sipe_digest_hmac_md5_destroy(gpointer context);
+gpointer sipe_digest_hmac_sha1_start(const guchar *key, gsize key_length);
+void sipe_digest_hmac_sha1_update(gpointer context, const guchar *data, gsize length);
+void sipe_digest_hmac_sha1_end(gpointer context, guchar *digest);
+void sipe_digest_hmac_sha1_destroy(gpointer context);
+
 /* Stream digests, e.g. for TLS */
 gpointer sipe_digest_md5_start(void);
 void sipe_digest_md5_update(gpointer context, const guchar *data, gsize length);
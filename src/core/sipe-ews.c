@@ -356,6 +356,7 @@ static void sipe_ews_send_http_request(struct sipe_calendar *cal)
 		sipe_core_email_authentication(cal->sipe_private,
 					       cal->request);
 		sipe_http_request_allow_redirect(cal->request);
+		sipe_http_request_compression(cal->request);
 		sipe_http_request_ready(cal->request);
 	}
 }
@@ -377,7 +378,7 @@ static void sipe_ews_do_avail_request(struct sipe_calendar *cal)
 		now_tm->tm_sec = 0;
 		now_tm->tm_min = 0;
 		now_tm->tm_hour = 0;
-		cal->fb_start = sipe_mktime_tz(now_tm, "UTC");
+		cal->fb_start = sipe_utils_timegm(now_tm);
 		cal->fb_start -= 24*60*60;
 		/* end = start + 4 days - 1 sec */
 		end = cal->fb_start + SIPE_FREE_BUSY_PERIOD_SEC - 1;
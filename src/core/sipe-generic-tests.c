@@ -27,11 +27,13 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 
 #include <glib.h>
 
 #include "sipe-common.h"
 #include "sipe-backend.h"
+#include "sipe-core.h"
 #include "sipe-crypt.h"
 #include "sipe-utils.h"
 #include "sip-transport.h"
@@ -146,8 +148,122 @@ static void tests_sipe_utils_time(void) {
 	assert_equal_uint(result_time,  365 * 24 * 60 * 60);
 }
 
+static void tests_sipe_utils_timegm(void) {
+	struct tm tm;
+	time_t result_time;
+
+	/* 2020-02-29T12:34:56Z */
+	sipe_utils_gmtime(1582979696, &tm);
+	assert_equal_uint(120, tm.tm_year);
+	assert_equal_uint(  1, tm.tm_mon);
+	assert_equal_uint( 29, tm.tm_mday);
+	assert_equal_uint( 12, tm.tm_hour);
+	assert_equal_uint( 34, tm.tm_min);
+	assert_equal_uint( 56, tm.tm_sec);
+	assert_equal_uint(  6, tm.tm_wday); /* Saturday */
+	assert_equal_uint( 59, tm.tm_yday);
+	result_time = sipe_utils_timegm(&tm);
+	assert_equal_uint(1582979696, result_time);
+
+	/* before epoch: 1969-12-31T23:59:59Z */
+	sipe_utils_gmtime(-1, &tm);
+	assert_equal_uint( 69, tm.tm_year);
+	assert_equal_uint( 11, tm.tm_mon);
+	assert_equal_uint( 31, tm.tm_mday);
+	assert_equal_uint(  3, tm.tm_wday); /* Wednesday */
+
+	/* normalization: 2019-12-32T00:00:7200Z -> 2020-01-01T02:00:00Z */
+	memset(&tm, 0, sizeof(tm));
+	tm.tm_year = 119;
+	tm.tm_mon  = 11;
+	tm.tm_mday = 32;
+	tm.tm_sec  = 7200;
+	result_time = sipe_utils_timegm(&tm);
+	assert_equal_uint(1577844000, result_time);
+	assert_equal_uint(120, tm.tm_year);
+	assert_equal_uint(  0, tm.tm_mon);
+	assert_equal_uint(  1, tm.tm_mday);
+	assert_equal_uint(  2, tm.tm_hour);
+	assert_equal_uint(  3, tm.tm_wday); /* Wednesday */
+
+	/* negative month: 2021-(-1)-01 -> 2020-12-01 */
+	memset(&tm, 0, sizeof(tm));
+	tm.tm_year = 121;
+	tm.tm_mon  = -1;
+	tm.tm_mday = 1;
+	result_time = sipe_utils_timegm(&tm);
+	assert_equal_uint(1606780800, result_time);
+	assert_equal_uint(120, tm.tm_year);
+	assert_equal_uint( 11, tm.tm_mon);
+}
+
+static void tests_sipe_utils_transport_buffer(void) {
+	struct sipe_transport_connection conn;
+	gchar *buffer;
+	gsize space;
+	gsize length;
+	guint i;
+
+	memset(&conn, 0, sizeof(conn));
+
+	/* first request allocates buffer */
+	buffer = sipe_core_transport_input_buffer(&conn, &space);
+	assert_equal_uint(TRUE, buffer == conn.buffer_memory);
+	assert_equal_uint(conn.buffer_length - 1, space);
+	assert_equal_str("", conn.buffer);
+
+	memcpy(buffer, "ABCDEFGH", 8);
+	sipe_core_transport_input_received(&conn, 8);
+	assert_equal_str("ABCDEFGH", conn.buffer);
+
+	/* consuming data doesn't move it */
+	sipe_utils_shrink_buffer(&conn, conn.buffer + 3);
+	assert_equal_str("DEFGH", conn.buffer);
+	assert_equal_uint(5, conn.buffer_used);
+	assert_equal_uint(3, conn.buffer - conn.buffer_memory);
+
+	/* consuming everything restarts at the beginning */
+	sipe_utils_shrink_buffer(&conn, conn.buffer + conn.buffer_used);
+	assert_equal_uint(0, conn.buffer_used);
+	assert_equal_uint(TRUE, conn.buffer == conn.buffer_memory);
+	assert_equal_str("", conn.buffer);
+
+	/* filling the buffer grows it geometrically */
+	length = conn.buffer_length;
+	for (i = 0; i < 3; i++) {
+		buffer = sipe_core_transport_input_buffer(&conn, &space);
+		memset(buffer, 'x', space);
+		sipe_core_transport_input_received(&conn, space);
+	}
+	assert_equal_uint(TRUE, conn.buffer_length >= 4 * length);
+	assert_equal_uint(conn.buffer_used, strlen(conn.buffer));
+
+	/* buffer more than half consumed -> compacted instead of grown */
+	length = conn.buffer_length;
+	sipe_utils_shrink_buffer(&conn, conn.buffer + conn.buffer_used - 10);
+	buffer = sipe_core_transport_input_buffer(&conn, &space);
+	assert_equal_uint(length, conn.buffer_length);
+	assert_equal_uint(TRUE, conn.buffer == conn.buffer_memory);
+	assert_equal_uint(10, conn.buffer_used);
+	assert_equal_str("xxxxxxxxxx", conn.buffer);
+
+	sipe_core_transport_input_free(&conn);
+	assert_equal_uint(0, conn.buffer_length);
+}
+
+static void tests_sipe_utils_strcase_hash(void) {
+	assert_equal_uint(sipe_utils_strcase_hash("Call-ID;Tag=1"),
+			  sipe_utils_strcase_hash("call-id;tag=1"));
+	assert_equal_uint(5381, sipe_utils_strcase_hash(""));
+	assert_equal_uint(TRUE,  sipe_utils_strcase_key_equal("CSeq", "cseq"));
+	assert_equal_uint(FALSE, sipe_utils_strcase_key_equal("CSeq", "cseq "));
+}
+
 static void generic_tests(void) {
 	tests_sipe_utils_time();
+	tests_sipe_utils_timegm();
+	tests_sipe_utils_transport_buffer();
+	tests_sipe_utils_strcase_hash();
 }
 
 int main(SIPE_UNUSED_PARAMETER int argc,
@@ -39,8 +39,15 @@
 #include "sipe-utils.h"
 #include "sipe-xml.h"
 
+/*
+ * Names and IDs aren't guaranteed to be unique, e.g. after renaming a
+ * group to the name of another group. Each index entry therefore holds
+ * all groups with that key, lookup returns the one indexed first.
+ */
 struct sipe_groups {
 	GSList *list;
+	GHashTable *id;   /* key: ID,   value: GQueue of sipe_group */
+	GHashTable *name; /* key: name, value: GQueue of sipe_group */
 };
 
 struct group_user_context {
@@ -112,42 +119,99 @@ struct sipe_group*
 sipe_group_find_by_id(struct sipe_core_private *sipe_private,
 		      guint id)
 {
-	struct sipe_group *group;
-	GSList *entry;
+	GQueue *queue;
 
 	if (!sipe_private)
 		return NULL;
 
-	entry = sipe_private->groups->list;
-	while (entry) {
-		group = entry->data;
-		if (group->id == id) {
-			return group;
-		}
-		entry = entry->next;
-	}
-	return NULL;
+	queue = g_hash_table_lookup(sipe_private->groups->id,
+				    GUINT_TO_POINTER(id));
+	return(queue ? g_queue_peek_head(queue) : NULL);
 }
 
 struct sipe_group*
 sipe_group_find_by_name(struct sipe_core_private *sipe_private,
 			const gchar * name)
 {
-	struct sipe_group *group;
-	GSList *entry;
+	GQueue *queue;
 
 	if (!sipe_private || !name)
 		return NULL;
 
-	entry = sipe_private->groups->list;
-	while (entry) {
-		group = entry->data;
-		if (sipe_strequal(group->name, name)) {
-			return group;
-		}
-		entry = entry->next;
+	queue = g_hash_table_lookup(sipe_private->groups->name, name);
+	return(queue ? g_queue_peek_head(queue) : NULL);
+}
+
+/* key is only copied for a new index entry */
+static void group_index_add(GHashTable *index,
+			    gconstpointer key,
+			    gpointer (*key_copy)(gconstpointer key),
+			    struct sipe_group *group)
+{
+	GQueue *queue = g_hash_table_lookup(index, key);
+
+	if (!queue) {
+		queue = g_queue_new();
+		g_hash_table_insert(index,
+				    key_copy ? (*key_copy)(key) : (gpointer) key,
+				    queue);
+	}
+	g_queue_push_tail(queue, group);
+}
+
+static void group_index_remove(GHashTable *index,
+			       gconstpointer key,
+			       struct sipe_group *group)
+{
+	GQueue *queue = g_hash_table_lookup(index, key);
+
+	if (queue) {
+		g_queue_remove(queue, group);
+		if (g_queue_is_empty(queue))
+			g_hash_table_remove(index, key);
 	}
-	return NULL;
+}
+
+static gpointer group_name_copy(gconstpointer name)
+{
+	return(g_strdup(name));
+}
+
+static void group_index(struct sipe_groups *groups,
+			struct sipe_group *group)
+{
+	group_index_add(groups->id,
+			GUINT_TO_POINTER(group->id),
+			NULL,
+			group);
+	group_index_add(groups->name,
+			group->name,
+			group_name_copy,
+			group);
+}
+
+static void group_unindex(struct sipe_groups *groups,
+			  struct sipe_group *group)
+{
+	group_index_remove(groups->id,
+			   GUINT_TO_POINTER(group->id),
+			   group);
+	group_index_remove(groups->name,
+			   group->name,
+			   group);
+}
+
+static void group_set_name(struct sipe_core_private *sipe_private,
+			   struct sipe_group *group,
+			   const gchar *name)
+{
+	struct sipe_groups *groups = sipe_private->groups;
+
+	/* other groups with the old name stay indexed under it */
+	group_index_remove(groups->name, group->name, group);
+	g_free(group->name);
+	group->name = g_strdup(name);
+	group_index_add(groups->name, group->name, group_name_copy, group);
 }
 
 void
@@ -192,10 +256,8 @@ gboolean sipe_group_rename(struct sipe_core_private *sipe_private,
 	gboolean renamed = sipe_backend_buddy_group_rename(SIPE_CORE_PUBLIC,
 							   group->name,
 							   name);
-	if (renamed) {
-		g_free(group->name);
-		group->name = g_strdup(name);
-	}
+	if (renamed)
+		group_set_name(sipe_private, group, name);
 	return(renamed);
 }
 
@@ -224,6 +286,7 @@ struct sipe_group *sipe_group_add(struct sipe_core_private *sipe_private,
 
 			sipe_private->groups->list = g_slist_append(sipe_private->groups->list,
 								    group);
+			group_index(sipe_private->groups, group);
 
 			SIPE_DEBUG_INFO("sipe_group_add: created backend group '%s' with id %d",
 					group->name, group->id);
@@ -243,6 +306,7 @@ static void group_free(struct sipe_core_private *sipe_private,
 {
 	sipe_private->groups->list = g_slist_remove(sipe_private->groups->list,
 						    group);
+	group_unindex(sipe_private->groups, group);
 	g_free(group->name);
 	g_free(group->exchange_key);
 	g_free(group->change_key);
@@ -287,8 +351,7 @@ sipe_core_group_rename(struct sipe_core_public *sipe_public,
 			g_free(request);
 		}
 
-		g_free(s_group->name);
-		s_group->name = g_strdup(new_name);
+		group_set_name(sipe_private, s_group, new_name);
 	} else {
 		SIPE_DEBUG_INFO("sipe_core_group_rename: cannot find group '%s'", old_name);
 	}
@@ -413,6 +476,16 @@ void sipe_group_update_start(struct sipe_core_private *sipe_private)
 	}
 }
 
+void sipe_group_update_cancel(struct sipe_core_private *sipe_private)
+{
+	GSList *entry = sipe_private->groups->list;
+
+	while (entry) {
+		((struct sipe_group *) entry->data)->is_obsolete = FALSE;
+		entry = entry->next;
+	}
+}
+
 void sipe_group_update_finish(struct sipe_core_private *sipe_private)
 {
 	GSList *entry = sipe_private->groups->list;
@@ -433,6 +506,15 @@ struct sipe_group *sipe_group_first(struct sipe_core_private *sipe_private)
 	return(sipe_private->groups->list ? sipe_private->groups->list->data : NULL);
 }
 
+void sipe_group_foreach(struct sipe_core_private *sipe_private,
+			GFunc callback,
+			gpointer callback_data)
+{
+	g_slist_foreach(sipe_private->groups->list,
+			callback,
+			callback_data);
+}
+
 guint sipe_group_count(struct sipe_core_private *sipe_private)
 {
 	return(g_slist_length(sipe_private->groups->list));
@@ -440,7 +522,14 @@ guint sipe_group_count(struct sipe_core_private *sipe_private)
 
 void sipe_group_init(struct sipe_core_private *sipe_private)
 {
-	sipe_private->groups = g_new0(struct sipe_groups, 1);
+	struct sipe_groups *groups = g_new0(struct sipe_groups, 1);
+
+	groups->id   = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+					     NULL,   (GDestroyNotify) g_queue_free);
+	groups->name = g_hash_table_new_full(g_str_hash,    g_str_equal,
+					     g_free, (GDestroyNotify) g_queue_free);
+
+	sipe_private->groups = groups;
 }
 
 void sipe_group_free(struct sipe_core_private *sipe_private)
@@ -450,6 +539,8 @@ void sipe_group_free(struct sipe_core_private *sipe_private)
 	while ((entry = sipe_private->groups->list) != NULL)
 		group_free(sipe_private, entry->data);
 
+	g_hash_table_destroy(sipe_private->groups->name);
+	g_hash_table_destroy(sipe_private->groups->id);
 	g_free(sipe_private->groups);
 	sipe_private->groups = NULL;
 }
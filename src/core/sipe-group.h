@@ -90,6 +90,13 @@ void sipe_group_update_buddy(struct sipe_core_private *sipe_private,
  */
 void sipe_group_update_start(struct sipe_core_private *sipe_private);
 
+/**
+ * Abort group list update. All groups are kept.
+ *
+ * @param sipe_private SIPE core data
+ */
+void sipe_group_update_cancel(struct sipe_core_private *sipe_private);
+
 /**
  * Finish group list update. This will remove obsolete groups.
  *
@@ -109,6 +116,17 @@ void sipe_group_update_finish(struct sipe_core_private *sipe_private);
  */
 struct sipe_group *sipe_group_first(struct sipe_core_private *sipe_private);
 
+/**
+ * Call function for each group
+ *
+ * @param sipe_private  SIPE core data
+ * @param callback      function to call (data is @c struct sipe_group)
+ * @param callback_data user data for callback
+ */
+void sipe_group_foreach(struct sipe_core_private *sipe_private,
+			GFunc callback,
+			gpointer callback_data);
+
 /**
  * Number of groups
  *
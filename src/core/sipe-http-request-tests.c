@@ -0,0 +1,422 @@
+/**
+ * @file sipe-http-request-tests.c
+ *
+ * pidgin-sipe
+ *
+ * Copyright (C) 2020 SIPE Project <http://sipe.sourceforge.net/>
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ * Tests for the HTTP request layer: connection pool, pipelining and
+ * fair queuing. The transport layer is replaced by a fake one.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+
+#include <glib.h>
+
+#include "sipe-http-request.c"
+
+/*
+ * Stubs
+ */
+gboolean sipe_backend_debug_enabled(void)
+{
+	return(FALSE);
+}
+
+void sipe_backend_debug_literal(SIPE_UNUSED_PARAMETER sipe_debug_level level,
+				SIPE_UNUSED_PARAMETER const gchar *msg)
+{
+}
+
+void sipe_backend_debug(SIPE_UNUSED_PARAMETER sipe_debug_level level,
+			SIPE_UNUSED_PARAMETER const gchar *format,
+			...)
+{
+}
+
+const gchar *sipe_core_user_agent(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+	return("test");
+}
+
+const gchar *sipmsg_find_header(SIPE_UNUSED_PARAMETER const struct sipmsg *msg,
+				SIPE_UNUSED_PARAMETER const gchar *name)
+{
+	return(NULL);
+}
+
+const gchar *sipmsg_find_header_instance(SIPE_UNUSED_PARAMETER const struct sipmsg *msg,
+					 SIPE_UNUSED_PARAMETER const gchar *name,
+					 SIPE_UNUSED_PARAMETER int which)
+{
+	return(NULL);
+}
+
+const gchar *sipmsg_find_auth_header(SIPE_UNUSED_PARAMETER struct sipmsg *msg,
+				     SIPE_UNUSED_PARAMETER const gchar *name)
+{
+	return(NULL);
+}
+
+SipSecContext sip_sec_create_context(SIPE_UNUSED_PARAMETER guint type,
+				     SIPE_UNUSED_PARAMETER gboolean sso,
+				     SIPE_UNUSED_PARAMETER gboolean http,
+				     SIPE_UNUSED_PARAMETER const gchar *username,
+				     SIPE_UNUSED_PARAMETER const gchar *password)
+{
+	return(NULL);
+}
+
+gboolean sip_sec_init_context_step(SIPE_UNUSED_PARAMETER SipSecContext context,
+				   SIPE_UNUSED_PARAMETER const gchar *target,
+				   SIPE_UNUSED_PARAMETER const gchar *input_toked_base64,
+				   SIPE_UNUSED_PARAMETER gchar **output_toked_base64,
+				   SIPE_UNUSED_PARAMETER guint *expires)
+{
+	return(FALSE);
+}
+
+const gchar *sip_sec_context_name(SIPE_UNUSED_PARAMETER SipSecContext context)
+{
+	return(NULL);
+}
+
+guint sip_sec_context_type(SIPE_UNUSED_PARAMETER SipSecContext context)
+{
+	return(0);
+}
+
+void sip_sec_destroy_context(SIPE_UNUSED_PARAMETER SipSecContext context)
+{
+}
+
+/* fake transport: one host, connections are opened one at a time */
+static struct sipe_http_host_public test_host;
+static guint   open_calls = 0;
+static GString *sent      = NULL;
+
+struct sipe_http_parsed_uri *sipe_http_parse_uri(SIPE_UNUSED_PARAMETER const gchar *uri)
+{
+	return(NULL);
+}
+
+void sipe_http_parsed_uri_free(SIPE_UNUSED_PARAMETER struct sipe_http_parsed_uri *parsed_uri)
+{
+}
+
+gboolean sipe_http_shutting_down(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+	return(FALSE);
+}
+
+struct sipe_http_host_public *sipe_http_transport_host(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+						       SIPE_UNUSED_PARAMETER const gchar *host,
+						       SIPE_UNUSED_PARAMETER guint32 port,
+						       SIPE_UNUSED_PARAMETER gboolean use_tls)
+{
+	return(&test_host);
+}
+
+void sipe_http_transport_open(struct sipe_http_host_public *host_public)
+{
+	struct sipe_http_connection_public *conn_public;
+	GSList *entry;
+
+	open_calls++;
+
+	if (g_slist_length(host_public->connections) >= SIPE_HTTP_MAX_CONNECTIONS)
+		return;
+	for (entry = host_public->connections; entry; entry = entry->next) {
+		conn_public = entry->data;
+		if (!conn_public->connected)
+			return;
+	}
+
+	conn_public = g_new0(struct sipe_http_connection_public, 1);
+	conn_public->sipe_private = host_public->sipe_private;
+	conn_public->host_public  = host_public;
+	conn_public->host         = host_public->host;
+	conn_public->http11       = TRUE;
+	host_public->connections  = g_slist_append(host_public->connections,
+						   conn_public);
+}
+
+/* records "<connection number><path>" for each request sent */
+void sipe_http_transport_send(struct sipe_http_connection_public *conn_public,
+			      const gchar *header,
+			      SIPE_UNUSED_PARAMETER const gchar *body)
+{
+	g_string_append_printf(sent, "%d%c",
+			       g_slist_index(conn_public->host_public->connections,
+					     conn_public),
+			       strchr(header, '/')[1]);
+}
+
+/*
+ * Tester code
+ */
+static guint succeeded = 0;
+static guint failed    = 0;
+
+static void assert_equal(guint expected, guint got, const gchar *what)
+{
+	if (expected == got) {
+		succeeded++;
+	} else {
+		printf("FAILED: %s: %u expected %u\n", what, got, expected);
+		failed++;
+	}
+}
+
+static void assert_string(const gchar *expected, const gchar *got, const gchar *what)
+{
+	if (g_str_equal(expected, got)) {
+		succeeded++;
+	} else {
+		printf("FAILED: %s: '%s' expected '%s'\n", what, got, expected);
+		failed++;
+	}
+}
+
+static const gchar * const paths[] = { "a", "b", "c", "d", "e", "f" };
+static GString *completed = NULL;
+static guint cancelled    = 0;
+
+static void callback_a(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+		       guint status,
+		       SIPE_UNUSED_PARAMETER GSList *headers,
+		       SIPE_UNUSED_PARAMETER const gchar *body,
+		       gpointer data)
+{
+	if (status == (guint) SIPE_HTTP_STATUS_CANCELLED)
+		cancelled++;
+	else
+		g_string_append(completed, data);
+}
+
+static void callback_b(struct sipe_core_private *sipe_private,
+		       guint status,
+		       GSList *headers,
+		       const gchar *body,
+		       gpointer data)
+{
+	callback_a(sipe_private, status, headers, body, data);
+}
+
+static struct sipe_http_request *test_request(struct sipe_core_private *sipe_private,
+					      const gchar *path,
+					      const gchar *body,
+					      sipe_http_response_callback *callback)
+{
+	struct sipe_http_parsed_uri uri = { (gchar *) "test", (gchar *) path, 80, FALSE };
+	struct sipe_http_request *req = sipe_http_request_new(sipe_private,
+							      &uri,
+							      NULL,
+							      body,
+							      body ? "text/plain" : NULL,
+							      callback,
+							      (gpointer) path);
+	sipe_http_request_ready(req);
+	return(req);
+}
+
+static struct sipe_http_connection_public *test_connection(guint index)
+{
+	return(g_slist_nth_data(test_host.connections, index));
+}
+
+/* connection has been established */
+static void test_connect(guint index)
+{
+	struct sipe_http_connection_public *conn_public = test_connection(index);
+
+	conn_public->connected = TRUE;
+	sipe_http_request_next(conn_public);
+}
+
+/* response for oldest request on connection */
+static void test_respond(guint index)
+{
+	struct sipe_http_connection_public *conn_public = test_connection(index);
+	struct sipmsg msg;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.response = SIPE_HTTP_STATUS_OK;
+	sipe_http_request_response(conn_public, &msg);
+	sipe_http_request_next(conn_public);
+}
+
+static void test_reset(void)
+{
+	GSList *entry;
+
+	for (entry = test_host.connections; entry; entry = entry->next) {
+		sipe_http_request_shutdown(entry->data, TRUE);
+		g_free(entry->data);
+	}
+	g_slist_free(test_host.connections);
+	test_host.connections = NULL;
+	sipe_http_request_host_shutdown(&test_host, TRUE);
+
+	open_calls = 0;
+	cancelled  = 0;
+	g_string_truncate(sent, 0);
+	g_string_truncate(completed, 0);
+}
+
+static void tests_pool(struct sipe_core_private *sipe_private)
+{
+	guint i;
+
+	test_reset();
+
+	/* requests are waiting for the first connection */
+	for (i = 0; i < 6; i++)
+		test_request(sipe_private, paths[i], NULL, callback_a);
+	assert_equal(1, g_slist_length(test_host.connections), "first connection opened");
+	assert_equal(0, sent->len, "nothing sent before connect");
+
+	/* each new connection adds the next one to the pool */
+	for (i = 0; i < SIPE_HTTP_MAX_CONNECTIONS; i++)
+		test_connect(i);
+	assert_equal(SIPE_HTTP_MAX_CONNECTIONS, g_slist_length(test_host.connections),
+		     "pool limit");
+	assert_string("0a1b2c3d", sent->str, "one request per connection");
+
+	/* completed request proves connection: remaining requests pipelined */
+	open_calls = 0;
+	test_respond(2);
+	assert_string("0a1b2c3d2e2f", sent->str, "completed connection reused");
+	assert_string("c", completed->str, "response for request on connection");
+	assert_equal(0, open_calls, "no open when pool is full");
+}
+
+static void tests_pipelining(struct sipe_core_private *sipe_private)
+{
+	struct sipe_http_request *req;
+	guint i;
+
+	test_reset();
+
+	/* connection has to prove itself before pipelining */
+	test_request(sipe_private, "a", NULL, callback_a);
+	test_connect(0);
+	test_request(sipe_private, "b", NULL, callback_a);
+	assert_string("0a", sent->str, "no pipelining on new connection");
+	assert_equal(2, g_slist_length(test_host.connections), "second connection requested");
+	test_respond(0);
+	assert_string("0a0b", sent->str, "request sent on completed connection");
+	assert_equal(TRUE, test_connection(0)->pipelining, "pipelining allowed");
+
+	/* pipelined connection was picked: don't open new connections */
+	open_calls = 0;
+	for (i = 0; i < SIPE_HTTP_PIPELINE_DEPTH - 1; i++)
+		test_request(sipe_private, paths[i + 2], NULL, callback_a);
+	assert_string("0a0b0c0d0e", sent->str, "requests pipelined");
+	assert_equal(0, open_calls, "no open for pipelined requests");
+
+	/* pipeline is full */
+	test_request(sipe_private, "f", NULL, callback_a);
+	assert_string("0a0b0c0d0e", sent->str, "pipeline depth");
+	assert_equal(1, open_calls, "open when pipeline is full");
+
+	/* POST is never pipelined */
+	test_reset();
+	test_request(sipe_private, "a", NULL, callback_a);
+	test_connect(0);
+	test_respond(0);
+	test_request(sipe_private, "b", NULL, callback_a);
+	test_request(sipe_private, "c", "body", callback_a);
+	assert_string("0a0b", sent->str, "POST not pipelined");
+
+	/* cancelled requests are not sent again after reconnect */
+	test_reset();
+	test_request(sipe_private, "a", NULL, callback_a);
+	test_connect(0);
+	test_respond(0);
+	test_request(sipe_private, "b", NULL, callback_a);
+	req = test_request(sipe_private, "c", NULL, callback_a);
+	test_request(sipe_private, "d", NULL, callback_a);
+	sipe_http_request_cancel(req);
+	assert_equal(3, g_slist_length(test_connection(0)->pending_requests),
+		     "cancelled request waits for response");
+	sipe_http_request_disconnected(test_connection(0));
+	assert_equal(2, g_slist_length(test_connection(0)->pending_requests),
+		     "cancelled request dropped at disconnect");
+	assert_equal(FALSE, test_connection(0)->pipelining, "pipelining reset at disconnect");
+	sipe_http_request_next(test_connection(0));
+	assert_string("0a0b0c0d0b0d", sent->str, "pending requests sent again");
+	assert_equal(0, cancelled, "no callback for cancelled request");
+	test_respond(0);
+	test_respond(0);
+	assert_string("abd", completed->str, "responses for re-sent requests");
+}
+
+static void tests_fair_queuing(struct sipe_core_private *sipe_private)
+{
+	guint i;
+
+	test_reset();
+
+	/* requester A floods the queue before requester B */
+	for (i = 0; i < 4; i++)
+		test_request(sipe_private, paths[i], NULL, callback_a);
+	test_request(sipe_private, "x", NULL, callback_b);
+	test_request(sipe_private, "y", NULL, callback_b);
+
+	/* single connection without pipelining: one request at a time */
+	test_connection(0)->http11 = FALSE;
+	test_connect(0);
+	for (i = 0; i < 6; i++)
+		test_respond(0);
+	assert_string("axbycd", completed->str, "round-robin between requesters");
+}
+
+int main(SIPE_UNUSED_PARAMETER int argc, SIPE_UNUSED_PARAMETER char *argv[])
+{
+	struct sipe_core_private *sipe_private = g_new0(struct sipe_core_private, 1);
+
+	test_host.sipe_private = sipe_private;
+	test_host.host         = (gchar *) "test";
+	sent      = g_string_new(NULL);
+	completed = g_string_new(NULL);
+
+	tests_pool(sipe_private);
+	tests_pipelining(sipe_private);
+	tests_fair_queuing(sipe_private);
+
+	test_reset();
+	g_string_free(completed, TRUE);
+	g_string_free(sent, TRUE);
+	g_free(sipe_private);
+
+	printf("Result: %d PASSED %d FAILED\n", succeeded, failed);
+	return(failed);
+}
+
+/*
+  Local Variables:
+  mode: c
+  c-file-style: "bsd"
+  indent-tabs-mode: t
+  tab-width: 8
+  End:
+*/
@@ -26,7 +26,8 @@
  *  - request handling: creation, parameters, deletion, cancelling
  *  - session handling: creation, closing
  *  - client authorization handling
- *  - connection request queue handling
+ *  - host request queue handling: fair queuing between requesters
+ *  - connection request handling: pipelining
  *  - compile HTTP header contents and hand-off to transport layer
  *  - process HTTP response and hand-off to user callback
  */
@@ -57,7 +58,8 @@ struct sipe_http_session {
 };
 
 struct sipe_http_request {
-	struct sipe_http_connection_public *connection;
+	struct sipe_http_host_public *host;
+	struct sipe_http_connection_public *connection; /* NULL while queued */
 
 	struct sipe_http_session *session;
 
@@ -76,10 +78,26 @@ struct sipe_http_request {
 	guint32 flags;
 };
 
-#define SIPE_HTTP_REQUEST_FLAG_FIRST     0x00000001
 #define SIPE_HTTP_REQUEST_FLAG_REDIRECT  0x00000002
 #define SIPE_HTTP_REQUEST_FLAG_AUTHDATA  0x00000004
 #define SIPE_HTTP_REQUEST_FLAG_HANDSHAKE 0x00000008
+#define SIPE_HTTP_REQUEST_FLAG_READY     0x00000010
+#define SIPE_HTTP_REQUEST_FLAG_SENT      0x00000020
+#define SIPE_HTTP_REQUEST_FLAG_CANCELLED 0x00000040
+#define SIPE_HTTP_REQUEST_FLAG_COMPRESS  0x00000080
+
+/* maximum number of requests in flight on one connection */
+#define SIPE_HTTP_PIPELINE_DEPTH 4
+
+/*
+ * Requests for a host are queued per response callback, i.e. per
+ * requesting subsystem. Queues are served round-robin, so that a
+ * subsystem with many or slow requests can't starve the others.
+ */
+struct sipe_http_request_queue {
+	sipe_http_response_callback *cb;
+	GQueue *requests;
+};
 
 static void sipe_http_request_free(struct sipe_core_private *sipe_private,
 				   struct sipe_http_request *req,
@@ -107,9 +125,9 @@ static void add_cookie_cb(SIPE_UNUSED_PARAMETER const gchar *key,
 	g_string_append_printf(string, "Cookie: %s\r\n", cookie);
 }
 
-static void sipe_http_request_send(struct sipe_http_connection_public *conn_public)
+static void sipe_http_request_send(struct sipe_http_connection_public *conn_public,
+				   struct sipe_http_request *req)
 {
-	struct sipe_http_request *req = conn_public->pending_requests->data;
 	gchar *header;
 	gchar *content = NULL;
 	gchar *cookie  = NULL;
@@ -131,11 +149,17 @@ static void sipe_http_request_send(struct sipe_http_connection_public *conn_publ
 	header = g_strdup_printf("%s /%s HTTP/1.1\r\n"
 				 "Host: %s\r\n"
 				 "User-Agent: %s\r\n"
-				 "%s%s%s%s",
+				 "%s%s%s%s%s",
 				 content ? "POST" : "GET",
 				 req->path,
 				 conn_public->host,
 				 sipe_core_user_agent(conn_public->sipe_private),
+#ifdef HAVE_ZLIB
+				 (req->flags & SIPE_HTTP_REQUEST_FLAG_COMPRESS) ?
+				 "Accept-Encoding: gzip, deflate\r\n" : "",
+#else
+				 "",
+#endif
 				 conn_public->cached_authorization ? conn_public->cached_authorization :
 				 req->authorization ? req->authorization : "",
 				 req->headers ? req->headers : "",
@@ -148,38 +172,238 @@ static void sipe_http_request_send(struct sipe_http_connection_public *conn_publ
 	g_free(req->authorization);
 	req->authorization = NULL;
 
+	/* list of requests on connection is in the order they were sent */
+	req->connection = conn_public;
+	req->flags     |= SIPE_HTTP_REQUEST_FLAG_SENT;
+	conn_public->pending_requests = g_slist_append(g_slist_remove(conn_public->pending_requests,
+								      req),
+						       req);
+
 	sipe_http_transport_send(conn_public,
 				 header,
 				 req->body);
 	g_free(header);
 }
 
+static void sipe_http_request_queue_add(struct sipe_http_host_public *host_public,
+					struct sipe_http_request *req,
+					gboolean front)
+{
+	struct sipe_http_request_queue *queue = NULL;
+	GSList *entry;
+
+	for (entry = host_public->queues; entry; entry = entry->next) {
+		queue = entry->data;
+		if (queue->cb == req->cb)
+			break;
+	}
+
+	if (!entry) {
+		queue           = g_new0(struct sipe_http_request_queue, 1);
+		queue->cb       = req->cb;
+		queue->requests = g_queue_new();
+		host_public->queues = g_slist_append(host_public->queues,
+						     queue);
+	}
+
+	req->connection = NULL;
+	req->flags     &= ~SIPE_HTTP_REQUEST_FLAG_SENT;
+	if (front)
+		g_queue_push_head(queue->requests, req);
+	else
+		g_queue_push_tail(queue->requests, req);
+}
+
+static void sipe_http_request_queue_remove(struct sipe_http_host_public *host_public,
+					   struct sipe_http_request *req)
+{
+	GSList *entry;
+
+	for (entry = host_public->queues; entry; entry = entry->next) {
+		struct sipe_http_request_queue *queue = entry->data;
+
+		if (g_queue_remove(queue->requests, req)) {
+			if (g_queue_is_empty(queue->requests)) {
+				host_public->queues = g_slist_delete_link(host_public->queues,
+									  entry);
+				g_queue_free(queue->requests);
+				g_free(queue);
+			}
+			break;
+		}
+	}
+}
+
+static gboolean sipe_http_request_handshake(struct sipe_http_connection_public *conn_public,
+					    struct sipe_http_request *except)
+{
+	GSList *entry;
+
+	for (entry = conn_public->pending_requests; entry; entry = entry->next) {
+		struct sipe_http_request *req = entry->data;
+		if ((req != except) &&
+		    (req->flags & SIPE_HTTP_REQUEST_FLAG_HANDSHAKE))
+			return(TRUE);
+	}
+
+	return(FALSE);
+}
+
+/*
+ * Only idempotent requests without authentication handshake in progress
+ * are pipelined, i.e. they can be safely re-sent when the server closes
+ * the connection before it responded.
+ */
+static struct sipe_http_connection_public *sipe_http_request_select(struct sipe_http_host_public *host_public,
+								    struct sipe_http_request *req)
+{
+	struct sipe_http_connection_public *best = NULL;
+	guint best_depth = SIPE_HTTP_PIPELINE_DEPTH;
+	gboolean pipeline = !req->body &&
+		!(req->flags & SIPE_HTTP_REQUEST_FLAG_HANDSHAKE);
+	GSList *entry;
+
+	for (entry = host_public->connections; entry; entry = entry->next) {
+		struct sipe_http_connection_public *conn_public = entry->data;
+		guint depth;
+
+		if (!conn_public->connected)
+			continue;
+
+		/* idle connection */
+		depth = g_slist_length(conn_public->pending_requests);
+		if (depth == 0)
+			return(conn_public);
+
+		if (pipeline                 &&
+		    conn_public->pipelining  &&
+		    (depth < best_depth)) {
+			best       = conn_public;
+			best_depth = depth;
+		}
+	}
+
+	/* all connections are busy: try to add one to the pool */
+	if (!best &&
+	    (g_slist_length(host_public->connections) < SIPE_HTTP_MAX_CONNECTIONS))
+		sipe_http_transport_open(host_public);
+
+	return(best);
+}
+
 gboolean sipe_http_request_pending(struct sipe_http_connection_public *conn_public)
 {
 	return(conn_public->pending_requests != NULL);
 }
 
+void sipe_http_request_dispatch(struct sipe_http_host_public *host_public)
+{
+	gboolean progress = TRUE;
+
+	while (progress) {
+		GSList *entry;
+
+		progress = FALSE;
+		for (entry = host_public->queues; entry; entry = entry->next) {
+			struct sipe_http_request_queue *queue = entry->data;
+			struct sipe_http_request *req = g_queue_peek_head(queue->requests);
+			struct sipe_http_connection_public *conn_public;
+
+			/* keep order of requests from the same requester */
+			if (!(req->flags & SIPE_HTTP_REQUEST_FLAG_READY))
+				continue;
+
+			conn_public = sipe_http_request_select(host_public, req);
+			if (!conn_public)
+				continue;
+
+			/* round-robin: move queue to the end */
+			g_queue_pop_head(queue->requests);
+			host_public->queues = g_slist_delete_link(host_public->queues,
+								  entry);
+			if (g_queue_is_empty(queue->requests)) {
+				g_queue_free(queue->requests);
+				g_free(queue);
+			} else {
+				host_public->queues = g_slist_append(host_public->queues,
+								     queue);
+			}
+
+			sipe_http_request_send(conn_public, req);
+
+			/* list has changed, restart */
+			progress = TRUE;
+			break;
+		}
+	}
+}
+
 void sipe_http_request_next(struct sipe_http_connection_public *conn_public)
 {
-	sipe_http_request_send(conn_public);
+	GSList *unsent = NULL;
+	GSList *entry;
+
+	/* requests which need to be (re-)sent on this connection */
+	for (entry = conn_public->pending_requests; entry; entry = entry->next) {
+		struct sipe_http_request *req = entry->data;
+		if (!(req->flags & SIPE_HTTP_REQUEST_FLAG_SENT))
+			unsent = g_slist_append(unsent, req);
+	}
+	for (entry = unsent; entry; entry = entry->next)
+		sipe_http_request_send(conn_public, entry->data);
+	g_slist_free(unsent);
+
+	sipe_http_request_dispatch(conn_public->host_public);
+}
+
+void sipe_http_request_disconnected(struct sipe_http_connection_public *conn_public)
+{
+	GSList *entry = conn_public->pending_requests;
+
+	while (entry) {
+		struct sipe_http_request *req = entry->data;
+		entry = entry->next;
+
+		/* response will never arrive: don't send request again */
+		if (req->flags & SIPE_HTTP_REQUEST_FLAG_CANCELLED) {
+			conn_public->pending_requests = g_slist_remove(conn_public->pending_requests,
+								       req);
+			req->connection = NULL;
+			sipe_http_request_free(conn_public->sipe_private,
+					       req,
+					       SIPE_HTTP_STATUS_CANCELLED);
+		} else
+			req->flags &= ~SIPE_HTTP_REQUEST_FLAG_SENT;
+	}
+
+	/* new connection needs to prove itself again */
+	conn_public->pipelining = FALSE;
 }
 
 static void sipe_http_request_enqueue(struct sipe_core_private *sipe_private,
 				      struct sipe_http_request *req,
 				      const struct sipe_http_parsed_uri *parsed_uri)
 {
-	struct sipe_http_connection_public *conn_public;
+	req->path = g_strdup(parsed_uri->path);
+	req->host = sipe_http_transport_host(sipe_private,
+					     parsed_uri->host,
+					     parsed_uri->port,
+					     parsed_uri->tls);
+	sipe_http_request_queue_add(req->host, req, FALSE);
+}
 
-	req->path       = g_strdup(parsed_uri->path);
-	req->connection = conn_public = sipe_http_transport_new(sipe_private,
-								parsed_uri->host,
-								parsed_uri->port,
-								parsed_uri->tls);
-	if (!sipe_http_request_pending(conn_public))
-		req->flags |= SIPE_HTTP_REQUEST_FLAG_FIRST;
+/* request is no longer on the wire or in a queue */
+static void sipe_http_request_remove(struct sipe_http_request *req)
+{
+	struct sipe_http_connection_public *conn_public = req->connection;
 
-	conn_public->pending_requests = g_slist_append(conn_public->pending_requests,
-						       req);
+	if (conn_public) {
+		conn_public->pending_requests = g_slist_remove(conn_public->pending_requests,
+							       req);
+		req->connection = NULL;
+	} else {
+		sipe_http_request_queue_remove(req->host, req);
+	}
 }
 
 static void sipe_http_request_drop_context(struct sipe_http_connection_public *conn_public)
@@ -249,17 +473,15 @@ static gboolean sipe_http_request_response_redirection(struct sipe_core_private
 
 		if (parsed_uri) {
 			/* remove request from old connection */
-			struct sipe_http_connection_public *conn_public = req->connection;
-			conn_public->pending_requests = g_slist_remove(conn_public->pending_requests,
-								       req);
+			sipe_http_request_remove(req);
 
 			/* free old request data */
 			g_free(req->path);
-			req->flags &= ~( SIPE_HTTP_REQUEST_FLAG_FIRST |
-					 SIPE_HTTP_REQUEST_FLAG_HANDSHAKE );
+			req->flags &= ~SIPE_HTTP_REQUEST_FLAG_HANDSHAKE;
 
 			/* resubmit request on other connection */
 			sipe_http_request_enqueue(sipe_private, req, parsed_uri);
+			sipe_http_request_dispatch(req->host);
 			failed = FALSE;
 
 			sipe_http_parsed_uri_free(parsed_uri);
@@ -392,10 +614,10 @@ static gboolean sipe_http_request_response_unauthorized(struct sipe_core_private
 				}
 
 				/*
-				 * Keep the request in the queue. As it is at
-				 * the head it will be pulled automatically
-				 * by the transport layer after returning.
+				 * Keep the request on the connection. It will
+				 * be sent again by sipe_http_request_next().
 				 */
+				req->flags &= ~SIPE_HTTP_REQUEST_FLAG_SENT;
 				failed = FALSE;
 
 			} else {
@@ -457,6 +679,9 @@ static void sipe_http_request_response_callback(struct sipe_core_private *sipe_p
 		}
 	}
 
+	/* remove completed request */
+	sipe_http_request_remove(req);
+
 	/* Callback: success */
 	(*req->cb)(sipe_private,
 		   msg->response,
@@ -464,18 +689,51 @@ static void sipe_http_request_response_callback(struct sipe_core_private *sipe_p
 		   msg->body,
 		   req->cb_data);
 
-	/* remove completed request */
-	sipe_http_request_cancel(req);
+	req->cb = NULL;
+	sipe_http_request_free(sipe_private, req, SIPE_HTTP_STATUS_OK);
 }
 
 void sipe_http_request_response(struct sipe_http_connection_public *conn_public,
 				struct sipmsg *msg)
 {
 	struct sipe_core_private *sipe_private = conn_public->sipe_private;
-	struct sipe_http_request *req = conn_public->pending_requests->data;
+	struct sipe_http_request *req = NULL;
 	gboolean failed;
+	GSList *entry;
+
+	/* responses arrive in the order the requests were sent */
+	for (entry = conn_public->pending_requests; entry; entry = entry->next) {
+		req = entry->data;
+		if (req->flags & SIPE_HTTP_REQUEST_FLAG_SENT)
+			break;
+	}
+	if (!entry) {
+		SIPE_DEBUG_ERROR("sipe_http_request_response: unexpected response %d from host '%s'",
+				 msg->response, conn_public->host);
+		return;
+	}
 
-	if ((req->flags & SIPE_HTTP_REQUEST_FLAG_REDIRECT)   &&
+	/* request was cancelled while it was on the wire */
+	if (req->flags & SIPE_HTTP_REQUEST_FLAG_CANCELLED) {
+		sipe_http_request_remove(req);
+		sipe_http_request_free(sipe_private, req, SIPE_HTTP_STATUS_CANCELLED);
+		return;
+	}
+
+	if (msg->response == SIPE_HTTP_STATUS_CLIENT_UNAUTHORIZED)
+		conn_public->pipelining = FALSE;
+
+	if ((msg->response == SIPE_HTTP_STATUS_CLIENT_UNAUTHORIZED) &&
+	    sipe_http_request_handshake(conn_public, req)) {
+		/*
+		 * Pipelined request was rejected while another request
+		 * has started the authentication handshake: retry later.
+		 */
+		sipe_http_request_remove(req);
+		sipe_http_request_queue_add(req->host, req, TRUE);
+		failed = FALSE;
+
+	} else if ((req->flags & SIPE_HTTP_REQUEST_FLAG_REDIRECT)   &&
 	    (msg->response >= SIPE_HTTP_STATUS_REDIRECTION)  &&
 	    (msg->response <  SIPE_HTTP_STATUS_CLIENT_ERROR)) {
 		failed = sipe_http_request_response_redirection(sipe_private,
@@ -498,6 +756,13 @@ void sipe_http_request_response(struct sipe_http_connection_public *conn_public,
 			sipe_http_request_drop_context(conn_public);
 		}
 
+		/* connection has completed a request: allow pipelining */
+		if (conn_public->http11                                &&
+		    (msg->response >= SIPE_HTTP_STATUS_OK)             &&
+		    (msg->response <  SIPE_HTTP_STATUS_REDIRECTION)    &&
+		    !sipe_http_request_handshake(conn_public, req))
+			conn_public->pipelining = TRUE;
+
 		/* All other cases are passed on to the user */
 		sipe_http_request_response_callback(sipe_private, req, msg);
 
@@ -506,6 +771,9 @@ void sipe_http_request_response(struct sipe_http_connection_public *conn_public,
 	}
 
 	if (failed) {
+		/* remove failed request */
+		sipe_http_request_remove(req);
+
 		/* Callback: request failed */
 		(*req->cb)(sipe_private,
 			   SIPE_HTTP_STATUS_FAILED,
@@ -513,8 +781,8 @@ void sipe_http_request_response(struct sipe_http_connection_public *conn_public,
 			   NULL,
 			   req->cb_data);
 
-		/* remove failed request */
-		sipe_http_request_cancel(req);
+		req->cb = NULL;
+		sipe_http_request_free(sipe_private, req, SIPE_HTTP_STATUS_FAILED);
 	}
 }
 
@@ -522,14 +790,20 @@ void sipe_http_request_shutdown(struct sipe_http_connection_public *conn_public,
 				gboolean abort)
 {
 	if (conn_public->pending_requests) {
-		GSList *entry = conn_public->pending_requests;
+		GSList *list  = conn_public->pending_requests;
+		GSList *entry = list;
 		guint status = abort ?
 			SIPE_HTTP_STATUS_ABORTED :
 			SIPE_HTTP_STATUS_FAILED;
 		gboolean warn = conn_public->connected && !abort;
+
+		/* callbacks might queue new requests */
+		conn_public->pending_requests = NULL;
 		while (entry) {
 			struct sipe_http_request *req = entry->data;
 
+			req->connection = NULL;
+
 			if (warn) {
 				SIPE_DEBUG_ERROR("sipe_http_request_shutdown: pending request at shutdown: could indicate missing _ready() call on request. Debugging information:\n"
 						 "Host:   %s\n"
@@ -547,8 +821,7 @@ void sipe_http_request_shutdown(struct sipe_http_connection_public *conn_public,
 					       status);
 			entry = entry->next;
 		}
-		g_slist_free(conn_public->pending_requests);
-		conn_public->pending_requests = NULL;
+		g_slist_free(list);
 	}
 
 	if (conn_public->context) {
@@ -559,6 +832,31 @@ void sipe_http_request_shutdown(struct sipe_http_connection_public *conn_public,
 	}
 }
 
+void sipe_http_request_host_shutdown(struct sipe_http_host_public *host_public,
+				     gboolean abort)
+{
+	GSList *queues = host_public->queues;
+	guint status = abort ?
+		SIPE_HTTP_STATUS_ABORTED :
+		SIPE_HTTP_STATUS_FAILED;
+
+	/* callbacks might queue new requests */
+	host_public->queues = NULL;
+	while (queues) {
+		struct sipe_http_request_queue *queue = queues->data;
+		struct sipe_http_request *req;
+
+		while ((req = g_queue_pop_head(queue->requests)) != NULL)
+			sipe_http_request_free(host_public->sipe_private,
+					       req,
+					       status);
+
+		g_queue_free(queue->requests);
+		g_free(queue);
+		queues = g_slist_delete_link(queues, queues);
+	}
+}
+
 struct sipe_http_request *sipe_http_request_new(struct sipe_core_private *sipe_private,
 						const struct sipe_http_parsed_uri *parsed_uri,
 						const gchar *headers,
@@ -609,12 +907,9 @@ struct sipe_http_request *sipe_http_request_new(struct sipe_core_private *sipe_p
 
 void sipe_http_request_ready(struct sipe_http_request *request)
 {
-	struct sipe_http_connection_public *conn_public = request->connection;
-
-	/* pass first request on already opened connection through directly */
-	if ((request->flags & SIPE_HTTP_REQUEST_FLAG_FIRST) &&
-	    conn_public->connected)
-		sipe_http_request_send(conn_public);
+	request->flags |= SIPE_HTTP_REQUEST_FLAG_READY;
+	if (!request->connection)
+		sipe_http_request_dispatch(request->host);
 }
 
 struct sipe_http_session *sipe_http_session_start(void)
@@ -637,14 +932,18 @@ void sipe_http_session_close(struct sipe_http_session *session)
 
 void sipe_http_request_cancel(struct sipe_http_request *request)
 {
-	struct sipe_http_connection_public *conn_public = request->connection;
-	conn_public->pending_requests = g_slist_remove(conn_public->pending_requests,
-						       request);
-
 	/* cancelled by requester, don't use callback */
 	request->cb = NULL;
 
-	sipe_http_request_free(conn_public->sipe_private,
+	/* response is already on its way: drop it when it arrives */
+	if (request->flags & SIPE_HTTP_REQUEST_FLAG_SENT) {
+		request->flags  |= SIPE_HTTP_REQUEST_FLAG_CANCELLED;
+		request->session = NULL;
+		return;
+	}
+
+	sipe_http_request_remove(request);
+	sipe_http_request_free(request->host->sipe_private,
 			       request,
 			       SIPE_HTTP_STATUS_CANCELLED);
 }
@@ -660,6 +959,11 @@ void sipe_http_request_allow_redirect(struct sipe_http_request *request)
 	request->flags |= SIPE_HTTP_REQUEST_FLAG_REDIRECT;
 }
 
+void sipe_http_request_compression(struct sipe_http_request *request)
+{
+	request->flags |= SIPE_HTTP_REQUEST_FLAG_COMPRESS;
+}
+
 void sipe_http_request_authentication(struct sipe_http_request *request,
 				      const gchar *user,
 				      const gchar *password)
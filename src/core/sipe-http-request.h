@@ -36,6 +36,7 @@
 struct sipmsg;
 struct sipe_core_private;
 struct sipe_http_connection_public;
+struct sipe_http_host_public;
 struct sipe_http_request;
 
 struct sipe_http_parsed_uri {
@@ -72,10 +73,29 @@ gboolean sipe_http_request_pending(struct sipe_http_connection_public *conn_publ
 /**
  * HTTP connection is ready for next request
  *
+ * (Re-)sends requests assigned to the connection and then pulls
+ * requests from the host queue.
+ *
  * @param conn_public HTTP connection public data
  */
 void sipe_http_request_next(struct sipe_http_connection_public *conn_public);
 
+/**
+ * Assign queued requests to connections of a host
+ *
+ * @param host_public HTTP host public data
+ */
+void sipe_http_request_dispatch(struct sipe_http_host_public *host_public);
+
+/**
+ * HTTP connection was closed and will be re-established
+ *
+ * Requests assigned to the connection will be sent again.
+ *
+ * @param conn_public HTTP connection public data
+ */
+void sipe_http_request_disconnected(struct sipe_http_connection_public *conn_public);
+
 /**
  * HTTP response received
  *
@@ -94,6 +114,15 @@ void sipe_http_request_response(struct sipe_http_connection_public *conn_public,
 void sipe_http_request_shutdown(struct sipe_http_connection_public *conn_public,
 				gboolean abort);
 
+/**
+ * HTTP host shutdown: fail all queued requests
+ *
+ * @param host_public HTTP host public data
+ * @param abort       @c TRUE if HTTP stack is shutting down
+ */
+void sipe_http_request_host_shutdown(struct sipe_http_host_public *host_public,
+				     gboolean abort);
+
 /**
  * Create new HTTP request (internal raw version)
  *
@@ -0,0 +1,522 @@
+/**
+ * @file sipe-http-transport-tests.c
+ *
+ * pidgin-sipe
+ *
+ * Copyright (C) 2020 SIPE Project <http://sipe.sourceforge.net/>
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ * Tests for the HTTP transport layer: response body decoding, i.e. chunked
+ * transfer encoding and gzip/deflate content encoding. The backend
+ * and the HTTP request layer are replaced by fake ones.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+
+#include <glib.h>
+
+#include "sipe-http-transport.c"
+#include "sip-transport.h"
+#include "sipe-mime.h"
+#include "sipe-rtf.h"
+
+/*
+ * Stubs
+ */
+gboolean sipe_backend_debug_enabled(void)
+{
+	return(FALSE);
+}
+
+void sipe_backend_debug_literal(SIPE_UNUSED_PARAMETER sipe_debug_level level,
+				SIPE_UNUSED_PARAMETER const gchar *msg)
+{
+}
+
+void sipe_backend_debug(SIPE_UNUSED_PARAMETER sipe_debug_level level,
+			SIPE_UNUSED_PARAMETER const gchar *format,
+			...)
+{
+}
+
+gchar *sipe_backend_markup_css_property(SIPE_UNUSED_PARAMETER const gchar *style,
+					SIPE_UNUSED_PARAMETER const gchar *option)
+{
+	return(NULL);
+}
+
+void sipe_mime_parts_foreach(SIPE_UNUSED_PARAMETER const gchar *type,
+			     SIPE_UNUSED_PARAMETER const gchar *body,
+			     SIPE_UNUSED_PARAMETER sipe_mime_parts_cb callback,
+			     SIPE_UNUSED_PARAMETER gpointer user_data)
+{
+}
+
+gchar *sipe_rtf_to_html(SIPE_UNUSED_PARAMETER const gchar *rtf)
+{
+	return(NULL);
+}
+
+const gchar *sip_transport_epid(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+	return(NULL);
+}
+
+/* needed when linking against NSS */
+void md4sum(const uint8_t *data, uint32_t length, uint8_t *digest);
+void md4sum(SIPE_UNUSED_PARAMETER const uint8_t *data,
+	    SIPE_UNUSED_PARAMETER uint32_t length,
+	    SIPE_UNUSED_PARAMETER uint8_t *digest)
+{
+}
+
+void sipe_schedule_seconds(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+			   SIPE_UNUSED_PARAMETER const gchar *name,
+			   SIPE_UNUSED_PARAMETER gpointer data,
+			   SIPE_UNUSED_PARAMETER guint timeout,
+			   SIPE_UNUSED_PARAMETER sipe_schedule_action action,
+			   SIPE_UNUSED_PARAMETER GDestroyNotify destroy)
+{
+}
+
+void sipe_schedule_cancel(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+			  SIPE_UNUSED_PARAMETER const gchar *name)
+{
+}
+
+/* fake backend: one connection at a time */
+static struct sipe_transport_connection *transport = NULL;
+static transport_input_cb *transport_input         = NULL;
+static transport_connected_cb *transport_connected = NULL;
+
+struct sipe_transport_connection *sipe_backend_transport_connect(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+								 const sipe_connect_setup *setup)
+{
+	transport            = g_new0(struct sipe_transport_connection, 1);
+	transport->user_data = setup->user_data;
+	transport_input      = setup->input;
+	transport_connected  = setup->connected;
+	return(transport);
+}
+
+void sipe_backend_transport_disconnect(struct sipe_transport_connection *conn)
+{
+	sipe_core_transport_input_free(conn);
+	g_free(conn);
+	if (conn == transport)
+		transport = NULL;
+}
+
+void sipe_backend_transport_message(SIPE_UNUSED_PARAMETER struct sipe_transport_connection *conn,
+				    SIPE_UNUSED_PARAMETER const gchar *buffer)
+{
+}
+
+/* fake HTTP request layer: records responses */
+static GString *responses = NULL;
+static GString *body      = NULL;
+
+void sipe_http_request_response(SIPE_UNUSED_PARAMETER struct sipe_http_connection_public *conn_public,
+				struct sipmsg *msg)
+{
+	g_string_append_printf(responses, "%d ", msg->response);
+	g_string_truncate(body, 0);
+	if (msg->body)
+		g_string_append_len(body, msg->body, msg->bodylen);
+}
+
+void sipe_http_request_next(SIPE_UNUSED_PARAMETER struct sipe_http_connection_public *conn_public)
+{
+}
+
+void sipe_http_request_dispatch(SIPE_UNUSED_PARAMETER struct sipe_http_host_public *host_public)
+{
+}
+
+gboolean sipe_http_request_pending(SIPE_UNUSED_PARAMETER struct sipe_http_connection_public *conn_public)
+{
+	return(FALSE);
+}
+
+void sipe_http_request_disconnected(SIPE_UNUSED_PARAMETER struct sipe_http_connection_public *conn_public)
+{
+}
+
+void sipe_http_request_shutdown(SIPE_UNUSED_PARAMETER struct sipe_http_connection_public *conn_public,
+				SIPE_UNUSED_PARAMETER gboolean abort)
+{
+}
+
+void sipe_http_request_host_shutdown(SIPE_UNUSED_PARAMETER struct sipe_http_host_public *host_public,
+				     SIPE_UNUSED_PARAMETER gboolean abort)
+{
+}
+
+/*
+ * Tester code
+ */
+static guint succeeded = 0;
+static guint failed    = 0;
+
+static void assert_equal(const gchar *expected, gsize expected_length,
+			 const gchar *got, gsize got_length,
+			 const gchar *what)
+{
+	if ((expected_length == got_length) &&
+	    (memcmp(expected, got, got_length) == 0)) {
+		succeeded++;
+	} else {
+		printf("FAILED: %s: (%" G_GSIZE_FORMAT ") '%s' expected (%" G_GSIZE_FORMAT ") '%s'\n",
+		       what, got_length, got, expected_length, expected);
+		failed++;
+	}
+}
+
+static void assert_true(gboolean condition, const gchar *what)
+{
+	if (condition) {
+		succeeded++;
+	} else {
+		printf("FAILED: %s\n", what);
+		failed++;
+	}
+}
+
+#define ASSERT_STRING(expected, got, what) \
+	assert_equal(expected, strlen(expected), (got)->str, (got)->len, what)
+
+/* fresh HTTP stack with one connected connection */
+static void test_connect(struct sipe_core_private *sipe_private)
+{
+	struct sipe_http_host_public *host_public;
+
+	sipe_http_free(sipe_private);
+	host_public = sipe_http_transport_host(sipe_private,
+					       "test",
+					       80,
+					       FALSE);
+	sipe_http_transport_open(host_public);
+	(*transport_connected)(transport);
+	g_string_truncate(responses, 0);
+	g_string_truncate(body, 0);
+}
+
+/* data arrives in reads of up to "size" bytes */
+static void test_input(const gchar *data, gsize length, gsize size)
+{
+	while (length && transport) {
+		gsize available;
+		gchar *buffer = sipe_core_transport_input_buffer(transport,
+								 &available);
+		gsize chunk   = MIN(MIN(length, size), available);
+
+		memcpy(buffer, data, chunk);
+		sipe_core_transport_input_received(transport, chunk);
+		(*transport_input)(transport);
+		data   += chunk;
+		length -= chunk;
+	}
+}
+
+#define TEST_HEADER \
+	"HTTP/1.1 200 OK\r\n" \
+	"Transfer-Encoding: chunked\r\n" \
+	"\r\n"
+
+static void tests_chunked(struct sipe_core_private *sipe_private)
+{
+	static const gchar simple[] =
+		TEST_HEADER
+		"4\r\nWiki\r\n"
+		"5\r\npedia\r\n"
+		"E\r\n in\r\n\r\nchunks.\r\n"
+		"0\r\n\r\n";
+	static const gchar extensions[] =
+		TEST_HEADER
+		"4;name=value\r\nWiki\r\n"
+		"5 ; quoted=\"x\"\r\npedia\r\n"
+		"0;last\r\n\r\n";
+	static const gchar trailers[] =
+		TEST_HEADER
+		"4\r\nWiki\r\n"
+		"0\r\n"
+		"X-Trailer: one\r\n"
+		"X-Trailer: two\r\n"
+		"\r\n";
+	static const gchar empty[] =
+		TEST_HEADER
+		"0\r\n\r\n";
+	static const gchar binary[] =
+		TEST_HEADER
+		"7\r\na\0\r\n0\r\n\r\n"
+		"1\r\n\0\r\n"
+		"0\r\n\r\n";
+	static const gchar pipelined[] =
+		TEST_HEADER
+		"3\r\none\r\n0\r\n\r\n"
+		"HTTP/1.1 404 Not Found\r\n"
+		"Content-Length: 3\r\n"
+		"\r\n"
+		"two";
+	static const gchar illegal[] =
+		TEST_HEADER
+		"x4\r\nWiki\r\n0\r\n\r\n";
+	static const gchar unterminated[] =
+		TEST_HEADER
+		"4\r\nWikipedia\r\n0\r\n\r\n";
+	gsize size;
+
+	/* every read size splits chunk headers at a different position */
+	for (size = 1; size <= sizeof(simple); size++) {
+		test_connect(sipe_private);
+		test_input(simple, sizeof(simple) - 1, size);
+		ASSERT_STRING("200 ", responses, "chunked response");
+		ASSERT_STRING("Wikipedia in\r\n\r\nchunks.", body, "chunked body");
+	}
+
+	test_connect(sipe_private);
+	test_input(extensions, sizeof(extensions) - 1, 3);
+	ASSERT_STRING("200 ", responses, "chunk extensions response");
+	ASSERT_STRING("Wikipedia", body, "chunk extensions ignored");
+
+	test_connect(sipe_private);
+	test_input(trailers, sizeof(trailers) - 1, 5);
+	ASSERT_STRING("200 ", responses, "trailer response");
+	ASSERT_STRING("Wiki", body, "trailer skipped");
+
+	test_connect(sipe_private);
+	test_input(empty, sizeof(empty) - 1, 1);
+	ASSERT_STRING("200 ", responses, "zero-length chunk response");
+	ASSERT_STRING("", body, "zero-length chunk body");
+
+	test_connect(sipe_private);
+	test_input(binary, sizeof(binary) - 1, 2);
+	ASSERT_STRING("200 ", responses, "binary response");
+	assert_equal("a\0\r\n0\r\n\0", 8, body->str, body->len, "binary body");
+
+	test_connect(sipe_private);
+	test_input(pipelined, sizeof(pipelined) - 1, sizeof(pipelined));
+	ASSERT_STRING("200 404 ", responses, "response after chunked response");
+	ASSERT_STRING("two", body, "body after chunked response");
+
+	/* malformed chunk framing drops the connection */
+	test_connect(sipe_private);
+	test_input(illegal, sizeof(illegal) - 1, sizeof(illegal));
+	ASSERT_STRING("500 ", responses, "illegal chunk size");
+	assert_true(transport == NULL, "connection dropped");
+
+	test_connect(sipe_private);
+	test_input(unterminated, sizeof(unterminated) - 1, sizeof(unterminated));
+	ASSERT_STRING("500 ", responses, "chunk data not terminated");
+}
+
+#ifdef HAVE_ZLIB
+/* @return compressed data, windowBits select gzip, zlib or raw deflate */
+static GString *test_compress(const gchar *data, gsize length, int bits)
+{
+	GString *compressed = g_string_new(NULL);
+	z_stream stream;
+	Bytef buffer[4096];
+	int ret;
+
+	memset(&stream, 0, sizeof(stream));
+	deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, bits, 8,
+		     Z_DEFAULT_STRATEGY);
+	stream.next_in  = (Bytef *) data;
+	stream.avail_in = length;
+	do {
+		stream.next_out  = buffer;
+		stream.avail_out = sizeof(buffer);
+		ret = deflate(&stream, Z_FINISH);
+		g_string_append_len(compressed,
+				    (gchar *) buffer,
+				    sizeof(buffer) - stream.avail_out);
+	} while (ret == Z_OK);
+	deflateEnd(&stream);
+
+	return(compressed);
+}
+
+/* response with compressed body, optionally chunked with 1 byte chunks */
+static GString *test_response(const gchar *encoding,
+			      const GString *compressed,
+			      gsize length,
+			      gboolean chunked)
+{
+	GString *response = g_string_new(NULL);
+
+	g_string_append_printf(response,
+			       "HTTP/1.1 200 OK\r\n"
+			       "Content-Encoding: %s\r\n",
+			       encoding);
+	if (chunked) {
+		gsize i;
+
+		g_string_append(response,
+				"Transfer-Encoding: chunked\r\n"
+				"\r\n");
+		for (i = 0; i < length; i++) {
+			g_string_append(response, "1\r\n");
+			g_string_append_c(response, compressed->str[i]);
+			g_string_append(response, "\r\n");
+		}
+		g_string_append(response, "0\r\n\r\n");
+	} else {
+		g_string_append_printf(response,
+				       "Content-Length: %" G_GSIZE_FORMAT "\r\n"
+				       "\r\n",
+				       length);
+		g_string_append_len(response, compressed->str, length);
+	}
+
+	return(response);
+}
+
+static void test_decode(struct sipe_core_private *sipe_private,
+			const gchar *encoding,
+			const GString *compressed,
+			gsize length,
+			gboolean chunked,
+			gsize size)
+{
+	GString *response = test_response(encoding, compressed, length, chunked);
+
+	test_connect(sipe_private);
+	test_input(response->str, response->len, size);
+	g_string_free(response, TRUE);
+}
+
+static void tests_compressed(struct sipe_core_private *sipe_private)
+{
+	static const gchar plain[] =
+		"<?xml version=\"1.0\" encoding=\"utf-8\"?>"
+		"<soap:Envelope><soap:Body>compressed body compressed body"
+		"</soap:Body></soap:Envelope>";
+	static const struct {
+		const gchar *encoding;
+		int bits;
+		const gchar *what;
+	} formats[] = {
+		{ "gzip",    MAX_WBITS + 16, "gzip"        },
+		{ "x-gzip",  MAX_WBITS + 16, "x-gzip"      },
+		{ "deflate", MAX_WBITS,      "zlib"        },
+		{ "deflate", -MAX_WBITS,     "raw deflate" },
+	};
+	GString *compressed;
+	gchar *zeros;
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(formats); i++) {
+		gchar *what;
+
+		compressed = test_compress(plain, sizeof(plain) - 1, formats[i].bits);
+
+		/* single read */
+		what = g_strdup_printf("%s body", formats[i].what);
+		test_decode(sipe_private, formats[i].encoding, compressed,
+			    compressed->len, FALSE, G_MAXSIZE);
+		ASSERT_STRING("200 ", responses, what);
+		ASSERT_STRING(plain, body, what);
+		g_free(what);
+
+		/* one byte per read: header check needs to wait for data */
+		what = g_strdup_printf("%s body byte by byte", formats[i].what);
+		test_decode(sipe_private, formats[i].encoding, compressed,
+			    compressed->len, FALSE, 1);
+		ASSERT_STRING("200 ", responses, what);
+		ASSERT_STRING(plain, body, what);
+		g_free(what);
+
+		/* one byte per chunk */
+		what = g_strdup_printf("%s chunked body", formats[i].what);
+		test_decode(sipe_private, formats[i].encoding, compressed,
+			    compressed->len, TRUE, 7);
+		ASSERT_STRING("200 ", responses, what);
+		ASSERT_STRING(plain, body, what);
+		g_free(what);
+
+		/* end of compressed stream is missing */
+		what = g_strdup_printf("%s truncated body", formats[i].what);
+		test_decode(sipe_private, formats[i].encoding, compressed,
+			    compressed->len / 2, FALSE, G_MAXSIZE);
+		ASSERT_STRING("500 ", responses, what);
+		g_free(what);
+		what = g_strdup_printf("%s truncated chunked body", formats[i].what);
+		test_decode(sipe_private, formats[i].encoding, compressed,
+			    1, TRUE, G_MAXSIZE);
+		ASSERT_STRING("500 ", responses, what);
+		g_free(what);
+
+		g_string_free(compressed, TRUE);
+	}
+
+	/* empty body isn't compressed */
+	compressed = g_string_new(NULL);
+	test_decode(sipe_private, "gzip", compressed, 0, FALSE, G_MAXSIZE);
+	ASSERT_STRING("200 ", responses, "empty body");
+	ASSERT_STRING("", body, "empty body");
+
+	/* not compressed at all */
+	g_string_append(compressed, plain);
+	test_decode(sipe_private, "gzip", compressed, compressed->len, FALSE, G_MAXSIZE);
+	ASSERT_STRING("500 ", responses, "invalid body");
+	g_string_free(compressed, TRUE);
+
+	/* decompression bomb */
+	zeros      = g_malloc0(SIPE_HTTP_MAX_INFLATED + 1);
+	compressed = test_compress(zeros, SIPE_HTTP_MAX_INFLATED + 1, MAX_WBITS + 16);
+	g_free(zeros);
+	test_decode(sipe_private, "gzip", compressed, compressed->len, FALSE, G_MAXSIZE);
+	ASSERT_STRING("500 ", responses, "oversized body");
+	assert_true(transport == NULL, "oversized body drops connection");
+	g_string_free(compressed, TRUE);
+}
+#endif
+
+int main(SIPE_UNUSED_PARAMETER int argc, SIPE_UNUSED_PARAMETER char *argv[])
+{
+	struct sipe_core_private *sipe_private = g_new0(struct sipe_core_private, 1);
+
+	responses = g_string_new(NULL);
+	body      = g_string_new(NULL);
+
+	tests_chunked(sipe_private);
+#ifdef HAVE_ZLIB
+	tests_compressed(sipe_private);
+#endif
+
+	sipe_http_free(sipe_private);
+	g_string_free(body, TRUE);
+	g_string_free(responses, TRUE);
+	g_free(sipe_private);
+
+	printf("Result: %d PASSED %d FAILED\n", succeeded, failed);
+	return(failed);
+}
+
+/*
+  Local Variables:
+  mode: c
+  c-file-style: "bsd"
+  indent-tabs-mode: t
+  tab-width: 8
+  End:
+*/
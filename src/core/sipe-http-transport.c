@@ -25,14 +25,23 @@
  *
  *  - connection handling: opening, closing, timeout
  *  - interface to backend: sending & receiving of raw messages
+ *  - response body decoding: chunked, gzip/deflate
  *  - request queue pulling
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <string.h>
 #include <time.h>
 
 #include <glib.h>
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 #include "sipmsg.h"
 #include "sipe-backend.h"
 #include "sipe-common.h"
@@ -50,25 +59,62 @@
 #define SIPE_HTTP_CONNECTION         ((struct sipe_http_connection *) connection->user_data)
 #define SIPE_HTTP_CONNECTION_PRIVATE ((struct sipe_http_connection *) conn_public)
 #define SIPE_HTTP_CONNECTION_PUBLIC  ((struct sipe_http_connection_public *) conn)
+#define SIPE_HTTP_HOST_PRIVATE       ((struct sipe_http_host *) host_public)
+#define SIPE_HTTP_HOST_PUBLIC        ((struct sipe_http_host_public *) host)
+#define SIPE_HTTP_CONNECTION_HOST    ((struct sipe_http_host *) conn->public.host_public)
 
 #define SIPE_HTTP_TIMEOUT_ACTION  "<+http-timeout>"
 #define SIPE_HTTP_DEFAULT_TIMEOUT 60 /* in seconds */
+#define SIPE_HTTP_MAX_INFLATED    (16 * 1024 * 1024) /* in bytes */
+
+struct sipe_http_host {
+	struct sipe_http_host_public public;
+
+	gchar *host_port;
+	gboolean use_tls;
+};
+
+/* HTTP/1.1 Transfer-Encoding: chunked */
+enum sipe_http_chunk_state {
+	SIPE_HTTP_CHUNK_SIZE,    /* waiting for chunk size line */
+	SIPE_HTTP_CHUNK_DATA,    /* copying chunk data          */
+	SIPE_HTTP_CHUNK_CRLF,    /* waiting for CRLF after data */
+	SIPE_HTTP_CHUNK_TRAILER  /* skipping trailer lines      */
+};
 
 struct sipe_http_connection {
 	struct sipe_http_connection_public public;
 
 	struct sipe_transport_connection *connection;
 
-	gchar *host_port;
 	time_t timeout;  /* in seconds from epoch */
-	gboolean use_tls;
+
+	/* response in progress: header has been received */
+	struct sipmsg *msg;
+	gchar *header;   /* for debugging only */
+	GString *body;   /* decoded body of chunked or compressed response */
+	gboolean chunked;
+	enum sipe_http_chunk_state chunk_state;
+	gsize chunk_remaining;
+#ifdef HAVE_ZLIB
+	z_stream *inflate; /* NULL if body isn't compressed */
+	gboolean inflate_started;
+	gboolean inflate_deflate;
+	gboolean inflate_done;      /* end of compressed stream reached */
+	guchar inflate_header[2];   /* to detect raw deflate data */
+	gsize inflate_header_length;
+#endif
 };
 
 struct sipe_http {
-	GHashTable *connections;
+	GHashTable *hosts;
 	GQueue *timeouts;
 	time_t next_timeout; /* in seconds from epoch, 0 if timer isn't running */
 	gboolean shutting_down;
+
+	/* statistics for compressed response bodies */
+	gsize compressed_bytes;
+	gsize decompressed_bytes;
 };
 
 static gint timeout_compare(gconstpointer a,
@@ -79,14 +125,32 @@ static gint timeout_compare(gconstpointer a,
 	       ((struct sipe_http_connection *) b)->timeout);
 }
 
+static void sipe_http_transport_input_reset(struct sipe_http_connection *conn)
+{
+	if (conn->msg)
+		sipmsg_free(conn->msg);
+	conn->msg = NULL;
+	g_free(conn->header);
+	conn->header = NULL;
+	if (conn->body)
+		g_string_free(conn->body, TRUE);
+	conn->body = NULL;
+#ifdef HAVE_ZLIB
+	if (conn->inflate) {
+		if (conn->inflate_started)
+			inflateEnd(conn->inflate);
+		g_free(conn->inflate);
+	}
+	conn->inflate = NULL;
+#endif
+}
+
 static void sipe_http_transport_update_timeout_queue(struct sipe_http_connection *conn,
 						     gboolean remove);
-static void sipe_http_transport_free(gpointer data)
+static void sipe_http_transport_free(struct sipe_http_connection *conn)
 {
-	struct sipe_http_connection *conn = data;
-
 	SIPE_DEBUG_INFO("sipe_http_transport_free: destroying connection '%s'(%p)",
-			conn->host_port, conn->connection);
+			SIPE_HTTP_CONNECTION_HOST->host_port, conn->connection);
 
 	if (conn->connection)
 		sipe_backend_transport_disconnect(conn->connection);
@@ -97,30 +161,44 @@ static void sipe_http_transport_free(gpointer data)
 	sipe_http_request_shutdown(SIPE_HTTP_CONNECTION_PUBLIC,
 				   conn->public.sipe_private->http->shutting_down);
 
+	sipe_http_transport_input_reset(conn);
 	g_free(conn->public.host);
-
-	g_free(conn->host_port);
 	g_free(conn);
 }
 
-static void sipe_http_transport_drop(struct sipe_http *http,
-				     struct sipe_http_connection *conn,
+static void sipe_http_host_free(gpointer data)
+{
+	struct sipe_http_host *host = data;
+	GSList *entry = host->public.connections;
+
+	/* connections are destroyed before the host */
+	host->public.connections = NULL;
+	while (entry) {
+		sipe_http_transport_free(entry->data);
+		entry = g_slist_delete_link(entry, entry);
+	}
+
+	sipe_http_request_host_shutdown(SIPE_HTTP_HOST_PUBLIC,
+					host->public.sipe_private->http->shutting_down);
+
+	g_free(host->public.host);
+	g_free(host->host_port);
+	g_free(host);
+}
+
+static void sipe_http_transport_drop(struct sipe_http_connection *conn,
 				     const gchar *message)
 {
+	struct sipe_http_host *host = SIPE_HTTP_CONNECTION_HOST;
+
 	SIPE_LOG_INFO("sipe_http_transport_drop: '%s'(%p): %s",
-		      conn->host_port,
+		      host->host_port,
 		      conn->connection,
 		      message ? message : "REASON UNKNOWN");
 
-#if GLIB_CHECK_VERSION(2,30,0)
-	/* this triggers sipe_http_transport_free() */
-	g_hash_table_remove(http->connections, conn->host_port);
-#else
-	/* GLIB < 2.30 calls destroy notifiers *before* removing the entry */
-	/* which can cause a race condition with sipe_http_transport_new() */
-	g_hash_table_steal(http->connections, conn->host_port);
+	host->public.connections = g_slist_remove(host->public.connections,
+						  conn);
 	sipe_http_transport_free(conn);
-#endif
 	/* conn is no longer valid */
 }
 
@@ -137,9 +215,14 @@ static void sipe_http_transport_timeout(struct sipe_core_private *sipe_private,
 	http->next_timeout = 0;
 
 	while (1) {
-		sipe_http_transport_drop(http, conn, "timeout");
+		struct sipe_http_host_public *host_public = conn->public.host_public;
+
+		sipe_http_transport_drop(conn, "timeout");
 		/* conn is no longer valid */
 
+		/* requests that were waiting for a free connection */
+		sipe_http_request_dispatch(host_public);
+
 		/* is there another active connection? */
 		conn = g_queue_peek_head(http->timeouts);
 		if (!conn)
@@ -220,8 +303,12 @@ void sipe_http_free(struct sipe_core_private *sipe_private)
 	/* HTTP stack is shutting down: reject all new requests */
 	http->shutting_down = TRUE;
 
+	if (http->compressed_bytes)
+		SIPE_DEBUG_INFO("sipe_http_free: compressed responses: %" G_GSIZE_FORMAT " bytes received, %" G_GSIZE_FORMAT " bytes decompressed",
+				http->compressed_bytes, http->decompressed_bytes);
+
 	sipe_schedule_cancel(sipe_private, SIPE_HTTP_TIMEOUT_ACTION);
-	g_hash_table_destroy(http->connections);
+	g_hash_table_destroy(http->hosts);
 	g_queue_free(http->timeouts);
 	g_free(http);
 	sipe_private->http = NULL;
@@ -234,9 +321,9 @@ static void sipe_http_init(struct sipe_core_private *sipe_private)
 		return;
 
 	sipe_private->http = http = g_new0(struct sipe_http, 1);
-	http->connections = g_hash_table_new_full(g_str_hash, g_str_equal,
-						  NULL,
-						  sipe_http_transport_free);
+	http->hosts = g_hash_table_new_full(g_str_hash, g_str_equal,
+					    NULL,
+					    sipe_http_host_free);
 	http->timeouts = g_queue_new();
 }
 
@@ -248,7 +335,7 @@ static void sipe_http_transport_connected(struct sipe_transport_connection *conn
 	time_t current_time = time(NULL);
 
 	SIPE_LOG_INFO("sipe_http_transport_connected: '%s'(%p)",
-		      conn->host_port, connection);
+		      SIPE_HTTP_CONNECTION_HOST->host_port, connection);
 	conn->public.connected = TRUE;
 
 	/* add active connection to timeout queue */
@@ -265,153 +352,329 @@ static void sipe_http_transport_connected(struct sipe_transport_connection *conn
 	sipe_http_request_next(SIPE_HTTP_CONNECTION_PUBLIC);
 }
 
-static void sipe_http_transport_input(struct sipe_transport_connection *connection)
+static void sipe_http_transport_connect(struct sipe_http_connection *conn);
+#ifdef HAVE_ZLIB
+/* @return FALSE on decompression error */
+static gboolean sipe_http_transport_inflate(struct sipe_http_connection *conn,
+					    const guchar *data,
+					    gsize length)
 {
-	struct sipe_http_connection *conn = SIPE_HTTP_CONNECTION;
-	char *current = connection->buffer;
+	struct sipe_http *http = conn->public.sipe_private->http;
+	z_stream *stream = conn->inflate;
+	gsize before = conn->body->len;
+	Bytef buffer[4096];
+	int ret;
+
+	/* data after end of compressed stream is ignored */
+	if (!length || conn->inflate_done)
+		return(TRUE);
+
+	stream->next_in  = (Bytef *) data;
+	stream->avail_in = length;
+	do {
+		stream->next_out  = buffer;
+		stream->avail_out = sizeof(buffer);
+		ret = inflate(stream, Z_NO_FLUSH);
+
+		/* all input consumed: wait for more data */
+		if ((ret == Z_BUF_ERROR) && (stream->avail_in == 0))
+			break;
+		if ((ret != Z_OK) && (ret != Z_STREAM_END))
+			return(FALSE);
+		conn->inflate_done = (ret == Z_STREAM_END);
+
+		g_string_append_len(conn->body,
+				    (gchar *) buffer,
+				    sizeof(buffer) - stream->avail_out);
+		if (conn->body->len > SIPE_HTTP_MAX_INFLATED) {
+			SIPE_DEBUG_ERROR("sipe_http_transport_inflate: decompressed body exceeds %d bytes",
+					 SIPE_HTTP_MAX_INFLATED);
+			return(FALSE);
+		}
+	} while (!conn->inflate_done &&
+		 (stream->avail_in || (stream->avail_out == 0)));
+
+	http->compressed_bytes   += length;
+	http->decompressed_bytes += conn->body->len - before;
+
+	return(TRUE);
+}
+#endif
 
-	/* according to the RFC remove CRLF at the beginning */
-	while (*current == '\r' || *current == '\n') {
-		current++;
+/*
+ * Add data to response body, decompress if necessary
+ *
+ * @return FALSE on decompression error
+ */
+static gboolean sipe_http_transport_body(struct sipe_http_connection *conn,
+					 const gchar *data,
+					 gsize length)
+{
+#ifdef HAVE_ZLIB
+	if (conn->inflate) {
+		const guchar *header = conn->inflate_header;
+
+		if (!conn->inflate_started) {
+			/* gzip: auto-detect gzip/zlib header */
+			int bits = MAX_WBITS + 32;
+
+			/* wait for enough data to check the header */
+			while (length && (conn->inflate_header_length < 2)) {
+				conn->inflate_header[conn->inflate_header_length++] = *data++;
+				length--;
+			}
+			if (conn->inflate_header_length < 2)
+				return(TRUE);
+
+			/* deflate: some servers send raw deflate data */
+			if (conn->inflate_deflate)
+				bits = (((header[0] & 0x0F) == Z_DEFLATED) &&
+					(((header[0] << 8) + header[1]) % 31 == 0)) ?
+					MAX_WBITS : -MAX_WBITS;
+
+			if (inflateInit2(conn->inflate, bits) != Z_OK)
+				return(FALSE);
+			conn->inflate_started = TRUE;
+
+			if (!sipe_http_transport_inflate(conn, header, 2))
+				return(FALSE);
+		}
+
+		return(sipe_http_transport_inflate(conn,
+						   (const guchar *) data,
+						   length));
 	}
-	if (current != connection->buffer)
-		sipe_utils_shrink_buffer(connection, current);
+#endif
+
+	g_string_append_len(conn->body, data, length);
+	return(TRUE);
+}
+
+/*
+ * Decode chunked body. Chunks are consumed from the input buffer as they
+ * arrive, i.e. every byte is only looked at once.
+ *
+ * @return TRUE when the body is complete or on a format error
+ */
+static gboolean sipe_http_transport_chunked(struct sipe_http_connection *conn,
+					    struct sipe_transport_connection *connection)
+{
+	while (connection->buffer_used) {
+		gchar *current = connection->buffer;
+		gchar *end;
+
+		switch (conn->chunk_state) {
+		case SIPE_HTTP_CHUNK_SIZE:
+			if ((end = strstr(current, "\r\n")) == NULL)
+				return(FALSE);
+
+			/* optional chunk extensions are ignored */
+			conn->chunk_remaining = g_ascii_strtoull(current, &end, 16);
+			if ((end == current) ||
+			    ((*end != '\r') && (*end != ';') && (*end != ' '))) {
+				SIPE_DEBUG_ERROR_NOFORMAT("sipe_http_transport_chunked: illegal chunk size");
+				conn->msg->response = SIPMSG_RESPONSE_FATAL_ERROR;
+				return(TRUE);
+			}
+			sipe_utils_shrink_buffer(connection,
+						 strstr(end, "\r\n") + 2);
+
+			conn->chunk_state = conn->chunk_remaining ?
+				SIPE_HTTP_CHUNK_DATA :
+				SIPE_HTTP_CHUNK_TRAILER;
+			break;
+
+		case SIPE_HTTP_CHUNK_DATA:
+			{
+				gsize length = MIN(conn->chunk_remaining,
+						   connection->buffer_used);
+
+				if (!sipe_http_transport_body(conn, current, length)) {
+					SIPE_DEBUG_ERROR_NOFORMAT("sipe_http_transport_chunked: decompression failed");
+					conn->msg->response = SIPMSG_RESPONSE_FATAL_ERROR;
+					return(TRUE);
+				}
+				sipe_utils_shrink_buffer(connection,
+							 current + length);
+
+				conn->chunk_remaining -= length;
+				if (conn->chunk_remaining == 0)
+					conn->chunk_state = SIPE_HTTP_CHUNK_CRLF;
+			}
+			break;
+
+		case SIPE_HTTP_CHUNK_CRLF:
+			if (connection->buffer_used < 2)
+				return(FALSE);
+
+			if ((current[0] != '\r') || (current[1] != '\n')) {
+				SIPE_DEBUG_ERROR_NOFORMAT("sipe_http_transport_chunked: chunk data not terminated by CRLF");
+				conn->msg->response = SIPMSG_RESPONSE_FATAL_ERROR;
+				return(TRUE);
+			}
+			sipe_utils_shrink_buffer(connection, current + 2);
+
+			conn->chunk_state = SIPE_HTTP_CHUNK_SIZE;
+			break;
 
-	if (conn->connection &&
-	    (current = strstr(connection->buffer, "\r\n\r\n")) != NULL) {
+		case SIPE_HTTP_CHUNK_TRAILER:
+			if ((end = strstr(current, "\r\n")) == NULL)
+				return(FALSE);
+			sipe_utils_shrink_buffer(connection, end + 2);
+
+			/* empty line terminates the body */
+			if (end == current)
+				return(TRUE);
+			break;
+		}
+	}
+
+	return(FALSE);
+}
+
+static void sipe_http_transport_input(struct sipe_transport_connection *connection)
+{
+	struct sipe_http_connection *conn = SIPE_HTTP_CONNECTION;
+
+	/* pipelined responses can arrive in one read */
+	while (conn->connection == connection) {
+		struct sipe_http_host_public *host_public = conn->public.host_public;
 		struct sipmsg *msg;
 		gboolean drop = FALSE;
-		gboolean next;
-
-		current += 2;
-		current[0] = '\0';
-		msg = sipmsg_parse_header(connection->buffer);
-		if (!msg) {
-			/* restore header for next try */
-			current[0] = '\r';
-			return;
-		}
 
-		/* HTTP/1.1 Transfer-Encoding: chunked */
-		if (msg->bodylen == SIPMSG_BODYLEN_CHUNKED) {
-			gchar *start        = current + 2;
-			GSList *chunks      = NULL;
-			gboolean incomplete = TRUE;
-
-			msg->bodylen = 0;
-			while (strlen(start) > 0) {
-				gchar *tmp;
-				guint length = g_ascii_strtoll(start, &tmp, 16);
-				guint remainder;
-				struct _chunk {
-					guint length;
-					const gchar *start;
-				} *chunk;
-
-				/* Illegal number */
-				if ((length == 0) && (start == tmp))
-					break;
-				msg->bodylen += length;
-
-				/* Chunk header not finished yet */
-				tmp = strstr(tmp, "\r\n");
-				if (tmp == NULL)
-					break;
-
-				/* Chunk not finished yet */
-				tmp += 2;
-				remainder = connection->buffer_used - (tmp - connection->buffer);
-				if (remainder < length + 2)
-					break;
-
-				/* Next chunk */
-				start = tmp + length + 2;
-
-				/* Body completed */
-				if (length == 0) {
-					gchar *dummy  = g_malloc(msg->bodylen + 1);
-					gchar *p      = dummy;
-					GSList *entry = chunks;
-
-					while (entry) {
-						chunk = entry->data;
-						memcpy(p, chunk->start, chunk->length);
-						p += chunk->length;
-						entry = entry->next;
-					}
-					p[0] = '\0';
-
-					msg->body = dummy;
-					sipe_utils_message_debug(connection,
-								 "HTTP",
-								 connection->buffer,
-								 msg->body,
-								 FALSE);
-
-					current = start;
-					sipe_utils_shrink_buffer(connection,
-								 current);
-
-					incomplete = FALSE;
-					break;
-				}
+		/* start of a new response */
+		if (!conn->msg) {
+			char *current = connection->buffer;
 
-				/* Append completed chunk */
-				chunk = g_new0(struct _chunk, 1);
-				chunk->length = length;
-				chunk->start  = tmp;
-				chunks = g_slist_append(chunks, chunk);
+			/* according to the RFC remove CRLF at the beginning */
+			while (*current == '\r' || *current == '\n') {
+				current++;
 			}
+			if (current != connection->buffer)
+				sipe_utils_shrink_buffer(connection, current);
+
+			if ((current = strstr(connection->buffer, "\r\n\r\n")) == NULL)
+				return;
 
-			if (chunks)
-				sipe_utils_slist_free_full(chunks, g_free);
+			/* pipelining is only safe with HTTP/1.1 persistent connections */
+			conn->public.http11 = g_str_has_prefix(connection->buffer, "HTTP/1.1 ");
 
-			if (incomplete) {
+			current += 2;
+			current[0] = '\0';
+			msg = sipmsg_parse_header(connection->buffer);
+			if (!msg) {
 				/* restore header for next try */
-				sipmsg_free(msg);
 				current[0] = '\r';
 				return;
 			}
 
-		} else {
-			guint remainder = connection->buffer_used - (current + 2 - connection->buffer);
-
-			if (remainder >= (guint) msg->bodylen) {
-				char *dummy = g_malloc(msg->bodylen + 1);
-				current += 2;
-				memcpy(dummy, current, msg->bodylen);
-				dummy[msg->bodylen] = '\0';
-				msg->body = dummy;
-				current += msg->bodylen;
-				sipe_utils_message_debug(connection,
-							 "HTTP",
-							 connection->buffer,
-							 msg->body,
-							 FALSE);
-				sipe_utils_shrink_buffer(connection, current);
-			} else {
-				SIPE_DEBUG_INFO("sipe_http_transport_input: body too short (%d < %d, strlen %" G_GSIZE_FORMAT ") - ignoring message",
-						remainder, msg->bodylen, strlen(connection->buffer));
+			conn->msg    = msg;
+			conn->header = g_strdup(connection->buffer);
+			sipe_utils_shrink_buffer(connection, current + 2);
 
-				/* restore header for next try */
-				sipmsg_free(msg);
-				current[0] = '\r';
+			conn->chunked = (msg->bodylen == SIPMSG_BODYLEN_CHUNKED);
+			if (conn->chunked) {
+				msg->bodylen          = 0;
+				conn->body            = g_string_new("");
+				conn->chunk_state     = SIPE_HTTP_CHUNK_SIZE;
+				conn->chunk_remaining = 0;
+			}
+
+#ifdef HAVE_ZLIB
+			{
+				const gchar *encoding = sipmsg_find_header(msg, "Content-Encoding");
+
+				if (sipe_strcase_equal(encoding, "gzip")   ||
+				    sipe_strcase_equal(encoding, "x-gzip") ||
+				    sipe_strcase_equal(encoding, "deflate")) {
+					conn->inflate               = g_new0(z_stream, 1);
+					conn->inflate_started       = FALSE;
+					conn->inflate_deflate       = sipe_strcase_equal(encoding, "deflate");
+					conn->inflate_done          = FALSE;
+					conn->inflate_header_length = 0;
+					if (!conn->body)
+						conn->body = g_string_new("");
+				}
+			}
+#endif
+		}
+		msg = conn->msg;
+
+		/* HTTP/1.1 Transfer-Encoding: chunked */
+		if (conn->chunked) {
+			if (!sipe_http_transport_chunked(conn, connection))
+				return;
+
+		} else {
+			if (connection->buffer_used < (gsize) msg->bodylen)
 				return;
+
+			/* compressed body */
+			if (conn->body) {
+				if (!sipe_http_transport_body(conn,
+							      connection->buffer,
+							      msg->bodylen)) {
+					SIPE_DEBUG_ERROR_NOFORMAT("sipe_http_transport_input: decompression failed");
+					msg->response = SIPMSG_RESPONSE_FATAL_ERROR;
+				}
+			} else {
+				/* body may contain NUL bytes */
+				msg->body = g_malloc(msg->bodylen + 1);
+				memcpy(msg->body, connection->buffer, msg->bodylen);
+				msg->body[msg->bodylen] = '\0';
 			}
+			sipe_utils_shrink_buffer(connection,
+						 connection->buffer + msg->bodylen);
 		}
 
+#ifdef HAVE_ZLIB
+		/* truncated compressed body, empty body is OK */
+		if (conn->inflate                &&
+		    !conn->inflate_done          &&
+		    conn->inflate_header_length) {
+			SIPE_DEBUG_ERROR_NOFORMAT("sipe_http_transport_input: compressed body is incomplete");
+			msg->response = SIPMSG_RESPONSE_FATAL_ERROR;
+		}
+#endif
+		if (conn->body) {
+			msg->bodylen = conn->body->len;
+			msg->body    = g_string_free(conn->body, FALSE);
+			conn->body   = NULL;
+		}
+#ifdef HAVE_ZLIB
+		if (conn->inflate) {
+			SIPE_DEBUG_INFO("sipe_http_transport_input: decompressed %" G_GSIZE_FORMAT " bytes to %d bytes",
+					(gsize) conn->inflate->total_in,
+					msg->bodylen);
+			if (conn->inflate_started)
+				inflateEnd(conn->inflate);
+			g_free(conn->inflate);
+			conn->inflate = NULL;
+		}
+#endif
+
+		/* response is complete */
+		conn->msg = NULL;
+		sipe_utils_message_debug(connection,
+					 "HTTP",
+					 conn->header,
+					 msg->body,
+					 FALSE);
+		g_free(conn->header);
+		conn->header = NULL;
+
 		if (msg->response == SIPMSG_RESPONSE_FATAL_ERROR) {
 			/* fatal header parse error */
 			msg->response = SIPE_HTTP_STATUS_SERVER_ERROR;
 			drop          = TRUE;
 		} else if (sipe_strcase_equal(sipmsg_find_header(msg, "Connection"), "close")) {
 			SIPE_DEBUG_INFO("sipe_http_transport_input: server requested close '%s'",
-					conn->host_port);
+					SIPE_HTTP_CONNECTION_HOST->host_port);
 			drop          = TRUE;
 		}
 
 		sipe_http_request_response(SIPE_HTTP_CONNECTION_PUBLIC, msg);
-		next = sipe_http_request_pending(SIPE_HTTP_CONNECTION_PUBLIC);
+		sipmsg_free(msg);
 
 		if (drop) {
 			/* drop backend connection */
@@ -420,18 +683,20 @@ static void sipe_http_transport_input(struct sipe_transport_connection *connecti
 			conn->public.connected = FALSE;
 
 			/* if we have pending requests we need to trigger re-connect */
-			if (next)
-				sipe_http_transport_new(conn->public.sipe_private,
-							conn->public.host,
-							conn->public.port,
-							conn->use_tls);
-
-		} else if (next) {
-			/* trigger sending of next pending request */
-			sipe_http_request_next(SIPE_HTTP_CONNECTION_PUBLIC);
+			if (sipe_http_request_pending(SIPE_HTTP_CONNECTION_PUBLIC)) {
+				sipe_http_request_disconnected(SIPE_HTTP_CONNECTION_PUBLIC);
+				sipe_http_transport_connect(conn);
+			} else {
+				sipe_http_transport_drop(conn, "closed by server");
+				/* conn is no longer valid */
+			}
+
+			sipe_http_request_dispatch(host_public);
+			return;
 		}
 
-		sipmsg_free(msg);
+		/* trigger sending of next pending request */
+		sipe_http_request_next(SIPE_HTTP_CONNECTION_PUBLIC);
 	}
 }
 
@@ -439,80 +704,119 @@ static void sipe_http_transport_error(struct sipe_transport_connection *connecti
 				      const gchar *msg)
 {
 	struct sipe_http_connection *conn = SIPE_HTTP_CONNECTION;
-	sipe_http_transport_drop(conn->public.sipe_private->http,
-				 conn,
-				 msg);
+	struct sipe_http_host_public *host_public = conn->public.host_public;
+
+	sipe_http_transport_drop(conn, msg);
 	/* conn is no longer valid */
+
+	/* host is unreachable: fail requests that are waiting for it */
+	if (!host_public->connections)
+		sipe_http_request_host_shutdown(host_public, FALSE);
+	else
+		sipe_http_request_dispatch(host_public);
 }
 
-struct sipe_http_connection_public *sipe_http_transport_new(struct sipe_core_private *sipe_private,
-							    const gchar *host_in,
-							    const guint32 port,
-							    gboolean use_tls)
+static void sipe_http_transport_connect(struct sipe_http_connection *conn)
+{
+	struct sipe_core_private *sipe_private = conn->public.sipe_private;
+	struct sipe_http_host *host = SIPE_HTTP_CONNECTION_HOST;
+	sipe_connect_setup setup = {
+		host->use_tls ? SIPE_TRANSPORT_TLS : SIPE_TRANSPORT_TCP,
+		host->public.host,
+		host->public.port,
+		conn,
+		sipe_http_transport_connected,
+		sipe_http_transport_input,
+		sipe_http_transport_error
+	};
+
+	/* will be re-inserted after connect */
+	sipe_http_transport_update_timeout_queue(conn, TRUE);
+	sipe_http_transport_input_reset(conn);
+
+	conn->public.connected = FALSE;
+	conn->connection = sipe_backend_transport_connect(SIPE_CORE_PUBLIC,
+							  &setup);
+}
+
+struct sipe_http_host_public *sipe_http_transport_host(struct sipe_core_private *sipe_private,
+						       const gchar *host_in,
+						       const guint32 port,
+						       gboolean use_tls)
 {
 	struct sipe_http *http;
-	struct sipe_http_connection *conn = NULL;
+	struct sipe_http_host *host = NULL;
 	/* host name matching should be case insensitive */
-	gchar *host = g_ascii_strdown(host_in, -1);
-	gchar *host_port = g_strdup_printf("%s:%" G_GUINT32_FORMAT, host, port);
+	gchar *host_port;
+	gchar *name = g_ascii_strdown(host_in, -1);
+
+	host_port = g_strdup_printf("%s:%" G_GUINT32_FORMAT, name, port);
 
 	sipe_http_init(sipe_private);
 
 	http = sipe_private->http;
 	if (http->shutting_down) {
-		SIPE_DEBUG_ERROR("sipe_http_transport_new: new connection requested during shutdown: THIS SHOULD NOT HAPPEN! Debugging information:\n"
+		SIPE_DEBUG_ERROR("sipe_http_transport_host: new connection requested during shutdown: THIS SHOULD NOT HAPPEN! Debugging information:\n"
 				 "Host/Port: %s", host_port);
+		g_free(host_port);
 	} else {
-		conn = g_hash_table_lookup(http->connections, host_port);
-
-		if (conn) {
-			/* re-establishing connection */
-			if (!conn->connection) {
-				SIPE_DEBUG_INFO("sipe_http_transport_new: re-establishing %s", host_port);
-
-				/* will be re-inserted after connect */
-				sipe_http_transport_update_timeout_queue(conn, TRUE);
-			}
+		host = g_hash_table_lookup(http->hosts, host_port);
 
+		if (host) {
+			g_free(host_port);
 		} else {
-			/* new connection */
-			SIPE_DEBUG_INFO("sipe_http_transport_new: new %s", host_port);
+			SIPE_DEBUG_INFO("sipe_http_transport_host: new %s", host_port);
 
-			conn = g_new0(struct sipe_http_connection, 1);
+			host = g_new0(struct sipe_http_host, 1);
 
-			conn->public.sipe_private = sipe_private;
-			conn->public.host         = g_strdup(host);
-			conn->public.port         = port;
+			host->public.sipe_private = sipe_private;
+			host->public.host         = name;
+			host->public.port         = port;
 
-			conn->host_port           = host_port;
-			conn->use_tls             = use_tls;
+			host->host_port           = host_port;
+			host->use_tls             = use_tls;
+			name = NULL; /* host takes ownership of the name */
 
-			g_hash_table_insert(http->connections,
+			g_hash_table_insert(http->hosts,
 					    host_port,
-					    conn);
-			host_port = NULL; /* conn_private takes ownership of the key */
+					    host);
+			/* host takes ownership of the key */
 		}
+	}
 
-		if (!conn->connection) {
-			sipe_connect_setup setup = {
-				use_tls ? SIPE_TRANSPORT_TLS : SIPE_TRANSPORT_TCP,
-				host,
-				port,
-				conn,
-				sipe_http_transport_connected,
-				sipe_http_transport_input,
-				sipe_http_transport_error
-			};
+	g_free(name);
+	return(host ? SIPE_HTTP_HOST_PUBLIC : NULL);
+}
 
-			conn->public.connected = FALSE;
-			conn->connection = sipe_backend_transport_connect(SIPE_CORE_PUBLIC,
-									  &setup);
-		}
+void sipe_http_transport_open(struct sipe_http_host_public *host_public)
+{
+	struct sipe_http_host *host = SIPE_HTTP_HOST_PRIVATE;
+	struct sipe_http_connection *conn;
+	GSList *entry;
+
+	if (g_slist_length(host_public->connections) >= SIPE_HTTP_MAX_CONNECTIONS)
+		return;
+
+	/* open only one connection at a time */
+	for (entry = host_public->connections; entry; entry = entry->next) {
+		conn = entry->data;
+		if (!conn->public.connected)
+			return;
 	}
 
-	g_free(host_port);
-	g_free(host);
-	return(SIPE_HTTP_CONNECTION_PUBLIC);
+	SIPE_DEBUG_INFO("sipe_http_transport_open: new connection #%d to %s",
+			g_slist_length(host_public->connections) + 1,
+			host->host_port);
+
+	conn = g_new0(struct sipe_http_connection, 1);
+	conn->public.sipe_private = host_public->sipe_private;
+	conn->public.host_public  = host_public;
+	conn->public.host         = g_strdup(host_public->host);
+	conn->public.port         = host_public->port;
+
+	host_public->connections = g_slist_append(host_public->connections,
+						  conn);
+	sipe_http_transport_connect(conn);
 }
 
 void sipe_http_transport_send(struct sipe_http_connection_public *conn_public,
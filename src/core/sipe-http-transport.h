@@ -36,16 +36,33 @@
 struct sipe_core_private;
 struct sip_sec_context;
 
+/* maximum number of connections per host/port */
+#define SIPE_HTTP_MAX_CONNECTIONS 4
+
+/* all connections to one host/port */
+struct sipe_http_host_public {
+	struct sipe_core_private *sipe_private;
+
+	GSList *queues;                  /* handled by sipe-http-request.c */
+	GSList *connections;             /* handled by sipe-http-transport.c */
+
+	gchar *host;
+	guint32 port;
+};
+
 struct sipe_http_connection_public {
 	struct sipe_core_private *sipe_private;
+	struct sipe_http_host_public *host_public;
 
 	GSList *pending_requests;        /* handled by sipe-http-request.c */
 	struct sip_sec_context *context; /* handled by sipe-http-request.c */
 	gchar *cached_authorization;     /* handled by sipe-http-request.c */
+	gboolean pipelining;             /* handled by sipe-http-request.c */
 
 	gchar *host;
 	guint32 port;
 	gboolean connected;
+	gboolean http11;                 /* last response was HTTP/1.1 */
 };
 
 /**
@@ -58,21 +75,32 @@ struct sipe_http_connection_public {
 gboolean sipe_http_shutting_down(struct sipe_core_private *sipe_private);
 
 /**
- * Initiate HTTP connection
+ * Get connection pool for host/port
  *
- * If a connection to this host/port already exists it will be reused.
+ * If a pool for this host/port already exists it will be reused.
  *
  * @param sipe_private SIPE core private data
  * @param host         name of the host to connect to
  * @param port         port number to connect to
  * @param use_tls      use TLS if @c TRUE, otherwise TCP
  *
- * @return HTTP connection public data
+ * @return HTTP host public data (@c NULL during shutdown)
+ */
+struct sipe_http_host_public *sipe_http_transport_host(struct sipe_core_private *sipe_private,
+						       const gchar *host,
+						       guint32 port,
+						       gboolean use_tls);
+
+/**
+ * Open additional HTTP connection to host
+ *
+ * Does nothing if the per-host connection limit has been reached or if
+ * a connection to this host is already being established.
+ * @c sipe_http_request_next() will be called when the connection is ready.
+ *
+ * @param host_public HTTP host public data
  */
-struct sipe_http_connection_public *sipe_http_transport_new(struct sipe_core_private *sipe_private,
-							    const gchar *host,
-							    guint32 port,
-							    gboolean use_tls);
+void sipe_http_transport_open(struct sipe_http_host_public *host_public);
 
 /**
  * Send HTTP request
@@ -151,6 +151,17 @@ void sipe_http_request_session(struct sipe_http_request *request,
  */
 void sipe_http_request_allow_redirect(struct sipe_http_request *request);
 
+/**
+ * Accept compressed response for HTTP request
+ *
+ * Adds "Accept-Encoding: gzip, deflate". The response body will be
+ * decompressed before it is passed to the callback. Does nothing if
+ * compiled without zlib.
+ *
+ * @param request pointer to opaque HTTP request data structure
+ */
+void sipe_http_request_compression(struct sipe_http_request *request);
+
 /**
  * Provide authentication information for HTTP request
  *
@@ -107,8 +107,10 @@ static void lync_request(struct sipe_core_private *sipe_private,
 						 sipe_lync_autodiscover_cb,
 						 request);
 
-	if (request->request)
+	if (request->request) {
+		sipe_http_request_compression(request->request);
 		sipe_http_request_ready(request->request);
+	}
 }
 
 static GSList *sipe_lync_autodiscover_add(GSList *servers,
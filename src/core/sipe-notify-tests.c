@@ -0,0 +1,855 @@
+/**
+ * @file sipe-notify-tests.c
+ *
+ * pidgin-sipe
+ *
+ * Copyright (C) 2020 SIPE Project <http://sipe.sourceforge.net/>
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ * Tests for the roaming contacts processing: full contact list, buddy
+ * list updates and incomplete or invalid documents. Buddy and group
+ * lists are replaced by a minimal model so that the test can inspect
+ * the result.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+
+#include <glib.h>
+
+#include "sipe-notify.c"
+#include "sip-transport.h"
+#include "sipe-crypt.h"
+#include "sipe-mime.h"
+#include "sipe-rtf.h"
+
+/*
+ * Stubs
+ */
+gboolean sipe_backend_debug_enabled(void)
+{
+	return(FALSE);
+}
+
+void sipe_backend_debug_literal(SIPE_UNUSED_PARAMETER sipe_debug_level level,
+				SIPE_UNUSED_PARAMETER const gchar *msg)
+{
+}
+
+void sipe_backend_debug(SIPE_UNUSED_PARAMETER sipe_debug_level level,
+			SIPE_UNUSED_PARAMETER const gchar *format,
+			...)
+{
+}
+
+gchar *sipe_backend_markup_css_property(SIPE_UNUSED_PARAMETER const gchar *style,
+					SIPE_UNUSED_PARAMETER const gchar *option)
+{
+	return(NULL);
+}
+
+void sipe_mime_parts_foreach(SIPE_UNUSED_PARAMETER const gchar *type,
+			     SIPE_UNUSED_PARAMETER const gchar *body,
+			     SIPE_UNUSED_PARAMETER sipe_mime_parts_cb callback,
+			     SIPE_UNUSED_PARAMETER gpointer user_data)
+{
+}
+
+gchar *sipe_rtf_to_html(SIPE_UNUSED_PARAMETER const gchar *rtf)
+{
+	return(NULL);
+}
+
+const gchar *sip_transport_epid(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+	return(NULL);
+}
+
+/* needed when linking against NSS */
+void md4sum(const uint8_t *data, uint32_t length, uint8_t *digest);
+void md4sum(SIPE_UNUSED_PARAMETER const uint8_t *data,
+	    SIPE_UNUSED_PARAMETER uint32_t length,
+	    SIPE_UNUSED_PARAMETER uint8_t *digest)
+{
+}
+
+void sip_csta_open(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+		   SIPE_UNUSED_PARAMETER const gchar *line_uri,
+		   SIPE_UNUSED_PARAMETER const gchar *server)
+{
+}
+
+void sip_soap_ocs2005_setacl(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+			     SIPE_UNUSED_PARAMETER const gchar *who,
+			     SIPE_UNUSED_PARAMETER gboolean allow)
+{
+}
+
+gchar *sip_to_tel_uri(SIPE_UNUSED_PARAMETER const gchar *phone)
+{
+	return(NULL);
+}
+
+void sipe_backend_buddy_request_authorization(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+					      SIPE_UNUSED_PARAMETER const gchar *who,
+					      SIPE_UNUSED_PARAMETER const gchar *alias,
+					      SIPE_UNUSED_PARAMETER gboolean on_list,
+					      SIPE_UNUSED_PARAMETER sipe_backend_buddy_request_authorization_cb auth_cb,
+					      SIPE_UNUSED_PARAMETER sipe_backend_buddy_request_authorization_cb deny_cb,
+					      SIPE_UNUSED_PARAMETER gpointer data)
+{
+}
+
+void sipe_backend_connection_error(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+				   SIPE_UNUSED_PARAMETER sipe_connection_error error,
+				   SIPE_UNUSED_PARAMETER const gchar *msg)
+{
+}
+
+void sipe_buddy_changes_start(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+}
+
+void sipe_buddy_changes_finish(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+}
+
+guint sipe_buddy_get_status(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+			    SIPE_UNUSED_PARAMETER const gchar *uri)
+{
+	return(SIPE_ACTIVITY_UNSET);
+}
+
+void sipe_buddy_got_status(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+			   SIPE_UNUSED_PARAMETER const gchar *uri,
+			   SIPE_UNUSED_PARAMETER guint activity,
+			   SIPE_UNUSED_PARAMETER time_t last_active)
+{
+}
+
+void sipe_buddy_refresh_photos(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+}
+
+void sipe_buddy_refresh_properties(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+				   SIPE_UNUSED_PARAMETER const gchar *uri)
+{
+}
+
+void sipe_buddy_update_photo(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+			     SIPE_UNUSED_PARAMETER const gchar *uri,
+			     SIPE_UNUSED_PARAMETER const gchar *photo_hash,
+			     SIPE_UNUSED_PARAMETER const gchar *photo_url,
+			     SIPE_UNUSED_PARAMETER const gchar *headers)
+{
+}
+
+void sipe_buddy_update_property(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+				SIPE_UNUSED_PARAMETER const gchar *uri,
+				SIPE_UNUSED_PARAMETER sipe_buddy_info_fields propkey,
+				SIPE_UNUSED_PARAMETER gchar *property_value)
+{
+}
+
+void sipe_cal_free_free_busy(SIPE_UNUSED_PARAMETER struct sipe_cal_free_busy *fb)
+{
+}
+
+void sipe_cal_parse_working_hours(SIPE_UNUSED_PARAMETER const struct _sipe_xml *xn_working_hours,
+				  SIPE_UNUSED_PARAMETER struct sipe_buddy *buddy)
+{
+}
+
+void sipe_conf_get_capabilities(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+}
+
+const gchar *sipe_core_activity_description(SIPE_UNUSED_PARAMETER guint type)
+{
+	return(NULL);
+}
+
+void sipe_groupchat_init(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+}
+
+const gchar *sipe_ocs2005_activity_description(SIPE_UNUSED_PARAMETER guint activity)
+{
+	return(NULL);
+}
+
+void sipe_ocs2005_schedule_status_update(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+}
+
+const gchar *sipe_ocs2005_status_from_activity_availability(SIPE_UNUSED_PARAMETER guint activity,
+							    SIPE_UNUSED_PARAMETER guint availablity)
+{
+	return(NULL);
+}
+
+void sipe_ocs2005_user_info_has_updated(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+					SIPE_UNUSED_PARAMETER const struct _sipe_xml *xn_userinfo)
+{
+}
+
+guint sipe_ocs2007_availability_from_status(SIPE_UNUSED_PARAMETER const gchar *sipe_status_id,
+					    SIPE_UNUSED_PARAMETER const gchar **activity_token)
+{
+	return(0);
+}
+
+void sipe_ocs2007_change_access_level(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+				      SIPE_UNUSED_PARAMETER const int container_id,
+				      SIPE_UNUSED_PARAMETER const gchar *type,
+				      SIPE_UNUSED_PARAMETER const gchar *value)
+{
+}
+
+const gchar *sipe_ocs2007_legacy_activity_description(SIPE_UNUSED_PARAMETER guint availability)
+{
+	return(NULL);
+}
+
+void sipe_ocs2007_process_roaming_self(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+				       SIPE_UNUSED_PARAMETER struct sipmsg *msg)
+{
+}
+
+const gchar *sipe_ocs2007_status_from_legacy_availability(SIPE_UNUSED_PARAMETER guint availability,
+							  SIPE_UNUSED_PARAMETER const gchar *activity)
+{
+	return(NULL);
+}
+
+void sipe_process_conference(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+			     SIPE_UNUSED_PARAMETER struct sipmsg *msg)
+{
+}
+
+void sipe_process_imdn(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+		       SIPE_UNUSED_PARAMETER struct sipmsg *msg)
+{
+}
+
+const gchar *sipe_status_activity_to_token(SIPE_UNUSED_PARAMETER guint type)
+{
+	return(NULL);
+}
+
+void sipe_status_set_token(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+			   SIPE_UNUSED_PARAMETER const gchar *status_id)
+{
+}
+
+guint sipe_status_token_to_activity(SIPE_UNUSED_PARAMETER const gchar *token)
+{
+	return(SIPE_ACTIVITY_UNSET);
+}
+
+void sipe_subscribe_poolfqdn_resource_uri(SIPE_UNUSED_PARAMETER const gchar *host,
+					  SIPE_UNUSED_PARAMETER GSList *server,
+					  SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+}
+
+void sipe_subscribe_presence_single(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+				    SIPE_UNUSED_PARAMETER const gchar *uri,
+				    SIPE_UNUSED_PARAMETER const gchar *to)
+{
+}
+
+void sipe_ucs_init(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+		   SIPE_UNUSED_PARAMETER gboolean migrated)
+{
+}
+
+gboolean sipe_ucs_is_migrated(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+	return(FALSE);
+}
+
+void sipe_group_create(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+		       SIPE_UNUSED_PARAMETER struct sipe_ucs_transaction *trans,
+		       SIPE_UNUSED_PARAMETER const gchar *name,
+		       SIPE_UNUSED_PARAMETER const gchar *who)
+{
+}
+
+void sipe_backend_buddy_list_processing_start(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public)
+{
+}
+
+void sipe_backend_buddy_list_processing_finish(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public)
+{
+}
+
+static guint subscribed = 0;
+void sipe_subscribe_presence_initial(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+	subscribed++;
+}
+
+static guint saved = 0;
+void sipe_snapshot_save(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+	saved++;
+}
+
+/*
+ * Buddy list model
+ *
+ * groups:  list of struct sipe_group
+ * buddies: URI -> struct sipe_buddy, buddy->groups is an array of
+ *          struct sipe_group pointers
+ */
+static GSList     *groups  = NULL;
+static GHashTable *buddies = NULL;
+
+#define MODEL_GROUP(buddy, index) g_array_index((buddy)->groups, struct sipe_group *, (index))
+
+struct sipe_group *sipe_group_add(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+				  const gchar *name,
+				  SIPE_UNUSED_PARAMETER const gchar *exchange_key,
+				  SIPE_UNUSED_PARAMETER const gchar *change_key,
+				  guint id)
+{
+	struct sipe_group *group = g_new0(struct sipe_group, 1);
+
+	group->name = g_strdup(name);
+	group->id   = id;
+	groups = g_slist_append(groups, group);
+	return(group);
+}
+
+static void model_group_free(gpointer data)
+{
+	struct sipe_group *group = data;
+	g_free(group->name);
+	g_free(group);
+}
+
+void sipe_group_remove(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+		       struct sipe_group *group)
+{
+	groups = g_slist_remove(groups, group);
+	model_group_free(group);
+}
+
+gboolean sipe_group_rename(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+			   struct sipe_group *group,
+			   const gchar *name)
+{
+	g_free(group->name);
+	group->name = g_strdup(name);
+	return(TRUE);
+}
+
+struct sipe_group *sipe_group_find_by_id(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+					 guint id)
+{
+	GSList *entry;
+	for (entry = groups; entry; entry = entry->next)
+		if (((struct sipe_group *) entry->data)->id == id)
+			return(entry->data);
+	return(NULL);
+}
+
+struct sipe_group *sipe_group_find_by_name(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+					   const gchar * name)
+{
+	GSList *entry;
+	for (entry = groups; entry; entry = entry->next)
+		if (sipe_strequal(((struct sipe_group *) entry->data)->name, name))
+			return(entry->data);
+	return(NULL);
+}
+
+struct sipe_group *sipe_group_first(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+	return(groups ? groups->data : NULL);
+}
+
+guint sipe_group_count(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+	return(g_slist_length(groups));
+}
+
+void sipe_group_foreach(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+			GFunc callback,
+			gpointer callback_data)
+{
+	g_slist_foreach(groups, callback, callback_data);
+}
+
+static void model_group_obsolete(gpointer data,
+				 gpointer user_data)
+{
+	((struct sipe_group *) data)->is_obsolete = GPOINTER_TO_INT(user_data);
+}
+
+void sipe_group_update_start(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+	g_slist_foreach(groups, model_group_obsolete, GINT_TO_POINTER(TRUE));
+}
+
+void sipe_group_update_cancel(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+	g_slist_foreach(groups, model_group_obsolete, GINT_TO_POINTER(FALSE));
+}
+
+void sipe_group_update_finish(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+	GSList *entry = groups;
+	while (entry) {
+		struct sipe_group *group = entry->data;
+		entry = entry->next;
+		if (group->is_obsolete)
+			sipe_group_remove(sipe_private, group);
+	}
+}
+
+static void model_buddy_free(gpointer data)
+{
+	struct sipe_buddy *buddy = data;
+	g_array_free(buddy->groups, TRUE);
+	g_free(buddy->alias);
+	g_free(buddy->name);
+	g_free(buddy);
+}
+
+struct sipe_buddy *sipe_buddy_find_by_uri(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+					  const gchar *uri)
+{
+	return(uri ? g_hash_table_lookup(buddies, uri) : NULL);
+}
+
+guint sipe_buddy_count(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+	return(g_hash_table_size(buddies));
+}
+
+struct sipe_buddy *sipe_buddy_add(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+				  const gchar *uri,
+				  SIPE_UNUSED_PARAMETER const gchar *exchange_key,
+				  SIPE_UNUSED_PARAMETER const gchar *change_key)
+{
+	struct sipe_buddy *buddy = g_hash_table_lookup(buddies, uri);
+
+	if (buddy) {
+		buddy->is_obsolete = FALSE;
+	} else {
+		buddy = g_new0(struct sipe_buddy, 1);
+		buddy->name   = g_strdup(uri);
+		buddy->groups = g_array_new(FALSE, FALSE, sizeof(struct sipe_group *));
+		g_hash_table_insert(buddies, buddy->name, buddy);
+	}
+	return(buddy);
+}
+
+guint sipe_buddy_group_count(struct sipe_buddy *buddy)
+{
+	return(buddy->groups->len);
+}
+
+static gboolean model_buddy_in_group(struct sipe_buddy *buddy,
+				     const struct sipe_group *group)
+{
+	guint i;
+	for (i = 0; i < buddy->groups->len; i++)
+		if (MODEL_GROUP(buddy, i) == group)
+			return(TRUE);
+	return(FALSE);
+}
+
+/* group array is sorted by group ID */
+void sipe_buddy_insert_group(struct sipe_buddy *buddy,
+			     struct sipe_group *group)
+{
+	guint i;
+
+	if (model_buddy_in_group(buddy, group))
+		return;
+	for (i = 0; i < buddy->groups->len; i++)
+		if (MODEL_GROUP(buddy, i)->id > group->id)
+			break;
+	g_array_insert_val(buddy->groups, i, group);
+}
+
+void sipe_buddy_add_to_group(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+			     struct sipe_buddy *buddy,
+			     struct sipe_group *group,
+			     const gchar *alias)
+{
+	if (alias) {
+		g_free(buddy->alias);
+		buddy->alias = g_strdup(alias);
+	}
+	sipe_buddy_insert_group(buddy, group);
+}
+
+void sipe_buddy_update_groups(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+			      struct sipe_buddy *buddy,
+			      GSList *new_groups)
+{
+	g_array_set_size(buddy->groups, 0);
+	for (; new_groups; new_groups = new_groups->next)
+		sipe_buddy_insert_group(buddy, new_groups->data);
+}
+
+gboolean sipe_buddy_keep_groups(struct sipe_buddy *buddy,
+				GSList *new_groups)
+{
+	if (buddy->groups->len != g_slist_length(new_groups))
+		return(FALSE);
+	for (; new_groups; new_groups = new_groups->next)
+		if (!model_buddy_in_group(buddy, new_groups->data))
+			return(FALSE);
+	buddy->is_obsolete = FALSE;
+	return(TRUE);
+}
+
+void sipe_buddy_remove(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+		       struct sipe_buddy *buddy)
+{
+	g_hash_table_remove(buddies, buddy->name);
+}
+
+void sipe_buddy_cleanup_local_list(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+}
+
+static void model_buddy_obsolete(SIPE_UNUSED_PARAMETER gpointer key,
+				 gpointer value,
+				 gpointer user_data)
+{
+	((struct sipe_buddy *) value)->is_obsolete = GPOINTER_TO_INT(user_data);
+}
+
+void sipe_buddy_update_start(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+	g_hash_table_foreach(buddies, model_buddy_obsolete, GINT_TO_POINTER(TRUE));
+}
+
+void sipe_buddy_update_cancel(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+	g_hash_table_foreach(buddies, model_buddy_obsolete, GINT_TO_POINTER(FALSE));
+}
+
+static gboolean model_buddy_remove_obsolete(SIPE_UNUSED_PARAMETER gpointer key,
+					    gpointer value,
+					    SIPE_UNUSED_PARAMETER gpointer user_data)
+{
+	return(((struct sipe_buddy *) value)->is_obsolete);
+}
+
+guint sipe_buddy_update_finish(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+	return(g_hash_table_foreach_remove(buddies,
+					   model_buddy_remove_obsolete,
+					   NULL));
+}
+
+/* backend buddy: the model buddy if it is in the group */
+sipe_backend_buddy sipe_backend_buddy_find(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+					   const gchar *buddy_name,
+					   const gchar *group_name)
+{
+	struct sipe_buddy *buddy = g_hash_table_lookup(buddies, buddy_name);
+	struct sipe_group *group = sipe_group_find_by_name(NULL, group_name);
+
+	return((buddy && group && model_buddy_in_group(buddy, group)) ? buddy : NULL);
+}
+
+sipe_backend_buddy sipe_backend_buddy_add(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+					  const gchar *name,
+					  SIPE_UNUSED_PARAMETER const gchar *alias,
+					  SIPE_UNUSED_PARAMETER const gchar *groupname)
+{
+	return(g_hash_table_lookup(buddies, name));
+}
+
+gchar* sipe_backend_buddy_get_alias(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+				    const sipe_backend_buddy who)
+{
+	return(g_strdup(((struct sipe_buddy *) who)->alias));
+}
+
+void sipe_backend_buddy_set_alias(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+				  const sipe_backend_buddy who,
+				  const gchar *alias)
+{
+	struct sipe_buddy *buddy = who;
+	g_free(buddy->alias);
+	buddy->alias = g_strdup(alias);
+}
+
+/*
+ * Tester code
+ */
+static guint succeeded = 0;
+static guint failed    = 0;
+
+static void assert_equal(guint expected, guint got, const gchar *what)
+{
+	if (expected == got) {
+		succeeded++;
+	} else {
+		printf("FAILED: %s: %u expected %u\n", what, got, expected);
+		failed++;
+	}
+}
+
+static void assert_string(const gchar *expected, const gchar *got, const gchar *what)
+{
+	if (sipe_strequal(expected, got)) {
+		succeeded++;
+	} else {
+		printf("FAILED: %s:\n  got      '%s'\n  expected '%s'\n",
+		       what, got, expected);
+		failed++;
+	}
+}
+
+static gint model_compare(gconstpointer a, gconstpointer b)
+{
+	return(strcmp(a, b));
+}
+
+/* "uri:group,group(alias) ..." sorted by URI, "!" marks obsolete entries */
+static gchar *model_buddies(void)
+{
+	GString *result = g_string_new(NULL);
+	GList *uris = g_list_sort(g_hash_table_get_keys(buddies), model_compare);
+	GList *entry;
+
+	for (entry = uris; entry; entry = entry->next) {
+		struct sipe_buddy *buddy = g_hash_table_lookup(buddies, entry->data);
+		guint i;
+
+		g_string_append_printf(result, "%s%s:",
+				       buddy->is_obsolete ? "!" : "",
+				       buddy->name);
+		for (i = 0; i < buddy->groups->len; i++)
+			g_string_append_printf(result, "%s%u",
+					       i ? "," : "",
+					       MODEL_GROUP(buddy, i)->id);
+		g_string_append_printf(result, "(%s) ",
+				       buddy->alias ? buddy->alias : "-");
+	}
+	g_list_free(uris);
+
+	return(g_string_free(result, FALSE));
+}
+
+/* "id:name ..." in list order, "!" marks obsolete entries */
+static gchar *model_groups(void)
+{
+	GString *result = g_string_new(NULL);
+	GSList *entry;
+
+	for (entry = groups; entry; entry = entry->next) {
+		struct sipe_group *group = entry->data;
+		g_string_append_printf(result, "%s%u:%s ",
+				       group->is_obsolete ? "!" : "",
+				       group->id,
+				       group->name);
+	}
+
+	return(g_string_free(result, FALSE));
+}
+
+static void assert_model(const gchar *expected_groups,
+			 const gchar *expected_buddies,
+			 const gchar *what)
+{
+	gchar *tmp = model_groups();
+	gchar *description = g_strdup_printf("%s: groups", what);
+	assert_string(expected_groups, tmp, description);
+	g_free(description);
+	g_free(tmp);
+
+	tmp = model_buddies();
+	description = g_strdup_printf("%s: buddies", what);
+	assert_string(expected_buddies, tmp, description);
+	g_free(description);
+	g_free(tmp);
+}
+
+static gboolean test_notify(struct sipe_core_private *sipe_private,
+			    const gchar *body)
+{
+	struct sipmsg *msg = sipmsg_parse_header("NOTIFY sip:test@test.com SIP/2.0\r\n"
+						 "Event: vnd-microsoft-roaming-contacts");
+	gboolean result;
+
+	msg->body    = g_strdup(body);
+	msg->bodylen = strlen(body);
+
+	saved      = 0;
+	subscribed = 0;
+	result = sipe_process_roaming_contacts(sipe_private, msg);
+	sipmsg_free(msg);
+
+	return(result);
+}
+
+#define CONTACT_LIST(delta, content)					\
+	"<contactList deltaNum=\"" delta "\">" content "</contactList>"
+#define CONTACT_DELTA(delta, content)					\
+	"<contactDelta deltaNum=\"" delta "\">" content "</contactDelta>"
+
+#define INITIAL_LIST							\
+	CONTACT_LIST("1",						\
+		     "<group id=\"1\" name=\"~\"/>"			\
+		     "<group id=\"2\" name=\"Friends\"/>"		\
+		     "<contact uri=\"a@test.com\" name=\"\" groups=\"1\"/>" \
+		     "<contact uri=\"b@test.com\" name=\"Bob\" groups=\"1 2\"/>")
+
+static void tests_contact_list(struct sipe_core_private *sipe_private)
+{
+	const gchar *update =
+		CONTACT_LIST("2",
+			     "<group id=\"1\" name=\"~\"/>"
+			     "<contact uri=\"a@test.com\" name=\"\" groups=\"1\"/>");
+	gchar *truncated = g_strndup(update, strlen(update) - 10);
+
+	assert_equal(TRUE, test_notify(sipe_private, INITIAL_LIST), "initial list: parsed");
+	assert_model("1:Other Contacts 2:Friends ",
+		     "sip:a@test.com:1(-) sip:b@test.com:1,2(Bob) ",
+		     "initial list");
+	assert_equal(1, sipe_private->deltanum_contacts, "initial list: deltaNum");
+	assert_equal(1, sipe_private->deltanum_snapshot, "initial list: snapshot deltaNum");
+	assert_equal(1, saved,      "initial list: snapshot saved");
+	assert_equal(1, subscribed, "initial list: presence subscribed");
+
+	/* incomplete list must not remove anything or leave obsolete flags */
+	assert_equal(FALSE,
+		     test_notify(sipe_private, truncated),
+		     "incomplete list: not parsed");
+	g_free(truncated);
+	assert_model("1:Other Contacts 2:Friends ",
+		     "sip:a@test.com:1(-) sip:b@test.com:1,2(Bob) ",
+		     "incomplete list");
+	assert_equal(1, sipe_private->deltanum_snapshot, "incomplete list: snapshot deltaNum");
+	assert_equal(0, saved,      "incomplete list: no snapshot");
+	assert_equal(0, subscribed, "incomplete list: no subscription");
+
+	/* complete update: b removed, group 2 removed */
+	assert_equal(TRUE, test_notify(sipe_private, update), "updated list: parsed");
+	assert_model("1:Other Contacts ",
+		     "sip:a@test.com:1(-) ",
+		     "updated list");
+	assert_equal(2, sipe_private->deltanum_snapshot, "updated list: snapshot deltaNum");
+	assert_equal(1, saved, "updated list: snapshot saved");
+}
+
+static void tests_contact_delta(struct sipe_core_private *sipe_private)
+{
+	const gchar *delta =
+		CONTACT_DELTA("4",
+			      "<addedContact uri=\"sip:d@test.com\" name=\"Dave\" groups=\"3\"/>"
+			      "<modifiedContact uri=\"sip:b@test.com\" name=\"Bob\" groups=\"3\"/>"
+			      "<deletedGroup id=\"2\"/>"
+			      "<deletedContact uri=\"sip:c@test.com\"/>");
+	gchar *partial = g_strndup(delta, strlen(delta) - 20);
+
+	assert_equal(TRUE,
+		     test_notify(sipe_private,
+				 CONTACT_DELTA("3",
+					       "<addedGroup id=\"2\" name=\"Friends\"/>"
+					       "<addedGroup id=\"3\" name=\"Work\"/>"
+					       "<addedContact uri=\"sip:b@test.com\" name=\"Bob\" groups=\"2\"/>"
+					       "<addedContact uri=\"sip:c@test.com\" name=\"\" groups=\"2\"/>"
+					       "<modifiedContact uri=\"sip:a@test.com\" name=\"Al\" groups=\"1 3\"/>"
+					       "<modifiedGroup id=\"3\" name=\"Office\"/>")),
+		     "delta: parsed");
+	assert_model("1:Other Contacts 2:Friends 3:Office ",
+		     "sip:a@test.com:1,3(Al) sip:b@test.com:2(Bob) sip:c@test.com:2(-) ",
+		     "delta");
+	assert_equal(3, sipe_private->deltanum_contacts, "delta: deltaNum");
+	assert_equal(3, sipe_private->deltanum_snapshot, "delta: snapshot deltaNum");
+	assert_equal(1, saved, "delta: snapshot saved");
+
+	/* incomplete delta: neither deltaNum nor group removal is applied */
+	assert_equal(FALSE,
+		     test_notify(sipe_private, partial),
+		     "partial delta: not parsed");
+	g_free(partial);
+	assert_model("1:Other Contacts 2:Friends 3:Office ",
+		     "sip:a@test.com:1,3(Al) sip:b@test.com:3(Bob) sip:c@test.com:2(-) sip:d@test.com:3(Dave) ",
+		     "partial delta");
+	assert_equal(3, sipe_private->deltanum_contacts, "partial delta: deltaNum");
+	assert_equal(3, sipe_private->deltanum_snapshot, "partial delta: snapshot deltaNum");
+	assert_equal(0, saved, "partial delta: no snapshot");
+
+	/* invalid delta: nothing changes */
+	assert_equal(FALSE,
+		     test_notify(sipe_private,
+				 CONTACT_DELTA("5",
+					       "<deletedGroup id=\"3\">"
+					       "</addedGroup>")),
+		     "invalid delta: not parsed");
+	assert_model("1:Other Contacts 2:Friends 3:Office ",
+		     "sip:a@test.com:1,3(Al) sip:b@test.com:3(Bob) sip:c@test.com:2(-) sip:d@test.com:3(Dave) ",
+		     "invalid delta");
+	assert_equal(3, sipe_private->deltanum_contacts, "invalid delta: deltaNum");
+	assert_equal(0, saved, "invalid delta: no snapshot");
+
+	/* same delta sent again */
+	assert_equal(TRUE, test_notify(sipe_private, delta), "repeated delta: parsed");
+	assert_model("1:Other Contacts 3:Office ",
+		     "sip:a@test.com:1,3(Al) sip:b@test.com:3(Bob) sip:d@test.com:3(Dave) ",
+		     "repeated delta");
+	assert_equal(4, sipe_private->deltanum_contacts, "repeated delta: deltaNum");
+	assert_equal(4, sipe_private->deltanum_snapshot, "repeated delta: snapshot deltaNum");
+}
+
+int main(SIPE_UNUSED_PARAMETER int argc,
+	 SIPE_UNUSED_PARAMETER char *argv[])
+{
+	struct sipe_core_private *sipe_private = g_new0(struct sipe_core_private, 1);
+
+	/* Initialization for crypto backend (test mode) */
+	sipe_crypto_init(FALSE);
+
+	buddies = g_hash_table_new_full(g_str_hash, g_str_equal,
+					NULL, model_buddy_free);
+	SIPE_CORE_PRIVATE_FLAG_SET(OCS2007);
+
+	tests_contact_list(sipe_private);
+	tests_contact_delta(sipe_private);
+
+	g_hash_table_destroy(buddies);
+	g_slist_free_full(groups, model_group_free);
+	g_free(sipe_private);
+
+	printf("Result: %d PASSED %d FAILED\n", succeeded, failed);
+	return(failed);
+}
+
+/*
+  Local Variables:
+  mode: c
+  c-file-style: "bsd"
+  indent-tabs-mode: t
+  tab-width: 8
+  End:
+*/
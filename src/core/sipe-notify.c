@@ -40,6 +40,7 @@
 #include "sipe-backend.h"
 #include "sipe-buddy.h"
 #include "sipe-cal.h"
+#include "sipe-common.h"
 #include "sipe-conf.h"
 #include "sipe-core.h"
 #include "sipe-core-private.h"
@@ -51,6 +52,7 @@
 #include "sipe-notify.h"
 #include "sipe-ocs2005.h"
 #include "sipe-ocs2007.h"
+#include "sipe-snapshot.h"
 #include "sipe-status.h"
 #include "sipe-subscriptions.h"
 #include "sipe-ucs.h"
@@ -430,7 +432,7 @@ static void process_incoming_notify_msrtc(struct sipe_core_private *sipe_private
 	}
 
 	if (xn_display_name || xn_contact)
-		sipe_backend_buddy_refresh_properties(SIPE_CORE_PUBLIC, uri);
+		sipe_buddy_refresh_properties(sipe_private, uri);
 
 	/* devicePresence */
 	for (node = sipe_xml_child(xn_presentity, "devices/devicePresence"); node; node = sipe_xml_twin(node)) {
@@ -547,7 +549,7 @@ static void process_incoming_notify_msrtc(struct sipe_core_private *sipe_private
 			sbuddy->cal_free_busy_base64 = cal_free_busy_base64;
 			cal_free_busy_base64 = NULL;
 
-			g_free(sbuddy->cal_free_busy);
+			sipe_cal_free_free_busy(sbuddy->cal_free_busy);
 			sbuddy->cal_free_busy = NULL;
 		}
 
@@ -577,10 +579,10 @@ static void process_incoming_notify_msrtc(struct sipe_core_private *sipe_private
 	g_free(activity);
 
 	SIPE_DEBUG_INFO("process_incoming_notify_msrtc: status(%s)", status_id);
-	sipe_core_buddy_got_status(SIPE_CORE_PUBLIC,
-				   uri,
-				   sipe_status_token_to_activity(status_id),
-				   0);
+	sipe_buddy_got_status(sipe_private,
+			      uri,
+			      sipe_status_token_to_activity(status_id),
+			      0);
 
 	if (!SIPE_CORE_PRIVATE_FLAG_IS(OCS2007) && sipe_strcase_equal(self_uri, uri)) {
 		sipe_ocs2005_user_info_has_updated(sipe_private, xn_userinfo);
@@ -592,380 +594,584 @@ static void process_incoming_notify_msrtc(struct sipe_core_private *sipe_private
 	g_free(self_uri);
 }
 
-static void process_incoming_notify_rlmi(struct sipe_core_private *sipe_private,
-					 const gchar *data,
-					 unsigned len)
+/* contactCard category of rlmi presence document */
+static void process_incoming_notify_rlmi_card(struct sipe_core_private *sipe_private,
+					      const gchar *uri,
+					      const sipe_xml *card)
 {
-	const char *uri;
-	struct sipe_buddy *sbuddy = NULL;
-	sipe_xml *xn_categories;
-	const sipe_xml *xn_category;
-	const char *status = NULL;
-	gboolean do_update_status = FALSE;
-	gboolean has_note_cleaned = FALSE;
-	gboolean has_free_busy_cleaned = FALSE;
-	time_t last_active = 0;
-
-	xn_categories = sipe_xml_parse(data, len);
-	uri = sipe_xml_attribute(xn_categories, "uri"); /* with 'sip:' prefix */
-	if (uri) {
-		sbuddy = sipe_buddy_find_by_uri(sipe_private, uri);
-	}
-
-	if (!sbuddy) {
-		/* Got presence of a buddy not in our contact list, ignore. */
-		sipe_xml_free(xn_categories);
-		return;
-	}
+	const sipe_xml *node;
+	/* identity - Display Name and email */
+	node = sipe_xml_child(card, "identity");
+	if (node) {
+		char* display_name = sipe_xml_data(
+			sipe_xml_child(node, "name/displayName"));
+		char* email = sipe_xml_data(
+			sipe_xml_child(node, "email"));
+
+		sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_DISPLAY_NAME, display_name);
+		sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_EMAIL, email);
 
-	for (xn_category = sipe_xml_child(xn_categories, "category");
-		 xn_category ;
-		 xn_category = sipe_xml_twin(xn_category) )
+		g_free(display_name);
+		g_free(email);
+	}
+	/* company */
+	node = sipe_xml_child(card, "company");
+	if (node) {
+		char* company = sipe_xml_data(node);
+		sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_COMPANY, company);
+		g_free(company);
+	}
+	/* department */
+	node = sipe_xml_child(card, "department");
+	if (node) {
+		char* department = sipe_xml_data(node);
+		sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_DEPARTMENT, department);
+		g_free(department);
+	}
+	/* title */
+	node = sipe_xml_child(card, "title");
+	if (node) {
+		char* title = sipe_xml_data(node);
+		sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_JOB_TITLE, title);
+		g_free(title);
+	}
+	/* office */
+	node = sipe_xml_child(card, "office");
+	if (node) {
+		char* office = sipe_xml_data(node);
+		sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_OFFICE, office);
+		g_free(office);
+	}
+	/* site (url) */
+	node = sipe_xml_child(card, "url");
+	if (node) {
+		char* site = sipe_xml_data(node);
+		sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_SITE, site);
+		g_free(site);
+	}
+	/* phone */
+	for (node = sipe_xml_child(card, "phone");
+	     node;
+	     node = sipe_xml_twin(node))
 	{
-		const sipe_xml *xn_node;
-		const char *tmp;
-		const char *attrVar = sipe_xml_attribute(xn_category, "name");
-		time_t publish_time = (tmp = sipe_xml_attribute(xn_category, "publishTime")) ?
-			sipe_utils_str_to_time(tmp) : 0;
-
-		/* contactCard */
-		if (sipe_strequal(attrVar, "contactCard"))
-		{
-			const sipe_xml *card = sipe_xml_child(xn_category, "contactCard");
-
-			if (card) {
-				const sipe_xml *node;
-				/* identity - Display Name and email */
-				node = sipe_xml_child(card, "identity");
-				if (node) {
-					char* display_name = sipe_xml_data(
-						sipe_xml_child(node, "name/displayName"));
-					char* email = sipe_xml_data(
-						sipe_xml_child(node, "email"));
-
-					sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_DISPLAY_NAME, display_name);
-					sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_EMAIL, email);
-
-					g_free(display_name);
-					g_free(email);
-				}
-				/* company */
-				node = sipe_xml_child(card, "company");
-				if (node) {
-					char* company = sipe_xml_data(node);
-					sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_COMPANY, company);
-					g_free(company);
-				}
-				/* department */
-				node = sipe_xml_child(card, "department");
-				if (node) {
-					char* department = sipe_xml_data(node);
-					sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_DEPARTMENT, department);
-					g_free(department);
-				}
-				/* title */
-				node = sipe_xml_child(card, "title");
-				if (node) {
-					char* title = sipe_xml_data(node);
-					sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_JOB_TITLE, title);
-					g_free(title);
-				}
-				/* office */
-				node = sipe_xml_child(card, "office");
-				if (node) {
-					char* office = sipe_xml_data(node);
-					sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_OFFICE, office);
-					g_free(office);
-				}
-				/* site (url) */
-				node = sipe_xml_child(card, "url");
-				if (node) {
-					char* site = sipe_xml_data(node);
-					sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_SITE, site);
-					g_free(site);
-				}
-				/* phone */
-				for (node = sipe_xml_child(card, "phone");
-				     node;
-				     node = sipe_xml_twin(node))
-				{
-					const char *phone_type = sipe_xml_attribute(node, "type");
-					char* phone = sipe_xml_data(sipe_xml_child(node, "uri"));
-					char* phone_display_string = sipe_xml_data(sipe_xml_child(node, "displayString"));
-
-					sipe_update_user_phone(sipe_private, uri, phone_type, phone, phone_display_string);
-
-					g_free(phone);
-					g_free(phone_display_string);
-				}
-				/* address */
-				for (node = sipe_xml_child(card, "address");
-				     node;
-				     node = sipe_xml_twin(node))
-				{
-					if (sipe_strequal(sipe_xml_attribute(node, "type"), "work")) {
-						char* street = sipe_xml_data(sipe_xml_child(node, "street"));
-						char* city = sipe_xml_data(sipe_xml_child(node, "city"));
-						char* state = sipe_xml_data(sipe_xml_child(node, "state"));
-						char* zipcode = sipe_xml_data(sipe_xml_child(node, "zipcode"));
-						char* country_code = sipe_xml_data(sipe_xml_child(node, "countryCode"));
-
-						sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_STREET, street);
-						sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_CITY, city);
-						sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_STATE, state);
-						sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_ZIPCODE, zipcode);
-						sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_COUNTRY, country_code);
-
-						g_free(street);
-						g_free(city);
-						g_free(state);
-						g_free(zipcode);
-						g_free(country_code);
-
-						break;
-					}
-				}
-				/* photo */
-				for (node = sipe_xml_child(card, "photo");
-				     node;
-				     node = sipe_xml_twin(node)) {
-					const gchar *type = sipe_xml_attribute(node, "type");
-					gchar *photo_url;
-					gchar *hash;
-					gboolean found = FALSE;
-
-					if (sipe_strequal(type, "default") &&
-					    !SIPE_CORE_PUBLIC_FLAG_IS(ALLOW_WEB_PHOTO)) {
-						SIPE_DEBUG_INFO("process_incoming_notify_rlmi: skipping download of web profile picture for %s", uri);
-						continue;
-					}
+		const char *phone_type = sipe_xml_attribute(node, "type");
+		char* phone = sipe_xml_data(sipe_xml_child(node, "uri"));
+		char* phone_display_string = sipe_xml_data(sipe_xml_child(node, "displayString"));
 
-					photo_url = sipe_xml_data(sipe_xml_child(node, "uri"));
-					hash = sipe_xml_data(sipe_xml_child(node, "hash"));
+		sipe_update_user_phone(sipe_private, uri, phone_type, phone, phone_display_string);
 
-					if (!is_empty(photo_url) && !is_empty(hash)) {
-						sipe_buddy_update_photo(sipe_private,
-									uri,
-									hash,
-									photo_url,
-									NULL);
-						found = TRUE;
-					}
+		g_free(phone);
+		g_free(phone_display_string);
+	}
+	/* address */
+	for (node = sipe_xml_child(card, "address");
+	     node;
+	     node = sipe_xml_twin(node))
+	{
+		if (sipe_strequal(sipe_xml_attribute(node, "type"), "work")) {
+			char* street = sipe_xml_data(sipe_xml_child(node, "street"));
+			char* city = sipe_xml_data(sipe_xml_child(node, "city"));
+			char* state = sipe_xml_data(sipe_xml_child(node, "state"));
+			char* zipcode = sipe_xml_data(sipe_xml_child(node, "zipcode"));
+			char* country_code = sipe_xml_data(sipe_xml_child(node, "countryCode"));
+
+			sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_STREET, street);
+			sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_CITY, city);
+			sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_STATE, state);
+			sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_ZIPCODE, zipcode);
+			sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_COUNTRY, country_code);
+
+			g_free(street);
+			g_free(city);
+			g_free(state);
+			g_free(zipcode);
+			g_free(country_code);
 
-					g_free(hash);
-					g_free(photo_url);
+			break;
+		}
+	}
+	/* photo */
+	for (node = sipe_xml_child(card, "photo");
+	     node;
+	     node = sipe_xml_twin(node)) {
+		const gchar *type = sipe_xml_attribute(node, "type");
+		gchar *photo_url;
+		gchar *hash;
+		gboolean found = FALSE;
+
+		if (sipe_strequal(type, "default") &&
+		    !SIPE_CORE_PUBLIC_FLAG_IS(ALLOW_WEB_PHOTO)) {
+			SIPE_DEBUG_INFO("process_incoming_notify_rlmi: skipping download of web profile picture for %s", uri);
+			continue;
+		}
 
-					if (found)
-						break;
-				}
-			}
+		photo_url = sipe_xml_data(sipe_xml_child(node, "uri"));
+		hash = sipe_xml_data(sipe_xml_child(node, "hash"));
+
+		if (!is_empty(photo_url) && !is_empty(hash)) {
+			sipe_buddy_update_photo(sipe_private,
+						uri,
+						hash,
+						photo_url,
+						NULL);
+			found = TRUE;
 		}
-		/* note */
-		else if (sipe_strequal(attrVar, "note"))
-		{
-			if (!has_note_cleaned) {
-				has_note_cleaned = TRUE;
 
-				g_free(sbuddy->note);
-				sbuddy->note = NULL;
-				sbuddy->is_oof_note = FALSE;
-				sbuddy->note_since = publish_time;
+		g_free(hash);
+		g_free(photo_url);
 
-				do_update_status = TRUE;
-			}
-			if (publish_time >= sbuddy->note_since) {
-				/* clean up in case no 'note' element is supplied
-				 * which indicate note removal in client
-				 */
-				g_free(sbuddy->note);
-				sbuddy->note = NULL;
-				sbuddy->is_oof_note = FALSE;
-				sbuddy->note_since = publish_time;
-
-				xn_node = sipe_xml_child(xn_category, "note/body");
-				if (xn_node) {
-					char *tmp;
-					sbuddy->note = g_markup_escape_text((tmp = sipe_xml_data(xn_node)), -1);
-					g_free(tmp);
-					sbuddy->is_oof_note = sipe_strequal(sipe_xml_attribute(xn_node, "type"), "OOF");
-					sbuddy->note_since = publish_time;
-
-					SIPE_DEBUG_INFO("process_incoming_notify_rlmi: uri(%s), note(%s)",
-							uri, sbuddy->note ? sbuddy->note : "");
-				}
-				/* to trigger UI refresh in case no status info is supplied in this update */
-				do_update_status = TRUE;
-			}
+		if (found)
+			break;
+	}
+}
+
+/* rlmi presence document is processed by the streaming XML parser */
+enum rlmi_category {
+	RLMI_CATEGORY_OTHER,
+	RLMI_CATEGORY_CONTACT_CARD,
+	RLMI_CATEGORY_NOTE,
+	RLMI_CATEGORY_STATE,
+	RLMI_CATEGORY_CALENDAR_DATA,
+};
+
+struct rlmi_context {
+	struct sipe_core_private *sipe_private;
+	struct sipe_buddy *sbuddy;
+	gchar *uri;
+	const gchar *status;
+	time_t last_active;
+	gboolean do_update_status;
+	gboolean has_note_cleaned;
+	gboolean has_free_busy_cleaned;
+
+	/* current category */
+	enum rlmi_category category;
+	time_t publish_time;
+	gboolean note_update;
+	gboolean note_body;
+
+	/* state: only first instance of each element is used */
+	gboolean state;
+	gchar *availability;
+	gchar *device;
+	guint activity;         /* number of activity elements */
+	gchar *activity_token;
+	gchar *activity_custom;
+	gchar *meeting_subject;
+	gchar *meeting_location;
+	gchar *state_last_active;
+};
+
+static void rlmi_state_clear(struct rlmi_context *context)
+{
+	g_free(context->availability);
+	g_free(context->device);
+	g_free(context->activity_token);
+	g_free(context->activity_custom);
+	g_free(context->meeting_subject);
+	g_free(context->meeting_location);
+	g_free(context->state_last_active);
+	context->availability      = NULL;
+	context->device            = NULL;
+	context->activity          = 0;
+	context->activity_token    = NULL;
+	context->activity_custom   = NULL;
+	context->meeting_subject   = NULL;
+	context->meeting_location  = NULL;
+	context->state_last_active = NULL;
+}
+
+/* keep text of first element instance */
+static void rlmi_text(gchar **store, const gchar *text)
+{
+	if (!*store)
+		*store = g_strdup(text);
+}
+
+/* move text to buddy field, empty text clears field */
+static void rlmi_text_to_field(gchar **field, gchar **text)
+{
+	g_free(*field);
+	*field = NULL;
+	if (!is_empty(*text)) {
+		*field = *text;
+		*text  = NULL;
+	}
+}
+
+static void rlmi_categories(sipe_xml_stream *stream,
+			    const gchar **attributes,
+			    gpointer user_data)
+{
+	struct rlmi_context *context = user_data;
+	const gchar *uri = sipe_xml_stream_attribute(attributes, "uri"); /* with 'sip:' prefix */
+
+	if (uri)
+		context->sbuddy = sipe_buddy_find_by_uri(context->sipe_private,
+							 uri);
+
+	if (context->sbuddy) {
+		context->uri = g_strdup(uri);
+	} else {
+		/* Got presence of a buddy not in our contact list, ignore. */
+		sipe_xml_stream_stop(stream);
+	}
+}
+
+static void rlmi_category(SIPE_UNUSED_PARAMETER sipe_xml_stream *stream,
+			  const gchar **attributes,
+			  gpointer user_data)
+{
+	struct rlmi_context *context = user_data;
+	struct sipe_buddy *sbuddy = context->sbuddy;
+	const gchar *attrVar = sipe_xml_stream_attribute(attributes, "name");
+	const gchar *tmp = sipe_xml_stream_attribute(attributes, "publishTime");
+
+	context->publish_time = tmp ? sipe_utils_str_to_time(tmp) : 0;
+	context->note_update  = FALSE;
+	context->note_body    = FALSE;
+	context->state        = FALSE;
+
+	if (sipe_strequal(attrVar, "contactCard")) {
+		context->category = RLMI_CATEGORY_CONTACT_CARD;
+	} else if (sipe_strequal(attrVar, "note")) {
+		context->category = RLMI_CATEGORY_NOTE;
+
+		if (!context->has_note_cleaned) {
+			context->has_note_cleaned = TRUE;
+
+			g_free(sbuddy->note);
+			sbuddy->note = NULL;
+			sbuddy->is_oof_note = FALSE;
+			sbuddy->note_since = context->publish_time;
+
+			context->do_update_status = TRUE;
 		}
-		/* state */
-		else if(sipe_strequal(attrVar, "state"))
-		{
-			char *tmp;
-			int availability;
-			const sipe_xml *xn_availability;
-			const sipe_xml *xn_activity;
-			const sipe_xml *xn_device;
-			const sipe_xml *xn_meeting_subject;
-			const sipe_xml *xn_meeting_location;
-			const gchar *legacy_activity;
-			const gchar *last_active_attr;
-
-			xn_node = sipe_xml_child(xn_category, "state");
-			if (!xn_node) continue;
-			xn_availability = sipe_xml_child(xn_node, "availability");
-			if (!xn_availability) continue;
-			xn_activity = sipe_xml_child(xn_node, "activity");
-			xn_meeting_subject = sipe_xml_child(xn_node, "meetingSubject");
-			xn_meeting_location = sipe_xml_child(xn_node, "meetingLocation");
-
-			tmp = sipe_xml_data(xn_availability);
-			availability = atoi(tmp);
-			g_free(tmp);
-
-			sbuddy->is_mobile = FALSE;
-			xn_device = sipe_xml_child(xn_node, "device");
-			if (xn_device) {
-				tmp = sipe_xml_data(xn_device);
-				sbuddy->is_mobile = !g_ascii_strcasecmp(tmp, "Mobile");
-				g_free(tmp);
-			}
+		if (context->publish_time >= sbuddy->note_since) {
+			/* clean up in case no 'note' element is supplied
+			 * which indicate note removal in client
+			 */
+			g_free(sbuddy->note);
+			sbuddy->note = NULL;
+			sbuddy->is_oof_note = FALSE;
+			sbuddy->note_since = context->publish_time;
+
+			/* to trigger UI refresh in case no status info is supplied in this update */
+			context->do_update_status = TRUE;
+			context->note_update = TRUE;
+		}
+	} else if (sipe_strequal(attrVar, "state")) {
+		context->category = RLMI_CATEGORY_STATE;
+	} else if (sipe_strequal(attrVar, "calendarData")) {
+		context->category = RLMI_CATEGORY_CALENDAR_DATA;
+	} else {
+		context->category = RLMI_CATEGORY_OTHER;
+	}
+}
 
-			/* activity */
-			g_free(sbuddy->activity);
-			sbuddy->activity = NULL;
-			if (xn_activity) {
-				const char *token = sipe_xml_attribute(xn_activity, "token");
-				const sipe_xml *xn_custom = sipe_xml_child(xn_activity, "custom");
-
-				/* from token */
-				if (!is_empty(token)) {
-					sbuddy->activity = g_strdup(sipe_core_activity_description(sipe_status_token_to_activity(token)));
-				}
-				/* from custom element */
-				if (xn_custom) {
-					char *custom = sipe_xml_data(xn_custom);
-
-					if (!is_empty(custom)) {
-						g_free(sbuddy->activity);
-						sbuddy->activity = custom;
-						custom = NULL;
-					}
-					g_free(custom);
-				}
-			}
-			/* meeting_subject */
-			g_free(sbuddy->meeting_subject);
-			sbuddy->meeting_subject = NULL;
-			if (xn_meeting_subject) {
-				char *meeting_subject = sipe_xml_data(xn_meeting_subject);
-
-				if (!is_empty(meeting_subject)) {
-					sbuddy->meeting_subject = meeting_subject;
-					meeting_subject = NULL;
-				}
-				g_free(meeting_subject);
-			}
-			/* meeting_location */
-			g_free(sbuddy->meeting_location);
-			sbuddy->meeting_location = NULL;
-			if (xn_meeting_location) {
-				char *meeting_location = sipe_xml_data(xn_meeting_location);
-
-				if (!is_empty(meeting_location)) {
-					sbuddy->meeting_location = meeting_location;
-					meeting_location = NULL;
-				}
-				g_free(meeting_location);
-			}
+static void rlmi_contact_card(SIPE_UNUSED_PARAMETER sipe_xml_stream *stream,
+			      const sipe_xml *card,
+			      gpointer user_data)
+{
+	struct rlmi_context *context = user_data;
 
-			status = sipe_ocs2007_status_from_legacy_availability(availability, NULL);
-			legacy_activity = sipe_ocs2007_legacy_activity_description(availability);
-			if (sbuddy->activity && legacy_activity) {
-				gchar *tmp2 = sbuddy->activity;
+	if (context->category == RLMI_CATEGORY_CONTACT_CARD)
+		process_incoming_notify_rlmi_card(context->sipe_private,
+						  context->uri,
+						  card);
 
-				sbuddy->activity = g_strdup_printf("%s, %s", sbuddy->activity, legacy_activity);
-				g_free(tmp2);
-			} else if (legacy_activity) {
-				sbuddy->activity = g_strdup(legacy_activity);
-			}
+	/* only first contactCard element */
+	context->category = RLMI_CATEGORY_OTHER;
+}
 
-			/* lastActive */
-			last_active_attr = sipe_xml_attribute(xn_node, "lastActive");
-			if (last_active_attr) {
-				last_active = sipe_utils_str_to_time(last_active_attr);
-			}
+static void rlmi_note_body_start(SIPE_UNUSED_PARAMETER sipe_xml_stream *stream,
+				 const gchar **attributes,
+				 gpointer user_data)
+{
+	struct rlmi_context *context = user_data;
+
+	if (context->note_update && !context->note_body)
+		context->sbuddy->is_oof_note = sipe_strequal(sipe_xml_stream_attribute(attributes,
+											"type"),
+							     "OOF");
+}
+
+static void rlmi_note_body_end(SIPE_UNUSED_PARAMETER sipe_xml_stream *stream,
+			       const gchar *text,
+			       gsize length,
+			       gpointer user_data)
+{
+	struct rlmi_context *context = user_data;
+	struct sipe_buddy *sbuddy = context->sbuddy;
+
+	if (context->note_update && !context->note_body) {
+		context->note_body = TRUE;
+
+		sbuddy->note = length ? g_markup_escape_text(text, length) : NULL;
+		sbuddy->note_since = context->publish_time;
+
+		SIPE_DEBUG_INFO("process_incoming_notify_rlmi: uri(%s), note(%s)",
+				context->uri, sbuddy->note ? sbuddy->note : "");
+	}
+}
+
+static void rlmi_state_start(SIPE_UNUSED_PARAMETER sipe_xml_stream *stream,
+			     const gchar **attributes,
+			     gpointer user_data)
+{
+	struct rlmi_context *context = user_data;
+
+	/* only first state element */
+	context->state = (context->category == RLMI_CATEGORY_STATE);
+	rlmi_state_clear(context);
+	if (context->state)
+		context->state_last_active = g_strdup(sipe_xml_stream_attribute(attributes,
+										 "lastActive"));
+}
+
+static void rlmi_state_end(SIPE_UNUSED_PARAMETER sipe_xml_stream *stream,
+			   SIPE_UNUSED_PARAMETER const gchar *text,
+			   SIPE_UNUSED_PARAMETER gsize length,
+			   gpointer user_data)
+{
+	struct rlmi_context *context = user_data;
+	struct sipe_buddy *sbuddy = context->sbuddy;
+	const gchar *legacy_activity;
+	int availability;
 
-			do_update_status = TRUE;
+	if (!context->state)
+		return;
+
+	/* only first state element */
+	context->state    = FALSE;
+	context->category = RLMI_CATEGORY_OTHER;
+
+	if (!context->availability) {
+		rlmi_state_clear(context);
+		return;
+	}
+
+	availability = atoi(context->availability);
+
+	sbuddy->is_mobile = context->device &&
+		!g_ascii_strcasecmp(context->device, "Mobile");
+
+	/* activity */
+	g_free(sbuddy->activity);
+	sbuddy->activity = NULL;
+	if (context->activity) {
+		/* from token */
+		if (!is_empty(context->activity_token)) {
+			sbuddy->activity = g_strdup(sipe_core_activity_description(sipe_status_token_to_activity(context->activity_token)));
 		}
-		/* calendarData */
-		else if(sipe_strequal(attrVar, "calendarData"))
-		{
-			const sipe_xml *xn_free_busy = sipe_xml_child(xn_category, "calendarData/freeBusy");
-			const sipe_xml *xn_working_hours = sipe_xml_child(xn_category, "calendarData/WorkingHours");
+		/* from custom element */
+		if (!is_empty(context->activity_custom)) {
+			g_free(sbuddy->activity);
+			sbuddy->activity = context->activity_custom;
+			context->activity_custom = NULL;
+		}
+	}
+	/* meeting_subject */
+	rlmi_text_to_field(&sbuddy->meeting_subject,
+			   &context->meeting_subject);
+	/* meeting_location */
+	rlmi_text_to_field(&sbuddy->meeting_location,
+			   &context->meeting_location);
+
+	context->status = sipe_ocs2007_status_from_legacy_availability(availability, NULL);
+	legacy_activity = sipe_ocs2007_legacy_activity_description(availability);
+	if (sbuddy->activity && legacy_activity) {
+		gchar *tmp2 = sbuddy->activity;
+
+		sbuddy->activity = g_strdup_printf("%s, %s", sbuddy->activity, legacy_activity);
+		g_free(tmp2);
+	} else if (legacy_activity) {
+		sbuddy->activity = g_strdup(legacy_activity);
+	}
 
-			if (xn_free_busy) {
-				if (!has_free_busy_cleaned) {
-					has_free_busy_cleaned = TRUE;
+	/* lastActive */
+	if (context->state_last_active) {
+		context->last_active = sipe_utils_str_to_time(context->state_last_active);
+	}
 
-					g_free(sbuddy->cal_start_time);
-					sbuddy->cal_start_time = NULL;
+	context->do_update_status = TRUE;
+	rlmi_state_clear(context);
+}
 
-					g_free(sbuddy->cal_free_busy_base64);
-					sbuddy->cal_free_busy_base64 = NULL;
+static void rlmi_availability(SIPE_UNUSED_PARAMETER sipe_xml_stream *stream,
+			      const gchar *text,
+			      SIPE_UNUSED_PARAMETER gsize length,
+			      gpointer user_data)
+{
+	struct rlmi_context *context = user_data;
+	if (context->state)
+		rlmi_text(&context->availability, text);
+}
 
-					g_free(sbuddy->cal_free_busy);
-					sbuddy->cal_free_busy = NULL;
+static void rlmi_device(SIPE_UNUSED_PARAMETER sipe_xml_stream *stream,
+			const gchar *text,
+			SIPE_UNUSED_PARAMETER gsize length,
+			gpointer user_data)
+{
+	struct rlmi_context *context = user_data;
+	if (context->state)
+		rlmi_text(&context->device, text);
+}
 
-					sbuddy->cal_free_busy_published = publish_time;
-				}
+static void rlmi_activity(SIPE_UNUSED_PARAMETER sipe_xml_stream *stream,
+			  const gchar **attributes,
+			  gpointer user_data)
+{
+	struct rlmi_context *context = user_data;
+	if (context->state && (++context->activity == 1)) {
+		context->activity_token = g_strdup(sipe_xml_stream_attribute(attributes,
+									     "token"));
+	}
+}
 
-				if (publish_time >= sbuddy->cal_free_busy_published) {
-					g_free(sbuddy->cal_start_time);
-					sbuddy->cal_start_time = g_strdup(sipe_xml_attribute(xn_free_busy, "startTime"));
+static void rlmi_activity_custom(SIPE_UNUSED_PARAMETER sipe_xml_stream *stream,
+				 const gchar *text,
+				 SIPE_UNUSED_PARAMETER gsize length,
+				 gpointer user_data)
+{
+	struct rlmi_context *context = user_data;
+	/* only in first activity element */
+	if (context->state && (context->activity == 1))
+		rlmi_text(&context->activity_custom, text);
+}
 
-					sbuddy->cal_granularity = sipe_strcase_equal(sipe_xml_attribute(xn_free_busy, "granularity"), "PT15M") ?
-						15 : 0;
+static void rlmi_meeting_subject(SIPE_UNUSED_PARAMETER sipe_xml_stream *stream,
+				 const gchar *text,
+				 SIPE_UNUSED_PARAMETER gsize length,
+				 gpointer user_data)
+{
+	struct rlmi_context *context = user_data;
+	if (context->state)
+		rlmi_text(&context->meeting_subject, text);
+}
 
-					g_free(sbuddy->cal_free_busy_base64);
-					sbuddy->cal_free_busy_base64 = sipe_xml_data(xn_free_busy);
+static void rlmi_meeting_location(SIPE_UNUSED_PARAMETER sipe_xml_stream *stream,
+				  const gchar *text,
+				  SIPE_UNUSED_PARAMETER gsize length,
+				  gpointer user_data)
+{
+	struct rlmi_context *context = user_data;
+	if (context->state)
+		rlmi_text(&context->meeting_location, text);
+}
 
-					g_free(sbuddy->cal_free_busy);
-					sbuddy->cal_free_busy = NULL;
+static void rlmi_calendar_data(SIPE_UNUSED_PARAMETER sipe_xml_stream *stream,
+			       const sipe_xml *xn_calendar_data,
+			       gpointer user_data)
+{
+	struct rlmi_context *context = user_data;
+	struct sipe_buddy *sbuddy = context->sbuddy;
+	time_t publish_time = context->publish_time;
+	const sipe_xml *xn_free_busy;
+	const sipe_xml *xn_working_hours;
 
-					sbuddy->cal_free_busy_published = publish_time;
+	if (context->category != RLMI_CATEGORY_CALENDAR_DATA)
+		return;
+	/* only first calendarData element */
+	context->category = RLMI_CATEGORY_OTHER;
 
-					SIPE_DEBUG_INFO("process_incoming_notify_rlmi: startTime=%s granularity=%d cal_free_busy_base64=\n%s", sbuddy->cal_start_time, sbuddy->cal_granularity, sbuddy->cal_free_busy_base64);
-				}
-			}
+	xn_free_busy = sipe_xml_child(xn_calendar_data, "freeBusy");
+	xn_working_hours = sipe_xml_child(xn_calendar_data, "WorkingHours");
 
-			if (xn_working_hours) {
-				sipe_cal_parse_working_hours(xn_working_hours, sbuddy);
-			}
+	if (xn_free_busy) {
+		if (!context->has_free_busy_cleaned) {
+			context->has_free_busy_cleaned = TRUE;
+
+			g_free(sbuddy->cal_start_time);
+			sbuddy->cal_start_time = NULL;
+
+			g_free(sbuddy->cal_free_busy_base64);
+			sbuddy->cal_free_busy_base64 = NULL;
+
+			sipe_cal_free_free_busy(sbuddy->cal_free_busy);
+			sbuddy->cal_free_busy = NULL;
+
+			sbuddy->cal_free_busy_published = publish_time;
+		}
+
+		if (publish_time >= sbuddy->cal_free_busy_published) {
+			g_free(sbuddy->cal_start_time);
+			sbuddy->cal_start_time = g_strdup(sipe_xml_attribute(xn_free_busy, "startTime"));
+
+			sbuddy->cal_granularity = sipe_strcase_equal(sipe_xml_attribute(xn_free_busy, "granularity"), "PT15M") ?
+				15 : 0;
+
+			g_free(sbuddy->cal_free_busy_base64);
+			sbuddy->cal_free_busy_base64 = sipe_xml_data(xn_free_busy);
+
+			sipe_cal_free_free_busy(sbuddy->cal_free_busy);
+			sbuddy->cal_free_busy = NULL;
+
+			sbuddy->cal_free_busy_published = publish_time;
+
+			SIPE_DEBUG_INFO("process_incoming_notify_rlmi: startTime=%s granularity=%d cal_free_busy_base64=\n%s", sbuddy->cal_start_time, sbuddy->cal_granularity, sbuddy->cal_free_busy_base64);
 		}
 	}
 
-	if (do_update_status) {
+	if (xn_working_hours) {
+		sipe_cal_parse_working_hours(xn_working_hours, sbuddy);
+	}
+}
+
+static const struct sipe_xml_stream_handler rlmi_handlers[] = {
+	{ "categories",                                   rlmi_categories,      NULL,                  NULL               },
+	{ "categories/category",                          rlmi_category,        NULL,                  NULL               },
+	{ "categories/category/contactCard",              NULL,                 NULL,                  rlmi_contact_card  },
+	{ "categories/category/note/body",                rlmi_note_body_start, rlmi_note_body_end,    NULL               },
+	{ "categories/category/state",                    rlmi_state_start,     rlmi_state_end,        NULL               },
+	{ "categories/category/state/availability",       NULL,                 rlmi_availability,     NULL               },
+	{ "categories/category/state/device",             NULL,                 rlmi_device,           NULL               },
+	{ "categories/category/state/activity",           rlmi_activity,        NULL,                  NULL               },
+	{ "categories/category/state/activity/custom",    NULL,                 rlmi_activity_custom,  NULL               },
+	{ "categories/category/state/meetingSubject",     NULL,                 rlmi_meeting_subject,  NULL               },
+	{ "categories/category/state/meetingLocation",    NULL,                 rlmi_meeting_location, NULL               },
+	{ "categories/category/calendarData",             NULL,                 NULL,                  rlmi_calendar_data },
+	{ NULL,                                           NULL,                 NULL,                  NULL               }
+};
+
+static void process_incoming_notify_rlmi(struct sipe_core_private *sipe_private,
+					 const gchar *data,
+					 unsigned len)
+{
+	struct rlmi_context context;
+
+	memset(&context, 0, sizeof(context));
+	context.sipe_private = sipe_private;
+
+	sipe_xml_stream_parse(data, len, rlmi_handlers, &context);
+	rlmi_state_clear(&context);
+
+	/* Got presence of a buddy not in our contact list, ignore. */
+	if (!context.sbuddy)
+		return;
+
+	if (context.do_update_status) {
 		guint activity;
 
-		if (status) {
-			SIPE_DEBUG_INFO("process_incoming_notify_rlmi: %s", status);
-			activity = sipe_status_token_to_activity(status);
+		if (context.status) {
+			SIPE_DEBUG_INFO("process_incoming_notify_rlmi: %s", context.status);
+			activity = sipe_status_token_to_activity(context.status);
 		} else {
 			/* no status category in this update,
 			   using contact's current status */
-			activity = sipe_backend_buddy_get_status(SIPE_CORE_PUBLIC,
-								 uri);
+			activity = sipe_buddy_get_status(sipe_private,
+							 context.uri);
 		}
 
-		sipe_core_buddy_got_status(SIPE_CORE_PUBLIC,
-					   uri,
-					   activity,
-					   last_active);
+		sipe_buddy_got_status(sipe_private,
+				      context.uri,
+				      activity,
+				      context.last_active);
 	}
 
-	sipe_backend_buddy_refresh_properties(SIPE_CORE_PUBLIC, uri);
+	sipe_buddy_refresh_properties(sipe_private, context.uri);
 
-	sipe_xml_free(xn_categories);
+	g_free(context.uri);
 }
 
 static void sipe_buddy_status_from_activity(struct sipe_core_private *sipe_private,
@@ -990,15 +1196,15 @@ static void sipe_buddy_status_from_activity(struct sipe_core_private *sipe_priva
 		}
 
 		SIPE_DEBUG_INFO("sipe_buddy_status_from_activity: status_id(%s)", status_id);
-		sipe_core_buddy_got_status(SIPE_CORE_PUBLIC,
-					   uri,
-					   sipe_status_token_to_activity(status_id),
-			                   0);
+		sipe_buddy_got_status(sipe_private,
+				      uri,
+				      sipe_status_token_to_activity(status_id),
+				      0);
 	} else {
-		sipe_core_buddy_got_status(SIPE_CORE_PUBLIC,
-					   uri,
-					   SIPE_ACTIVITY_OFFLINE,
-					   0);
+		sipe_buddy_got_status(sipe_private,
+				      uri,
+				      SIPE_ACTIVITY_OFFLINE,
+				      0);
 	}
 }
 
@@ -1055,7 +1261,7 @@ static void process_incoming_notify_pidf(struct sipe_core_private *sipe_private,
 		sipe_buddy_update_property(sipe_private, uri, SIPE_BUDDY_INFO_DISPLAY_NAME, display_name);
 		g_free(display_name);
 
-		sipe_backend_buddy_refresh_properties(SIPE_CORE_PUBLIC, uri);
+		sipe_buddy_refresh_properties(sipe_private, uri);
 	}
 
 	if ((tuple = sipe_xml_child(pidf, "tuple"))) {
@@ -1102,6 +1308,9 @@ static void sipe_process_presence(struct sipe_core_private *sipe_private,
 
 	SIPE_DEBUG_INFO("sipe_process_presence: Content-Type: %s", ctype ? ctype : "");
 
+	/* one backend update per buddy for the whole NOTIFY */
+	sipe_buddy_changes_start(sipe_private);
+
 	if (ctype &&
 	    (strstr(ctype, "application/rlmi+xml") ||
 	     strstr(ctype, "application/msrtc-event-categories+xml")))
@@ -1127,6 +1336,8 @@ static void sipe_process_presence(struct sipe_core_private *sipe_private,
 	{
 		process_incoming_notify_pidf(sipe_private, msg->body, msg->bodylen);
 	}
+
+	sipe_buddy_changes_finish(sipe_private);
 }
 
 /**
@@ -1184,41 +1395,34 @@ static void sipe_process_registration_notify(struct sipe_core_private *sipe_priv
 }
 
 /* Replace "~" with localized version of "Other Contacts" */
-static const gchar *get_group_name(const sipe_xml *node)
+static const gchar *get_group_name(const gchar *name)
 {
-	const gchar *name = sipe_xml_attribute(node, "name");
 	return(g_str_has_prefix(name, "~") ? _("Other Contacts") : name);
 }
 
 static void add_new_group(struct sipe_core_private *sipe_private,
-			  const sipe_xml *node)
+			  const gchar *name,
+			  const gchar *id)
 {
 	sipe_group_add(sipe_private,
-		       get_group_name(node),
+		       get_group_name(name),
 		       NULL,
 		       NULL,
-		       sipe_xml_int_attribute(node, "id", 0));
+		       id ? g_ascii_strtoull(id, NULL, 10) : 0);
 }
 
-static void add_new_buddy(struct sipe_core_private *sipe_private,
-			  const sipe_xml *node,
-			  const gchar *uri)
+/* Returns list of sipe_group for a contact "groups" attribute */
+static GSList *contact_groups(struct sipe_core_private *sipe_private,
+			      const gchar *groups,
+			      const gchar *uri)
 {
-	const gchar *name = sipe_xml_attribute(node, "name");
-	struct sipe_buddy *buddy = NULL;
+	GSList *list = NULL;
 	gchar *tmp;
 	gchar **item_groups;
 	int i = 0;
 
-	/* "name" attribute is a contact alias which user can manually assign by
-	 * renaming the item in the contact list. Empty string means no alias
-	 * and the display name from the contact card should be used instead. */
-	if (name && strlen(name) == 0) {
-		name = NULL;
-	}
-
 	/* assign to group Other Contacts if nothing else received */
-	tmp = g_strdup(sipe_xml_attribute(node, "groups"));
+	tmp = g_strdup(groups);
 	if (is_empty(tmp)) {
 		struct sipe_group *group = sipe_group_find_by_name(sipe_private,
 								   _("Other Contacts"));
@@ -1239,16 +1443,8 @@ static void add_new_buddy(struct sipe_core_private *sipe_private,
 			group = sipe_group_first(sipe_private);
 
 		if (group) {
-			if (!buddy)
-				buddy = sipe_buddy_add(sipe_private,
-						       uri,
-						       NULL,
-						       NULL);
-
-			sipe_buddy_add_to_group(sipe_private,
-						buddy,
-						group,
-						name);
+			if (!g_slist_find(list, group))
+				list = g_slist_append(list, group);
 		} else {
 			SIPE_DEBUG_INFO("No group found for contact %s!  Unable to add to buddy list",
 					uri);
@@ -1258,250 +1454,532 @@ static void add_new_buddy(struct sipe_core_private *sipe_private,
 	}
 
 	g_strfreev(item_groups);
+
+	return(list);
 }
 
-static gboolean sipe_process_roaming_contacts(struct sipe_core_private *sipe_private,
-					      struct sipmsg *msg)
+static void add_new_buddy(struct sipe_core_private *sipe_private,
+			  const gchar *name,
+			  const gchar *groups,
+			  const gchar *uri)
 {
-	int len = msg->bodylen;
+	struct sipe_buddy *buddy = NULL;
+	GSList *list, *entry;
 
-	const gchar *tmp = sipmsg_find_event_header(msg);
-	const sipe_xml *item;
-	sipe_xml *isc;
-	guint delta;
-	const sipe_xml *group_node;
+	/* "name" attribute is a contact alias which user can manually assign by
+	 * renaming the item in the contact list. Empty string means no alias
+	 * and the display name from the contact card should be used instead. */
+	if (name && strlen(name) == 0) {
+		name = NULL;
+	}
 
-	if (!g_str_has_prefix(tmp, "vnd-microsoft-roaming-contacts")) {
-		return FALSE;
+	list = contact_groups(sipe_private, groups, uri);
+	for (entry = list; entry; entry = entry->next) {
+		if (!buddy)
+			buddy = sipe_buddy_add(sipe_private,
+					       uri,
+					       NULL,
+					       NULL);
+
+		sipe_buddy_add_to_group(sipe_private,
+					buddy,
+					entry->data,
+					name);
 	}
+	g_slist_free(list);
+}
 
-	/* Convert the contact from XML to backend Buddies */
-	isc = sipe_xml_parse(msg->body, len);
-	if (!isc) {
-		return FALSE;
+/*
+ * Contact is already in the buddy list with the same alias & groups.
+ * Used for buddy list updates, i.e. also marks the buddy as not obsolete.
+ */
+static gboolean contact_unchanged(struct sipe_core_private *sipe_private,
+				  const gchar *name,
+				  const gchar *groups,
+				  const gchar *uri)
+{
+	struct sipe_buddy *buddy = sipe_buddy_find_by_uri(sipe_private, uri);
+	gboolean unchanged = FALSE;
+
+	/* empty alias doesn't change the existing one, see add_new_buddy() */
+	if (buddy &&
+	    (is_empty(name) || sipe_strequal(buddy->alias, name))) {
+		GSList *list = contact_groups(sipe_private, groups, uri);
+		unchanged = sipe_buddy_keep_groups(buddy, list);
+		g_slist_free(list);
 	}
 
+	return(unchanged);
+}
+
+/*
+ * Whole buddy list is processed by the streaming XML parser
+ *
+ *  - Only sent once
+ *    * up to Lync 2010
+ *    * Lync 2013 (and later) with buddy list not migrated
+ *
+ *  - Lync 2013 with buddy list migrated to Unified Contact Store (UCS)
+ *    * Notify piggy-backed on SUBSCRIBE response with empty list
+ *    * NOTIFY send by server with standard list (ignored by us)
+ *
+ * If we already have a buddy list, e.g. loaded from snapshot, then only
+ * the entries that differ from the existing list are updated.
+ */
+struct contact_list_context {
+	struct sipe_core_private *sipe_private;
+	guint contacts;
+	guint changed;           /* added or updated groups/contacts */
+	gboolean processing;     /* contact list processing started */
+	gboolean groups_done;
+	gboolean delta;          /* buddy list updates */
+	gboolean incremental;    /* update existing buddy list */
+	gboolean unchanged;      /* same as buddy list loaded from snapshot */
+	guint delta_num;         /* applied after parsing */
+	GSList *deleted_groups;  /* contactDelta: group IDs */
+};
+
+static void contact_list_start(sipe_xml_stream *stream,
+			       const gchar **attributes,
+			       gpointer user_data)
+{
+	struct contact_list_context *context = user_data;
+	struct sipe_core_private *sipe_private = context->sipe_private;
+	const gchar *ucsmode = sipe_xml_stream_attribute(attributes, "ucsmode");
+	const gchar *tmp = sipe_xml_stream_attribute(attributes, "deltaNum");
+
 	/* [MS-SIP]: deltaNum MUST be non-zero */
-	delta = sipe_xml_int_attribute(isc, "deltaNum", 0);
+	guint delta = tmp ? g_ascii_strtoull(tmp, NULL, 10) : 0;
 	if (delta) {
 		sipe_private->deltanum_contacts = delta;
 	}
 
-	/*
-	 * Process whole buddy list
-	 *
-	 *  - Only sent once
-	 *    * up to Lync 2010
-	 *    * Lync 2013 (and later) with buddy list not migrated
-	 *
-	 *  - Lync 2013 with buddy list migrated to Unified Contact Store (UCS)
-	 *    * Notify piggy-backed on SUBSCRIBE response with empty list
-	 *    * NOTIFY send by server with standard list (ignored by us)
-	 */
-	if (sipe_strequal(sipe_xml_name(isc), "contactList")) {
-		const gchar *ucsmode = sipe_xml_attribute(isc, "ucsmode");
-
-		SIPE_CORE_PRIVATE_FLAG_UNSET(LYNC2013);
-		if (ucsmode) {
-			gboolean migrated = sipe_strcase_equal(ucsmode,
-							       "migrated");
-			SIPE_CORE_PRIVATE_FLAG_SET(LYNC2013);
-			SIPE_LOG_INFO_NOFORMAT("sipe_process_roaming_contacts: contact list contains 'ucsmode' attribute (indicates Lync 2013+)");
-
-			if (migrated)
-				SIPE_LOG_INFO_NOFORMAT("sipe_process_roaming_contacts: contact list has been migrated to Unified Contact Store (UCS)");
-			sipe_ucs_init(sipe_private, migrated);
+	SIPE_CORE_PRIVATE_FLAG_UNSET(LYNC2013);
+	if (ucsmode) {
+		gboolean migrated = sipe_strcase_equal(ucsmode,
+						       "migrated");
+		SIPE_CORE_PRIVATE_FLAG_SET(LYNC2013);
+		SIPE_LOG_INFO_NOFORMAT("sipe_process_roaming_contacts: contact list contains 'ucsmode' attribute (indicates Lync 2013+)");
+
+		if (migrated)
+			SIPE_LOG_INFO_NOFORMAT("sipe_process_roaming_contacts: contact list has been migrated to Unified Contact Store (UCS)");
+		sipe_ucs_init(sipe_private, migrated);
+	}
+
+	if (sipe_ucs_is_migrated(sipe_private)) {
+		sipe_xml_stream_stop(stream);
+	} else if (SIPE_CORE_PRIVATE_FLAG_IS(SNAPSHOT) &&
+		   delta &&
+		   (delta == sipe_private->deltanum_snapshot)) {
+		SIPE_DEBUG_INFO("sipe_process_roaming_contacts: contact list deltaNum %u unchanged since snapshot",
+				delta);
+		SIPE_CORE_PRIVATE_FLAG_UNSET(SNAPSHOT);
+		sipe_xml_stream_stop(stream);
+		context->unchanged = TRUE;
+	} else {
+		/* buddies & groups not in this list will be removed */
+		if (sipe_buddy_count(sipe_private) > 0) {
+			sipe_group_update_start(sipe_private);
+			sipe_buddy_update_start(sipe_private);
+			context->incremental = TRUE;
 		}
+		context->delta_num = delta;
 
-		if (!sipe_ucs_is_migrated(sipe_private)) {
-			/* Start processing contact list */
-			sipe_backend_buddy_list_processing_start(SIPE_CORE_PUBLIC);
+		/* Start processing contact list */
+		sipe_backend_buddy_list_processing_start(SIPE_CORE_PUBLIC);
+		context->processing = TRUE;
+	}
+}
 
-			/* Parse groups */
-			for (group_node = sipe_xml_child(isc, "group"); group_node; group_node = sipe_xml_twin(group_node))
-				add_new_group(sipe_private, group_node);
+static void contact_list_groups_done(struct contact_list_context *context)
+{
+	struct sipe_core_private *sipe_private = context->sipe_private;
 
-			/* Make sure we have at least one group */
-			if (sipe_group_count(sipe_private) == 0) {
-				sipe_group_create(sipe_private,
-						  NULL,
-						  _("Other Contacts"),
-						  NULL);
-			}
+	if (context->groups_done)
+		return;
+	context->groups_done = TRUE;
+
+	/* Make sure we have at least one group */
+	if (sipe_group_count(sipe_private) == 0) {
+		sipe_group_create(sipe_private,
+				  NULL,
+				  _("Other Contacts"),
+				  NULL);
+	}
+}
 
-			/* Parse contacts */
-			for (item = sipe_xml_child(isc, "contact"); item; item = sipe_xml_twin(item)) {
-				const gchar *name = sipe_xml_attribute(item, "uri");
-				gchar *uri        = sip_uri_from_name(name);
-				add_new_buddy(sipe_private, item, uri);
-				g_free(uri);
-			}
+static void contact_list_group(SIPE_UNUSED_PARAMETER sipe_xml_stream *stream,
+			       const gchar **attributes,
+			       gpointer user_data)
+{
+	struct contact_list_context *context = user_data;
+	struct sipe_core_private *sipe_private = context->sipe_private;
+	const gchar *name = sipe_xml_stream_attribute(attributes, "name");
+	const gchar *id = sipe_xml_stream_attribute(attributes, "id");
 
-			sipe_buddy_cleanup_local_list(sipe_private);
+	if (context->incremental && id) {
+		struct sipe_group *group = sipe_group_find_by_id(sipe_private,
+								 g_ascii_strtoull(id, NULL, 10));
 
-			/* Add self-contact if not there yet. 2005 systems. */
-			/* This will resemble subscription to roaming_self in 2007 systems */
-			if (!SIPE_CORE_PRIVATE_FLAG_IS(OCS2007)) {
-				gchar *self_uri = sip_uri_self(sipe_private);
-				sipe_buddy_add(sipe_private,
-					       self_uri,
-					       NULL,
-					       NULL);
-				g_free(self_uri);
+		if (group) {
+			name = get_group_name(name);
+			if (!(is_empty(name) ||
+			      sipe_strequal(group->name, name)) &&
+			    sipe_group_rename(sipe_private,
+					      group,
+					      name)) {
+				SIPE_DEBUG_INFO("Replaced group %d name with %s", group->id, name);
+				context->changed++;
 			}
+			group->is_obsolete = FALSE;
+			return;
+		}
+	}
+
+	add_new_group(sipe_private, name, id);
+	context->changed++;
+}
+
+static void contact_list_contact(SIPE_UNUSED_PARAMETER sipe_xml_stream *stream,
+				 const gchar **attributes,
+				 gpointer user_data)
+{
+	struct contact_list_context *context = user_data;
+	gchar *uri = sip_uri_from_name(sipe_xml_stream_attribute(attributes,
+								 "uri"));
 
-			/* Finished processing contact list */
-			sipe_backend_buddy_list_processing_finish(SIPE_CORE_PUBLIC);
+	const gchar *name = sipe_xml_stream_attribute(attributes, "name");
+	const gchar *groups = sipe_xml_stream_attribute(attributes, "groups");
+
+	/* schema: groups before contacts */
+	contact_list_groups_done(context);
+
+	if (!(context->incremental &&
+	      contact_unchanged(context->sipe_private, name, groups, uri))) {
+		add_new_buddy(context->sipe_private, name, groups, uri);
+		context->changed++;
+	}
+	context->contacts++;
+	g_free(uri);
+}
+
+/*
+ * Buddy list updates are processed in document order by the same
+ * streaming parser. deltaNum and group removals are only applied after
+ * the whole document has been parsed successfully.
+ */
+static guint contact_delta_id(const gchar **attributes)
+{
+	const gchar *id = sipe_xml_stream_attribute(attributes, "id");
+	return(id ? g_ascii_strtoull(id, NULL, 10) : 0);
+}
+
+static void contact_delta_start(SIPE_UNUSED_PARAMETER sipe_xml_stream *stream,
+				const gchar **attributes,
+				gpointer user_data)
+{
+	struct contact_list_context *context = user_data;
+	const gchar *tmp = sipe_xml_stream_attribute(attributes, "deltaNum");
+
+	context->delta     = TRUE;
+	context->delta_num = tmp ? g_ascii_strtoull(tmp, NULL, 10) : 0;
+}
+
+static void contact_delta_added_group(SIPE_UNUSED_PARAMETER sipe_xml_stream *stream,
+				      const gchar **attributes,
+				      gpointer user_data)
+{
+	struct contact_list_context *context = user_data;
+
+	add_new_group(context->sipe_private,
+		      sipe_xml_stream_attribute(attributes, "name"),
+		      sipe_xml_stream_attribute(attributes, "id"));
+	context->changed++;
+}
+
+static void contact_delta_modified_group(SIPE_UNUSED_PARAMETER sipe_xml_stream *stream,
+					 const gchar **attributes,
+					 gpointer user_data)
+{
+	struct contact_list_context *context = user_data;
+	struct sipe_core_private *sipe_private = context->sipe_private;
+	struct sipe_group *group = sipe_group_find_by_id(sipe_private,
+							 contact_delta_id(attributes));
+
+	if (group) {
+		const gchar *name = get_group_name(sipe_xml_stream_attribute(attributes,
+									     "name"));
+
+		if (!(is_empty(name) ||
+		      sipe_strequal(group->name, name)) &&
+		    sipe_group_rename(sipe_private,
+				      group,
+				      name)) {
+			SIPE_DEBUG_INFO("Replaced group %d name with %s", group->id, name);
+			context->changed++;
 		}
+	}
+}
 
-	/* Process buddy list updates */
-	} else if (sipe_strequal(sipe_xml_name(isc), "contactDelta")) {
+static void contact_delta_deleted_group(SIPE_UNUSED_PARAMETER sipe_xml_stream *stream,
+					const gchar **attributes,
+					gpointer user_data)
+{
+	struct contact_list_context *context = user_data;
 
-		/* Process new groups */
-		for (group_node = sipe_xml_child(isc, "addedGroup"); group_node; group_node = sipe_xml_twin(group_node))
-			add_new_group(sipe_private, group_node);
+	context->deleted_groups = g_slist_append(context->deleted_groups,
+						 GUINT_TO_POINTER(contact_delta_id(attributes)));
+}
 
-		/* Process modified groups */
-		for (group_node = sipe_xml_child(isc, "modifiedGroup"); group_node; group_node = sipe_xml_twin(group_node)) {
+static void contact_delta_added_contact(SIPE_UNUSED_PARAMETER sipe_xml_stream *stream,
+					const gchar **attributes,
+					gpointer user_data)
+{
+	struct contact_list_context *context = user_data;
+
+	add_new_buddy(context->sipe_private,
+		      sipe_xml_stream_attribute(attributes, "name"),
+		      sipe_xml_stream_attribute(attributes, "groups"),
+		      sipe_xml_stream_attribute(attributes, "uri"));
+	context->changed++;
+}
+
+static void contact_delta_modified_contact(SIPE_UNUSED_PARAMETER sipe_xml_stream *stream,
+					   const gchar **attributes,
+					   gpointer user_data)
+{
+	struct contact_list_context *context = user_data;
+	struct sipe_core_private *sipe_private = context->sipe_private;
+	const gchar *uri = sipe_xml_stream_attribute(attributes, "uri");
+	const gchar *groups = sipe_xml_stream_attribute(attributes, "groups");
+	struct sipe_buddy *buddy = sipe_buddy_find_by_uri(sipe_private,
+							  uri);
+
+	/* groups should be defined. Otherwise we would get "deletedContact" */
+	if (buddy && groups) {
+		guint count = sipe_buddy_group_count(buddy);
+		gchar **item_groups = g_strsplit(groups, " ", 0);
+		const gchar *name = sipe_xml_stream_attribute(attributes, "name");
+		gboolean empty_name = is_empty(name);
+		GSList *found = NULL;
+		int i = 0;
+
+		while (item_groups[i]) {
 			struct sipe_group *group = sipe_group_find_by_id(sipe_private,
-									 (int)g_ascii_strtod(sipe_xml_attribute(group_node, "id"),
-											     NULL));
+									 g_ascii_strtod(item_groups[i],
+											NULL));
+			/* ignore unkown groups */
 			if (group) {
-				const gchar *name = get_group_name(group_node);
-
-				if (!(is_empty(name) ||
-				      sipe_strequal(group->name, name)) &&
-				    sipe_group_rename(sipe_private,
-						      group,
-						      name))
-					SIPE_DEBUG_INFO("Replaced group %d name with %s", group->id, name);
+				sipe_backend_buddy b = sipe_backend_buddy_find(SIPE_CORE_PUBLIC,
+									       uri,
+									       group->name);
+
+				/* add group to found list */
+				found = g_slist_prepend(found, group);
+
+				if (b) {
+					/* new alias? */
+					gchar *b_alias = sipe_backend_buddy_get_alias(SIPE_CORE_PUBLIC,
+										      b);
+
+					if (!(empty_name ||
+					      sipe_strequal(b_alias, name))) {
+						sipe_backend_buddy_set_alias(SIPE_CORE_PUBLIC,
+									     b,
+									     name);
+						SIPE_DEBUG_INFO("Replaced for buddy %s in group '%s' old alias '%s' with '%s'",
+								uri, group->name, b_alias, name);
+						context->changed++;
+					}
+					g_free(b_alias);
+
+				} else {
+					const gchar *alias = empty_name ? uri : name;
+					/* buddy was not in this group */
+					sipe_backend_buddy_add(SIPE_CORE_PUBLIC,
+							       uri,
+							       alias,
+							       group->name);
+					/* new backend buddy doesn't have a status yet */
+					buddy->status_pushed = FALSE;
+					sipe_buddy_insert_group(buddy, group);
+					SIPE_DEBUG_INFO("Added buddy %s (alias '%s' to group '%s'",
+							uri, alias, group->name);
+					context->changed++;
+				}
 			}
-		}
 
-		/* Process new buddies */
-		for (item = sipe_xml_child(isc, "addedContact"); item; item = sipe_xml_twin(item)) {
-			add_new_buddy(sipe_private,
-				      item,
-				      sipe_xml_attribute(item, "uri"));
+			/* next group */
+			i++;
 		}
+		g_strfreev(item_groups);
 
-		/* Process modified buddies */
-		for (item = sipe_xml_child(isc, "modifiedContact"); item; item = sipe_xml_twin(item)) {
-			const gchar *uri = sipe_xml_attribute(item, "uri");
-			struct sipe_buddy *buddy = sipe_buddy_find_by_uri(sipe_private,
-									  uri);
-
-			if (buddy) {
-				gchar **item_groups = g_strsplit(sipe_xml_attribute(item,
-										    "groups"),
-								 " ", 0);
-
-				/* this should be defined. Otherwise we would get "deletedContact" */
-				if (item_groups) {
-					const gchar *name = sipe_xml_attribute(item, "name");
-					gboolean empty_name = is_empty(name);
-					GSList *found = NULL;
-					int i = 0;
-
-					while (item_groups[i]) {
-						struct sipe_group *group = sipe_group_find_by_id(sipe_private,
-												 g_ascii_strtod(item_groups[i],
-														NULL));
-						/* ignore unkown groups */
-						if (group) {
-							sipe_backend_buddy b = sipe_backend_buddy_find(SIPE_CORE_PUBLIC,
-												       uri,
-												       group->name);
-
-							/* add group to found list */
-							found = g_slist_prepend(found, group);
-
-							if (b) {
-								/* new alias? */
-								gchar *b_alias = sipe_backend_buddy_get_alias(SIPE_CORE_PUBLIC,
-													      b);
-
-								if (!(empty_name ||
-								      sipe_strequal(b_alias, name))) {
-									sipe_backend_buddy_set_alias(SIPE_CORE_PUBLIC,
-												     b,
-												     name);
-									SIPE_DEBUG_INFO("Replaced for buddy %s in group '%s' old alias '%s' with '%s'",
-											uri, group->name, b_alias, name);
-								}
-								g_free(b_alias);
-
-							} else {
-								const gchar *alias = empty_name ? uri : name;
-								/* buddy was not in this group */
-								sipe_backend_buddy_add(SIPE_CORE_PUBLIC,
-										       uri,
-										       alias,
-										       group->name);
-								sipe_buddy_insert_group(buddy, group);
-								SIPE_DEBUG_INFO("Added buddy %s (alias '%s' to group '%s'",
-										uri, alias, group->name);
-							}
-						}
-
-						/* next group */
-						i++;
-					}
-					g_strfreev(item_groups);
+		/* removed from groups? */
+		sipe_buddy_update_groups(sipe_private,
+					 buddy,
+					 found);
+		g_slist_free(found);
 
- 					/* removed from groups? */
-					sipe_buddy_update_groups(sipe_private,
-								 buddy,
-								 found);
-					g_slist_free(found);
-				}
-			}
+		/* one or more groups removed */
+		if (sipe_buddy_group_count(buddy) < count)
+			context->changed++;
+	}
+}
+
+static void contact_delta_deleted_contact(SIPE_UNUSED_PARAMETER sipe_xml_stream *stream,
+					  const gchar **attributes,
+					  gpointer user_data)
+{
+	struct contact_list_context *context = user_data;
+	struct sipe_core_private *sipe_private = context->sipe_private;
+	const gchar *uri = sipe_xml_stream_attribute(attributes, "uri");
+	struct sipe_buddy *buddy = sipe_buddy_find_by_uri(sipe_private,
+							  uri);
+
+	if (buddy) {
+		SIPE_DEBUG_INFO("Removing buddy %s", uri);
+		sipe_buddy_remove(sipe_private, buddy);
+		context->changed++;
+	}
+}
+
+/*
+ * Process deleted groups
+ *
+ * NOTE: all buddies will already have been removed from the
+ *       group prior to this. The log shows that OCS actually
+ *       sends two separate updates when you delete a group:
+ *
+ *         - first one with "modifiedContact" removing buddies
+ *           from the group, leaving it empty, and
+ *
+ *         - then one with "deletedGroup" removing the group
+ */
+static void contact_delta_finish(struct contact_list_context *context)
+{
+	struct sipe_core_private *sipe_private = context->sipe_private;
+	GSList *entry;
+
+	/* [MS-SIP]: deltaNum MUST be non-zero */
+	if (context->delta_num) {
+		sipe_private->deltanum_contacts = context->delta_num;
+		sipe_private->deltanum_snapshot = context->delta_num;
+	}
+
+	for (entry = context->deleted_groups; entry; entry = entry->next) {
+		struct sipe_group *group = sipe_group_find_by_id(sipe_private,
+								 GPOINTER_TO_UINT(entry->data));
+		if (group) {
+			sipe_group_remove(sipe_private, group);
+			context->changed++;
 		}
+	}
+
+	SIPE_DEBUG_INFO("sipe_process_roaming_contacts: deltaNum %u, %u entries changed",
+			context->delta_num, context->changed);
+}
+
+static const struct sipe_xml_stream_handler contact_list_handlers[] = {
+	{ "contactList",                  contact_list_start,             NULL, NULL },
+	{ "contactList/group",            contact_list_group,             NULL, NULL },
+	{ "contactList/contact",          contact_list_contact,           NULL, NULL },
+	{ "contactDelta",                 contact_delta_start,            NULL, NULL },
+	{ "contactDelta/addedGroup",      contact_delta_added_group,      NULL, NULL },
+	{ "contactDelta/modifiedGroup",   contact_delta_modified_group,   NULL, NULL },
+	{ "contactDelta/deletedGroup",    contact_delta_deleted_group,    NULL, NULL },
+	{ "contactDelta/addedContact",    contact_delta_added_contact,    NULL, NULL },
+	{ "contactDelta/modifiedContact", contact_delta_modified_contact, NULL, NULL },
+	{ "contactDelta/deletedContact",  contact_delta_deleted_contact,  NULL, NULL },
+	{ NULL,                           NULL,                           NULL, NULL }
+};
+
+static gboolean sipe_process_roaming_contacts(struct sipe_core_private *sipe_private,
+					      struct sipmsg *msg)
+{
+	int len = msg->bodylen;
+
+	const gchar *tmp = sipmsg_find_event_header(msg);
+	struct contact_list_context context;
+	gboolean parsed;
+
+	if (!g_str_has_prefix(tmp, "vnd-microsoft-roaming-contacts")) {
+		return FALSE;
+	}
+
+	/* Convert the contact from XML to backend Buddies */
+	memset(&context, 0, sizeof(context));
+	context.sipe_private = sipe_private;
+	parsed = sipe_xml_stream_parse(msg->body, len,
+				       contact_list_handlers,
+				       &context);
 
-		/* Process deleted buddies */
-		for (item = sipe_xml_child(isc, "deletedContact"); item; item = sipe_xml_twin(item)) {
-			const gchar *uri = sipe_xml_attribute(item, "uri");
-			struct sipe_buddy *buddy = sipe_buddy_find_by_uri(sipe_private,
-									  uri);
+	if (context.processing) {
+		/* don't remove buddies if list is incomplete */
+		if (parsed) {
+			guint removed = 0;
 
-			if (buddy) {
-				SIPE_DEBUG_INFO("Removing buddy %s", uri);
-				sipe_buddy_remove(sipe_private, buddy);
+			contact_list_groups_done(&context);
+
+			/* Add self-contact if not there yet. 2005 systems. */
+			/* This will resemble subscription to roaming_self in 2007 systems */
+			if (!SIPE_CORE_PRIVATE_FLAG_IS(OCS2007)) {
+				gchar *self_uri = sip_uri_self(sipe_private);
+				sipe_buddy_add(sipe_private,
+					       self_uri,
+					       NULL,
+					       NULL);
+				g_free(self_uri);
+			}
+
+			if (context.incremental) {
+				removed = sipe_buddy_update_finish(sipe_private);
+				sipe_group_update_finish(sipe_private);
+				SIPE_CORE_PRIVATE_FLAG_UNSET(SNAPSHOT);
 			}
+			sipe_buddy_cleanup_local_list(sipe_private);
+			sipe_private->deltanum_snapshot = context.delta_num;
+
+			SIPE_DEBUG_INFO("sipe_process_roaming_contacts: %u contacts, %u entries changed, %u buddies removed",
+					context.contacts, context.changed, removed);
+		} else if (context.incremental) {
+			/* keep buddy list as it is */
+			sipe_buddy_update_cancel(sipe_private);
+			sipe_group_update_cancel(sipe_private);
 		}
 
-		/* Process deleted groups
-		 *
-		 * NOTE: all buddies will already have been removed from the
-		 *       group prior to this. The log shows that OCS actually
-		 *       sends two separate updates when you delete a group:
-		 *
-		 *         - first one with "modifiedContact" removing buddies
-		 *           from the group, leaving it empty, and
-		 *
-		 *         - then one with "deletedGroup" removing the group
-		 */
-		for (group_node = sipe_xml_child(isc, "deletedGroup"); group_node; group_node = sipe_xml_twin(group_node))
-			sipe_group_remove(sipe_private,
-					  sipe_group_find_by_id(sipe_private,
-								(int)g_ascii_strtod(sipe_xml_attribute(group_node, "id"),
-										    NULL)));
-
-	}
-	sipe_xml_free(isc);
+		/* Finished processing contact list */
+		sipe_backend_buddy_list_processing_finish(SIPE_CORE_PUBLIC);
+	}
+
+	if (context.delta) {
+		if (parsed)
+			contact_delta_finish(&context);
+		g_slist_free(context.deleted_groups);
+	}
+
+	if (!parsed) {
+		return FALSE;
+	}
 
 	/* Subscribe to buddies, if contact list not migrated to UCS */
-	if (!sipe_ucs_is_migrated(sipe_private))
+	if (!sipe_ucs_is_migrated(sipe_private)) {
+		gboolean initial = !SIPE_CORE_PRIVATE_FLAG_IS(SUBSCRIBED_BUDDIES);
+
 		sipe_subscribe_presence_initial(sipe_private);
 
+		/* list from snapshot is still valid */
+		if (!(initial && context.unchanged))
+			sipe_snapshot_save(sipe_private);
+	}
+
 	/* for 2005 systems schedule contacts' status update
 	 * based on their calendar information
 	 */
 	if (!SIPE_CORE_PRIVATE_FLAG_IS(OCS2007)) {
-		sipe_ocs2005_schedule_status_update(sipe_private, time(NULL));
+		sipe_ocs2005_schedule_status_update(sipe_private);
 	}
 
-	return 0;
+	return TRUE;
 }
 
 static void sipe_process_roaming_acl(struct sipe_core_private *sipe_private,
@@ -415,6 +415,44 @@ void sipe_ocs2005_reset_status(struct sipe_core_private *sipe_private)
 	send_presence_soap(sipe_private, FALSE, TRUE);
 }
 
+static void update_calendar_status(struct sipe_core_private *sipe_private,
+				   gpointer uri)
+{
+	struct sipe_buddy *sbuddy = sipe_buddy_find_by_uri(sipe_private, uri);
+
+	/* will reschedule itself for the next status change */
+	if (sbuddy)
+		sipe_ocs2005_apply_calendar_status(sipe_private, sbuddy, NULL);
+}
+
+/**
+ * Schedules update of contact's status at the time
+ * when their calendar status changes next.
+ */
+static void schedule_buddy_status_update(struct sipe_core_private *sipe_private,
+					 struct sipe_buddy *sbuddy)
+{
+	time_t now = time(NULL);
+	time_t next = sipe_cal_get_next_switch(sbuddy, now);
+	gchar *action_name = g_strdup_printf("<+2005-cal-status><%s>",
+					     sbuddy->name);
+
+	if (next == (time_t) -1) {
+		sipe_schedule_cancel(sipe_private, action_name);
+	} else {
+		SIPE_DEBUG_INFO("schedule_buddy_status_update: %s at %s",
+				sbuddy->name,
+				sipe_utils_time_to_debug_str(localtime(&next)));
+		sipe_schedule_seconds(sipe_private,
+				      action_name,
+				      g_strdup(sbuddy->name),
+				      next - now,
+				      update_calendar_status,
+				      g_free);
+	}
+	g_free(action_name);
+}
+
 void sipe_ocs2005_apply_calendar_status(struct sipe_core_private *sipe_private,
 					struct sipe_buddy *sbuddy,
 					const char *status_id)
@@ -426,6 +464,8 @@ void sipe_ocs2005_apply_calendar_status(struct sipe_core_private *sipe_private,
 
 	if (!sbuddy) return;
 
+	schedule_buddy_status_update(sipe_private, sbuddy);
+
 	if (cal_status < SIPE_CAL_NO_DATA) {
 		SIPE_DEBUG_INFO("sipe_apply_calendar_status: cal_status      : %d for %s", cal_status, sbuddy->name);
 		SIPE_DEBUG_INFO("sipe_apply_calendar_status: cal_avail_since : %s", sipe_utils_time_to_debug_str(localtime(&cal_avail_since)));
@@ -469,9 +509,9 @@ void sipe_ocs2005_apply_calendar_status(struct sipe_core_private *sipe_private,
 
 	/* then set status_id actually */
 	SIPE_DEBUG_INFO("sipe_apply_calendar_status: to %s for %s", status_id, sbuddy->name ? sbuddy->name : "" );
-	sipe_backend_buddy_set_status(SIPE_CORE_PUBLIC, sbuddy->name,
-				      sipe_status_token_to_activity(status_id),
-		                      0);
+	sipe_buddy_set_status(sipe_private, sbuddy,
+			      sipe_status_token_to_activity(status_id),
+			      0);
 
 	/* set our account state to the one in roaming (including calendar info) */
 	self_uri = sip_uri_self(sipe_private);
@@ -487,56 +527,22 @@ void sipe_ocs2005_apply_calendar_status(struct sipe_core_private *sipe_private,
 	g_free(self_uri);
 }
 
-static void update_calendar_status_cb(SIPE_UNUSED_PARAMETER char *name,
+static void schedule_status_update_cb(SIPE_UNUSED_PARAMETER char *name,
 				      struct sipe_buddy *sbuddy,
 				      struct sipe_core_private *sipe_private)
 {
-	sipe_ocs2005_apply_calendar_status(sipe_private, sbuddy, NULL);
+	schedule_buddy_status_update(sipe_private, sbuddy);
 }
 
 /**
- * Updates contact's status
+ * Schedules process of contacts' status update
  * based on their calendar information.
  */
-static void update_calendar_status(struct sipe_core_private *sipe_private,
-				   SIPE_UNUSED_PARAMETER void *unused)
+void sipe_ocs2005_schedule_status_update(struct sipe_core_private *sipe_private)
 {
-	SIPE_DEBUG_INFO_NOFORMAT("update_calendar_status() started.");
 	sipe_buddy_foreach(sipe_private,
-			   (GHFunc) update_calendar_status_cb,
+			   (GHFunc) schedule_status_update_cb,
 			   sipe_private);
-
-	/* repeat scheduling */
-	sipe_ocs2005_schedule_status_update(sipe_private,
-					    time(NULL) + 3 * 60 /* 3 min */);
-}
-
-/**
- * Schedules process of contacts' status update
- * based on their calendar information.
- * Should be scheduled to the beginning of every
- * 15 min interval, like:
- * 13:00, 13:15, 13:30, 13:45, etc.
- */
-void sipe_ocs2005_schedule_status_update(struct sipe_core_private *sipe_private,
-					 time_t calculate_from)
-{
-#define SCHEDULE_INTERVAL 15 * 60 /* 15 min */
-
-	/* start of the beginning of closest 15 min interval. */
-	time_t next_start = (calculate_from / SCHEDULE_INTERVAL + 1) * SCHEDULE_INTERVAL;
-
-	SIPE_DEBUG_INFO("sipe_ocs2005_schedule_status_update: calculate_from time: %s",
-			sipe_utils_time_to_debug_str(localtime(&calculate_from)));
-	SIPE_DEBUG_INFO("sipe_ocs2005_schedule_status_update: next start time    : %s",
-			sipe_utils_time_to_debug_str(localtime(&next_start)));
-
-	sipe_schedule_seconds(sipe_private,
-			      "<+2005-cal-status>",
-			      NULL,
-			      next_start - time(NULL),
-			      update_calendar_status,
-			      NULL);
 }
 
 /*
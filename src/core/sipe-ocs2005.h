@@ -43,8 +43,7 @@ void sipe_ocs2005_user_info_has_updated(struct sipe_core_private *sipe_private,
 void sipe_ocs2005_apply_calendar_status(struct sipe_core_private *sipe_private,
 					struct sipe_buddy *sbuddy,
 					const char *status_id);
-void sipe_ocs2005_schedule_status_update(struct sipe_core_private *sipe_private,
-					 time_t calculate_from);
+void sipe_ocs2005_schedule_status_update(struct sipe_core_private *sipe_private);
 
 /*
   Local Variables:
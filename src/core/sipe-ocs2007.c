@@ -250,7 +250,11 @@ static void sipe_remove_category_container_publications(GHashTable *our_publicat
 struct sipe_container {
 	guint id;
 	guint version;
+	/** members have been changed locally, version is stale */
+	gboolean modified;
 	GSList *members;
+	/** key: member_key(), value: sipe_container_member */
+	GHashTable *member_index;
 };
 
 /** MS-PRES container member */
@@ -260,9 +264,70 @@ struct sipe_container_member {
 	gchar *value;
 };
 
+/** cached result of sipe_ocs2007_find_access_level() */
+struct sipe_access_level {
+	int container_id;
+	gboolean is_group_access;
+};
+
 static const guint containers[] = {32000, 400, 300, 200, 100};
 #define CONTAINERS_LEN (sizeof(containers) / sizeof(guint))
 
+/**
+ * Lookup key for member type & value. Comparison is case insensitive.
+ * NULL and empty value are different members.
+ *
+ * @return key. Must be @c g_free()'d.
+ */
+static gchar *member_key(const gchar *type,
+			 const gchar *value)
+{
+	/* NOTE: g_strconcat() stops at value separator if value is NULL */
+	gchar *key = g_strconcat(type, value ? "\n" : NULL, value, NULL);
+	gchar *folded = g_ascii_strdown(key, -1);
+	g_free(key);
+	return(folded);
+}
+
+static struct sipe_container *container_new(guint id,
+					    guint version)
+{
+	struct sipe_container *container = g_new0(struct sipe_container, 1);
+
+	container->id           = id;
+	container->version      = version;
+	container->member_index = g_hash_table_new_full(g_str_hash,
+							g_str_equal,
+							g_free,
+							NULL);
+
+	return(container);
+}
+
+static struct sipe_container_member *container_add_member(struct sipe_container *container,
+							  const gchar *type,
+							  const gchar *value)
+{
+	struct sipe_container_member *member = g_new0(struct sipe_container_member, 1);
+
+	member->type  = g_strdup(type);
+	member->value = g_strdup(value);
+	container->members = g_slist_append(container->members, member);
+
+	/* first member wins, as with the old list search */
+	if (type) {
+		gchar *key = member_key(type, value);
+		if (g_hash_table_lookup(container->member_index, key))
+			g_free(key);
+		else
+			g_hash_table_insert(container->member_index,
+					    key,
+					    member);
+	}
+
+	return(member);
+}
+
 static void free_container_member(struct sipe_container_member *member)
 {
 	if (!member) return;
@@ -284,9 +349,72 @@ static void sipe_ocs2007_free_container(struct sipe_container *container)
 		entry = g_slist_remove(entry, data);
 		free_container_member((struct sipe_container_member *)data);
 	}
+	g_hash_table_destroy(container->member_index);
 	g_free(container);
 }
 
+static void container_remove_member(struct sipe_container *container,
+				    struct sipe_container_member *member)
+{
+	GSList *entry;
+	gchar *key = member_key(member->type, member->value);
+
+	container->members = g_slist_remove(container->members, member);
+	g_hash_table_remove(container->member_index, key);
+	free_container_member(member);
+
+	/* another member with the same key? */
+	for (entry = container->members; entry; entry = entry->next) {
+		member = entry->data;
+		if (member->type) {
+			gchar *other = member_key(member->type, member->value);
+			if (sipe_strequal(key, other)) {
+				g_hash_table_insert(container->member_index,
+						    other,
+						    member);
+				break;
+			}
+			g_free(other);
+		}
+	}
+	g_free(key);
+}
+
+static void access_level_cache_flush(struct sipe_core_private *sipe_private)
+{
+	if (sipe_private->access_levels)
+		g_hash_table_remove_all(sipe_private->access_levels);
+}
+
+/* user members are stored without "sip:" prefix */
+static gchar *access_level_key(const gchar *type,
+			       const gchar *value)
+{
+	if (sipe_strequal("user", type))
+		value = sipe_get_no_sip_uri(value);
+	return(member_key(type, value));
+}
+
+/**
+ * Drop cached access level after a local member change. A user member
+ * only affects that user, all other member types affect many users.
+ */
+static void access_level_cache_invalidate(struct sipe_core_private *sipe_private,
+					  const gchar *type,
+					  const gchar *value)
+{
+	if (!sipe_private->access_levels)
+		return;
+
+	if (sipe_strequal("user", type)) {
+		gchar *key = access_level_key(type, value);
+		g_hash_table_remove(sipe_private->access_levels, key);
+		g_free(key);
+	} else {
+		access_level_cache_flush(sipe_private);
+	}
+}
+
 void sipe_core_buddy_menu_free(struct sipe_core_public *sipe_public)
 {
 	struct sipe_core_private *sipe_private = SIPE_CORE_PRIVATE;
@@ -307,13 +435,10 @@ static struct sipe_container *create_container(guint index,
 					       const gchar *member_value,
 					       gboolean is_group)
 {
-	struct sipe_container *container = g_new0(struct sipe_container, 1);
-	struct sipe_container_member *member = g_new0(struct sipe_container_member, 1);
+	struct sipe_container *container = container_new(is_group ? (guint) -1 : containers[index],
+							  0);
 
-	container->id = is_group ? (guint) -1 : containers[index];
-	container->members = g_slist_append(container->members, member);
-	member->type = g_strdup(member_type);
-	member->value = g_strdup(member_value);
+	container_add_member(container, member_type, member_value);
 
 	return(container);
 }
@@ -322,6 +447,11 @@ void sipe_ocs2007_free(struct sipe_core_private *sipe_private)
 {
 	sipe_utils_slist_free_full(sipe_private->containers,
 				   (GDestroyNotify) sipe_ocs2007_free_container);
+	sipe_private->containers = NULL;
+	if (sipe_private->access_levels) {
+		g_hash_table_destroy(sipe_private->access_levels);
+		sipe_private->access_levels = NULL;
+	}
 }
 
 /**
@@ -333,23 +463,17 @@ sipe_find_container_member(struct sipe_container *container,
 			   const gchar *value)
 {
 	struct sipe_container_member *member;
-	GSList *entry;
+	gchar *key;
 
 	if (container == NULL || type == NULL) {
 		return NULL;
 	}
 
-	entry = container->members;
-	while (entry) {
-		member = entry->data;
-		if (sipe_strcase_equal(member->type, type) &&
-		    sipe_strcase_equal(member->value, value))
-		{
-			return member;
-		}
-		entry = entry->next;
-	}
-	return NULL;
+	key = member_key(type, value);
+	member = g_hash_table_lookup(container->member_index, key);
+	g_free(key);
+
+	return member;
 }
 
 /**
@@ -468,11 +592,10 @@ const gchar *sipe_ocs2007_access_level_name(guint id)
 	return _("Unknown");
 }
 
-/** Member type: user, domain, sameEnterprise, federated, publicCloud; everyone */
-int sipe_ocs2007_find_access_level(struct sipe_core_private *sipe_private,
-				   const gchar *type,
-				   const gchar *value,
-				   gboolean *is_group_access)
+static int find_access_level(struct sipe_core_private *sipe_private,
+			     const gchar *type,
+			     const gchar *value,
+			     gboolean *is_group_access)
 {
 	int container_id = -1;
 
@@ -518,6 +641,42 @@ int sipe_ocs2007_find_access_level(struct sipe_core_private *sipe_private,
 	return container_id;
 }
 
+/** Member type: user, domain, sameEnterprise, federated, publicCloud; everyone */
+int sipe_ocs2007_find_access_level(struct sipe_core_private *sipe_private,
+				   const gchar *type,
+				   const gchar *value,
+				   gboolean *is_group_access)
+{
+	struct sipe_access_level *level;
+	gchar *key;
+
+	if (!type)
+		return(find_access_level(sipe_private, type, value, is_group_access));
+
+	/* results are valid until our containers change */
+	if (!sipe_private->access_levels)
+		sipe_private->access_levels = g_hash_table_new_full(g_str_hash,
+								    g_str_equal,
+								    g_free,
+								    g_free);
+
+	key   = access_level_key(type, value);
+	level = g_hash_table_lookup(sipe_private->access_levels, key);
+	if (level) {
+		g_free(key);
+	} else {
+		level = g_new(struct sipe_access_level, 1);
+		level->container_id = find_access_level(sipe_private,
+							type,
+							value,
+							&level->is_group_access);
+		g_hash_table_insert(sipe_private->access_levels, key, level);
+	}
+
+	if (is_group_access) *is_group_access = level->is_group_access;
+	return(level->container_id);
+}
+
 static GSList *get_access_domains(struct sipe_core_private *sipe_private)
 {
 	struct sipe_container *container;
@@ -641,7 +800,9 @@ void sipe_ocs2007_change_access_level(struct sipe_core_private *sipe_private,
 			if (container_id < 0 || container_id != current_container_id) {
 				sipe_send_container_members_prepare(current_container_id, container->version, "remove", type, value, &container_xmls);
 				/* remove member from our cache, to be able to recalculate AL below */
-				container->members = g_slist_remove(container->members, member);
+				container_remove_member(container, member);
+				container->modified = TRUE;
+				access_level_cache_invalidate(sipe_private, type, value);
 			}
 		}
 	}
@@ -655,6 +816,7 @@ void sipe_ocs2007_change_access_level(struct sipe_core_private *sipe_private,
 		guint version = container ? container->version : 0;
 
 		sipe_send_container_members_prepare(container_id, version, "add", type, value, &container_xmls);
+		access_level_cache_invalidate(sipe_private, type, value);
 	}
 
 	if (container_xmls) {
@@ -2089,7 +2251,7 @@ void sipe_ocs2007_process_roaming_self(struct sipe_core_private *sipe_private,
 
 	SIPE_DEBUG_INFO_NOFORMAT("sipe_ocs2007_process_roaming_self");
 
-	xml = sipe_xml_parse(msg->body, msg->bodylen);
+	xml = sipe_xml_parse_arena(msg->body, msg->bodylen);
 	if (!xml) return;
 
 	contact = get_contact(sipe_private);
@@ -2375,24 +2537,29 @@ void sipe_ocs2007_process_roaming_self(struct sipe_core_private *sipe_private,
 	/* containers */
 	for (node = sipe_xml_child(xml, "containers/container"); node; node = sipe_xml_twin(node)) {
 		guint id = sipe_xml_int_attribute(node, "id", 0);
+		guint version = sipe_xml_int_attribute(node, "version", 0);
 		struct sipe_container *container = sipe_find_container(sipe_private, id);
 
 		if (container) {
+			/* members can't change without new version */
+			if (!container->modified && (container->version == version)) {
+				SIPE_DEBUG_INFO("sipe_ocs2007_process_roaming_self: unchanged container id=%d v%d", id, version);
+				continue;
+			}
+
 			sipe_private->containers = g_slist_remove(sipe_private->containers, container);
 			SIPE_DEBUG_INFO("sipe_ocs2007_process_roaming_self: removed existing container id=%d v%d", container->id, container->version);
 			sipe_ocs2007_free_container(container);
 		}
-		container = g_new0(struct sipe_container, 1);
-		container->id = id;
-		container->version = sipe_xml_int_attribute(node, "version", 0);
+		container = container_new(id, version);
 		sipe_private->containers = g_slist_append(sipe_private->containers, container);
+		access_level_cache_flush(sipe_private);
 		SIPE_DEBUG_INFO("sipe_ocs2007_process_roaming_self: added container id=%d v%d", container->id, container->version);
 
 		for (node2 = sipe_xml_child(node, "member"); node2; node2 = sipe_xml_twin(node2)) {
-			struct sipe_container_member *member = g_new0(struct sipe_container_member, 1);
-			member->type = g_strdup(sipe_xml_attribute(node2, "type"));
-			member->value = g_strdup(sipe_xml_attribute(node2, "value"));
-			container->members = g_slist_append(container->members, member);
+			struct sipe_container_member *member = container_add_member(container,
+										    sipe_xml_attribute(node2, "type"),
+										    sipe_xml_attribute(node2, "value"));
 			SIPE_DEBUG_INFO("sipe_ocs2007_process_roaming_self: added container member type=%s value=%s",
 					member->type, member->value ? member->value : "");
 		}
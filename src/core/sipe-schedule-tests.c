@@ -0,0 +1,336 @@
+/**
+ * @file sipe-schedule-tests.c
+ *
+ * pidgin-sipe
+ *
+ * Copyright (C) 2020 SIPE Project <http://sipe.sourceforge.net/>
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+
+#include <glib.h>
+
+#include "sipe-common.h"
+#include "sip-transport.h"
+
+#define SIPE_SCHEDULE_COMPILING_TEST
+static gint64 schedule_test_now = 0;
+#include "sipe-schedule.c"
+
+/*
+ * Stubs
+ */
+gboolean sipe_backend_debug_enabled(void)
+{
+	return(FALSE);
+}
+
+void sipe_backend_debug_literal(SIPE_UNUSED_PARAMETER sipe_debug_level level,
+				SIPE_UNUSED_PARAMETER const gchar *msg)
+{
+}
+
+void sipe_backend_debug(SIPE_UNUSED_PARAMETER sipe_debug_level level,
+			SIPE_UNUSED_PARAMETER const gchar *format,
+			...)
+{
+}
+
+const gchar *sip_transport_epid(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+	return(NULL);
+}
+
+/* needed when linking against NSS */
+void md4sum(const uint8_t *data, uint32_t length, uint8_t *digest);
+void md4sum(SIPE_UNUSED_PARAMETER const uint8_t *data,
+	    SIPE_UNUSED_PARAMETER uint32_t length,
+	    SIPE_UNUSED_PARAMETER uint8_t *digest)
+{
+}
+
+static const gchar *slack_setting = NULL;
+const gchar *sipe_backend_setting(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+				  sipe_setting type)
+{
+	return((type == SIPE_SETTING_SCHEDULE_SLACK) ? slack_setting : NULL);
+}
+
+/* backend: single timer */
+static gpointer backend_timer    = NULL;
+static guint    backend_timeout  = 0;
+static guint    backend_requests = 0;
+
+gpointer sipe_backend_schedule_mseconds(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+					guint timeout,
+					gpointer data)
+{
+	backend_timer   = data;
+	backend_timeout = timeout;
+	backend_requests++;
+	return(data);
+}
+
+void sipe_backend_schedule_cancel(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+				  gpointer data)
+{
+	if (data == backend_timer)
+		backend_timer = NULL;
+}
+
+/*
+ * Tester code
+ */
+static guint succeeded = 0;
+static guint failed    = 0;
+
+static void assert_equal(gint64 expected, gint64 got, const gchar *what)
+{
+	if (expected == got) {
+		succeeded++;
+	} else {
+		printf("FAILED: %s: %" G_GINT64_FORMAT " expected %" G_GINT64_FORMAT "\n",
+		       what, got, expected);
+		failed++;
+	}
+}
+
+/* fire backend timer, i.e. advance clock to its deadline */
+static gboolean backend_fire(void)
+{
+	gpointer queue = backend_timer;
+
+	if (!queue)
+		return(FALSE);
+	schedule_test_now += backend_timeout;
+	backend_timer = NULL;
+	sipe_core_schedule_execute(queue);
+	return(TRUE);
+}
+
+static GString *executed   = NULL;
+static guint    destroyed  = 0;
+static gint64   last_fired = 0;
+static gboolean ordered    = TRUE;
+
+static void test_action(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+			gpointer data)
+{
+	if (schedule_test_now < last_fired)
+		ordered = FALSE;
+	last_fired = schedule_test_now;
+	g_string_append(executed, data);
+}
+
+static void test_destroy(SIPE_UNUSED_PARAMETER gpointer data)
+{
+	destroyed++;
+}
+
+static void test_reset(struct sipe_core_private *sipe_private)
+{
+	sipe_schedule_cancel_all(sipe_private);
+	g_string_truncate(executed, 0);
+	schedule_test_now = 0;
+	destroyed         = 0;
+	last_fired        = 0;
+	ordered           = TRUE;
+	backend_timer     = NULL;
+	backend_requests  = 0;
+}
+
+static void tests_heap(struct sipe_core_private *sipe_private)
+{
+	static const gchar * const payloads[] = { "a", "b", "c", "d", "e",
+						  "f", "g", "h", "i", "j" };
+	guint32 seed = 4711;
+	guint count  = 0;
+	guint i;
+
+	test_reset(sipe_private);
+
+	/* pseudo-random deadlines, names repeat and replace earlier entries */
+	for (i = 0; i < 1000; i++) {
+		gchar *name = g_strdup_printf("<test><%u>", i % 300);
+		seed = seed * 1103515245 + 12345;
+		sipe_schedule_mseconds(sipe_private,
+				       name,
+				       (gpointer) payloads[i % 10],
+				       (seed >> 8) % 100000,
+				       test_action,
+				       test_destroy);
+		g_free(name);
+	}
+	assert_equal(300, sipe_private->timeouts->heap->len, "entries after replace");
+	assert_equal(300, g_hash_table_size(sipe_private->timeouts->names), "names after replace");
+	assert_equal(700, destroyed, "replaced payloads destroyed");
+
+	/* heap invariant and name index after random cancels */
+	for (i = 0; i < 300; i += 3) {
+		gchar *name = g_strdup_printf("<test><%u>", i);
+		sipe_schedule_cancel(sipe_private, name);
+		g_free(name);
+	}
+	for (i = 1; i < sipe_private->timeouts->heap->len; i++)
+		if (HEAP_ENTRY(sipe_private->timeouts->heap, (i - 1) / 2)->deadline >
+		    HEAP_ENTRY(sipe_private->timeouts->heap, i)->deadline)
+			break;
+	assert_equal(sipe_private->timeouts->heap->len, i, "heap invariant");
+	assert_equal(200, g_hash_table_size(sipe_private->timeouts->names), "names after cancel");
+	assert_equal(TRUE,
+		     sipe_private->timeouts->backend_deadline <=
+		     HEAP_ENTRY(sipe_private->timeouts->heap, 0)->deadline,
+		     "backend timer not later than earliest deadline");
+
+	while (backend_fire())
+		count++;
+	assert_equal(200, executed->len, "all remaining actions executed");
+	assert_equal(TRUE, ordered, "execution in deadline order");
+	assert_equal(1000, destroyed, "all payloads destroyed");
+	assert_equal(TRUE, count <= 200, "at most one backend timeout per action");
+	assert_equal(TRUE, sipe_private->timeouts->heap->len == 0, "heap empty");
+}
+
+static void tests_reschedule(struct sipe_core_private *sipe_private)
+{
+	test_reset(sipe_private);
+
+	/* rescheduling replaces the action and moves its deadline */
+	sipe_schedule_mseconds(sipe_private, "<x>", "1", 100,
+			       test_action, test_destroy);
+	sipe_schedule_mseconds(sipe_private, "<y>", "y", 200,
+			       test_action, test_destroy);
+	sipe_schedule_mseconds(sipe_private, "<x>", "2", 300,
+			       test_action, test_destroy);
+	assert_equal(TRUE, sipe_private->timeouts->backend_deadline <= 200,
+		     "backend timer not later than moved deadline");
+	while (backend_fire());
+	assert_equal(TRUE, sipe_strequal(executed->str, "y2"), "rescheduled action order");
+	assert_equal(300, last_fired, "rescheduled deadline");
+	assert_equal(3, destroyed, "replaced payload destroyed");
+}
+
+static void self_reschedule(struct sipe_core_private *sipe_private,
+			    gpointer data)
+{
+	test_action(sipe_private, data);
+	sipe_schedule_mseconds(sipe_private, "<self>", data, 0,
+			       self_reschedule, NULL);
+}
+
+static void tests_same_pass(struct sipe_core_private *sipe_private)
+{
+	test_reset(sipe_private);
+
+	/* actions added during execution wait for the next backend timer */
+	sipe_schedule_mseconds(sipe_private, "<self>", "s", 0,
+			       self_reschedule, NULL);
+	backend_fire();
+	assert_equal(1, executed->len, "0ms action runs once per pass");
+	assert_equal(TRUE, backend_timer != NULL, "0ms action scheduled again");
+	backend_fire();
+	assert_equal(2, executed->len, "0ms action runs in next pass");
+}
+
+static void tests_slack(struct sipe_core_private *sipe_private)
+{
+	test_reset(sipe_private);
+
+	/* default slack: timers in seconds close to each other coalesce */
+	sipe_schedule_seconds(sipe_private, "<a>", "a", 10,
+			      test_action, NULL);
+	schedule_test_now = 300;
+	sipe_schedule_seconds(sipe_private, "<b>", "b", 10,
+			      test_action, NULL);
+	schedule_test_now = 0;
+	sipe_schedule_mseconds(sipe_private, "<c>", "c", 10400,
+			       test_action, NULL);
+	assert_equal(1, backend_requests, "no new backend timer for slack");
+	backend_fire();
+	assert_equal(TRUE, sipe_strequal(executed->str, "ab"), "seconds timers coalesced");
+	assert_equal(400, backend_timeout, "milliseconds timer not coalesced");
+	backend_fire();
+	assert_equal(TRUE, sipe_strequal(executed->str, "abc"), "milliseconds timer");
+
+	/* slack from account setting, read when the queue is created */
+	test_reset(sipe_private);
+	slack_setting = "0";
+	sipe_schedule_seconds(sipe_private, "<a>", "a", 10,
+			      test_action, NULL);
+	schedule_test_now = 300;
+	sipe_schedule_seconds(sipe_private, "<b>", "b", 10,
+			      test_action, NULL);
+	schedule_test_now = 0;
+	backend_fire();
+	assert_equal(TRUE, sipe_strequal(executed->str, "a"), "no slack from setting");
+	slack_setting = "invalid";
+	test_reset(sipe_private);
+	sipe_schedule_seconds(sipe_private, "<a>", "a", 1,
+			      test_action, NULL);
+	assert_equal(SIPE_SCHEDULE_SLACK_MSECONDS, sipe_private->timeouts->slack,
+		     "invalid setting uses default");
+	slack_setting = NULL;
+}
+
+static void tests_long_timeout(struct sipe_core_private *sipe_private)
+{
+	test_reset(sipe_private);
+
+	/* 5,000,000 seconds doesn't fit into guint milliseconds */
+	sipe_schedule_seconds(sipe_private, "<long>", "l", 5000000,
+			      test_action, NULL);
+	assert_equal(((gint64) 5000000) * 1000,
+		     HEAP_ENTRY(sipe_private->timeouts->heap, 0)->deadline,
+		     "deadline computed in 64-bit");
+	assert_equal(G_MAXUINT, backend_timeout, "backend timeout clamped");
+	backend_fire();
+	assert_equal(0, executed->len, "not executed before deadline");
+	assert_equal(TRUE, backend_timer != NULL, "backend timer restarted");
+	test_reset(sipe_private);
+}
+
+int main(SIPE_UNUSED_PARAMETER int argc, SIPE_UNUSED_PARAMETER char *argv[])
+{
+	struct sipe_core_private *sipe_private = g_new0(struct sipe_core_private, 1);
+
+	executed = g_string_new(NULL);
+
+	tests_heap(sipe_private);
+	tests_reschedule(sipe_private);
+	tests_same_pass(sipe_private);
+	tests_slack(sipe_private);
+	tests_long_timeout(sipe_private);
+
+	g_string_free(executed, TRUE);
+	g_free(sipe_private);
+
+	printf("Result: %d PASSED %d FAILED\n", succeeded, failed);
+	return(failed);
+}
+
+/*
+  Local Variables:
+  mode: c
+  c-file-style: "bsd"
+  indent-tabs-mode: t
+  tab-width: 8
+  End:
+*/
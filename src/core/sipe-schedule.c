@@ -20,12 +20,31 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+#include <stdlib.h>
+
 #include <glib.h>
 
 #include "sipe-backend.h"
 #include "sipe-core.h"
 #include "sipe-core-private.h"
 #include "sipe-schedule.h"
+#include "sipe-utils.h"
+
+/*
+ * Timers are kept in a binary min-heap ordered by deadline. A hash table
+ * maps action names to heap entries for O(1) cancel. Only the earliest
+ * deadline is scheduled with the backend.
+ *
+ * Timers scheduled in seconds are allowed to fire up to the slack window
+ * early, so that timers expiring close to each other are executed by a
+ * single backend timeout. The window is SIPE_SCHEDULE_SLACK_MSECONDS
+ * unless the account setting SIPE_SETTING_SCHEDULE_SLACK overrides it.
+ *
+ * Timers added while actions are executed are left for the next backend
+ * timeout, even if they are already due. Otherwise an action that
+ * reschedules itself with 0ms would never return to the main loop.
+ */
+#define SIPE_SCHEDULE_SLACK_MSECONDS 500
 
 struct sipe_schedule {
 	/**
@@ -34,13 +53,40 @@ struct sipe_schedule {
 	 * Example:  <presence><sip:user@domain.com> or <registration>
 	 */
 	gchar *name;
-	struct sipe_core_private *sipe_private;
-	gpointer backend_private;
 	gpointer payload;
 	sipe_schedule_action action;
 	GDestroyNotify destroy;
+	gint64 deadline;        /* milliseconds */
+	guint slack;            /* milliseconds */
+	guint index;            /* position in heap */
+	guint pass;             /* execution pass when scheduled */
 };
 
+struct sipe_schedule_queue {
+	struct sipe_core_private *sipe_private;
+	GPtrArray *heap;        /* struct sipe_schedule * */
+	GHashTable *names;      /* name -> struct sipe_schedule * */
+	gpointer backend_private;
+	gint64 backend_deadline;
+	guint slack;            /* milliseconds, for timers in seconds */
+	guint pass;             /* incremented for each execution */
+	gboolean executing;
+	gboolean cancelled;     /* cancel_all() called during execution */
+};
+
+gint64 sipe_schedule_now(void)
+{
+#ifdef SIPE_SCHEDULE_COMPILING_TEST
+	return(schedule_test_now);
+#elif GLIB_CHECK_VERSION(2,28,0)
+	return(g_get_monotonic_time() / 1000);
+#else
+	GTimeVal now;
+	g_get_current_time(&now);
+	return(((gint64) now.tv_sec) * 1000 + now.tv_usec / 1000);
+#endif
+}
+
 static void sipe_schedule_deallocate(struct sipe_schedule *schedule)
 {
 	if (schedule->destroy) (*schedule->destroy)(schedule->payload);
@@ -48,41 +94,209 @@ static void sipe_schedule_deallocate(struct sipe_schedule *schedule)
 	g_free(schedule);
 }
 
+#define HEAP_ENTRY(heap, i) ((struct sipe_schedule *) g_ptr_array_index(heap, i))
+
+static void heap_set(GPtrArray *heap, guint i, struct sipe_schedule *schedule)
+{
+	g_ptr_array_index(heap, i) = schedule;
+	schedule->index = i;
+}
+
+static void heap_sift_up(GPtrArray *heap, guint i)
+{
+	struct sipe_schedule *schedule = HEAP_ENTRY(heap, i);
+
+	while (i > 0) {
+		guint parent = (i - 1) / 2;
+		struct sipe_schedule *p = HEAP_ENTRY(heap, parent);
+		if (p->deadline <= schedule->deadline)
+			break;
+		heap_set(heap, i, p);
+		i = parent;
+	}
+	heap_set(heap, i, schedule);
+}
+
+static void heap_sift_down(GPtrArray *heap, guint i)
+{
+	struct sipe_schedule *schedule = HEAP_ENTRY(heap, i);
+	guint length = heap->len;
+
+	while (1) {
+		guint child = 2 * i + 1;
+		struct sipe_schedule *c;
+		if (child >= length)
+			break;
+		if ((child + 1 < length) &&
+		    (HEAP_ENTRY(heap, child + 1)->deadline < HEAP_ENTRY(heap, child)->deadline))
+			child++;
+		c = HEAP_ENTRY(heap, child);
+		if (schedule->deadline <= c->deadline)
+			break;
+		heap_set(heap, i, c);
+		i = child;
+	}
+	heap_set(heap, i, schedule);
+}
+
+/* removes entry from heap and name index, but doesn't free it */
+static void sipe_schedule_unlink(struct sipe_schedule_queue *queue,
+				 struct sipe_schedule *schedule)
+{
+	GPtrArray *heap = queue->heap;
+	guint i = schedule->index;
+	struct sipe_schedule *last = g_ptr_array_remove_index(heap, heap->len - 1);
+
+	g_hash_table_remove(queue->names, schedule->name);
+
+	if (last != schedule) {
+		heap_set(heap, i, last);
+		heap_sift_down(heap, i);
+		heap_sift_up(heap, last->index);
+	}
+}
+
+/* (re-)schedule backend timer for the earliest deadline */
+static void sipe_schedule_update_timer(struct sipe_schedule_queue *queue)
+{
+	struct sipe_core_private *sipe_private = queue->sipe_private;
+	struct sipe_schedule *first;
+	gint64 now;
+
+	/* will be called after all expired actions have been executed */
+	if (queue->executing)
+		return;
+
+	if (queue->heap->len == 0) {
+		if (queue->backend_private) {
+			sipe_backend_schedule_cancel(SIPE_CORE_PUBLIC,
+						     queue->backend_private);
+			queue->backend_private = NULL;
+		}
+		return;
+	}
+
+	first = HEAP_ENTRY(queue->heap, 0);
+
+	/* current timer is early enough or only slightly late */
+	if (queue->backend_private &&
+	    (queue->backend_deadline <= first->deadline + first->slack))
+		return;
+
+	if (queue->backend_private)
+		sipe_backend_schedule_cancel(SIPE_CORE_PUBLIC,
+					     queue->backend_private);
+
+	now = sipe_schedule_now();
+	queue->backend_deadline = first->deadline;
+	queue->backend_private  = sipe_backend_schedule_mseconds(SIPE_CORE_PUBLIC,
+								 (first->deadline <= now) ?
+								 0 :
+								 (first->deadline - now > G_MAXUINT) ?
+								 G_MAXUINT :
+								 (guint) (first->deadline - now),
+								 queue);
+}
+
+static void sipe_schedule_queue_free(struct sipe_schedule_queue *queue)
+{
+	g_ptr_array_free(queue->heap, TRUE);
+	g_hash_table_destroy(queue->names);
+	g_free(queue);
+}
+
 void sipe_core_schedule_execute(gpointer data)
 {
-	struct sipe_schedule *expired = data;
-	struct sipe_core_private *sipe_private = expired->sipe_private;
+	struct sipe_schedule_queue *queue = data;
+	struct sipe_core_private *sipe_private = queue->sipe_private;
+	gint64 now = sipe_schedule_now();
+
+	/* backend timer has expired */
+	queue->backend_private = NULL;
+	queue->executing       = TRUE;
+	queue->pass++;
+
+	while (!queue->cancelled && queue->heap->len) {
+		struct sipe_schedule *expired = HEAP_ENTRY(queue->heap, 0);
+
+		if ((expired->deadline > now + expired->slack) ||
+		    (expired->pass == queue->pass))
+			break;
+
+		SIPE_DEBUG_INFO("sipe_core_schedule_execute: executing %s", expired->name);
+		sipe_schedule_unlink(queue, expired);
+		SIPE_DEBUG_INFO("sipe_core_schedule_execute timeouts count %d after removal",
+				queue->heap->len);
+
+		(*expired->action)(sipe_private, expired->payload);
+		sipe_schedule_deallocate(expired);
+	}
+
+	queue->executing = FALSE;
+	if (queue->cancelled)
+		sipe_schedule_queue_free(queue);
+	else
+		sipe_schedule_update_timer(queue);
+}
+
+static guint sipe_schedule_slack(struct sipe_core_private *sipe_private)
+{
+	const gchar *setting = sipe_backend_setting(SIPE_CORE_PUBLIC,
+						    SIPE_SETTING_SCHEDULE_SLACK);
 
-	SIPE_DEBUG_INFO("sipe_core_schedule_execute: executing %s", expired->name);
-	sipe_private->timeouts = g_slist_remove(sipe_private->timeouts, expired);
-	SIPE_DEBUG_INFO("sipe_core_schedule_execute timeouts count %d after removal",
-			g_slist_length(sipe_private->timeouts));
+	if (!is_empty(setting)) {
+		gchar *end;
+		gulong slack = strtoul(setting, &end, 10);
+
+		if ((*end == '\0') && (slack <= G_MAXUINT))
+			return(slack);
+		SIPE_DEBUG_ERROR("sipe_schedule_slack: invalid setting '%s'",
+				 setting);
+	}
 
-	(*expired->action)(sipe_private, expired->payload);
-	sipe_schedule_deallocate(expired);
+	return(SIPE_SCHEDULE_SLACK_MSECONDS);
 }
 
-static struct sipe_schedule *sipe_schedule_allocate(struct sipe_core_private *sipe_private,
-						    const gchar *name,
-						    gpointer payload,
-						    sipe_schedule_action action,
-						    GDestroyNotify destroy)
+static void sipe_schedule_allocate(struct sipe_core_private *sipe_private,
+				   const gchar *name,
+				   gpointer payload,
+				   gint64 milliseconds,
+				   gboolean coalesce,
+				   sipe_schedule_action action,
+				   GDestroyNotify destroy)
 {
+	struct sipe_schedule_queue *queue;
 	struct sipe_schedule *new;
 
 	/* Make sure each action only exists once */
 	sipe_schedule_cancel(sipe_private, name);
 
+	queue = sipe_private->timeouts;
+	if (!queue) {
+		sipe_private->timeouts = queue = g_new0(struct sipe_schedule_queue, 1);
+		queue->sipe_private = sipe_private;
+		queue->heap         = g_ptr_array_new();
+		queue->names        = g_hash_table_new(g_str_hash, g_str_equal);
+		queue->slack        = sipe_schedule_slack(sipe_private);
+	}
+
 	new = g_new0(struct sipe_schedule, 1);
 	new->name = g_strdup(name);
-	new->sipe_private = sipe_private;
 	new->payload = payload;
 	new->action = action;
 	new->destroy = destroy;
-	sipe_private->timeouts = g_slist_append(sipe_private->timeouts, new);
+	new->deadline = sipe_schedule_now() + milliseconds;
+	new->slack = coalesce ? queue->slack : 0;
+	new->pass = queue->pass;
+
+	g_ptr_array_add(queue->heap, new);
+	new->index = queue->heap->len - 1;
+	heap_sift_up(queue->heap, new->index);
+	g_hash_table_insert(queue->names, new->name, new);
 	SIPE_DEBUG_INFO("sipe_schedule_allocate timeouts count %d after addition",
-			g_slist_length(sipe_private->timeouts));
-	return(new);
+			queue->heap->len);
+
+	sipe_schedule_update_timer(queue);
 }
 
 void sipe_schedule_seconds(struct sipe_core_private *sipe_private,
@@ -92,16 +306,15 @@ void sipe_schedule_seconds(struct sipe_core_private *sipe_private,
 			   sipe_schedule_action action,
 			   GDestroyNotify destroy)
 {
-	struct sipe_schedule *new = sipe_schedule_allocate(sipe_private,
-							   name,
-							   payload,
-							   action,
-							   destroy);
 	SIPE_DEBUG_INFO("scheduling action %s timeout %d seconds",
 			name, seconds);
-	new->backend_private = sipe_backend_schedule_seconds(SIPE_CORE_PUBLIC,
-							     seconds,
-							     new);
+	sipe_schedule_allocate(sipe_private,
+			       name,
+			       payload,
+			       ((gint64) seconds) * 1000,
+			       TRUE,
+			       action,
+			       destroy);
 }
 
 void sipe_schedule_mseconds(struct sipe_core_private *sipe_private,
@@ -111,61 +324,63 @@ void sipe_schedule_mseconds(struct sipe_core_private *sipe_private,
 			    sipe_schedule_action action,
 			    GDestroyNotify destroy)
 {
-	struct sipe_schedule *new = sipe_schedule_allocate(sipe_private,
-							   name,
-							   payload,
-							   action,
-							   destroy);
 	SIPE_DEBUG_INFO("scheduling action %s timeout %d milliseconds",
 			name, milliseconds);
-	new->backend_private = sipe_backend_schedule_mseconds(SIPE_CORE_PUBLIC,
-							      milliseconds,
-							      new);
-}
-
-static void sipe_schedule_remove(struct sipe_core_private *sipe_private,
-				 struct sipe_schedule *schedule)
-{
-	SIPE_DEBUG_INFO("sipe_schedule_remove: action name=%s",
-			schedule->name);
-	sipe_backend_schedule_cancel(SIPE_CORE_PUBLIC,
-				     schedule->backend_private);
-	sipe_schedule_deallocate(schedule);
+	sipe_schedule_allocate(sipe_private,
+			       name,
+			       payload,
+			       milliseconds,
+			       FALSE,
+			       action,
+			       destroy);
 }
 
 void sipe_schedule_cancel(struct sipe_core_private *sipe_private,
 			  const gchar *name)
 {
-	GSList *entry;
-
-	if (!sipe_private->timeouts || !name) return;
-
-	entry = sipe_private->timeouts;
-	while (entry) {
-		struct sipe_schedule *schedule = entry->data;
-		if (sipe_strequal(schedule->name, name)) {
-			GSList *to_delete = entry;
-			entry = entry->next;
-			sipe_private->timeouts = g_slist_delete_link(sipe_private->timeouts,
-								     to_delete);
-			sipe_schedule_remove(sipe_private, schedule);
-		} else {
-			entry = entry->next;
-		}
+	struct sipe_schedule_queue *queue = sipe_private->timeouts;
+	struct sipe_schedule *schedule;
+
+	if (!queue || !name) return;
+
+	schedule = g_hash_table_lookup(queue->names, name);
+	if (schedule) {
+		SIPE_DEBUG_INFO("sipe_schedule_remove: action name=%s",
+				schedule->name);
+		sipe_schedule_unlink(queue, schedule);
+		sipe_schedule_deallocate(schedule);
+		sipe_schedule_update_timer(queue);
 	}
 }
 
 void sipe_schedule_cancel_all(struct sipe_core_private *sipe_private)
 {
-	GSList *entry = sipe_private->timeouts;
+	struct sipe_schedule_queue *queue = sipe_private->timeouts;
+	guint i;
+
+	if (!queue) return;
 
-	while (entry) {
-		sipe_schedule_remove(sipe_private, entry->data);
-		entry = entry->next;
+	if (queue->backend_private) {
+		sipe_backend_schedule_cancel(SIPE_CORE_PUBLIC,
+					     queue->backend_private);
+		queue->backend_private = NULL;
 	}
 
-	g_slist_free(sipe_private->timeouts);
+	for (i = 0; i < queue->heap->len; i++) {
+		struct sipe_schedule *schedule = HEAP_ENTRY(queue->heap, i);
+		SIPE_DEBUG_INFO("sipe_schedule_remove: action name=%s",
+				schedule->name);
+		sipe_schedule_deallocate(schedule);
+	}
+	g_ptr_array_set_size(queue->heap, 0);
+	g_hash_table_remove_all(queue->names);
 	sipe_private->timeouts = NULL;
+
+	/* sipe_core_schedule_execute() frees queue after action returns */
+	if (queue->executing)
+		queue->cancelled = TRUE;
+	else
+		sipe_schedule_queue_free(queue);
 }
 
 /*
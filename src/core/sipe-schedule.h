@@ -53,6 +53,13 @@ void sipe_schedule_cancel(struct sipe_core_private *sipe_private,
 			  const gchar *name);
 void sipe_schedule_cancel_all(struct sipe_core_private *sipe_private);
 
+/**
+ * Monotonic clock used for schedule deadlines
+ *
+ * @return current time in milliseconds
+ */
+gint64 sipe_schedule_now(void);
+
 /*
   Local Variables:
   mode: c
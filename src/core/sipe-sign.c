@@ -30,150 +30,249 @@
 #include "sipe-sign.h"
 #include "sipe-utils.h"
 
-static gchar * const empty_string = "";
+/* value slice borrowed from a header */
+struct sipmsg_breakdown_field {
+	const gchar *value;
+	gsize length;
+};
 
-void sipmsg_breakdown_parse(struct sipmsg_breakdown * msg, const gchar * realm, const gchar * target,
-			    const gchar *protocol)
+static void field_set(struct sipmsg_breakdown_field *field,
+		      const gchar *value,
+		      gsize length)
 {
-	const gchar * hdr;
-	if (msg == NULL || msg->msg == NULL) {
-		SIPE_DEBUG_INFO_NOFORMAT("sipmsg_breakdown_parse msg or msg->msg is NULL");
+	field->value  = value;
+	field->length = length;
+}
+
+static void field_set_string(struct sipmsg_breakdown_field *field,
+			     const gchar *value)
+{
+	if (value)
+		field_set(field, value, strlen(value));
+	else
+		field_set(field, "", 0);
+}
+
+/* same semantics as sipmsg_find_part_of_header() */
+static void field_set_part(struct sipmsg_breakdown_field *field,
+			   const gchar *hdr,
+			   const gchar *before,
+			   const gchar *after)
+{
+	const gchar *start = hdr && before ? strstr(hdr, before) : hdr;
+	const gchar *end;
+
+	if (!start) {
+		field_set(field, "", 0);
 		return;
 	}
+	if (before)
+		start += strlen(before);
+
+	end = after ? strstr(start, after) : NULL;
+	if (end)
+		field_set(field, start, end - start);
+	else
+		field_set_string(field, start);
+}
 
-	msg->rand = msg->num = msg->realm = msg->target_name =
-		msg->cseq = msg->from_url = msg->from_tag = msg->to_url = msg->to_tag =
-		msg->p_assertet_identity_sip_uri = msg->p_assertet_identity_tel_uri = empty_string;
-	msg->call_id = msg->expires = empty_string;
-
-	if ((hdr = sipmsg_find_header(msg->msg, "Proxy-Authorization")) ||
-	    (hdr = sipmsg_find_header(msg->msg, "Proxy-Authentication-Info")) ||
-	    (hdr = sipmsg_find_header(msg->msg, "Authentication-Info")) ) {
-		msg->protocol = sipmsg_find_part_of_header(hdr, NULL, " ", empty_string);
-		msg->rand   = sipmsg_find_part_of_header(hdr, "rand=\"", "\"", empty_string);
-		msg->num    = sipmsg_find_part_of_header(hdr, "num=\"", "\"", empty_string);
-		msg->realm  = sipmsg_find_part_of_header(hdr, "realm=\"", "\"", empty_string);
-		msg->target_name = sipmsg_find_part_of_header(hdr, "targetname=\"", "\"", empty_string);
+/* same semantics as parse_from() */
+static void field_set_address(struct sipmsg_breakdown_field *field,
+			      const gchar *hdr)
+{
+	const gchar *start;
+	const gchar *end;
+
+	field_set(field, "", 0);
+	if (!hdr)
+		return;
+
+	start = strchr(hdr, '<');
+	if (start) { /* sip address in <...> */
+		start++;
+		end = strchr(start, '>');
+		if (end)
+			field_set(field, start, end - start);
 	} else {
-		msg->protocol = g_strdup(protocol);
-		msg->realm = g_strdup(realm);
-		msg->target_name = g_strdup(target);
+		end = strchr(hdr, ';');
+		if (end)
+			field_set(field, hdr, end - hdr);
+		else
+			field_set_string(field, hdr);
 	}
+}
 
-	msg->call_id = sipmsg_find_call_id_header(msg->msg);
+/* same semantics as sipmsg_parse_p_asserted_identity() */
+static void field_set_p_asserted_identity(struct sipmsg_breakdown_field *sip_uri,
+					  struct sipmsg_breakdown_field *tel_uri,
+					  const gchar *hdr)
+{
+	field_set(sip_uri, "", 0);
+	field_set(tel_uri, "", 0);
+	if (!hdr)
+		return;
 
-	hdr = sipmsg_find_cseq_header(msg->msg);
-	if (NULL != hdr) {
-		msg->cseq = sipmsg_find_part_of_header(hdr, NULL, " ", empty_string);
+	if (g_ascii_strncasecmp(hdr, "tel:", 4) == 0) {
+		field_set_string(tel_uri, hdr);
+		return;
 	}
 
-	hdr = sipmsg_find_from_header(msg->msg);
-	if (NULL != hdr) {
-		gchar *address = parse_from(hdr);
-		if (address)
-			msg->from_url = address;
-		msg->from_tag = sipmsg_find_part_of_header(hdr, ";tag=", ";", empty_string);
-	}
+	while (*hdr) {
+		const gchar *end   = strchr(hdr, ',');
+		const gchar *start;
 
-	hdr = sipmsg_find_to_header(msg->msg);
-	if (NULL != hdr) {
-		gchar *address = parse_from(hdr);
-		if (address)
-			msg->to_url = address;
-		msg->to_tag = sipmsg_find_part_of_header(hdr, ";tag=", ";", empty_string);
-	}
+		if (!end)
+			end = hdr + strlen(hdr);
 
-	hdr = sipmsg_find_header(msg->msg, "P-Asserted-Identity");
-	if (NULL == hdr) {
-		hdr = sipmsg_find_header(msg->msg, "P-Preferred-Identity");
-	}
-	if (NULL != hdr) {
-		gchar *sip_uri = NULL;
-		gchar *tel_uri = NULL;
-
-		sipmsg_parse_p_asserted_identity(hdr, &sip_uri, &tel_uri);
-		if (sip_uri)
-			msg->p_assertet_identity_sip_uri = sip_uri;
-		if (tel_uri)
-			msg->p_assertet_identity_tel_uri = tel_uri;
-	}
+		start = memchr(hdr, '<', end - hdr);
+		if (start) {
+			const gchar *stop;
+			gsize length;
+
+			start++;
+			stop   = memchr(start, '>', end - start);
+			length = (stop ? stop : end) - start;
 
-	msg->expires = sipmsg_find_expires_header(msg->msg);
+			/* first URI of each type wins */
+			if ((length >= 4) &&
+			    (g_ascii_strncasecmp(start, "sip:", 4) == 0)) {
+				if (!sip_uri->length)
+					field_set(sip_uri, start, length);
+			} else if ((length >= 4) &&
+				   (g_ascii_strncasecmp(start, "tel:", 4) == 0)) {
+				if (!tel_uri->length)
+					field_set(tel_uri, start, length);
+			}
+		}
+
+		hdr = *end ? end + 1 : end;
+	}
 }
 
-void
-sipmsg_breakdown_free(struct sipmsg_breakdown * msg)
+static void append_field(GString *buffer,
+			 const struct sipmsg_breakdown_field *field)
 {
-	if (msg->protocol != empty_string)
-		g_free(msg->protocol);
-	if (msg->rand != empty_string)
-		g_free(msg->rand);
-	if (msg->num != empty_string)
-		g_free(msg->num);
-	if (msg->realm != empty_string)
-		g_free(msg->realm);
-	if (msg->target_name != empty_string)
-		g_free(msg->target_name);
-
-	// straight from header
-	//g_free(msg->call_id);
-
-	if (msg->cseq != empty_string)
-		g_free(msg->cseq);
-	if (msg->from_url != empty_string)
-		g_free(msg->from_url);
-	if (msg->from_tag != empty_string)
-		g_free(msg->from_tag);
-	if (msg->to_url != empty_string)
-		g_free(msg->to_url);
-	if (msg->to_tag != empty_string)
-		g_free(msg->to_tag);
-
-	if (msg->p_assertet_identity_sip_uri != empty_string)
-		g_free(msg->p_assertet_identity_sip_uri);
-	if (msg->p_assertet_identity_tel_uri != empty_string)
-		g_free(msg->p_assertet_identity_tel_uri);
-
-	// straight from header
-	//g_free (msg->expires);
+	g_string_append_c(buffer, '<');
+	g_string_append_len(buffer, field->value, field->length);
+	g_string_append_c(buffer, '>');
 }
 
-gchar *
-sipmsg_breakdown_get_string(int version,
-			    struct sipmsg_breakdown * msgbd)
+gboolean sipmsg_breakdown_signature_input(GString *buffer,
+					  int version,
+					  const struct sipmsg *msg,
+					  const gchar *realm,
+					  const gchar *target,
+					  const gchar *protocol,
+					  const gchar *rand,
+					  const gchar *num)
 {
-	gchar *response_str;
-	gchar *msg;
-	if (msgbd->realm == empty_string || msgbd->realm == NULL) {
-		SIPE_DEBUG_INFO_NOFORMAT("realm NULL, so returning NULL signature string");
-		return NULL;
+	struct sipmsg_breakdown_field f_protocol, f_rand, f_num, f_realm, f_target;
+	struct sipmsg_breakdown_field f_call_id, f_cseq, f_method;
+	struct sipmsg_breakdown_field f_from_url, f_from_tag, f_to_url, f_to_tag;
+	struct sipmsg_breakdown_field f_pai_sip_uri, f_pai_tel_uri, f_expires;
+	const gchar *proxy_authorization = NULL;
+	const gchar *proxy_authentication_info = NULL;
+	const gchar *p_asserted_identity = NULL;
+	const gchar *p_preferred_identity = NULL;
+	const gchar *auth;
+	const gchar *hdr;
+	struct sipmsg_header_iter iter;
+	const gchar *name;
+	const gchar *value;
+
+	g_string_truncate(buffer, 0);
+
+	/* single pass for headers that aren't indexed */
+	sipmsg_header_iter_init(&iter, msg);
+	while (sipmsg_header_iter_next(&iter, &name, &value)) {
+		if ((name[0] != 'P') && (name[0] != 'p'))
+			continue;
+		if (!proxy_authorization &&
+		    !g_ascii_strcasecmp(name, "Proxy-Authorization"))
+			proxy_authorization = value;
+		else if (!proxy_authentication_info &&
+			 !g_ascii_strcasecmp(name, "Proxy-Authentication-Info"))
+			proxy_authentication_info = value;
+		else if (!p_asserted_identity &&
+			 !g_ascii_strcasecmp(name, "P-Asserted-Identity"))
+			p_asserted_identity = value;
+		else if (!p_preferred_identity &&
+			 !g_ascii_strcasecmp(name, "P-Preferred-Identity"))
+			p_preferred_identity = value;
 	}
 
-	response_str = msgbd->msg->response != 0 ? g_strdup_printf("<%d>", msgbd->msg->response) : empty_string;
-	if (version < 3) {
-		msg = g_strdup_printf(
-			"<%s><%s><%s><%s><%s><%s><%s><%s><%s><%s><%s>" // 1 - 11
-			"<%s>%s", // 12 - 13
-			msgbd->protocol, msgbd->rand, msgbd->num, msgbd->realm, msgbd->target_name, msgbd->call_id, msgbd->cseq,
-			msgbd->msg->method, msgbd->from_url, msgbd->from_tag, msgbd->to_tag,
-			msgbd->expires ? msgbd->expires : empty_string, response_str
-		);
+	auth = proxy_authorization ? proxy_authorization :
+		proxy_authentication_info ? proxy_authentication_info :
+		sipmsg_find_known_header(msg, SIPMSG_HEADER_AUTHENTICATION_INFO);
+	if (auth) {
+		field_set_part(&f_protocol, auth, NULL,           " ");
+		field_set_part(&f_rand,     auth, "rand=\"",       "\"");
+		field_set_part(&f_num,      auth, "num=\"",        "\"");
+		field_set_part(&f_realm,    auth, "realm=\"",      "\"");
+		field_set_part(&f_target,   auth, "targetname=\"", "\"");
 	} else {
-		msg = g_strdup_printf(
-			"<%s><%s><%s><%s><%s><%s><%s><%s><%s><%s><%s><%s><%s><%s>" // 1 - 14
-			"<%s>%s", // 15 - 16
-			msgbd->protocol, msgbd->rand, msgbd->num, msgbd->realm, msgbd->target_name, msgbd->call_id, msgbd->cseq,
-			msgbd->msg->method, msgbd->from_url, msgbd->from_tag, msgbd->to_url, msgbd->to_tag,
-			msgbd->p_assertet_identity_sip_uri, msgbd->p_assertet_identity_tel_uri,
-			msgbd->expires ? msgbd->expires : empty_string, response_str
-		);
+		field_set_string(&f_protocol, protocol);
+		field_set(&f_rand, "", 0);
+		field_set(&f_num,  "", 0);
+		field_set_string(&f_realm,    realm);
+		field_set_string(&f_target,   target);
+	}
+	if (!f_realm.length) {
+		SIPE_DEBUG_INFO_NOFORMAT("sipmsg_breakdown_signature_input: realm unknown, no signature input");
+		return(FALSE);
+	}
+	if (rand)
+		field_set_string(&f_rand, rand);
+	if (num)
+		field_set_string(&f_num, num);
+
+	field_set_string(&f_call_id, sipmsg_find_known_header(msg, SIPMSG_HEADER_CALL_ID));
+	field_set_part(&f_cseq,
+		       sipmsg_find_known_header(msg, SIPMSG_HEADER_CSEQ),
+		       NULL, " ");
+	field_set_string(&f_method, msg->method);
+
+	hdr = sipmsg_find_known_header(msg, SIPMSG_HEADER_FROM);
+	field_set_address(&f_from_url, hdr);
+	field_set_part(&f_from_tag, hdr, ";tag=", ";");
+
+	hdr = sipmsg_find_known_header(msg, SIPMSG_HEADER_TO);
+	field_set_address(&f_to_url, hdr);
+	field_set_part(&f_to_tag, hdr, ";tag=", ";");
+
+	field_set_p_asserted_identity(&f_pai_sip_uri, &f_pai_tel_uri,
+				      p_asserted_identity ? p_asserted_identity : p_preferred_identity);
+
+	field_set_string(&f_expires, sipmsg_find_known_header(msg, SIPMSG_HEADER_EXPIRES));
+
+	append_field(buffer, &f_protocol);
+	append_field(buffer, &f_rand);
+	append_field(buffer, &f_num);
+	append_field(buffer, &f_realm);
+	append_field(buffer, &f_target);
+	append_field(buffer, &f_call_id);
+	append_field(buffer, &f_cseq);
+	append_field(buffer, &f_method);
+	append_field(buffer, &f_from_url);
+	append_field(buffer, &f_from_tag);
+	/* @since 3 */
+	if (version >= 3)
+		append_field(buffer, &f_to_url);
+	append_field(buffer, &f_to_tag);
+	/* @since 3 */
+	if (version >= 3) {
+		append_field(buffer, &f_pai_sip_uri);
+		append_field(buffer, &f_pai_tel_uri);
 	}
+	append_field(buffer, &f_expires);
 
-	if (response_str != empty_string) {
-		g_free(response_str);
+	if (msg->response) {
+		gchar response[16];
+		g_snprintf(response, sizeof(response), "<%d>", msg->response);
+		g_string_append(buffer, response);
 	}
 
-	return msg;
+	return(TRUE);
 }
 
 /*
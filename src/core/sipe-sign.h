@@ -21,32 +21,35 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111-1301  USA
  */
 
-struct sipmsg_breakdown {
-	struct sipmsg * msg;
-	gchar * protocol;
-	gchar * rand;
-	gchar * num;
-	gchar * realm;
-	gchar * target_name;
-	const gchar * call_id;
-	gchar * cseq;
-	//method
-	gchar * from_url;
-	gchar * from_tag;
-	/** @since 3 */
-	gchar * to_url;
-	gchar * to_tag;
-	/** @since 3 */
-	gchar * p_assertet_identity_sip_uri;
-	/** @since 3 */
-	gchar * p_assertet_identity_tel_uri;
-	const gchar * expires;
-	//response code
-};
+/* Forward declarations */
+struct sipmsg;
 
-void sipmsg_breakdown_parse(struct sipmsg_breakdown * msg, const gchar * realm, const gchar * target,
-			    const gchar *protocol);
-gchar*
-sipmsg_breakdown_get_string(int version,
-			    struct sipmsg_breakdown * msgbd);
-void sipmsg_breakdown_free(struct sipmsg_breakdown * msg);
+/**
+ * Create signature input string for a SIP message
+ *
+ * Extracts all fields in a single pass over the message headers. The
+ * fields are copied directly from the header values, i.e. apart from
+ * growing @c buffer no memory is allocated.
+ *
+ * If the message has an authentication header then the protocol, realm
+ * and target name are taken from it, otherwise the defaults are used.
+ *
+ * @param buffer   (out) buffer for signature input (old content is discarded)
+ * @param version  authentication protocol version
+ * @param msg      SIP message
+ * @param realm    default realm
+ * @param target   default target name
+ * @param protocol default protocol
+ * @param rand     value for rand field (may be @c NULL, i.e. from header)
+ * @param num      value for num field (may be @c NULL, i.e. from header)
+ *
+ * @return @c FALSE if realm is unknown, i.e. no signature input available
+ */
+gboolean sipmsg_breakdown_signature_input(GString *buffer,
+					  int version,
+					  const struct sipmsg *msg,
+					  const gchar *realm,
+					  const gchar *target,
+					  const gchar *protocol,
+					  const gchar *rand,
+					  const gchar *num);
@@ -234,21 +234,22 @@ static void msg_tests(void) {
 			"SERVER: RTCC/3.5.0.0 MCXService/3.5.0.0 communicator.NOKIAS60R2.JVP.EN_US/1.0.6875.0\r\n"
 			"\r\n";
 		const gchar *response_sig = "<NTLM><1B6D47A1><11><SIP Communications Service><LOC-COMPANYT-FE03.COMPANY.COM><41CEg82ECa0AC8i3DD7mE673t9CF4b19DAxF780x><1><INVITE><sip:sender@company.com><2420628112><sip:recipient@company.com><7aee15546a><SIP:recipient@company.com><><><180>";
-		struct sipmsg_breakdown msgbd;
-		gchar *msg_str;
-
-		msgbd.msg = sipmsg_parse_msg(response);
-		sipmsg_breakdown_parse(&msgbd,
-				       "SIP Communications Service",
-				       "LOC-COMPANYT-FE03.COMPANY.COM",
-				       NULL);
-		msg_str = sipmsg_breakdown_get_string(4, &msgbd);
-
-		assert_equal(response_sig, msg_str);
-
-		g_free(msg_str);
-		sipmsg_free(msgbd.msg);
-		sipmsg_breakdown_free(&msgbd);
+		struct sipmsg *msg = sipmsg_parse_msg(response);
+		GString *msg_str   = g_string_new(NULL);
+
+		sipmsg_breakdown_signature_input(msg_str,
+						 4,
+						 msg,
+						 "SIP Communications Service",
+						 "LOC-COMPANYT-FE03.COMPANY.COM",
+						 NULL,
+						 NULL,
+						 NULL);
+
+		assert_equal(response_sig, msg_str->str);
+
+		g_string_free(msg_str, TRUE);
+		sipmsg_free(msg);
 	}
 
 	/* Test parsing of address fields where URIs wrapped in "<...>" */
@@ -264,21 +265,195 @@ static void msg_tests(void) {
 			"P-Asserted-Identity: <SIP:recipient@company.com>\r\n"
 			"\r\n";
 		const gchar *response_sig = "<NTLM><1B6D47A1><11><foo><bar><41CEg82ECa0AC8i3DD7mE673t9CF4b19DAxF780x><1><INVITE><sip:sender@company.com><2420628112><sip:recipient@company.com><7aee15546a><SIP:recipient@company.com><><><180>";
-		struct sipmsg_breakdown msgbd;
-		gchar *msg_str;
-
-		msgbd.msg = sipmsg_parse_msg(response);
-		sipmsg_breakdown_parse(&msgbd,
-				       "foo",
-				       "bar",
-				       NULL);
-		msg_str = sipmsg_breakdown_get_string(4, &msgbd);
+		struct sipmsg *msg = sipmsg_parse_msg(response);
+		GString *msg_str   = g_string_new(NULL);
+
+		sipmsg_breakdown_signature_input(msg_str,
+						 4,
+						 msg,
+						 "foo",
+						 "bar",
+						 NULL,
+						 NULL,
+						 NULL);
+
+		assert_equal(response_sig, msg_str->str);
+
+		g_string_free(msg_str, TRUE);
+		sipmsg_free(msg);
+	}
 
-		assert_equal(response_sig, msg_str);
+	/* Indexed header parser must behave like header list parser */
+	{
+		const gchar *header =
+			"SIP/2.0 200 OK\r\n"
+			"VIA: SIP/2.0/tls 192.168.44.10:50230\r\n"
+			"From: <sip:sender@company.com>;tag=2420628112\r\n"
+			"To: <sip:recipient@company.com>\r\n"
+			"CSeq: 1 SUBSCRIBE\r\n"
+			"Call-ID: 41CEg82ECa0AC8i3DD7mE673t9CF4b19DAxF780x\r\n"
+			"Contact: <sip:first@company.com>\r\n"
+			"X-Folded:\tfirst\r\n"
+			"  second\r\n"
+			"\tthird\r\n"
+			"contact: <sip:second@company.com>\r\n"
+			"Supported: gruu-10\r\n"
+			"Supported: adhoclist\r\n"
+			"Content-Length: 0";
+		struct sipmsg *list    = sipmsg_parse_header(header);
+		struct sipmsg *indexed = sipmsg_parse_header_indexed(header);
+		struct sipmsg_header_iter iter_list, iter_indexed;
+		const gchar *name_list, *name_indexed;
+		const gchar *value_list, *value_indexed;
+		static const gchar *keepers[] = { "Call-ID", "CSeq", NULL };
+		const gchar *call_id, *supported;
+		gchar *str_list, *str_indexed;
+		guint i;
+
+		assert_equal(list->method, indexed->method);
+		assert_equal(list->responsestr, indexed->responsestr);
+		assert_equal("first second third",
+			     sipmsg_find_header(indexed, "x-folded"));
+		assert_equal("SIP/2.0/tls 192.168.44.10:50230",
+			     sipmsg_find_known_header(indexed, SIPMSG_HEADER_VIA));
+		assert_equal(sipmsg_find_header_instance(list, "Contact", 1),
+			     sipmsg_find_header_instance(indexed, "Contact", 1));
+		assert_equal(NULL,
+			     sipmsg_find_header_instance(indexed, "Contact", 2));
+		for (i = 0; i < SIPMSG_HEADER_MAX; i++)
+			assert_equal(sipmsg_find_known_header(list, i),
+				     sipmsg_find_known_header(indexed, i));
+
+		sipmsg_header_iter_init(&iter_list, list);
+		sipmsg_header_iter_init(&iter_indexed, indexed);
+		while (sipmsg_header_iter_next(&iter_list, &name_list, &value_list)) {
+			if (!sipmsg_header_iter_next(&iter_indexed, &name_indexed, &value_indexed))
+				break;
+			assert_equal(name_list, name_indexed);
+			assert_equal(value_list, value_indexed);
+		}
+		assert_equal(NULL,
+			     sipmsg_header_iter_next(&iter_indexed, &name_indexed, &value_indexed) ?
+			     name_indexed : NULL);
+
+		/* header removal keeps the other header strings */
+		call_id   = sipmsg_find_header(indexed, "Call-ID");
+		supported = sipmsg_find_header(indexed, "Supported");
+		sipmsg_remove_header_now(list, "Contact");
+		sipmsg_remove_header_now(indexed, "Contact");
+		assert_equal("41CEg82ECa0AC8i3DD7mE673t9CF4b19DAxF780x", call_id);
+		assert_equal("<sip:second@company.com>",
+			     sipmsg_find_header(indexed, "Contact"));
+		assert_equal("<sip:second@company.com>",
+			     sipmsg_find_known_header(indexed, SIPMSG_HEADER_CONTACT));
+		sipmsg_add_header_now(indexed, "Expires", "600");
+		sipmsg_add_header_now(list, "Expires", "600");
+		str_list    = sipmsg_to_string(list);
+		str_indexed = sipmsg_to_string(indexed);
+		assert_equal(str_list, str_indexed);
+		g_free(str_indexed);
+		g_free(str_list);
+
+		sipmsg_strip_headers(list, keepers);
+		sipmsg_strip_headers(indexed, keepers);
+		str_list    = sipmsg_to_string(list);
+		str_indexed = sipmsg_to_string(indexed);
+		assert_equal(str_list, str_indexed);
+		g_free(str_indexed);
+		g_free(str_list);
+		assert_equal("41CEg82ECa0AC8i3DD7mE673t9CF4b19DAxF780x", call_id);
+		assert_equal("gruu-10", supported);
+		assert_equal(NULL, sipmsg_find_header(indexed, "Supported"));
+		assert_equal(NULL,
+			     sipmsg_find_known_header(indexed, SIPMSG_HEADER_CONTACT));
+
+		sipmsg_free(indexed);
+		sipmsg_free(list);
+
+		/* same error handling */
+		assert_equal(NULL,
+			     (const gchar *) sipmsg_parse_header_indexed("SIP/2.0 200 OK\r\nBroken header\r\n"));
+		assert_equal(NULL,
+			     (const gchar *) sipmsg_parse_header_indexed("INVALID"));
+	}
 
-		g_free(msg_str);
-		sipmsg_free(msgbd.msg);
-		sipmsg_breakdown_free(&msgbd);
+	/* request builder must create the same message as the parser */
+	{
+		const gchar *request =
+			"SUBSCRIBE sip:recipient@company.com SIP/2.0\r\n"
+			"Via: SIP/2.0/TLS 192.168.44.10:50230;branch=z9hG4bK1\r\n"
+			"From: <sip:sender@company.com>;tag=2420628112;epid=4ccf\r\n"
+			"To: <sip:recipient@company.com>\r\n"
+			"Max-Forwards: 70\r\n"
+			"CSeq: 1 SUBSCRIBE\r\n"
+			"Call-ID: 41CEg82ECa0AC8i3DD7mE673t9CF4b19DAxF780x\r\n"
+			"Route: <sip:proxy1.company.com;lr>\r\n"
+			"Route: <sip:proxy2.company.com;lr>\r\n"
+			"Event: presence\r\n"
+			"Accept: application/msrtc-event-categories+xml\r\n"
+			"Content-Length: 4\r\n"
+			"\r\n"
+			"body";
+		struct sipmsg *parsed = sipmsg_parse_msg(request);
+		struct sipmsg *built  = sipmsg_new_request("SUBSCRIBE",
+							   "sip:recipient@company.com");
+		static const gchar *keepers[] = { "Via", "From", "To", "CSeq", "Call-ID",
+						  "Expires", "User-Agent", "Content-Length",
+						  NULL };
+		gchar *str_parsed, *str_built;
+
+		sipmsg_add_header_now(built, "Via", "SIP/2.0/TLS 192.168.44.10:50230;branch=z9hG4bK1");
+		sipmsg_add_header_now(built, "From", "<sip:sender@company.com>;tag=2420628112;epid=4ccf");
+		sipmsg_add_header_now(built, "To", "<sip:recipient@company.com>");
+		sipmsg_add_header_now(built, "Max-Forwards", "70");
+		sipmsg_add_header_now(built, "CSeq", "1 SUBSCRIBE");
+		sipmsg_add_header_now(built, "Call-ID", "41CEg82ECa0AC8i3DD7mE673t9CF4b19DAxF780x");
+		sipmsg_add_header_now(built, "Route", "<sip:proxy1.company.com;lr>");
+		sipmsg_add_header_now(built, "Route", "<sip:proxy2.company.com;lr>");
+		assert_equal("TRUE",
+			     sipmsg_add_headers_now(built,
+						    "Event: presence\r\n"
+						    "Accept: application/msrtc-event-categories+xml\r\n") ?
+			     "TRUE" : "FALSE");
+		sipmsg_set_body(built, "body");
+
+		str_parsed = sipmsg_to_string(parsed);
+		str_built  = sipmsg_to_string(built);
+		assert_equal(request, str_parsed);
+		assert_equal(str_parsed, str_built);
+		assert_equal(parsed->method, built->method);
+		assert_equal(parsed->target, built->target);
+		assert_equal("4", sipmsg_find_known_header(built, SIPMSG_HEADER_CONTENT_LENGTH));
+		g_free(str_built);
+		g_free(str_parsed);
+
+		/* appending after header removal, strip & merge */
+		sipmsg_remove_header_now(built, "Content-Length");
+		sipmsg_add_header_now(built, "Supported", "gruu-10");
+		sipmsg_add_header(built, "Expires", "600");
+		sipmsg_add_header(built, "User-Agent", "UCCAPI");
+		sipmsg_merge_new_headers(built);
+		sipmsg_add_header_now(built, "Content-Length", "4");
+		sipmsg_strip_headers(built, keepers);
+		sipmsg_add_header_now(built, "Contact", "<sip:sender@company.com>");
+		str_built = sipmsg_to_string(built);
+		assert_equal("SUBSCRIBE sip:recipient@company.com SIP/2.0\r\n"
+			     "Via: SIP/2.0/TLS 192.168.44.10:50230;branch=z9hG4bK1\r\n"
+			     "From: <sip:sender@company.com>;tag=2420628112;epid=4ccf\r\n"
+			     "To: <sip:recipient@company.com>\r\n"
+			     "CSeq: 1 SUBSCRIBE\r\n"
+			     "Call-ID: 41CEg82ECa0AC8i3DD7mE673t9CF4b19DAxF780x\r\n"
+			     "Expires: 600\r\n"
+			     "User-Agent: UCCAPI\r\n"
+			     "Content-Length: 4\r\n"
+			     "Contact: <sip:sender@company.com>\r\n"
+			     "\r\n"
+			     "body",
+			     str_built);
+		g_free(str_built);
+
+		sipmsg_free(built);
+		sipmsg_free(parsed);
 	}
 
 	/* UUID tests - begin tests from MS-SIPRE */
@@ -0,0 +1,468 @@
+/**
+ * @file sipe-snapshot-tests.c
+ *
+ * pidgin-sipe
+ *
+ * Copyright (C) 2020 SIPE Project <http://sipe.sourceforge.net/>
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ * Tests for the buddy list snapshot: round trip of groups, buddies and
+ * presence and rejection of damaged snapshot files. Buddy and group
+ * lists are replaced by stubs that record what the snapshot restores.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+
+#include <glib.h>
+
+#include "sipe-snapshot.c"
+#include "sip-transport.h"
+
+/*
+ * Stubs
+ */
+gboolean sipe_backend_debug_enabled(void)
+{
+	return(FALSE);
+}
+
+void sipe_backend_debug_literal(SIPE_UNUSED_PARAMETER sipe_debug_level level,
+				SIPE_UNUSED_PARAMETER const gchar *msg)
+{
+}
+
+void sipe_backend_debug(SIPE_UNUSED_PARAMETER sipe_debug_level level,
+			SIPE_UNUSED_PARAMETER const gchar *format,
+			...)
+{
+}
+
+const gchar *sip_transport_epid(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+	return(NULL);
+}
+
+/* needed when linking against NSS */
+void md4sum(const uint8_t *data, uint32_t length, uint8_t *digest);
+void md4sum(SIPE_UNUSED_PARAMETER const uint8_t *data,
+	    SIPE_UNUSED_PARAMETER uint32_t length,
+	    SIPE_UNUSED_PARAMETER uint8_t *digest)
+{
+}
+
+sipe_backend_buddy sipe_backend_buddy_find(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+					   const gchar *buddy_name,
+					   SIPE_UNUSED_PARAMETER const gchar *group_name)
+{
+	return((gpointer) buddy_name);
+}
+
+gchar* sipe_backend_buddy_get_alias(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+				    const sipe_backend_buddy who)
+{
+	return(g_strdup_printf("alias of %s", (const gchar *) who));
+}
+
+static guint processing = 0;
+void sipe_backend_buddy_list_processing_start(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public)
+{
+	processing++;
+}
+
+void sipe_backend_buddy_list_processing_finish(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public)
+{
+}
+
+/* saved lists: buddy i is a member of group j if bit j is set */
+#define TEST_GROUPS  2
+#define TEST_BUDDIES 3
+
+static struct sipe_group test_groups[TEST_GROUPS] = {
+	{ (gchar *) "Friends", (gchar *) "AAEF", (gchar *) "CK1", 1, FALSE },
+	{ (gchar *) "Work",    NULL,             NULL,            7, FALSE },
+};
+static struct sipe_buddy test_buddies[TEST_BUDDIES];
+static const guint test_members[TEST_BUDDIES] = { 0x1, 0x3, 0x0 };
+
+void sipe_group_foreach(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+			GFunc callback,
+			gpointer callback_data)
+{
+	guint i;
+	for (i = 0; i < TEST_GROUPS; i++)
+		(*callback)(&test_groups[i], callback_data);
+}
+
+void sipe_buddy_foreach(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+			GHFunc callback,
+			gpointer callback_data)
+{
+	guint i;
+	for (i = 0; i < TEST_BUDDIES; i++)
+		(*callback)(test_buddies[i].name, &test_buddies[i], callback_data);
+}
+
+void sipe_buddy_foreach_group(struct sipe_buddy *buddy,
+			      GFunc callback,
+			      gpointer callback_data)
+{
+	guint members = test_members[buddy - test_buddies];
+	guint i;
+	for (i = 0; i < TEST_GROUPS; i++)
+		if (members & (1 << i))
+			(*callback)(&test_groups[i], callback_data);
+}
+
+/* restored lists */
+static GString   *restored        = NULL;
+static GPtrArray *restored_groups = NULL;
+static GPtrArray *restored_buddies = NULL;
+
+struct sipe_group *sipe_group_add(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+				  const gchar *name,
+				  const gchar *exchange_key,
+				  const gchar *change_key,
+				  guint id)
+{
+	struct sipe_group *group = g_new0(struct sipe_group, 1);
+
+	group->name = g_strdup(name);
+	group->id   = id;
+	g_ptr_array_add(restored_groups, group);
+	g_string_append_printf(restored, "G%u:%s/%s/%s ",
+			       id,
+			       name ? name : "-",
+			       exchange_key ? exchange_key : "-",
+			       change_key ? change_key : "-");
+	return(group);
+}
+
+struct sipe_buddy *sipe_buddy_add(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+				  const gchar *uri,
+				  const gchar *exchange_key,
+				  const gchar *change_key)
+{
+	struct sipe_buddy *buddy = g_new0(struct sipe_buddy, 1);
+
+	buddy->name = g_strdup(uri);
+	g_ptr_array_add(restored_buddies, buddy);
+	g_string_append_printf(restored, "B:%s/%s/%s ",
+			       uri,
+			       exchange_key ? exchange_key : "-",
+			       change_key ? change_key : "-");
+	return(buddy);
+}
+
+void sipe_buddy_add_to_group(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+			     struct sipe_buddy *buddy,
+			     struct sipe_group *group,
+			     const gchar *alias)
+{
+	g_string_append_printf(restored, "M:%s>%s(%s) ",
+			       buddy->name,
+			       group->name,
+			       alias ? alias : "-");
+}
+
+void sipe_buddy_set_status(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+			   struct sipe_buddy *sbuddy,
+			   guint activity,
+			   SIPE_UNUSED_PARAMETER time_t last_active)
+{
+	g_string_append_printf(restored, "S:%s=%u ", sbuddy->name, activity);
+}
+
+/*
+ * Tester code
+ */
+static guint succeeded = 0;
+static guint failed    = 0;
+
+static void assert_equal(guint expected, guint got, const gchar *what)
+{
+	if (expected == got) {
+		succeeded++;
+	} else {
+		printf("FAILED: %s: %u expected %u\n", what, got, expected);
+		failed++;
+	}
+}
+
+static void assert_string(const gchar *expected, const gchar *got, const gchar *what)
+{
+	if (sipe_strequal(expected, got)) {
+		succeeded++;
+	} else {
+		printf("FAILED: %s:\n  got      '%s'\n  expected '%s'\n",
+		       what, got, expected);
+		failed++;
+	}
+}
+
+static void test_reset(struct sipe_core_private *sipe_private)
+{
+	guint i;
+
+	for (i = 0; i < restored_groups->len; i++) {
+		struct sipe_group *group = g_ptr_array_index(restored_groups, i);
+		g_free(group->name);
+		g_free(group);
+	}
+	g_ptr_array_set_size(restored_groups, 0);
+	for (i = 0; i < restored_buddies->len; i++) {
+		struct sipe_buddy *buddy = g_ptr_array_index(restored_buddies, i);
+		g_free(buddy->name);
+		g_free(buddy);
+	}
+	g_ptr_array_set_size(restored_buddies, 0);
+
+	g_string_truncate(restored, 0);
+	processing = 0;
+	sipe_private->deltanum_snapshot = 0;
+}
+
+#define RESTORED_LIST							\
+	"G1:Friends/AAEF/CK1 G7:Work/-/- "				\
+	"B:sip:a@test.com/AAEA/CKA "					\
+	"M:sip:a@test.com>Friends(alias of sip:a@test.com) "		\
+	"S:sip:a@test.com=8 "						\
+	"B:sip:b@test.com/-/- "						\
+	"M:sip:b@test.com>Friends(alias of sip:b@test.com) "		\
+	"M:sip:b@test.com>Work(alias of sip:b@test.com) "		\
+	"B:sip:c@test.com/-/- "
+
+static void tests_round_trip(struct sipe_core_private *sipe_private)
+{
+	GByteArray *data;
+
+	test_reset(sipe_private);
+	sipe_private->deltanum_snapshot = 4711;
+	data = snapshot_build(sipe_private);
+	sipe_private->deltanum_snapshot = 0;
+
+	assert_equal(TRUE,
+		     snapshot_populate(sipe_private,
+				       (const gchar *) data->data,
+				       data->len),
+		     "round trip: valid snapshot");
+	assert_string(RESTORED_LIST, restored->str, "round trip: restored list");
+	assert_equal(4711, sipe_private->deltanum_snapshot, "round trip: deltaNum");
+	assert_equal(1, processing, "round trip: backend list processing");
+
+	g_byte_array_free(data, TRUE);
+}
+
+/* header field offsets */
+#define HEADER_FIELD(field) G_STRUCT_OFFSET(struct snapshot_header, field)
+
+static void set_field(GByteArray *data, gsize offset, guint32 value)
+{
+	memcpy(data->data + offset, &value, sizeof(value));
+}
+
+static guint32 get_field(GByteArray *data, gsize offset)
+{
+	guint32 value;
+	memcpy(&value, data->data + offset, sizeof(value));
+	return(value);
+}
+
+static void test_invalid(struct sipe_core_private *sipe_private,
+			 GByteArray *data,
+			 gsize length,
+			 const gchar *what)
+{
+	test_reset(sipe_private);
+	assert_equal(FALSE,
+		     snapshot_populate(sipe_private,
+				       (const gchar *) data->data,
+				       length),
+		     what);
+	assert_string("", restored->str, what);
+	assert_equal(0, processing, what);
+	assert_equal(0, sipe_private->deltanum_snapshot, what);
+}
+
+static void tests_invalid(struct sipe_core_private *sipe_private)
+{
+	GByteArray *valid;
+	GByteArray *data;
+	guint32 value;
+
+	test_reset(sipe_private);
+	valid = snapshot_build(sipe_private);
+
+#define TEST_COPY()						\
+	data = g_byte_array_new();				\
+	g_byte_array_append(data, valid->data, valid->len)
+#define TEST_DONE() g_byte_array_free(data, TRUE)
+
+	/* header */
+	TEST_COPY();
+	test_invalid(sipe_private, data, 0, "empty file");
+	test_invalid(sipe_private, data, sizeof(struct snapshot_header) - 1, "short header");
+	data->data[0] = 'X';
+	test_invalid(sipe_private, data, data->len, "bad magic");
+	TEST_DONE();
+
+	TEST_COPY();
+	set_field(data, HEADER_FIELD(version), SIPE_SNAPSHOT_VERSION + 1);
+	test_invalid(sipe_private, data, data->len, "newer version");
+	set_field(data, HEADER_FIELD(version), 0);
+	test_invalid(sipe_private, data, data->len, "older version");
+	TEST_DONE();
+
+	TEST_COPY();
+	set_field(data, HEADER_FIELD(byte_order), GUINT32_SWAP_LE_BE(SIPE_SNAPSHOT_BYTE_ORDER));
+	test_invalid(sipe_private, data, data->len, "other byte order");
+	TEST_DONE();
+
+	/* bounds */
+	TEST_COPY();
+	set_field(data, HEADER_FIELD(groups), G_MAXUINT32);
+	test_invalid(sipe_private, data, data->len, "group count too large");
+	TEST_DONE();
+
+	TEST_COPY();
+	set_field(data, HEADER_FIELD(buddies), G_MAXUINT32 / sizeof(struct snapshot_buddy) + 1);
+	test_invalid(sipe_private, data, data->len, "buddy count overflow");
+	TEST_DONE();
+
+	TEST_COPY();
+	value = get_field(data, HEADER_FIELD(members));
+	set_field(data, HEADER_FIELD(members), value + 1);
+	test_invalid(sipe_private, data, data->len, "member count beyond data");
+	set_field(data, HEADER_FIELD(members), value - 1);
+	test_invalid(sipe_private, data, data->len, "member count too small");
+	TEST_DONE();
+
+	TEST_COPY();
+	test_invalid(sipe_private, data, data->len - 1, "truncated file");
+	g_byte_array_append(data, (const guint8 *) "", 1);
+	test_invalid(sipe_private, data, data->len, "trailing data");
+	TEST_DONE();
+
+	/* string table */
+	TEST_COPY();
+	set_field(data, HEADER_FIELD(strings), 0);
+	test_invalid(sipe_private, data, data->len, "empty string table");
+	set_field(data, HEADER_FIELD(strings), G_MAXUINT32);
+	test_invalid(sipe_private, data, data->len, "string table too large");
+	TEST_DONE();
+
+	TEST_COPY();
+	data->data[data->len - 1] = 'X';
+	test_invalid(sipe_private, data, data->len, "unterminated string table");
+	TEST_DONE();
+
+	g_byte_array_free(valid, TRUE);
+}
+
+static void tests_invalid_records(struct sipe_core_private *sipe_private)
+{
+	GByteArray *data;
+	gsize groups;
+	gsize buddies;
+	gsize members;
+	struct snapshot_buddy buddy;
+	struct snapshot_member member;
+
+	test_reset(sipe_private);
+	data = snapshot_build(sipe_private);
+	groups  = sizeof(struct snapshot_header);
+	buddies = groups  + TEST_GROUPS  * sizeof(struct snapshot_group);
+	members = buddies + TEST_BUDDIES * sizeof(struct snapshot_buddy);
+
+	/* buddy a: URI outside of string table */
+	memcpy(&buddy, data->data + buddies, sizeof(buddy));
+	buddy.uri = get_field(data, HEADER_FIELD(strings));
+	memcpy(data->data + buddies, &buddy, sizeof(buddy));
+
+	/* buddy b: member records outside of member table */
+	memcpy(&buddy, data->data + buddies + sizeof(buddy), sizeof(buddy));
+	buddy.first_member = G_MAXUINT32;
+	memcpy(data->data + buddies + sizeof(buddy), &buddy, sizeof(buddy));
+
+	/* buddy c: member of a non-existing group */
+	memcpy(&buddy, data->data + buddies + 2 * sizeof(buddy), sizeof(buddy));
+	buddy.first_member = 0;
+	buddy.members      = 1;
+	memcpy(data->data + buddies + 2 * sizeof(buddy), &buddy, sizeof(buddy));
+	memcpy(&member, data->data + members, sizeof(member));
+	member.group = TEST_GROUPS;
+	memcpy(data->data + members, &member, sizeof(member));
+
+	/* records are skipped, the rest is restored */
+	assert_equal(TRUE,
+		     snapshot_populate(sipe_private,
+				       (const gchar *) data->data,
+				       data->len),
+		     "invalid records: snapshot accepted");
+	assert_string("G1:Friends/AAEF/CK1 G7:Work/-/- "
+		      "B:sip:c@test.com/-/- ",
+		      restored->str,
+		      "invalid records: skipped");
+
+	g_byte_array_free(data, TRUE);
+}
+
+int main(SIPE_UNUSED_PARAMETER int argc,
+	 SIPE_UNUSED_PARAMETER char *argv[])
+{
+	struct sipe_core_private *sipe_private = g_new0(struct sipe_core_private, 1);
+
+	restored         = g_string_new(NULL);
+	restored_groups  = g_ptr_array_new();
+	restored_buddies = g_ptr_array_new();
+
+	/* a: pushed status, b: offline, c: no status yet */
+	test_buddies[0].name            = (gchar *) "sip:a@test.com";
+	test_buddies[0].exchange_key    = (gchar *) "AAEA";
+	test_buddies[0].change_key      = (gchar *) "CKA";
+	test_buddies[0].status_pushed   = TRUE;
+	test_buddies[0].pushed_activity = SIPE_ACTIVITY_AWAY;
+	test_buddies[1].name            = (gchar *) "sip:b@test.com";
+	test_buddies[1].status_pushed   = TRUE;
+	test_buddies[1].pushed_activity = SIPE_ACTIVITY_OFFLINE;
+	test_buddies[2].name            = (gchar *) "sip:c@test.com";
+
+	tests_round_trip(sipe_private);
+	tests_invalid(sipe_private);
+	tests_invalid_records(sipe_private);
+
+	test_reset(sipe_private);
+	g_ptr_array_free(restored_buddies, TRUE);
+	g_ptr_array_free(restored_groups, TRUE);
+	g_string_free(restored, TRUE);
+	g_free(sipe_private);
+
+	printf("Result: %d PASSED %d FAILED\n", succeeded, failed);
+	return(failed);
+}
+
+/*
+  Local Variables:
+  mode: c
+  c-file-style: "bsd"
+  indent-tabs-mode: t
+  tab-width: 8
+  End:
+*/
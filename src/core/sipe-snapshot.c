@@ -0,0 +1,465 @@
+/**
+ * @file sipe-snapshot.c
+ *
+ * pidgin-sipe
+ *
+ * Copyright (C) 2020 SIPE Project <http://sipe.sourceforge.net/>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ * Buddy list snapshot
+ *
+ * Groups, buddies, their UCS keys and last known presence are stored in
+ * the user cache directory, one file per account. On the next login the
+ * buddy list is populated from the snapshot before the server sends the
+ * contact list. If the contact list has the same deltaNum as the snapshot
+ * it doesn't need to be processed at all.
+ *
+ * The file is used directly from a read-only memory mapping. Layout, all
+ * fields are 32-bit in host byte order:
+ *
+ *   header
+ *   group records
+ *   buddy records
+ *   member records (buddy in group)
+ *   string table (NUL terminated strings, offset 0 means NULL)
+ */
+
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "sipe-common.h"
+#include "sipe-backend.h"
+#include "sipe-buddy.h"
+#include "sipe-core.h"
+#include "sipe-core-private.h"
+#include "sipe-group.h"
+#include "sipe-snapshot.h"
+#include "sipe-utils.h"
+
+#define SIPE_SNAPSHOT_MAGIC      "SIPESNAP"
+#define SIPE_SNAPSHOT_VERSION    1
+#define SIPE_SNAPSHOT_BYTE_ORDER 0x01020304
+
+struct snapshot_header {
+	gchar   magic[8];
+	guint32 version;
+	guint32 byte_order;
+	guint32 deltanum;
+	guint32 groups;
+	guint32 buddies;
+	guint32 members;
+	guint32 strings;  /* size of string table */
+};
+
+struct snapshot_group {
+	guint32 id;
+	guint32 name;
+	guint32 exchange_key;
+	guint32 change_key;
+};
+
+struct snapshot_buddy {
+	guint32 uri;
+	guint32 exchange_key;
+	guint32 change_key;
+	guint32 activity;
+	guint32 first_member;
+	guint32 members;
+};
+
+struct snapshot_member {
+	guint32 group;    /* index of group record */
+	guint32 alias;
+};
+
+struct snapshot_writer {
+	struct sipe_core_private *sipe_private;
+	GByteArray *groups;
+	GByteArray *buddies;
+	GByteArray *members;
+	GByteArray *strings;
+	GHashTable *group_index;
+	/* current buddy */
+	struct sipe_buddy *buddy;
+	guint32 buddy_members;
+};
+
+static gchar *snapshot_filename(struct sipe_core_private *sipe_private)
+{
+	gchar *account = g_strdup(sipe_private->username);
+	gchar *name;
+	gchar *filename;
+
+	/* account name is used as file name */
+	g_strcanon(account,
+		   G_CSET_a_2_z G_CSET_A_2_Z G_CSET_DIGITS "@.-_",
+		   '_');
+	name     = g_strdup_printf("%s.snapshot", account);
+	filename = g_build_filename(g_get_user_cache_dir(),
+				    "sipe",
+				    name,
+				    NULL);
+	g_free(name);
+	g_free(account);
+
+	return(filename);
+}
+
+static guint32 snapshot_string(struct snapshot_writer *writer,
+			       const gchar *string)
+{
+	guint32 offset;
+
+	if (!string)
+		return(0);
+
+	offset = writer->strings->len;
+	g_byte_array_append(writer->strings,
+			    (const guint8 *) string,
+			    strlen(string) + 1);
+	return(offset);
+}
+
+static void snapshot_write_group(gpointer data,
+				 gpointer user_data)
+{
+	const struct sipe_group *group = data;
+	struct snapshot_writer *writer = user_data;
+	struct snapshot_group record;
+
+	record.id           = group->id;
+	record.name         = snapshot_string(writer, group->name);
+	record.exchange_key = snapshot_string(writer, group->exchange_key);
+	record.change_key   = snapshot_string(writer, group->change_key);
+
+	g_hash_table_insert(writer->group_index,
+			    (gpointer) group,
+			    GUINT_TO_POINTER(writer->groups->len / sizeof(record)));
+	g_byte_array_append(writer->groups,
+			    (const guint8 *) &record,
+			    sizeof(record));
+}
+
+static void snapshot_write_member(gpointer data,
+				  gpointer user_data)
+{
+	const struct sipe_group *group = data;
+	struct snapshot_writer *writer = user_data;
+	struct sipe_core_private *sipe_private = writer->sipe_private;
+	gpointer index;
+	struct snapshot_member record;
+
+	if (g_hash_table_lookup_extended(writer->group_index,
+					 group,
+					 NULL,
+					 &index)) {
+		sipe_backend_buddy bb = sipe_backend_buddy_find(SIPE_CORE_PUBLIC,
+								writer->buddy->name,
+								group->name);
+		gchar *alias = bb ?
+			sipe_backend_buddy_get_alias(SIPE_CORE_PUBLIC, bb) :
+			NULL;
+
+		record.group = GPOINTER_TO_UINT(index);
+		record.alias = snapshot_string(writer, alias);
+		g_free(alias);
+
+		g_byte_array_append(writer->members,
+				    (const guint8 *) &record,
+				    sizeof(record));
+		writer->buddy_members++;
+	}
+}
+
+static void snapshot_write_buddy(SIPE_UNUSED_PARAMETER gpointer key,
+				 gpointer value,
+				 gpointer user_data)
+{
+	struct sipe_buddy *buddy = value;
+	struct snapshot_writer *writer = user_data;
+	struct snapshot_buddy record;
+
+	writer->buddy         = buddy;
+	writer->buddy_members = 0;
+
+	record.uri          = snapshot_string(writer, buddy->name);
+	record.exchange_key = snapshot_string(writer, buddy->exchange_key);
+	record.change_key   = snapshot_string(writer, buddy->change_key);
+	/* status known to the core: during disconnect the backend may
+	 * already show all buddies as offline */
+	record.activity     = buddy->status_pushed ?
+		buddy->pushed_activity :
+		SIPE_ACTIVITY_UNSET;
+	record.first_member = writer->members->len / sizeof(struct snapshot_member);
+	sipe_buddy_foreach_group(buddy, snapshot_write_member, writer);
+	record.members      = writer->buddy_members;
+
+	g_byte_array_append(writer->buddies,
+			    (const guint8 *) &record,
+			    sizeof(record));
+}
+
+static GByteArray *snapshot_build(struct sipe_core_private *sipe_private)
+{
+	struct snapshot_writer writer;
+	struct snapshot_header header;
+	GByteArray *data;
+
+	memset(&writer, 0, sizeof(writer));
+	writer.sipe_private = sipe_private;
+	writer.groups       = g_byte_array_new();
+	writer.buddies      = g_byte_array_new();
+	writer.members      = g_byte_array_new();
+	writer.strings      = g_byte_array_new();
+	writer.group_index  = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	/* offset 0 is reserved for NULL */
+	g_byte_array_append(writer.strings, (const guint8 *) "", 1);
+
+	sipe_group_foreach(sipe_private, snapshot_write_group, &writer);
+	sipe_buddy_foreach(sipe_private, snapshot_write_buddy, &writer);
+
+	memcpy(header.magic, SIPE_SNAPSHOT_MAGIC, sizeof(header.magic));
+	header.version    = SIPE_SNAPSHOT_VERSION;
+	header.byte_order = SIPE_SNAPSHOT_BYTE_ORDER;
+	header.deltanum   = sipe_private->deltanum_snapshot;
+	header.groups     = writer.groups->len  / sizeof(struct snapshot_group);
+	header.buddies    = writer.buddies->len / sizeof(struct snapshot_buddy);
+	header.members    = writer.members->len / sizeof(struct snapshot_member);
+	header.strings    = writer.strings->len;
+
+	data = g_byte_array_sized_new(sizeof(header) +
+				      writer.groups->len +
+				      writer.buddies->len +
+				      writer.members->len +
+				      writer.strings->len);
+	g_byte_array_append(data, (const guint8 *) &header, sizeof(header));
+	g_byte_array_append(data, writer.groups->data,  writer.groups->len);
+	g_byte_array_append(data, writer.buddies->data, writer.buddies->len);
+	g_byte_array_append(data, writer.members->data, writer.members->len);
+	g_byte_array_append(data, writer.strings->data, writer.strings->len);
+
+	g_hash_table_destroy(writer.group_index);
+	g_byte_array_free(writer.strings, TRUE);
+	g_byte_array_free(writer.members, TRUE);
+	g_byte_array_free(writer.buddies, TRUE);
+	g_byte_array_free(writer.groups,  TRUE);
+
+	return(data);
+}
+
+void sipe_snapshot_save(struct sipe_core_private *sipe_private)
+{
+	struct snapshot_header header;
+	GByteArray *data;
+	gchar *filename;
+	gchar *dirname;
+	GError *error = NULL;
+
+	/* don't overwrite a valid snapshot with incomplete data */
+	if (!(SIPE_CORE_PRIVATE_FLAG_IS(SUBSCRIBED_BUDDIES) ||
+	      SIPE_CORE_PRIVATE_FLAG_IS(SNAPSHOT)) ||
+	    !sipe_private->username)
+		return;
+
+	data = snapshot_build(sipe_private);
+	memcpy(&header, data->data, sizeof(header));
+
+	filename = snapshot_filename(sipe_private);
+	dirname  = g_path_get_dirname(filename);
+	if (g_mkdir_with_parents(dirname, 0700) ||
+	    !g_file_set_contents(filename,
+				 (const gchar *) data->data,
+				 data->len,
+				 &error)) {
+		SIPE_DEBUG_ERROR("sipe_snapshot_save: can't write '%s': %s",
+				 filename,
+				 error ? error->message : "can't create directory");
+		if (error)
+			g_error_free(error);
+	} else {
+		SIPE_DEBUG_INFO("sipe_snapshot_save: %u groups, %u buddies, deltaNum %u (%u bytes)",
+				header.groups, header.buddies,
+				header.deltanum, data->len);
+	}
+	g_free(dirname);
+	g_free(filename);
+	g_byte_array_free(data, TRUE);
+}
+
+/* returns NULL for offset 0 or invalid offsets */
+static const gchar *snapshot_lookup(const gchar *strings,
+				    guint32 size,
+				    guint32 offset)
+{
+	return((offset && (offset < size)) ? strings + offset : NULL);
+}
+
+static gboolean snapshot_populate(struct sipe_core_private *sipe_private,
+				  const gchar *contents,
+				  gsize length)
+{
+	struct snapshot_header header;
+	const gchar *groups;
+	const gchar *buddies;
+	const gchar *members;
+	const gchar *strings;
+	struct sipe_group **group_table;
+	guint32 i;
+
+	if (length < sizeof(header))
+		return(FALSE);
+	memcpy(&header, contents, sizeof(header));
+
+	if (memcmp(header.magic, SIPE_SNAPSHOT_MAGIC, sizeof(header.magic)) ||
+	    (header.version    != SIPE_SNAPSHOT_VERSION) ||
+	    (header.byte_order != SIPE_SNAPSHOT_BYTE_ORDER))
+		return(FALSE);
+
+	/* bound counts by file length first to avoid overflows */
+	if ((header.groups  > length / sizeof(struct snapshot_group))  ||
+	    (header.buddies > length / sizeof(struct snapshot_buddy))  ||
+	    (header.members > length / sizeof(struct snapshot_member)) ||
+	    (header.strings > length) ||
+	    (header.strings == 0)     ||
+	    (length != sizeof(header) +
+	     (gsize) header.groups  * sizeof(struct snapshot_group) +
+	     (gsize) header.buddies * sizeof(struct snapshot_buddy) +
+	     (gsize) header.members * sizeof(struct snapshot_member) +
+	     header.strings))
+		return(FALSE);
+
+	groups  = contents + sizeof(header);
+	buddies = groups   + header.groups  * sizeof(struct snapshot_group);
+	members = buddies  + header.buddies * sizeof(struct snapshot_buddy);
+	strings = members  + header.members * sizeof(struct snapshot_member);
+
+	/* string table must be terminated */
+	if (strings[header.strings - 1] != '\0')
+		return(FALSE);
+
+	sipe_backend_buddy_list_processing_start(SIPE_CORE_PUBLIC);
+
+	group_table = g_new0(struct sipe_group *, header.groups + 1);
+	for (i = 0; i < header.groups; i++) {
+		struct snapshot_group record;
+
+		memcpy(&record,
+		       groups + i * sizeof(record),
+		       sizeof(record));
+		group_table[i] = sipe_group_add(sipe_private,
+						snapshot_lookup(strings, header.strings, record.name),
+						snapshot_lookup(strings, header.strings, record.exchange_key),
+						snapshot_lookup(strings, header.strings, record.change_key),
+						record.id);
+	}
+
+	for (i = 0; i < header.buddies; i++) {
+		struct snapshot_buddy record;
+		const gchar *uri;
+
+		memcpy(&record,
+		       buddies + i * sizeof(record),
+		       sizeof(record));
+		uri = snapshot_lookup(strings, header.strings, record.uri);
+
+		if (uri &&
+		    (record.first_member <= header.members) &&
+		    (record.members <= header.members - record.first_member)) {
+			struct sipe_buddy *buddy = sipe_buddy_add(sipe_private,
+								  uri,
+								  snapshot_lookup(strings, header.strings, record.exchange_key),
+								  snapshot_lookup(strings, header.strings, record.change_key));
+			guint32 j;
+
+			for (j = 0; j < record.members; j++) {
+				struct snapshot_member member;
+
+				memcpy(&member,
+				       members + (record.first_member + j) * sizeof(member),
+				       sizeof(member));
+				if ((member.group < header.groups) &&
+				    group_table[member.group])
+					sipe_buddy_add_to_group(sipe_private,
+								buddy,
+								group_table[member.group],
+								snapshot_lookup(strings, header.strings, member.alias));
+			}
+
+			/* last known presence until server sends an update */
+			if ((record.activity != SIPE_ACTIVITY_UNSET) &&
+			    (record.activity != SIPE_ACTIVITY_OFFLINE))
+				sipe_buddy_set_status(sipe_private,
+						      buddy,
+						      record.activity,
+						      0);
+		}
+	}
+	g_free(group_table);
+
+	sipe_backend_buddy_list_processing_finish(SIPE_CORE_PUBLIC);
+
+	sipe_private->deltanum_snapshot = header.deltanum;
+	SIPE_DEBUG_INFO("sipe_snapshot_load: %u groups, %u buddies, deltaNum %u",
+			header.groups, header.buddies, header.deltanum);
+
+	return(TRUE);
+}
+
+gboolean sipe_snapshot_load(struct sipe_core_private *sipe_private)
+{
+	gchar *filename;
+	GMappedFile *file;
+	gboolean loaded = FALSE;
+
+	if (!sipe_private->username ||
+	    SIPE_CORE_PRIVATE_FLAG_IS(SUBSCRIBED_BUDDIES))
+		return(FALSE);
+
+	filename = snapshot_filename(sipe_private);
+	file = g_mapped_file_new(filename, FALSE, NULL);
+	if (file) {
+		loaded = snapshot_populate(sipe_private,
+					   g_mapped_file_get_contents(file),
+					   g_mapped_file_get_length(file));
+		if (!loaded)
+			SIPE_DEBUG_ERROR("sipe_snapshot_load: ignoring invalid snapshot '%s'",
+					 filename);
+#if GLIB_CHECK_VERSION(2,22,0)
+		g_mapped_file_unref(file);
+#else
+		g_mapped_file_free(file);
+#endif
+	}
+	g_free(filename);
+
+	if (loaded)
+		SIPE_CORE_PRIVATE_FLAG_SET(SNAPSHOT);
+
+	return(loaded);
+}
+
+/*
+  Local Variables:
+  mode: c
+  c-file-style: "bsd"
+  indent-tabs-mode: t
+  tab-width: 8
+  End:
+*/
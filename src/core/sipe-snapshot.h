@@ -0,0 +1,51 @@
+/**
+ * @file sipe-snapshot.h
+ *
+ * pidgin-sipe
+ *
+ * Copyright (C) 2020 SIPE Project <http://sipe.sourceforge.net/>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Forward declarations */
+struct sipe_core_private;
+
+/**
+ * Populate groups and buddies from the snapshot of the last session.
+ * Sets @c SIPE_CORE_PRIVATE_FLAG_SNAPSHOT on success.
+ *
+ * @param sipe_private SIPE core data
+ *
+ * @return @c TRUE if a valid snapshot was found
+ */
+gboolean sipe_snapshot_load(struct sipe_core_private *sipe_private);
+
+/**
+ * Store groups, buddies and the last presence passed to the backend in
+ * the snapshot. Does nothing if the buddy list hasn't been received yet.
+ *
+ * @param sipe_private SIPE core data
+ */
+void sipe_snapshot_save(struct sipe_core_private *sipe_private);
+
+/*
+  Local Variables:
+  mode: c
+  c-file-style: "bsd"
+  indent-tabs-mode: t
+  tab-width: 8
+  End:
+*/
@@ -0,0 +1,542 @@
+/**
+ * @file sipe-subscriptions-tests.c
+ *
+ * pidgin-sipe
+ *
+ * Copyright (C) 2020 SIPE Project <http://sipe.sourceforge.net/>
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ * Tests for the rate controlled presence subscription queue and the
+ * resource list of batched presence subscriptions. Transport
+ * and scheduler are replaced by stubs so that the test controls when
+ * timers fire and when responses arrive.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+
+#include <glib.h>
+
+#include "sipe-subscriptions.c"
+#include "sipe-crypt.h"
+#include "sipe-rtf.h"
+
+/*
+ * Stubs
+ */
+gboolean sipe_backend_debug_enabled(void)
+{
+	return(FALSE);
+}
+
+void sipe_backend_debug_literal(SIPE_UNUSED_PARAMETER sipe_debug_level level,
+				SIPE_UNUSED_PARAMETER const gchar *msg)
+{
+}
+
+void sipe_backend_debug(SIPE_UNUSED_PARAMETER sipe_debug_level level,
+			SIPE_UNUSED_PARAMETER const gchar *format,
+			...)
+{
+}
+
+void sipe_backend_notify_error(SIPE_UNUSED_PARAMETER struct sipe_core_public *sipe_public,
+			       SIPE_UNUSED_PARAMETER const gchar *title,
+			       SIPE_UNUSED_PARAMETER const gchar *msg)
+{
+}
+
+gchar *sipe_backend_markup_css_property(SIPE_UNUSED_PARAMETER const gchar *style,
+					SIPE_UNUSED_PARAMETER const gchar *option)
+{
+	return(NULL);
+}
+
+void sipe_mime_parts_foreach(SIPE_UNUSED_PARAMETER const gchar *type,
+			     SIPE_UNUSED_PARAMETER const gchar *body,
+			     SIPE_UNUSED_PARAMETER sipe_mime_parts_cb callback,
+			     SIPE_UNUSED_PARAMETER gpointer user_data)
+{
+}
+
+gchar *sipe_rtf_to_html(SIPE_UNUSED_PARAMETER const gchar *rtf)
+{
+	return(NULL);
+}
+
+const gchar *sip_transport_epid(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+	return(NULL);
+}
+
+void process_incoming_notify(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+			     SIPE_UNUSED_PARAMETER struct sipmsg *msg)
+{
+}
+
+/* buddy list: URI -> struct sipe_buddy */
+static GHashTable *buddies = NULL;
+
+guint sipe_buddy_count(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private)
+{
+	return(buddies ? g_hash_table_size(buddies) : 0);
+}
+
+struct sipe_buddy *sipe_buddy_find_by_uri(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+					  SIPE_UNUSED_PARAMETER const gchar *uri)
+{
+	return(NULL);
+}
+
+void sipe_buddy_foreach(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+			GHFunc callback,
+			gpointer callback_data)
+{
+	if (buddies)
+		g_hash_table_foreach(buddies, callback, callback_data);
+}
+
+void sipe_dialog_free(struct sip_dialog *dialog)
+{
+	g_free(dialog);
+}
+
+void sipe_dialog_parse(SIPE_UNUSED_PARAMETER struct sip_dialog *dialog,
+		       SIPE_UNUSED_PARAMETER const struct sipmsg *msg,
+		       SIPE_UNUSED_PARAMETER gboolean outgoing)
+{
+}
+
+void sipe_ucs_init(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+		   SIPE_UNUSED_PARAMETER gboolean migrated)
+{
+}
+
+/* needed when linking against NSS */
+void md4sum(const uint8_t *data, uint32_t length, uint8_t *digest);
+void md4sum(SIPE_UNUSED_PARAMETER const uint8_t *data,
+	    SIPE_UNUSED_PARAMETER uint32_t length,
+	    SIPE_UNUSED_PARAMETER uint8_t *digest)
+{
+}
+
+/* transport: outstanding queued SUBSCRIBE transactions */
+static GSList *transactions = NULL;
+static GHashTable *subscribed = NULL;
+
+struct transaction *sip_transport_request_timeout(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+						  SIPE_UNUSED_PARAMETER const gchar *method,
+						  const gchar *url,
+						  SIPE_UNUSED_PARAMETER const gchar *to,
+						  SIPE_UNUSED_PARAMETER const gchar *addheaders,
+						  SIPE_UNUSED_PARAMETER const gchar *body,
+						  SIPE_UNUSED_PARAMETER struct sip_dialog *dialog,
+						  TransCallback callback,
+						  SIPE_UNUSED_PARAMETER guint timeout,
+						  TransCallback timeout_callback)
+{
+	struct transaction *trans = g_new0(struct transaction, 1);
+	guint count = GPOINTER_TO_UINT(g_hash_table_lookup(subscribed, url));
+
+	g_hash_table_insert(subscribed, g_strdup(url), GUINT_TO_POINTER(count + 1));
+
+	trans->callback         = callback;
+	trans->timeout_callback = timeout_callback;
+	transactions = g_slist_append(transactions, trans);
+	return(trans);
+}
+
+/* transport: last dialog SUBSCRIBE */
+static guint subscribe_count = 0;
+static gchar *subscribe_body = NULL;
+
+void sip_transport_subscribe(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+			     SIPE_UNUSED_PARAMETER const gchar *uri,
+			     SIPE_UNUSED_PARAMETER const gchar *addheaders,
+			     const gchar *body,
+			     SIPE_UNUSED_PARAMETER struct sip_dialog *dialog,
+			     SIPE_UNUSED_PARAMETER TransCallback callback)
+{
+	subscribe_count++;
+	g_free(subscribe_body);
+	subscribe_body = g_strdup(body);
+}
+
+/* same order as sip-transport.c: callback first, then payload destroy */
+static void transaction_remove(struct transaction *trans)
+{
+	transactions = g_slist_remove(transactions, trans);
+	if (trans->payload) {
+		if (trans->payload->destroy)
+			(*trans->payload->destroy)(trans->payload->data);
+		g_free(trans->payload);
+	}
+	g_free(trans);
+}
+
+/* scheduler: single timer slot, time is advanced by the test */
+static gint64 fake_now = 0;
+static gchar *timer_name = NULL;
+static gpointer timer_payload = NULL;
+static sipe_schedule_action timer_action = NULL;
+static GDestroyNotify timer_destroy = NULL;
+static gint64 timer_deadline = 0;
+
+gint64 sipe_schedule_now(void)
+{
+	return(fake_now);
+}
+
+void sipe_schedule_cancel(SIPE_UNUSED_PARAMETER struct sipe_core_private *sipe_private,
+			  const gchar *name)
+{
+	if (timer_name && sipe_strequal(timer_name, name)) {
+		GDestroyNotify destroy = timer_destroy;
+		gpointer payload       = timer_payload;
+
+		g_free(timer_name);
+		timer_name    = NULL;
+		timer_payload = NULL;
+		timer_action  = NULL;
+		timer_destroy = NULL;
+		if (destroy) (*destroy)(payload);
+	}
+}
+
+void sipe_schedule_mseconds(struct sipe_core_private *sipe_private,
+			    const gchar *name,
+			    gpointer payload,
+			    guint milliseconds,
+			    sipe_schedule_action action,
+			    GDestroyNotify destroy)
+{
+	if (!sipe_strequal(name, SIPE_PRESENCE_QUEUE_NAME)) {
+		if (destroy) (*destroy)(payload);
+		return;
+	}
+
+	sipe_schedule_cancel(sipe_private, name);
+	timer_name     = g_strdup(name);
+	timer_payload  = payload;
+	timer_action   = action;
+	timer_destroy  = destroy;
+	timer_deadline = fake_now + milliseconds;
+}
+
+void sipe_schedule_seconds(struct sipe_core_private *sipe_private,
+			   const gchar *name,
+			   gpointer payload,
+			   guint seconds,
+			   sipe_schedule_action action,
+			   GDestroyNotify destroy)
+{
+	sipe_schedule_mseconds(sipe_private, name, payload, seconds * 1000,
+			       action, destroy);
+}
+
+static gboolean timer_fire(struct sipe_core_private *sipe_private)
+{
+	gchar *name = timer_name;
+	gpointer payload = timer_payload;
+	sipe_schedule_action action = timer_action;
+	GDestroyNotify destroy = timer_destroy;
+
+	if (!name)
+		return(FALSE);
+
+	/* like sipe-schedule.c: entry is unlinked before it is executed */
+	timer_name    = NULL;
+	timer_payload = NULL;
+	timer_action  = NULL;
+	timer_destroy = NULL;
+	if (timer_deadline > fake_now)
+		fake_now = timer_deadline;
+
+	(*action)(sipe_private, payload);
+	if (destroy) (*destroy)(payload);
+	g_free(name);
+
+	return(TRUE);
+}
+
+/*
+ * Tester code
+ */
+static guint succeeded = 0;
+static guint failed    = 0;
+
+static void assert_equal_uint(gsize expected, gsize got, const gchar *what)
+{
+	if (expected == got) {
+		succeeded++;
+	} else {
+		printf("FAILED: %s: %" G_GSIZE_FORMAT "\n        %" G_GSIZE_FORMAT "\n",
+		       what, got, expected);
+		failed++;
+	}
+}
+
+static void respond_first(struct sipe_core_private *sipe_private,
+			  guint response)
+{
+	struct transaction *trans = transactions->data;
+	struct sipmsg *msg = g_new0(struct sipmsg, 1);
+
+	msg->response = response;
+	fake_now += 10;
+
+	sipe_presence_queue_feedback(sipe_private, trans, msg);
+	transaction_remove(trans);
+
+	g_free(msg);
+}
+
+#define TEST_URIS (3 * SIPE_PRESENCE_QUEUE_IN_FLIGHT + 7)
+
+static void tests_presence_queue_in_flight(struct sipe_core_private *sipe_private)
+{
+	struct sipe_presence_queue *queue;
+	guint max_in_flight = 0;
+	guint stalled = 0;
+	guint rounds = 0;
+	guint i;
+
+	for (i = 0; i < TEST_URIS; i++)
+		sipe_presence_queue_add(sipe_private,
+					g_strdup_printf("sip:user%u@test.com", i));
+	/* duplicates are ignored */
+	sipe_presence_queue_add(sipe_private, g_strdup("sip:user0@test.com"));
+
+	queue = sipe_private->presence_queue;
+	assert_equal_uint(TEST_URIS, g_queue_get_length(queue->uris), "queued");
+
+	/*
+	 * A response is only delivered when no dispatch is scheduled, i.e.
+	 * the in-flight limit has been reached or everything has been sent.
+	 * Every response must free a slot and schedule the next dispatch.
+	 */
+	while (rounds++ < 10 * TEST_URIS) {
+		if (timer_fire(sipe_private)) {
+			if (queue->in_flight > max_in_flight)
+				max_in_flight = queue->in_flight;
+		} else if (transactions) {
+			respond_first(sipe_private, 200);
+			if (!timer_name && !g_queue_is_empty(queue->uris))
+				stalled++;
+		} else {
+			break;
+		}
+	}
+
+	assert_equal_uint(SIPE_PRESENCE_QUEUE_IN_FLIGHT, max_in_flight, "max. in flight");
+	assert_equal_uint(0, stalled, "stalled after response");
+	assert_equal_uint(0, g_queue_get_length(queue->uris), "pending after drain");
+	assert_equal_uint(0, queue->in_flight, "in flight after drain");
+	assert_equal_uint(TEST_URIS, g_hash_table_size(subscribed), "subscribed URIs");
+	for (i = 0; i < TEST_URIS; i++) {
+		gchar *uri = g_strdup_printf("sip:user%u@test.com", i);
+		assert_equal_uint(1,
+				  GPOINTER_TO_UINT(g_hash_table_lookup(subscribed, uri)),
+				  uri);
+		g_free(uri);
+	}
+}
+
+static void tests_presence_queue_dropped(struct sipe_core_private *sipe_private)
+{
+	struct sipe_presence_queue *queue = sipe_private->presence_queue;
+
+	sipe_presence_queue_add(sipe_private, g_strdup("sip:dropped@test.com"));
+	while (timer_fire(sipe_private));
+	assert_equal_uint(1, queue->in_flight, "in flight before drop");
+
+	/* transaction removed without response, e.g. on disconnect */
+	while (transactions)
+		transaction_remove(transactions->data);
+	assert_equal_uint(0, queue->in_flight, "in flight after drop");
+}
+
+#define TEST_BUDDIES 5000
+
+static void tests_presence_batch(struct sipe_core_private *sipe_private)
+{
+	GHashTable *seen = g_hash_table_new(g_str_hash, g_str_equal);
+	const gchar *list[] = { "sip:b@test.com", "sip:a@test.com", "sip:c@test.com" };
+	GSList *server = NULL;
+	sipe_xml *xml;
+	const sipe_xml *node;
+	guint contexts = 0;
+	guint just_added = 0;
+	guint ordered = 0;
+	guint i;
+
+	buddies = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	for (i = 0; i < TEST_BUDDIES; i++) {
+		struct sipe_buddy *buddy = g_new0(struct sipe_buddy, 1);
+		buddy->just_added = (i % 3) == 0;
+		g_hash_table_insert(buddies,
+				    g_strdup_printf("sip:buddy%u@test.com", i),
+				    buddy);
+	}
+
+	/* initial subscription: whole contact list in one adhocList */
+	SIPE_CORE_PRIVATE_FLAG_SET(BATCHED_SUPPORT);
+	SIPE_CORE_PRIVATE_FLAG_SET(OCS2007);
+	sipe_subscribe_presence_initial(sipe_private);
+	assert_equal_uint(1, subscribe_count, "initial batched SUBSCRIBE");
+
+	xml = sipe_xml_parse(subscribe_body, strlen(subscribe_body));
+	for (node = sipe_xml_child(xml, "action/adhocList/resource");
+	     node;
+	     node = sipe_xml_twin(node)) {
+		const gchar *uri = sipe_xml_attribute(node, "uri");
+
+		if (uri &&
+		    g_hash_table_lookup(buddies, uri) &&
+		    !g_hash_table_lookup(seen, uri))
+			g_hash_table_insert(seen, (gpointer) uri, (gpointer) uri);
+		if (sipe_xml_child(node, "context"))
+			contexts++;
+	}
+	assert_equal_uint(TEST_BUDDIES, g_hash_table_size(seen), "each contact once");
+	assert_equal_uint((TEST_BUDDIES + 2) / 3, contexts, "context for new contacts");
+	sipe_xml_free(xml);
+	g_hash_table_destroy(seen);
+
+	/* context is only sent once */
+	for (i = 0; i < TEST_BUDDIES; i++) {
+		gchar *uri = g_strdup_printf("sip:buddy%u@test.com", i);
+		struct sipe_buddy *buddy = g_hash_table_lookup(buddies, uri);
+		if (buddy->just_added)
+			just_added++;
+		g_free(uri);
+	}
+	assert_equal_uint(0, just_added, "context flag cleared");
+
+	/* initial subscription is only sent once */
+	sipe_subscribe_presence_initial(sipe_private);
+	assert_equal_uint(1, subscribe_count, "no repeated initial SUBSCRIBE");
+	g_hash_table_destroy(buddies);
+	buddies = NULL;
+
+	/* resubscription for contacts on other pool: list order is kept */
+	SIPE_CORE_PRIVATE_FLAG_UNSET(OCS2007);
+	for (i = 0; i < G_N_ELEMENTS(list); i++)
+		server = g_slist_append(server, g_strdup(list[i]));
+	sipe_subscribe_poolfqdn_resource_uri("pool.test.com", server, sipe_private);
+	assert_equal_uint(2, subscribe_count, "routed batched SUBSCRIBE");
+
+	xml = sipe_xml_parse(subscribe_body, strlen(subscribe_body));
+	for (node = sipe_xml_child(xml, "create/resource"), i = 0;
+	     node;
+	     node = sipe_xml_twin(node), i++)
+		if ((i < G_N_ELEMENTS(list)) &&
+		    sipe_strequal(list[i], sipe_xml_attribute(node, "uri")))
+			ordered++;
+	assert_equal_uint(G_N_ELEMENTS(list), i, "routed resources");
+	assert_equal_uint(G_N_ELEMENTS(list), ordered, "routed resource order");
+	sipe_xml_free(xml);
+
+	g_free(subscribe_body);
+	subscribe_body = NULL;
+}
+
+static void tests_presence_queue_sent(struct sipe_core_private *sipe_private)
+{
+	struct sipe_presence_queue *queue = sipe_private->presence_queue;
+
+	sipe_presence_queue_add(sipe_private, g_strdup("sip:sent@test.com"));
+	while (timer_fire(sipe_private));
+	assert_equal_uint(1, queue->in_flight, "in flight");
+
+	/* SUBSCRIBE for this URI is already on the wire */
+	sipe_presence_queue_add(sipe_private, g_strdup("sip:sent@test.com"));
+	assert_equal_uint(0, g_queue_get_length(queue->uris), "in flight URI not queued");
+
+	/* overload: URI is queued again for retry */
+	respond_first(sipe_private, 408);
+	assert_equal_uint(1, g_queue_get_length(queue->uris), "retry after overload");
+	sipe_presence_queue_free(sipe_private);
+}
+
+static void tests_presence_queue_increase(struct sipe_core_private *sipe_private)
+{
+	struct sipe_presence_queue *queue;
+	guint rate;
+	guint i;
+
+	for (i = 0; i < SIPE_PRESENCE_QUEUE_BURST; i++)
+		sipe_presence_queue_add(sipe_private,
+					g_strdup_printf("sip:rtt%u@test.com", i));
+	queue = sipe_private->presence_queue;
+	rate  = queue->rate;
+	timer_fire(sipe_private);
+	assert_equal_uint(SIPE_PRESENCE_QUEUE_BURST, queue->in_flight, "window sent");
+
+	/* all responses of one window arrive within one round trip time */
+	fake_now += 100;
+	while (transactions)
+		respond_first(sipe_private, 200);
+	assert_equal_uint(rate + 1, queue->rate, "one increase per round trip time");
+
+	/* next window */
+	sipe_presence_queue_add(sipe_private, g_strdup("sip:next@test.com"));
+	timer_fire(sipe_private);
+	fake_now += 200;
+	respond_first(sipe_private, 200);
+	assert_equal_uint(rate + 2, queue->rate, "increase in next round trip");
+	sipe_presence_queue_free(sipe_private);
+}
+
+int main(SIPE_UNUSED_PARAMETER int argc,
+	 SIPE_UNUSED_PARAMETER char *argv[])
+{
+	struct sipe_core_private *sipe_private = g_new0(struct sipe_core_private, 1);
+
+	/* Initialization for crypto backend (test mode) */
+	sipe_crypto_init(FALSE);
+
+	sipe_private->username = g_strdup("self@test.com");
+	sipe_subscriptions_init(sipe_private);
+	subscribed = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+	tests_presence_queue_in_flight(sipe_private);
+	tests_presence_queue_dropped(sipe_private);
+	tests_presence_queue_sent(sipe_private);
+	tests_presence_queue_increase(sipe_private);
+	tests_presence_batch(sipe_private);
+
+	sipe_subscriptions_destroy(sipe_private);
+	g_hash_table_destroy(subscribed);
+	g_free(sipe_private->username);
+	g_free(sipe_private);
+
+	printf("Result: %d PASSED %d FAILED\n", succeeded, failed);
+	return(failed);
+}
+
+/*
+  Local Variables:
+  mode: c
+  c-file-style: "bsd"
+  indent-tabs-mode: t
+  tab-width: 8
+  End:
+*/
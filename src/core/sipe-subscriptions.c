@@ -53,6 +53,50 @@ struct sip_subscription {
 	GSList *buddies; /* batched subscriptions */
 };
 
+/*
+ * Rate controlled presence subscription queue
+ *
+ * Servers without batched subscription support require one SUBSCRIBE per
+ * contact. Contacts are queued (each URI at most once, also while its
+ * SUBSCRIBE is in flight) and dispatched through a token bucket. The rate
+ * is increased by one per round trip time while the server responds
+ * quickly and halved on overload responses or timeouts.
+ */
+#define SIPE_PRESENCE_QUEUE_RATE_INITIAL   25 /* requests per second */
+#define SIPE_PRESENCE_QUEUE_RATE_MIN        1
+#define SIPE_PRESENCE_QUEUE_RATE_MAX       50
+#define SIPE_PRESENCE_QUEUE_BURST           5 /* bucket size */
+#define SIPE_PRESENCE_QUEUE_IN_FLIGHT      50 /* max. outstanding requests */
+#define SIPE_PRESENCE_QUEUE_LATENCY_MAX  1000 /* milliseconds */
+#define SIPE_PRESENCE_QUEUE_RETRY_AFTER    30 /* seconds, for 503 without Retry-After */
+#define SIPE_PRESENCE_QUEUE_TIMEOUT        32 /* seconds, RFC3261 Timer F */
+#define SIPE_PRESENCE_QUEUE_NAME "<+presence-queue>"
+
+struct sipe_presence_queue {
+	GQueue *uris;           /* pending URIs in FIFO order */
+	GHashTable *pending;    /* URI -> link in uris */
+	GHashTable *sent;       /* URI -> request in flight */
+	gpointer timer;         /* payload of scheduled dispatch or NULL */
+	gint64 refilled;        /* last bucket refill [ms] */
+	gint64 hold;            /* no dispatch before this time [ms] */
+	gint64 window;          /* no rate increase before this time [ms] */
+	gdouble tokens;
+	guint rate;             /* requests per second */
+	guint latency;          /* smoothed response latency [ms] */
+	guint in_flight;
+};
+
+struct presence_queue_timer {
+	struct sipe_presence_queue *queue;
+};
+
+struct presence_queue_request {
+	struct sipe_presence_queue *queue;
+	gchar *uri;
+	gint64 sent;
+	gboolean done;          /* response or timeout processed */
+};
+
 static void sipe_subscription_free(struct sip_subscription *subscription)
 {
 
@@ -108,8 +152,10 @@ void sipe_subscriptions_unsubscribe(struct sipe_core_private *sipe_private)
 
 }
 
+static void sipe_presence_queue_free(struct sipe_core_private *sipe_private);
 void sipe_subscriptions_destroy(struct sipe_core_private *sipe_private)
 {
+	sipe_presence_queue_free(sipe_private);
 	g_hash_table_destroy(sipe_private->subscriptions);
 }
 
@@ -514,21 +560,44 @@ void sipe_subscribe_conference(struct sipe_core_private *sipe_private,
 /**
  * code for presence subscription
  */
-static void sipe_subscribe_presence_buddy(struct sipe_core_private *sipe_private,
-					  const gchar *uri,
-					  const gchar *request,
-					  const gchar *body)
+static gboolean process_subscribe_presence_queued_response(struct sipe_core_private *sipe_private,
+							   struct sipmsg *msg,
+							   struct transaction *trans);
+static gboolean process_subscribe_presence_queued_timeout(struct sipe_core_private *sipe_private,
+							  struct sipmsg *msg,
+							  struct transaction *trans);
+static struct transaction *sipe_subscribe_presence_buddy(struct sipe_core_private *sipe_private,
+							 const gchar *uri,
+							 const gchar *request,
+							 const gchar *body,
+							 gboolean queued)
 {
 	gchar *key = sipe_utils_presence_key(uri);
-
-	sip_transport_subscribe(sipe_private,
-				uri,
-				request,
-				body,
-				sipe_subscribe_dialog(sipe_private, key),
-				process_subscribe_response);
+	struct sip_dialog *dialog = sipe_subscribe_dialog(sipe_private, key);
+	struct transaction *trans = NULL;
+
+	if (queued) {
+		trans = sip_transport_request_timeout(sipe_private,
+						      "SUBSCRIBE",
+						      uri,
+						      uri,
+						      request,
+						      body,
+						      dialog,
+						      process_subscribe_presence_queued_response,
+						      SIPE_PRESENCE_QUEUE_TIMEOUT,
+						      process_subscribe_presence_queued_timeout);
+	} else {
+		sip_transport_subscribe(sipe_private,
+					uri,
+					request,
+					body,
+					dialog,
+					process_subscribe_response);
+	}
 
 	g_free(key);
+	return(trans);
 }
 
 /**
@@ -542,9 +611,10 @@ static void sipe_subscribe_presence_buddy(struct sipe_core_private *sipe_private
  * The To-URI and the URI listed in the resource list MUST be the same for a single category SUBSCRIBE request.
  *
  */
-void sipe_subscribe_presence_single(struct sipe_core_private *sipe_private,
-				    const gchar *uri,
-				    const gchar *to)
+static struct transaction *sipe_subscribe_presence_single_send(struct sipe_core_private *sipe_private,
+							       const gchar *uri,
+							       const gchar *to,
+							       gboolean queued)
 {
 	gchar *self = NULL;
 	gchar *contact = get_contact(sipe_private);
@@ -552,6 +622,7 @@ void sipe_subscribe_presence_single(struct sipe_core_private *sipe_private,
 	gchar *content = NULL;
 	const gchar *additional = "";
 	const gchar *content_type = "";
+	struct transaction *trans;
 	struct sipe_buddy *sbuddy = sipe_buddy_find_by_uri(sipe_private,
 							   uri);
 
@@ -598,11 +669,254 @@ void sipe_subscribe_presence_single(struct sipe_core_private *sipe_private,
 				  contact);
 	g_free(contact);
 
-	sipe_subscribe_presence_buddy(sipe_private, to, request, content);
+	trans = sipe_subscribe_presence_buddy(sipe_private, to, request, content, queued);
 
 	g_free(content);
 	g_free(self);
 	g_free(request);
+
+	return(trans);
+}
+
+void sipe_subscribe_presence_single(struct sipe_core_private *sipe_private,
+				    const gchar *uri,
+				    const gchar *to)
+{
+	sipe_subscribe_presence_single_send(sipe_private, uri, to, FALSE);
+}
+
+static struct sipe_presence_queue *sipe_presence_queue_get(struct sipe_core_private *sipe_private)
+{
+	struct sipe_presence_queue *queue = sipe_private->presence_queue;
+
+	if (!queue) {
+		sipe_private->presence_queue = queue = g_new0(struct sipe_presence_queue, 1);
+		queue->uris     = g_queue_new();
+		queue->pending  = g_hash_table_new(g_str_hash, g_str_equal);
+		queue->sent     = g_hash_table_new(g_str_hash, g_str_equal);
+		queue->refilled = sipe_schedule_now();
+		queue->tokens   = SIPE_PRESENCE_QUEUE_BURST;
+		queue->rate     = SIPE_PRESENCE_QUEUE_RATE_INITIAL;
+	}
+
+	return(queue);
+}
+
+static void sipe_presence_queue_free(struct sipe_core_private *sipe_private)
+{
+	struct sipe_presence_queue *queue = sipe_private->presence_queue;
+
+	if (queue) {
+		sipe_schedule_cancel(sipe_private, SIPE_PRESENCE_QUEUE_NAME);
+		g_hash_table_destroy(queue->pending);
+		g_hash_table_destroy(queue->sent);
+		while (!g_queue_is_empty(queue->uris))
+			g_free(g_queue_pop_head(queue->uris));
+		g_queue_free(queue->uris);
+		g_free(queue);
+		sipe_private->presence_queue = NULL;
+	}
+}
+
+static void sipe_presence_queue_timer_free(gpointer data)
+{
+	struct presence_queue_timer *timer = data;
+	/* dispatch may already have scheduled a new timer */
+	if (timer->queue->timer == timer)
+		timer->queue->timer = NULL;
+	g_free(timer);
+}
+
+static void sipe_presence_queue_request_free(gpointer data)
+{
+	struct presence_queue_request *request = data;
+	/* transaction dropped without response, e.g. on disconnect */
+	if (!request->done) {
+		g_hash_table_remove(request->queue->sent, request->uri);
+		request->queue->in_flight--;
+	}
+	g_free(request->uri);
+	g_free(request);
+}
+
+static void sipe_presence_queue_dispatch(struct sipe_core_private *sipe_private,
+					 gpointer data);
+static void sipe_presence_queue_schedule(struct sipe_core_private *sipe_private,
+					 struct sipe_presence_queue *queue)
+{
+	gint64 now = sipe_schedule_now();
+	guint delay = 0;
+	struct presence_queue_timer *timer;
+
+	if (queue->timer ||
+	    g_queue_is_empty(queue->uris) ||
+	    (queue->in_flight >= SIPE_PRESENCE_QUEUE_IN_FLIGHT))
+		return;
+
+	if (queue->hold > now)
+		delay = queue->hold - now;
+	else if (queue->tokens < 1)
+		delay = (1 - queue->tokens) * 1000 / queue->rate + 1;
+
+	timer = g_new(struct presence_queue_timer, 1);
+	timer->queue = queue;
+	queue->timer = timer;
+	sipe_schedule_mseconds(sipe_private,
+			       SIPE_PRESENCE_QUEUE_NAME,
+			       timer,
+			       delay,
+			       sipe_presence_queue_dispatch,
+			       sipe_presence_queue_timer_free);
+}
+
+static void sipe_presence_queue_dispatch(struct sipe_core_private *sipe_private,
+					 SIPE_UNUSED_PARAMETER gpointer data)
+{
+	struct sipe_presence_queue *queue = sipe_private->presence_queue;
+	gint64 now = sipe_schedule_now();
+	guint sent = 0;
+
+	queue->timer = NULL;
+
+	if (queue->hold <= now) {
+		queue->tokens += (gdouble) (now - queue->refilled) * queue->rate / 1000;
+		if (queue->tokens > SIPE_PRESENCE_QUEUE_BURST)
+			queue->tokens = SIPE_PRESENCE_QUEUE_BURST;
+		queue->refilled = now;
+
+		while ((queue->tokens >= 1) &&
+		       (queue->in_flight < SIPE_PRESENCE_QUEUE_IN_FLIGHT) &&
+		       !g_queue_is_empty(queue->uris)) {
+			gchar *uri = g_queue_pop_head(queue->uris);
+			struct transaction *trans;
+
+			g_hash_table_remove(queue->pending, uri);
+			queue->tokens -= 1;
+
+			trans = sipe_subscribe_presence_single_send(sipe_private,
+								    uri,
+								    NULL,
+								    TRUE);
+			if (trans) {
+				struct transaction_payload *payload = g_new0(struct transaction_payload, 1);
+				struct presence_queue_request *request = g_new(struct presence_queue_request, 1);
+
+				request->queue   = queue;
+				request->uri     = uri;
+				request->sent    = now;
+				request->done    = FALSE;
+				payload->destroy = sipe_presence_queue_request_free;
+				payload->data    = request;
+				trans->payload   = payload;
+				g_hash_table_insert(queue->sent, uri, request);
+				queue->in_flight++;
+				sent++;
+			} else {
+				g_free(uri);
+			}
+		}
+
+		SIPE_DEBUG_INFO("sipe_presence_queue_dispatch: sent %u, %u pending, %u in flight, rate %u/s",
+				sent,
+				g_queue_get_length(queue->uris),
+				queue->in_flight,
+				queue->rate);
+	}
+
+	sipe_presence_queue_schedule(sipe_private, queue);
+}
+
+/* takes ownership of uri */
+static void sipe_presence_queue_add(struct sipe_core_private *sipe_private,
+				    gchar *uri)
+{
+	struct sipe_presence_queue *queue = sipe_presence_queue_get(sipe_private);
+
+	if (g_hash_table_lookup(queue->pending, uri) ||
+	    g_hash_table_lookup(queue->sent, uri)) {
+		SIPE_DEBUG_INFO("sipe_presence_queue_add: %s already queued", uri);
+		g_free(uri);
+	} else {
+		g_queue_push_tail(queue->uris, uri);
+		g_hash_table_insert(queue->pending, uri, queue->uris->tail);
+		sipe_presence_queue_schedule(sipe_private, queue);
+	}
+}
+
+static void sipe_presence_queue_feedback(struct sipe_core_private *sipe_private,
+					 struct transaction *trans,
+					 struct sipmsg *msg)
+{
+	struct presence_queue_request *request = trans->payload->data;
+	struct sipe_presence_queue *queue = request->queue;
+	gint64 now = sipe_schedule_now();
+	guint latency = now - request->sent;
+	gboolean overload = !msg || (msg->response == 503) || (msg->response == 408);
+
+	/*
+	 * Release the slot now: the transaction is only destroyed after
+	 * this callback returns, i.e. after the schedule attempt below.
+	 */
+	request->done = TRUE;
+	g_hash_table_remove(queue->sent, request->uri);
+	queue->in_flight--;
+
+	queue->latency = queue->latency ?
+		(7 * queue->latency + latency) / 8 :
+		latency;
+
+	if (overload) {
+		const gchar *retry_after = msg ? sipmsg_find_header(msg, "Retry-After") : NULL;
+		guint seconds = retry_after ? (guint) atoi(retry_after) : 0;
+
+		if (!seconds || (seconds > 10 * SIPE_PRESENCE_QUEUE_RETRY_AFTER))
+			seconds = SIPE_PRESENCE_QUEUE_RETRY_AFTER;
+		if (msg && (msg->response == 503))
+			queue->hold = now + 1000 * seconds;
+
+		queue->rate   = MAX(queue->rate / 2, SIPE_PRESENCE_QUEUE_RATE_MIN);
+		queue->window = now + queue->latency;
+		SIPE_DEBUG_INFO("sipe_presence_queue_feedback: %s for %s, rate reduced to %u/s",
+				msg ? "overload" : "timeout",
+				request->uri,
+				queue->rate);
+
+		/* try again later */
+		sipe_presence_queue_add(sipe_private, g_strdup(request->uri));
+
+	} else if (queue->latency > SIPE_PRESENCE_QUEUE_LATENCY_MAX) {
+		queue->rate   = MAX(queue->rate * 3 / 4, SIPE_PRESENCE_QUEUE_RATE_MIN);
+		queue->window = now + queue->latency;
+	} else if ((queue->rate < SIPE_PRESENCE_QUEUE_RATE_MAX) &&
+		   (now >= queue->window)) {
+		/* additive increase: once per round trip time */
+		queue->rate++;
+		queue->window = now + queue->latency;
+	}
+
+	sipe_presence_queue_schedule(sipe_private, queue);
+}
+
+static gboolean process_subscribe_presence_queued_response(struct sipe_core_private *sipe_private,
+							   struct sipmsg *msg,
+							   struct transaction *trans)
+{
+	sipe_presence_queue_feedback(sipe_private, trans, msg);
+	return(process_subscribe_response(sipe_private, msg, trans));
+}
+
+static gboolean process_subscribe_presence_queued_timeout(struct sipe_core_private *sipe_private,
+							  SIPE_UNUSED_PARAMETER struct sipmsg *msg,
+							  struct transaction *trans)
+{
+	sipe_presence_queue_feedback(sipe_private, trans, NULL);
+	return(TRUE);
+}
+
+static void sipe_subscribe_presence_queue_cb(struct sipe_core_private *sipe_private,
+					     gpointer uri)
+{
+	sipe_presence_queue_add(sipe_private, g_strdup(uri));
 }
 
 void sipe_subscribe_presence_single_cb(struct sipe_core_private *sipe_private,
@@ -620,7 +934,7 @@ void sipe_subscribe_presence_single_cb(struct sipe_core_private *sipe_private,
  *   This header will be send only if adhoclist there is a "Supported: adhoclist" in REGISTER answer else will be send a Single Category SUBSCRIBE
  */
 static void sipe_subscribe_presence_batched_to(struct sipe_core_private *sipe_private,
-					       gchar *resources_uri,
+					       const gchar *resources_uri,
 					       const gchar *to)
 {
 	gchar *contact = get_contact(sipe_private);
@@ -658,7 +972,6 @@ static void sipe_subscribe_presence_batched_to(struct sipe_core_private *sipe_pr
 					  sipe_private->username,
 					  resources_uri);
 	}
-	g_free(resources_uri);
 
 	request = g_strdup_printf("Require: adhoclist%s\r\n"
 				  "Supported: eventlist\r\n"
@@ -676,12 +989,59 @@ static void sipe_subscribe_presence_batched_to(struct sipe_core_private *sipe_pr
 				  contact);
 	g_free(contact);
 
-	sipe_subscribe_presence_buddy(sipe_private, to, request, content);
+	sipe_subscribe_presence_buddy(sipe_private, to, request, content, FALSE);
 
 	g_free(content);
 	g_free(request);
 }
 
+/*
+ * Resource list for a batched SUBSCRIBE. All resources for one target
+ * are sent in a single adhocList, because the list is tied to the
+ * subscription dialog: a refresh SUBSCRIBE replaces the whole list.
+ */
+struct presence_batch {
+	struct sipe_core_private *sipe_private;
+	const gchar *to;
+	GString *resources;
+	guint count;
+};
+
+static struct presence_batch *sipe_subscribe_presence_batch_new(struct sipe_core_private *sipe_private,
+								const gchar *to)
+{
+	struct presence_batch *batch = g_new0(struct presence_batch, 1);
+	batch->sipe_private = sipe_private;
+	batch->to           = to;
+	batch->resources    = g_string_sized_new(4096);
+	return(batch);
+}
+
+static void sipe_subscribe_presence_batch_add(struct presence_batch *batch,
+					      const gchar *uri,
+					      const gchar *context)
+{
+	g_string_append_printf(batch->resources,
+			       "<resource uri=\"%s\"%s\n",
+			       uri, context);
+	batch->count++;
+}
+
+static void sipe_subscribe_presence_batch_send(struct presence_batch *batch)
+{
+	SIPE_DEBUG_INFO("sipe_subscribe_presence_batch_send: %u contacts to %s",
+			batch->count, batch->to);
+	sipe_subscribe_presence_batched_to(batch->sipe_private,
+					   batch->resources->str,
+					   batch->to);
+}
+
+static void sipe_subscribe_presence_batch_free(struct presence_batch *batch)
+{
+	g_string_free(batch->resources, TRUE);
+	g_free(batch);
+}
+
 struct presence_batched_routed {
 	gchar  *host;
 	const GSList *buddies; /* points to subscription->buddies */
@@ -699,16 +1059,14 @@ static void sipe_subscribe_presence_batched_routed(struct sipe_core_private *sip
 {
 	struct presence_batched_routed *data = payload;
 	const GSList *buddies = data->buddies;
-	gchar *resources_uri = g_strdup("");
+	struct presence_batch *batch = sipe_subscribe_presence_batch_new(sipe_private,
+									 data->host);
 	while (buddies) {
-		gchar *tmp = resources_uri;
-		resources_uri = g_strdup_printf("%s<resource uri=\"%s\"/>\n", tmp, (char *) buddies->data);
-		g_free(tmp);
+		sipe_subscribe_presence_batch_add(batch, buddies->data, "/>");
 		buddies = buddies->next;
 	}
-	sipe_subscribe_presence_batched_to(sipe_private,
-					   resources_uri,
-					   data->host);
+	sipe_subscribe_presence_batch_send(batch);
+	sipe_subscribe_presence_batch_free(batch);
 }
 
 static void sipe_subscribe_presence_batched_schedule(struct sipe_core_private *sipe_private,
@@ -750,27 +1108,23 @@ static void sipe_subscribe_presence_batched_schedule(struct sipe_core_private *s
 
 static void sipe_subscribe_resource_uri_with_context(const gchar *name,
 						     gpointer value,
-						     gchar **resources_uri)
+						     struct presence_batch *batch)
 {
 	struct sipe_buddy *sbuddy = (struct sipe_buddy *)value;
 	const gchar *context = sbuddy && sbuddy->just_added ? "><context/></resource>" : "/>";
-	gchar *tmp = *resources_uri;
 
 	/* should be enough to include context one time */
 	if (sbuddy)
 		sbuddy->just_added = FALSE;
 
-	*resources_uri = g_strdup_printf("%s<resource uri=\"%s\"%s\n", tmp, name, context);
-	g_free(tmp);
+	sipe_subscribe_presence_batch_add(batch, name, context);
 }
 
 static void sipe_subscribe_resource_uri(const char *name,
 					SIPE_UNUSED_PARAMETER gpointer value,
-					gchar **resources_uri)
+					struct presence_batch *batch)
 {
-	gchar *tmp = *resources_uri;
-        *resources_uri = g_strdup_printf("%s<resource uri=\"%s\"/>\n", tmp, name);
-	g_free(tmp);
+	sipe_subscribe_presence_batch_add(batch, name, "/>");
 }
 
 /**
@@ -780,24 +1134,7 @@ static void schedule_buddy_resubscription_cb(char *buddy_name,
 					     SIPE_UNUSED_PARAMETER struct sipe_buddy *buddy,
 					     struct sipe_core_private *sipe_private)
 {
-	guint time_range = (sipe_buddy_count(sipe_private) * 1000) / 25; /* time interval for 25 requests per sec. In msec. */
-
-	/*
-	 * g_hash_table_size() can never return 0, otherwise this function
-	 * wouldn't be called :-) But to keep Coverity happy...
-	 */
-	if (time_range) {
-		gchar *action_name = sipe_utils_presence_key(buddy_name);
-		guint timeout = ((guint) rand()) / (RAND_MAX / time_range) + 1; /* random period within the range but never 0! */
-
-		sipe_schedule_mseconds(sipe_private,
-				       action_name,
-				       g_strdup(buddy_name),
-				       timeout,
-				       sipe_subscribe_presence_single_cb,
-				       g_free);
-		g_free(action_name);
-	}
+	sipe_presence_queue_add(sipe_private, g_strdup(buddy_name));
 }
 
 void sipe_subscribe_presence_initial(struct sipe_core_private *sipe_private)
@@ -812,17 +1149,19 @@ void sipe_subscribe_presence_initial(struct sipe_core_private *sipe_private)
 		if (sipe_buddy_count(sipe_private) > 0) {
 			if (SIPE_CORE_PRIVATE_FLAG_IS(BATCHED_SUPPORT)) {
 				gchar *to = sip_uri_self(sipe_private);
-				gchar *resources_uri = g_strdup("");
+				struct presence_batch *batch = sipe_subscribe_presence_batch_new(sipe_private,
+												 to);
 				if (SIPE_CORE_PRIVATE_FLAG_IS(OCS2007)) {
 					sipe_buddy_foreach(sipe_private,
 							   (GHFunc) sipe_subscribe_resource_uri_with_context,
-							   &resources_uri);
+							   batch);
 				} else {
 					sipe_buddy_foreach(sipe_private,
 							   (GHFunc) sipe_subscribe_resource_uri,
-							   &resources_uri);
+							   batch);
 				}
-				sipe_subscribe_presence_batched_to(sipe_private, resources_uri, to);
+				sipe_subscribe_presence_batch_send(batch);
+				sipe_subscribe_presence_batch_free(batch);
 				g_free(to);
 
 			} else {
@@ -921,7 +1260,7 @@ static void sipe_subscription_expiration(struct sipe_core_private *sipe_private,
 						      action_name,
 						      g_strdup(who),
 						      timeout,
-						      sipe_subscribe_presence_single_cb,
+						      sipe_subscribe_presence_queue_cb,
 						      g_free);
 				g_free(action_name);
 				SIPE_DEBUG_INFO("Resubscription single contact '%s' in %d seconds", who, timeout);
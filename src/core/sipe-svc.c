@@ -222,6 +222,7 @@ static gboolean sipe_svc_https_request(struct sipe_core_private *sipe_private,
 							data);
 
 		sipe_http_request_session(request, session->session);
+		sipe_http_request_compression(request);
 		sipe_http_request_ready(request);
 
 	} else {
@@ -43,6 +43,12 @@
  *    $ sipe_tls_tester
  *
  *   You can add <host>[:<port>] to connect to a server on another machine
+ *
+ * - Measuring the throughput of the TLS record layer (no server needed):
+ *
+ *    $ sipe_tls_tester --benchmark
+ *
+ *   The record contents are checked by sipe_tls_tests ("make check").
  */
 
 #include <stdlib.h>
@@ -61,23 +67,24 @@
 #include <glib.h>
 
 #include "sipe-common.h" /* coverity[hfa: FALSE] */
-#include "sipe-backend.h"
-#include "sipe-cert-crypto.h"
-#include "sipe-crypt.h"
-#include "sipe-tls.h"
+/* benchmark needs access to the record layer internals */
+#include "sipe-tls.c"
 
 /*
  * Stubs
  */
+static gboolean debug_output = TRUE;
+
 gboolean sipe_backend_debug_enabled(void)
 {
-	return(TRUE);
+	return(debug_output);
 }
 
 void sipe_backend_debug_literal(sipe_debug_level level,
 				const gchar *msg)
 {
-	printf("DEBUG(%d): %s\n", level, msg);
+	if (debug_output)
+		printf("DEBUG(%d): %s\n", level, msg);
 }
 
 void sipe_backend_debug(sipe_debug_level level,
@@ -85,7 +92,12 @@ void sipe_backend_debug(sipe_debug_level level,
 			...)
 {
 	va_list ap;
-	gchar *newformat = g_strdup_printf("DEBUG(%d): %s\n", level, format);
+	gchar *newformat;
+
+	if (!debug_output)
+		return;
+
+	newformat = g_strdup_printf("DEBUG(%d): %s\n", level, format);
 
 	va_start(ap, format);
 	vprintf(newformat, ap);
@@ -299,6 +311,102 @@ static int tls_connect(const gchar *param)
 	return(fd);
 }
 
+static const struct {
+	guint suite;
+	const gchar *label;
+} record_suites[] = {
+	{ TLS_RSA_WITH_RC4_128_MD5,     "RC4-MD5"    },
+	{ TLS_RSA_WITH_RC4_128_SHA,     "RC4-SHA"    },
+	{ TLS_RSA_WITH_AES_128_CBC_SHA, "AES128-SHA" },
+	{ TLS_RSA_WITH_AES_256_CBC_SHA, "AES256-SHA" }
+};
+
+/* state with faked server selection of cipher suite */
+static struct tls_internal_state *tls_record_state(guint suite)
+{
+	struct tls_internal_state *state = g_new0(struct tls_internal_state, 1);
+	struct tls_parsed_integer *cipher_suite = g_new0(struct tls_parsed_integer, 1);
+
+	state->md5_context  = sipe_digest_md5_start();
+	state->sha1_context = sipe_digest_sha1_start();
+	state->data = g_hash_table_new_full(g_str_hash, g_str_equal,
+					    NULL, g_free);
+	cipher_suite->value = suite;
+	g_hash_table_insert(state->data, (gpointer) "CipherSuite", cipher_suite);
+	if (!check_cipher_suite(state)) {
+		sipe_tls_free((struct sipe_tls_state *) state);
+		return(NULL);
+	}
+	free_parse_data(state);
+
+	return(state);
+}
+
+static void tls_record_compile(struct tls_internal_state *state,
+			       const guchar *payload,
+			       gsize length)
+{
+	gsize record = tls_record_start(state, TLS_RECORD_TYPE_HANDSHAKE);
+	memcpy(tls_out_reserve(state, length), payload, length);
+	state->common.out_length += length;
+	compile_encrypted_tls_record(state, record);
+}
+
+/* 16MB per cipher suite and record size */
+#define BENCHMARK_TOTAL_MB 16
+
+static void tls_record_benchmark(void)
+{
+	static const gsize sizes[] = { 64, 1024, 4096, 16384 };
+	guchar *payload = g_malloc(16384);
+	GTimer *timer   = g_timer_new();
+	guint i;
+
+	/* per-record debug output would dominate the measurement */
+	debug_output = FALSE;
+	memset(payload, 0x5A, 16384);
+
+	for (i = 0; i < G_N_ELEMENTS(record_suites); i++) {
+		struct tls_internal_state *state = tls_record_state(record_suites[i].suite);
+		guint j;
+
+		if (!state) {
+			printf("%-10s: cipher suite not supported\n", record_suites[i].label);
+			continue;
+		}
+		sipe_tls_fill_random(&state->client_random,
+				     TLS_ARRAY_RANDOM_LENGTH * 8); /* -> bits */
+		sipe_tls_fill_random(&state->server_random,
+				     TLS_ARRAY_RANDOM_LENGTH * 8); /* -> bits */
+		tls_calculate_secrets(state);
+
+		for (j = 0; j < G_N_ELEMENTS(sizes); j++) {
+			guint iterations = (BENCHMARK_TOTAL_MB * 1024 * 1024) / sizes[j];
+			gdouble elapsed;
+			guint k;
+
+			g_timer_start(timer);
+			for (k = 0; k < iterations; k++) {
+				tls_record_compile(state, payload, sizes[j]);
+				tls_out_discard(state);
+			}
+			elapsed = g_timer_elapsed(timer, NULL);
+
+			printf("%-10s: %5" G_GSIZE_FORMAT " bytes/record %8.1f MB/s %9.0f records/s\n",
+			       record_suites[i].label,
+			       sizes[j],
+			       BENCHMARK_TOTAL_MB / elapsed,
+			       iterations / elapsed);
+		}
+
+		sipe_tls_free((struct sipe_tls_state *) state);
+	}
+
+	g_timer_destroy(timer);
+	g_free(payload);
+	debug_output = TRUE;
+}
+
 int main(int argc, char *argv[])
 {
 	struct sipe_cert_crypto *scc;
@@ -306,6 +414,12 @@ int main(int argc, char *argv[])
 	sipe_crypto_init(FALSE);
 	srand(time(NULL));
 
+	if ((argc > 1) && (strcmp(argv[1], "--benchmark") == 0)) {
+		tls_record_benchmark();
+		sipe_crypto_shutdown();
+		return(0);
+	}
+
 	scc = sipe_cert_crypto_init();
 	if (scc) {
 		gpointer certificate;
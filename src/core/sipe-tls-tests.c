@@ -0,0 +1,606 @@
+/**
+ * @file sipe-tls-tests.c
+ *
+ * pidgin-sipe
+ *
+ * Copyright (C) 2020 SIPE Project <http://sipe.sourceforge.net/>
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ * Tests for the TLS handshake implementation: record layer known answers
+ * and the complete client flight sent in response to the server hello.
+ * The flight is checked with keys derived independently from the
+ * decrypted pre-master secret.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+
+#include <glib.h>
+
+/* tests need access to the TLS internals */
+#include "sipe-tls.c"
+
+/*
+ * Stubs
+ */
+gboolean sipe_backend_debug_enabled(void)
+{
+	return(FALSE);
+}
+
+void sipe_backend_debug_literal(SIPE_UNUSED_PARAMETER sipe_debug_level level,
+				SIPE_UNUSED_PARAMETER const gchar *msg)
+{
+}
+
+void sipe_backend_debug(SIPE_UNUSED_PARAMETER sipe_debug_level level,
+			SIPE_UNUSED_PARAMETER const gchar *format,
+			...)
+{
+}
+
+/*
+ * Tester code
+ */
+static guint succeeded = 0;
+static guint failed    = 0;
+
+static void assert_equal(guint expected, guint got, const gchar *what)
+{
+	if (expected == got) {
+		succeeded++;
+	} else {
+		printf("FAILED: %s: %u expected %u\n", what, got, expected);
+		failed++;
+	}
+}
+
+static gchar *hex_string(const guchar *data, gsize length)
+{
+	gchar *hex = g_malloc(2 * length + 1);
+	gsize i;
+
+	hex[0] = '\0';
+	for (i = 0; i < length; i++)
+		sprintf(hex + 2 * i, "%02X", data[i]);
+	return(hex);
+}
+
+static void assert_buffer(const guchar *expected, gsize expected_length,
+			  const guchar *got, gsize got_length,
+			  const gchar *what)
+{
+	if ((expected_length == got_length) &&
+	    (memcmp(expected, got, got_length) == 0)) {
+		succeeded++;
+	} else {
+		gchar *expected_hex = hex_string(expected, expected_length);
+		gchar *got_hex      = hex_string(got, got_length);
+		printf("FAILED: %s:\n  got      %s\n  expected %s\n",
+		       what, got_hex, expected_hex);
+		g_free(got_hex);
+		g_free(expected_hex);
+		failed++;
+	}
+}
+
+static const struct {
+	guint suite;
+	const gchar *label;
+} record_suites[] = {
+	{ TLS_RSA_WITH_RC4_128_MD5,     "RC4-MD5"    },
+	{ TLS_RSA_WITH_RC4_128_SHA,     "RC4-SHA"    },
+	{ TLS_RSA_WITH_AES_128_CBC_SHA, "AES128-SHA" },
+	{ TLS_RSA_WITH_AES_256_CBC_SHA, "AES256-SHA" }
+};
+
+/* state with faked server selection of cipher suite */
+static struct tls_internal_state *tls_record_state(guint suite)
+{
+	struct tls_internal_state *state = g_new0(struct tls_internal_state, 1);
+	struct tls_parsed_integer *cipher_suite = g_new0(struct tls_parsed_integer, 1);
+
+	state->md5_context  = sipe_digest_md5_start();
+	state->sha1_context = sipe_digest_sha1_start();
+	state->data = g_hash_table_new_full(g_str_hash, g_str_equal,
+					    NULL, g_free);
+	cipher_suite->value = suite;
+	g_hash_table_insert(state->data, (gpointer) "CipherSuite", cipher_suite);
+	if (!check_cipher_suite(state)) {
+		sipe_tls_free((struct sipe_tls_state *) state);
+		return(NULL);
+	}
+	free_parse_data(state);
+
+	return(state);
+}
+
+/*
+ * Known answers for the record layer: key block bytes 0x00, 0x01, ...,
+ * sequence number 42 and the payload below. Verified independently with
+ * HMAC from Python and "openssl enc" (RC4, AES-CBC with -nopad).
+ */
+static const guchar known_answer_payload[] = "TLS-DSK known answer test payload";
+static const gchar * const known_answer_records[] = {
+	/* RC4-MD5 */
+	"1603010031F8D2201768566F620C3F067F329D57AB59F5C676AF1EA0311475C9"
+	"53EA1B935A11DD3C799BB5FC10B683CAA98ACECFB712",
+	/* RC4-SHA */
+	"160301003551B2C34FD3C0C4CC4E5056B5BD643A6D2A3347827E098C82DE4BCC"
+	"94FD9ABA0C637EAB4ED897A2DA606E3A2EA2289999755629516B",
+	/* AES128-SHA */
+	"1603010040860067A1B12198AE283A7F7E48027D587FFD0E68CCFB9A49043238"
+	"B0F01D8F8FD0454BE04A63102939CDB9EF19D99F20D0D7EDDF0797EE2A09FE04"
+	"33B96DA0CD",
+	/* AES256-SHA */
+	"16030100400BEBC101E1E0B8BAC7D4045F15A67C1EAA75169CC0F593841B145A"
+	"3556E6B3895913DE8D350A34642E0E5AFFCAECCC52C8EEC4D598D80CDDDFC9C1"
+	"79265E9391"
+};
+#define KNOWN_ANSWER_SEQUENCE 42
+
+static void tls_record_fixed_keys(struct tls_internal_state *state)
+{
+	gsize length = 2 * (state->mac_length + state->key_length +
+			    (state->stream_cipher ? 0 : TLS_AES_CBC_BLOCK_LENGTH));
+	guchar *key_block = g_malloc(length);
+	gsize i;
+
+	for (i = 0; i < length; i++)
+		key_block[i] = i;
+
+	/* same partitioning as tls_calculate_secrets() */
+	state->key_block               = key_block;
+	state->client_write_mac_secret = key_block;
+	state->client_write_secret     = key_block + 2 * state->mac_length;
+	state->mac_context = state->mac->start(state->client_write_mac_secret,
+					       state->mac_length);
+	if (state->stream_cipher)
+		state->cipher_context = sipe_crypt_tls_start(state->client_write_secret,
+							     state->key_length);
+	else
+		state->client_write_iv = key_block + 2 * (state->mac_length + state->key_length);
+	state->sequence_number = KNOWN_ANSWER_SEQUENCE;
+}
+
+static void tests_known_answers(void)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(record_suites); i++) {
+		struct tls_internal_state *state = tls_record_state(record_suites[i].suite);
+		gsize record;
+		gchar *hex;
+
+		if (!state) {
+			printf("FAILED: %s: cipher suite not supported\n",
+			       record_suites[i].label);
+			failed++;
+			continue;
+		}
+
+		tls_record_fixed_keys(state);
+		record = tls_record_start(state, TLS_RECORD_TYPE_HANDSHAKE);
+		memcpy(tls_out_reserve(state, sizeof(known_answer_payload) - 1),
+		       known_answer_payload,
+		       sizeof(known_answer_payload) - 1);
+		state->common.out_length += sizeof(known_answer_payload) - 1;
+		compile_encrypted_tls_record(state, record);
+
+		hex = hex_string(state->common.out_buffer,
+				 state->common.out_length);
+		if (strcmp(hex, known_answer_records[i]) == 0) {
+			succeeded++;
+		} else {
+			printf("FAILED: %s known answer:\n  got      %s\n  expected %s\n",
+			       record_suites[i].label, hex, known_answer_records[i]);
+			failed++;
+		}
+		assert_equal(KNOWN_ANSWER_SEQUENCE + 1, state->sequence_number,
+			     record_suites[i].label);
+
+		g_free(hex);
+		sipe_tls_free((struct sipe_tls_state *) state);
+	}
+}
+
+/*
+ * Complete client flight after the server hello
+ */
+static void append_integer(GByteArray *array, guint value, gsize length)
+{
+	guchar bytes[4];
+
+	lowlevel_integer_to_tls(bytes, length, value);
+	g_byte_array_append(array, bytes, length);
+}
+
+static void append_handshake(GByteArray *array, guint type,
+			     const guchar *data, gsize length)
+{
+	append_integer(array, type,   1);
+	append_integer(array, length, 3);
+	g_byte_array_append(array, data, length);
+}
+
+/* ServerHello, Certificate, CertificateRequest & ServerHelloDone */
+static GByteArray *server_hello_flight(guint suite,
+				       gpointer certificate,
+				       const guchar *server_random)
+{
+	GByteArray *record = g_byte_array_new();
+	GByteArray *msg    = g_byte_array_new();
+	gsize certificate_length = sipe_cert_crypto_raw_length(certificate);
+	static const guchar certificate_request[] = {
+		0x01, 0x01, /* CertificateType: rsa_sign */
+		0x00, 0x00  /* empty DistinguishedName list */
+	};
+
+	append_integer(record, TLS_RECORD_TYPE_HANDSHAKE, 1);
+	append_integer(record, TLS_PROTOCOL_VERSION_1_0,  2);
+	append_integer(record, 0,                         2);
+
+	append_integer(msg, TLS_PROTOCOL_VERSION_1_0, 2);
+	g_byte_array_append(msg, server_random, TLS_ARRAY_RANDOM_LENGTH);
+	append_integer(msg, 0,                        1); /* empty SessionID */
+	append_integer(msg, suite,                    2);
+	append_integer(msg, TLS_COMP_METHOD_NULL,     1);
+	append_handshake(record, TLS_HANDSHAKE_TYPE_SERVER_HELLO,
+			 msg->data, msg->len);
+
+	/* VECTOR_MAX24 of VECTOR_MAX24s */
+	g_byte_array_set_size(msg, 0);
+	append_integer(msg, certificate_length + 3, 3);
+	append_integer(msg, certificate_length,     3);
+	g_byte_array_append(msg,
+			    sipe_cert_crypto_raw(certificate),
+			    certificate_length);
+	append_handshake(record, TLS_HANDSHAKE_TYPE_CERTIFICATE,
+			 msg->data, msg->len);
+
+	append_handshake(record, TLS_HANDSHAKE_TYPE_CERTIFICATE_REQ,
+			 certificate_request, sizeof(certificate_request));
+	append_handshake(record, TLS_HANDSHAKE_TYPE_SERVER_HELLO_DONE,
+			 NULL, 0);
+
+	lowlevel_integer_to_tls(record->data + TLS_RECORD_OFFSET_LENGTH, 2,
+				record->len - TLS_RECORD_HEADER_LENGTH);
+	g_byte_array_free(msg, TRUE);
+
+	return(record);
+}
+
+/* returns start of next record, NULL if there is none */
+static const guchar *next_record(const guchar *bytes, const guchar *end,
+				 guint *type, gsize *length)
+{
+	if ((gsize) (end - bytes) < TLS_RECORD_HEADER_LENGTH)
+		return(NULL);
+	*type   = bytes[TLS_RECORD_OFFSET_TYPE];
+	*length = lowlevel_integer_to_host(bytes + TLS_RECORD_OFFSET_LENGTH, 2);
+	if ((lowlevel_integer_to_host(bytes + TLS_RECORD_OFFSET_VERSION, 2) != TLS_PROTOCOL_VERSION_1_0) ||
+	    ((gsize) (end - bytes) < TLS_RECORD_HEADER_LENGTH + *length))
+		return(NULL);
+	return(bytes + TLS_RECORD_HEADER_LENGTH);
+}
+
+/* returns start of message contents, NULL if there is none */
+static const guchar *next_handshake(const guchar *bytes, const guchar *end,
+				    guint *type, gsize *length)
+{
+	if ((gsize) (end - bytes) < TLS_HANDSHAKE_HEADER_LENGTH)
+		return(NULL);
+	*type   = bytes[TLS_HANDSHAKE_OFFSET_TYPE];
+	*length = lowlevel_integer_to_host(bytes + TLS_HANDSHAKE_OFFSET_LENGTH, 3);
+	if ((gsize) (end - bytes) < TLS_HANDSHAKE_HEADER_LENGTH + *length)
+		return(NULL);
+	return(bytes + TLS_HANDSHAKE_HEADER_LENGTH);
+}
+
+static void handshake_digests(const GByteArray *transcript, guchar *digests)
+{
+	sipe_digest_md5(transcript->data, transcript->len, digests);
+	sipe_digest_sha1(transcript->data, transcript->len,
+			 digests + SIPE_DIGEST_MD5_LENGTH);
+}
+
+/* Finished record as the server must receive it */
+static GByteArray *expected_finished(struct tls_internal_state *state,
+				     const guchar *pre_master_secret,
+				     const guchar *server_random,
+				     const GByteArray *transcript)
+{
+	gsize key_block_length = 2 * (state->mac_length + state->key_length +
+				      (state->stream_cipher ? 0 : TLS_AES_CBC_BLOCK_LENGTH));
+	guchar randoms[2 * TLS_ARRAY_RANDOM_LENGTH];
+	guchar digests[SIPE_DIGEST_MD5_LENGTH + SIPE_DIGEST_SHA1_LENGTH];
+	guchar mac[SIPE_DIGEST_HMAC_SHA1_LENGTH];
+	guchar *master_secret, *key_block, *verify;
+	GByteArray *plaintext = g_byte_array_new();
+	GByteArray *record    = g_byte_array_new();
+	const guchar *write_key;
+
+	memcpy(randoms, state->client_random.buffer, TLS_ARRAY_RANDOM_LENGTH);
+	memcpy(randoms + TLS_ARRAY_RANDOM_LENGTH, server_random, TLS_ARRAY_RANDOM_LENGTH);
+	master_secret = sipe_tls_prf(state,
+				     pre_master_secret, TLS_ARRAY_MASTER_SECRET_LENGTH,
+				     (guchar *) "master secret", 13,
+				     randoms, sizeof(randoms),
+				     TLS_ARRAY_MASTER_SECRET_LENGTH);
+	memcpy(randoms, server_random, TLS_ARRAY_RANDOM_LENGTH);
+	memcpy(randoms + TLS_ARRAY_RANDOM_LENGTH, state->client_random.buffer, TLS_ARRAY_RANDOM_LENGTH);
+	key_block = sipe_tls_prf(state,
+				 master_secret, TLS_ARRAY_MASTER_SECRET_LENGTH,
+				 (guchar *) "key expansion", 13,
+				 randoms, sizeof(randoms),
+				 key_block_length);
+	write_key = key_block + 2 * state->mac_length;
+
+	handshake_digests(transcript, digests);
+	verify = sipe_tls_prf(state,
+			      master_secret, TLS_ARRAY_MASTER_SECRET_LENGTH,
+			      (guchar *) "client finished", 15,
+			      digests, sizeof(digests),
+			      TLS_ARRAY_VERIFY_LENGTH);
+
+	/* MAC input: sequence number 0 + plaintext record */
+	append_integer(plaintext, 0, 4);
+	append_integer(plaintext, 0, 4);
+	append_integer(plaintext, TLS_RECORD_TYPE_HANDSHAKE, 1);
+	append_integer(plaintext, TLS_PROTOCOL_VERSION_1_0,  2);
+	append_integer(plaintext, TLS_HANDSHAKE_HEADER_LENGTH + TLS_ARRAY_VERIFY_LENGTH, 2);
+	append_handshake(plaintext, TLS_HANDSHAKE_TYPE_FINISHED,
+			 verify, TLS_ARRAY_VERIFY_LENGTH);
+	if (state->mac_length == SIPE_DIGEST_HMAC_MD5_LENGTH)
+		sipe_digest_hmac_md5(key_block, state->mac_length,
+				     plaintext->data, plaintext->len,
+				     mac);
+	else
+		sipe_digest_hmac_sha1(key_block, state->mac_length,
+				      plaintext->data, plaintext->len,
+				      mac);
+
+	/* content + MAC [+ padding + padding_length] */
+	g_byte_array_remove_range(plaintext, 0, 8 + TLS_RECORD_HEADER_LENGTH);
+	g_byte_array_append(plaintext, mac, state->mac_length);
+	if (!state->stream_cipher) {
+		guchar padding = TLS_AES_CBC_BLOCK_LENGTH - 1 -
+			plaintext->len % TLS_AES_CBC_BLOCK_LENGTH;
+		guint i;
+
+		for (i = 0; i <= padding; i++)
+			g_byte_array_append(plaintext, &padding, 1);
+	}
+
+	append_integer(record, TLS_RECORD_TYPE_HANDSHAKE, 1);
+	append_integer(record, TLS_PROTOCOL_VERSION_1_0,  2);
+	append_integer(record, plaintext->len,            2);
+	g_byte_array_set_size(record, TLS_RECORD_HEADER_LENGTH + plaintext->len);
+	if (state->stream_cipher) {
+		gpointer context = sipe_crypt_tls_start(write_key, state->key_length);
+		sipe_crypt_tls_stream(context,
+				      plaintext->data, plaintext->len,
+				      record->data + TLS_RECORD_HEADER_LENGTH);
+		sipe_crypt_tls_destroy(context);
+	} else {
+		sipe_crypt_tls_block(write_key, state->key_length,
+				     key_block + 2 * (state->mac_length + state->key_length),
+				     TLS_AES_CBC_BLOCK_LENGTH,
+				     plaintext->data, plaintext->len,
+				     record->data + TLS_RECORD_HEADER_LENGTH);
+	}
+
+	g_byte_array_free(plaintext, TRUE);
+	g_free(verify);
+	g_free(key_block);
+	g_free(master_secret);
+
+	return(record);
+}
+
+static void test_server_hello(gpointer certificate,
+			      guint suite,
+			      const gchar *label)
+{
+	struct sipe_tls_state *state = sipe_tls_start(certificate);
+	/* Avoid "cast increases required alignment" errors */
+	struct tls_internal_state *internal = (void *) state;
+	gsize certificate_length = sipe_cert_crypto_raw_length(certificate);
+	/* server view of the same certificate */
+	gpointer imported = sipe_cert_crypto_import(sipe_cert_crypto_raw(certificate),
+						    certificate_length);
+	gsize modulus_length = sipe_cert_crypto_modulus_length(imported);
+	GByteArray *transcript = g_byte_array_new();
+	GByteArray *server;
+	guchar server_random[TLS_ARRAY_RANDOM_LENGTH];
+	guchar digests[SIPE_DIGEST_MD5_LENGTH + SIPE_DIGEST_SHA1_LENGTH];
+	guchar *pre_master_secret = g_malloc(modulus_length);
+	const guchar *bytes, *end, *content, *msg;
+	gsize length, msg_length;
+	guint type, msg_type;
+	guint i;
+
+	printf("%s\n", label);
+
+	/* ClientHello */
+	assert_equal(TRUE, sipe_tls_next(state), "client hello");
+	g_byte_array_append(transcript,
+			    state->out_buffer + TLS_RECORD_HEADER_LENGTH,
+			    state->out_length - TLS_RECORD_HEADER_LENGTH);
+	g_free(state->out_buffer);
+
+	/* server flight, using the same certificate */
+	for (i = 0; i < TLS_ARRAY_RANDOM_LENGTH; i++)
+		server_random[i] = 0xA0 + i;
+	server = server_hello_flight(suite, certificate, server_random);
+	g_byte_array_append(transcript,
+			    server->data + TLS_RECORD_HEADER_LENGTH,
+			    server->len - TLS_RECORD_HEADER_LENGTH);
+	state->in_buffer = server->data;
+	state->in_length = server->len;
+
+	assert_equal(TRUE, sipe_tls_next(state), "server hello");
+	assert_equal(TLS_HANDSHAKE_STATE_FINISHED, internal->state, "state");
+	assert_equal(1, (guint) internal->sequence_number, "sequence number");
+	bytes = state->out_buffer;
+	end   = bytes + state->out_length;
+
+	/* record 1: Certificate, ClientKeyExchange & CertificateVerify */
+	content = next_record(bytes, end, &type, &length);
+	assert_equal(TRUE, content != NULL, "record 1");
+	if (!content)
+		goto out;
+	assert_equal(TLS_RECORD_TYPE_HANDSHAKE, type, "record 1 type");
+	bytes = content + length;
+
+	msg = next_handshake(content, bytes, &msg_type, &msg_length);
+	assert_equal(TRUE, msg != NULL, "certificate");
+	if (!msg)
+		goto out;
+	assert_equal(TLS_HANDSHAKE_TYPE_CERTIFICATE, msg_type, "certificate type");
+	assert_equal(2 * 3 + certificate_length, msg_length, "certificate length");
+	assert_buffer(sipe_cert_crypto_raw(certificate), certificate_length,
+		      msg + 2 * 3, msg_length - 2 * 3,
+		      "certificate");
+	msg += msg_length;
+
+	msg = next_handshake(msg, bytes, &msg_type, &msg_length);
+	assert_equal(TRUE, msg != NULL, "client key exchange");
+	if (!msg)
+		goto out;
+	assert_equal(TLS_HANDSHAKE_TYPE_CLIENT_KEY_EXCHANGE, msg_type, "client key exchange type");
+	assert_equal(2 + modulus_length, msg_length, "client key exchange length");
+	/* PKCS#1 block type 2 with TLS 1.0 pre-master secret */
+	assert_equal(TRUE,
+		     sipe_crypt_rsa_decrypt(sipe_cert_crypto_private_key(certificate),
+					    modulus_length,
+					    msg + 2,
+					    pre_master_secret),
+		     "pre-master secret decryption");
+	assert_equal(0x0002, lowlevel_integer_to_host(pre_master_secret, 2), "PKCS#1 block type");
+	assert_equal(0, pre_master_secret[modulus_length - TLS_ARRAY_MASTER_SECRET_LENGTH - 1],
+		     "PKCS#1 separator");
+	assert_buffer(internal->pre_master_secret.buffer, TLS_ARRAY_MASTER_SECRET_LENGTH,
+		      pre_master_secret + modulus_length - TLS_ARRAY_MASTER_SECRET_LENGTH,
+		      TLS_ARRAY_MASTER_SECRET_LENGTH,
+		      "pre-master secret");
+	assert_equal(TLS_PROTOCOL_VERSION_1_0,
+		     lowlevel_integer_to_host(pre_master_secret + modulus_length - TLS_ARRAY_MASTER_SECRET_LENGTH, 2),
+		     "pre-master secret version");
+	msg += msg_length;
+
+	/* signature covers all handshake messages up to here */
+	g_byte_array_append(transcript, content, msg - content);
+	handshake_digests(transcript, digests);
+	content = msg;
+	msg = next_handshake(msg, bytes, &msg_type, &msg_length);
+	assert_equal(TRUE, msg != NULL, "certificate verify");
+	if (!msg)
+		goto out;
+	assert_equal(TLS_HANDSHAKE_TYPE_CERTIFICATE_VERIFY, msg_type, "certificate verify type");
+	assert_equal(2 + lowlevel_integer_to_host(msg, 2), msg_length, "certificate verify length");
+	assert_equal(TRUE,
+		     sipe_crypt_verify_rsa(sipe_cert_crypto_public_key(imported),
+					   digests, sizeof(digests),
+					   msg + 2, msg_length - 2),
+		     "certificate verify signature");
+	assert_equal(TRUE, msg + msg_length == bytes, "record 1 end");
+	g_byte_array_append(transcript, content, bytes - content);
+
+	/* record 2: ChangeCipherSpec */
+	content = next_record(bytes, end, &type, &length);
+	assert_equal(TRUE, content != NULL, "record 2");
+	if (!content)
+		goto out;
+	assert_equal(TLS_RECORD_TYPE_CHANGE_CIPHER_SPEC, type, "record 2 type");
+	assert_equal(1, length, "record 2 length");
+	assert_equal(0x01, content[0], "change cipher spec");
+	bytes = content + length;
+
+	/* record 3: encrypted Finished */
+	content = next_record(bytes, end, &type, &length);
+	assert_equal(TRUE, content != NULL, "record 3");
+	if (!content)
+		goto out;
+	{
+		GByteArray *expected = expected_finished(internal,
+							 pre_master_secret + modulus_length - TLS_ARRAY_MASTER_SECRET_LENGTH,
+							 server_random,
+							 transcript);
+		assert_buffer(expected->data, expected->len,
+			      bytes, TLS_RECORD_HEADER_LENGTH + length,
+			      "finished");
+		g_byte_array_free(expected, TRUE);
+	}
+	assert_equal(TRUE, content + length == end, "flight end");
+
+out:
+	sipe_cert_crypto_destroy(imported);
+	g_free(pre_master_secret);
+	g_byte_array_free(server, TRUE);
+	g_byte_array_free(transcript, TRUE);
+	sipe_tls_free(state);
+}
+
+static void tests_server_hello(void)
+{
+	struct sipe_cert_crypto *scc = sipe_cert_crypto_init();
+	gpointer certificate;
+	guint i;
+
+	assert_equal(TRUE, scc != NULL, "cert crypto");
+	if (!scc)
+		return;
+	certificate = sipe_cert_crypto_test_certificate(scc);
+	assert_equal(TRUE, certificate != NULL, "test certificate");
+
+	if (certificate)
+		for (i = 0; i < G_N_ELEMENTS(record_suites); i++)
+			test_server_hello(certificate,
+					  record_suites[i].suite,
+					  record_suites[i].label);
+
+	sipe_cert_crypto_destroy(certificate);
+	sipe_cert_crypto_free(scc);
+}
+
+int main(SIPE_UNUSED_PARAMETER int argc,
+	 SIPE_UNUSED_PARAMETER char *argv[])
+{
+	/* Initialization for crypto backend (test mode) */
+	sipe_crypto_init(FALSE);
+
+	tests_known_answers();
+	tests_server_hello();
+
+	sipe_crypto_shutdown();
+
+	printf("Result: %d PASSED %d FAILED\n", succeeded, failed);
+	return(failed);
+}
+
+/*
+  Local Variables:
+  mode: c
+  c-file-style: "bsd"
+  indent-tabs-mode: t
+  tab-width: 8
+  End:
+*/
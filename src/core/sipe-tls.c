@@ -59,6 +59,13 @@ enum tls_handshake_state {
 	TLS_HANDSHAKE_STATE_FAILED
 };
 
+struct tls_mac_functions {
+	gpointer (*start)(const guchar *key, gsize key_length);
+	void (*update)(gpointer context, const guchar *data, gsize length);
+	void (*end)(gpointer context, guchar *digest);
+	void (*destroy)(gpointer context);
+};
+
 struct tls_internal_state {
 	struct sipe_tls_state common;
 	gpointer certificate;
@@ -84,10 +91,10 @@ struct tls_internal_state {
 	const guchar *server_write_secret;
 	const guchar *client_write_iv;
 	const guchar *server_write_iv;
-	void (*mac_func)(const guchar *key, gsize key_length,
-			 const guchar *data, gsize data_length,
-			 guchar *digest);
+	const struct tls_mac_functions *mac;
+	gpointer mac_context;
 	gpointer cipher_context;
+	gsize out_size;
 	guint64 sequence_number;
 	gboolean stream_cipher;
 	gboolean encrypted;
@@ -221,12 +228,6 @@ struct tls_compile_compression {
 	guint methods[1];
 };
 
-/* compiled message */
-struct tls_compiled_message {
-	gsize size;
-	guchar data[];
-};
-
 /*
  * Random byte buffers
  */
@@ -1017,127 +1018,126 @@ static gboolean tls_record_parse(struct tls_internal_state *state,
 #ifndef _SIPE_COMPILING_ANALYZER
 
 /*
- * TLS message compiler
+ * TLS record compiler
+ *
+ * All records of one flight are compiled directly into the output buffer,
+ * which is grown as needed. Encryption happens in place.
  */
-static void compile_tls_record(struct tls_internal_state *state,
-			       ...)
+#define TLS_OUT_BUFFER_INITIAL_SIZE 4096
+
+static guchar *tls_out_reserve(struct tls_internal_state *state,
+			       gsize size)
 {
-	gsize total_size = 0;
-	guchar *current;
-	va_list ap;
-
-	/* calculate message size */
-	va_start(ap, state);
-	while (1) {
-		const struct tls_compiled_message *msg = va_arg(ap, struct tls_compiled_message *);
-		if (!msg) break;
-		total_size += msg->size;
+	gsize needed = state->common.out_length + size;
+
+	if (needed > state->out_size) {
+		gsize new_size = state->out_size ? state->out_size : TLS_OUT_BUFFER_INITIAL_SIZE;
+
+		while (new_size < needed)
+			new_size *= 2;
+		state->common.out_buffer = g_realloc(state->common.out_buffer,
+						     new_size);
+		state->out_size = new_size;
 	}
-	va_end(ap);
 
-	SIPE_DEBUG_INFO("compile_tls_record: total size %" G_GSIZE_FORMAT,
-			total_size);
+	return(state->common.out_buffer + state->common.out_length);
+}
 
-	state->common.out_buffer = current = g_malloc(total_size + TLS_RECORD_HEADER_LENGTH);
-	state->common.out_length = total_size + TLS_RECORD_HEADER_LENGTH;
+static void tls_out_discard(struct tls_internal_state *state)
+{
+	g_free(state->common.out_buffer);
+	state->common.out_buffer = NULL;
+	state->common.out_length = 0;
+	state->out_size          = 0;
+}
 
-	/* add TLS record header */
-	current[TLS_RECORD_OFFSET_TYPE] = TLS_RECORD_TYPE_HANDSHAKE;
+/* returns offset of the new record in the output buffer */
+static gsize tls_record_start(struct tls_internal_state *state,
+			      guint type)
+{
+	gsize record    = state->common.out_length;
+	guchar *current = tls_out_reserve(state, TLS_RECORD_HEADER_LENGTH);
+
+	current[TLS_RECORD_OFFSET_TYPE] = type;
 	lowlevel_integer_to_tls(current + TLS_RECORD_OFFSET_VERSION, 2,
 				TLS_PROTOCOL_VERSION_1_0);
-	lowlevel_integer_to_tls(current + TLS_RECORD_OFFSET_LENGTH, 2,
-				total_size);
-	current += TLS_RECORD_HEADER_LENGTH;
+	state->common.out_length += TLS_RECORD_HEADER_LENGTH;
+
+	return(record);
+}
 
-	/* copy messages */
-	va_start(ap, state);
-	while (1) {
-		const struct tls_compiled_message *msg = va_arg(ap, struct tls_compiled_message *);
-		if (!msg) break;
+static void compile_tls_record(struct tls_internal_state *state,
+			       gsize record)
+{
+	gsize total_size = state->common.out_length - record - TLS_RECORD_HEADER_LENGTH;
 
-		memcpy(current, msg->data, msg->size);
-		current += msg->size;
-	}
-	va_end(ap);
+	SIPE_DEBUG_INFO("compile_tls_record: total size %" G_GSIZE_FORMAT,
+			total_size);
+
+	lowlevel_integer_to_tls(state->common.out_buffer + record + TLS_RECORD_OFFSET_LENGTH, 2,
+				total_size);
 }
 
 static void compile_encrypted_tls_record(struct tls_internal_state *state,
-					 const struct tls_compiled_message *msg)
+					 gsize record)
 {
-	guchar *plaintext;
-	gsize plaintext_length; /* header + content        */
+	guchar sequence[sizeof(guint64)];
+	guchar *header;
 	guchar *mac;
-	gsize mac_length;
-	guchar *message;
-	guchar *encrypted;
-	gsize message_length;   /* header + content + MAC  */
+	gsize plaintext_length; /* content                 */
+	gsize message_length;   /* content + MAC           */
 	gsize padding_length;   /* for block cipher        */
-	gsize encrypted_length; /* header + encrypted data */
+	gsize encrypted_length; /* encrypted data          */
 
 	/* Create plaintext TLS record */
-	compile_tls_record(state, msg, NULL);
-	plaintext        = state->common.out_buffer;
-	plaintext_length = state->common.out_length;
-	if (plaintext_length == 0) /* make Coverity happy */
-		return;
-
-	/* Prepare encryption buffer */
+	compile_tls_record(state, record);
+	plaintext_length = state->common.out_length - record - TLS_RECORD_HEADER_LENGTH;
+
+	/* Prepare encryption buffer: MAC + padding + padding_length */
+	tls_out_reserve(state,
+			state->mac_length + TLS_AES_CBC_BLOCK_LENGTH + 1);
+	header         = state->common.out_buffer + record;
+	mac            = header + TLS_RECORD_HEADER_LENGTH + plaintext_length;
 	message_length = plaintext_length + state->mac_length;
 	if (state->stream_cipher) {
 		padding_length   = 0;
 		encrypted_length = message_length;
 	} else {
-		if (message_length < TLS_RECORD_HEADER_LENGTH) /* make Coverity happy */
-			return;
-		padding_length   = TLS_AES_CBC_BLOCK_LENGTH - (message_length - TLS_RECORD_HEADER_LENGTH + 1) % TLS_AES_CBC_BLOCK_LENGTH;
+		padding_length   = TLS_AES_CBC_BLOCK_LENGTH - (message_length + 1) % TLS_AES_CBC_BLOCK_LENGTH;
 		encrypted_length = message_length + padding_length + 1;
 	}
 	SIPE_DEBUG_INFO("compile_encrypted_tls_record: total size %" G_GSIZE_FORMAT,
-			encrypted_length - TLS_RECORD_HEADER_LENGTH);
-	message = g_malloc(message_length);
-	memcpy(message, plaintext, plaintext_length);
-	lowlevel_integer_to_tls(message + TLS_RECORD_OFFSET_LENGTH, 2,
-				encrypted_length - TLS_RECORD_HEADER_LENGTH);
+			encrypted_length);
 
 	/*
 	 * Calculate MAC and append to message
 	 *
 	 * HMAC_hash(client_write_mac_secret,
 	 *           sequence_number + type + version + length + fragment)
-	 *                             \---  == original TLS record  ---/
+	 *                             \---  == plaintext TLS record  ---/
 	 */
-	mac_length = sizeof(guint64) + plaintext_length;
-	mac        = g_malloc(mac_length);
-	lowlevel_integer_to_tls(mac,
+	lowlevel_integer_to_tls(sequence,
 				sizeof(guint64),
 				state->sequence_number++);
-	memcpy(mac + sizeof(guint64), plaintext, plaintext_length);
-	g_free(plaintext);
-	state->mac_func(state->client_write_mac_secret,
-			state->mac_length,
-			mac,
-			mac_length,
-			message + plaintext_length);
-	g_free(mac);
-
-	encrypted = g_malloc(encrypted_length);
-	/* header (unencrypted) */
-	memcpy(encrypted, message, TLS_RECORD_HEADER_LENGTH);
+	state->mac->update(state->mac_context, sequence, sizeof(guint64));
+	state->mac->update(state->mac_context,
+			   header,
+			   TLS_RECORD_HEADER_LENGTH + plaintext_length);
+	state->mac->end(state->mac_context, mac);
+
+	lowlevel_integer_to_tls(header + TLS_RECORD_OFFSET_LENGTH, 2,
+				encrypted_length);
+
 	if (state->stream_cipher) {
 		/* ENCRYPT(content + MAC) */
 		sipe_crypt_tls_stream(state->cipher_context,
-				      message + TLS_RECORD_HEADER_LENGTH,
-				      encrypted_length - TLS_RECORD_HEADER_LENGTH,
-				      encrypted + TLS_RECORD_HEADER_LENGTH);
+				      header + TLS_RECORD_HEADER_LENGTH,
+				      encrypted_length,
+				      header + TLS_RECORD_HEADER_LENGTH);
 	} else {
 		/* TLS 1.0 GenericBlockCipher */
-		/* content + MAC */
-		memcpy(encrypted + TLS_RECORD_HEADER_LENGTH,
-		       message + TLS_RECORD_HEADER_LENGTH,
-		       message_length - TLS_RECORD_HEADER_LENGTH);
-
 		/* padding + padding_length */
-		memset(encrypted + message_length,
+		memset(mac + state->mac_length,
 		       padding_length,
 		       padding_length + 1);
 
@@ -1146,21 +1146,18 @@ static void compile_encrypted_tls_record(struct tls_internal_state *state,
 				     state->key_length,
 				     state->client_write_iv,
 				     TLS_AES_CBC_BLOCK_LENGTH,
-				     encrypted + TLS_RECORD_HEADER_LENGTH,
-				     encrypted_length - TLS_RECORD_HEADER_LENGTH,
-				     encrypted + TLS_RECORD_HEADER_LENGTH);
+				     header + TLS_RECORD_HEADER_LENGTH,
+				     encrypted_length,
+				     header + TLS_RECORD_HEADER_LENGTH);
 	}
-	g_free(message);
 
-	/* swap buffers */
-	state->common.out_buffer = encrypted;
-	state->common.out_length = encrypted_length;
+	state->common.out_length = record + TLS_RECORD_HEADER_LENGTH + encrypted_length;
 }
 
-static struct tls_compiled_message *compile_handshake_msg(struct tls_internal_state *state,
-							  const struct msg_descriptor *desc,
-							  gpointer data,
-							  gsize size)
+static void compile_handshake_msg(struct tls_internal_state *state,
+				  const struct msg_descriptor *desc,
+				  gpointer data,
+				  gsize size)
 {
 	/*
 	 * Estimate the size of the compiled message
@@ -1173,10 +1170,8 @@ static struct tls_compiled_message *compile_handshake_msg(struct tls_internal_st
 	 *
 	 * Therefore we don't need space checks in the compiler functions
 	 */
-	gsize total_size = sizeof(struct tls_compiled_message) +
-		size + TLS_HANDSHAKE_HEADER_LENGTH;
-	struct tls_compiled_message *msg = g_malloc(total_size);
-	guchar *handshake = msg->data;
+	gsize total_size = size + TLS_HANDSHAKE_HEADER_LENGTH;
+	guchar *handshake = tls_out_reserve(state, total_size);
 	const struct layout_descriptor *ldesc = desc->layouts;
 	gsize length;
 
@@ -1206,23 +1201,21 @@ static struct tls_compiled_message *compile_handshake_msg(struct tls_internal_st
 	SIPE_DEBUG_INFO("compile_handshake_msg: (%d)%s, size %" G_GSIZE_FORMAT,
 			desc->type, desc->description, length);
 
-	msg->size = length + TLS_HANDSHAKE_HEADER_LENGTH;
+	length += TLS_HANDSHAKE_HEADER_LENGTH;
+	state->common.out_length += length;
 
 	/* update digest contexts */
-	sipe_digest_md5_update(state->md5_context, handshake, msg->size);
-	sipe_digest_sha1_update(state->sha1_context, handshake, msg->size);
-
-	return(msg);
+	sipe_digest_md5_update(state->md5_context, handshake, length);
+	sipe_digest_sha1_update(state->sha1_context, handshake, length);
 }
 
 /*
  * Specific TLS data verficiation & message compilers
  */
-static struct tls_compiled_message *tls_client_certificate(struct tls_internal_state *state)
+static gboolean tls_client_certificate(struct tls_internal_state *state)
 {
 	struct Certificate_host *certificate;
 	gsize certificate_length = sipe_cert_crypto_raw_length(state->certificate);
-	struct tls_compiled_message *msg;
 
 	/* setup our response */
 	/* Client Certificate is VECTOR_MAX24 of VECTOR_MAX24s */
@@ -1235,13 +1228,27 @@ static struct tls_compiled_message *tls_client_certificate(struct tls_internal_s
 	       sipe_cert_crypto_raw(state->certificate),
 	       certificate_length);
 
-	msg = compile_handshake_msg(state, &Certificate_m, certificate,
-				    sizeof(struct Certificate_host) + certificate_length + 3);
+	compile_handshake_msg(state, &Certificate_m, certificate,
+			      sizeof(struct Certificate_host) + certificate_length + 3);
 	g_free(certificate);
 
-	return(msg);
+	return(TRUE);
 }
 
+static const struct tls_mac_functions tls_mac_md5 = {
+	sipe_digest_hmac_md5_start,
+	sipe_digest_hmac_md5_update,
+	sipe_digest_hmac_md5_end,
+	sipe_digest_hmac_md5_destroy
+};
+
+static const struct tls_mac_functions tls_mac_sha1 = {
+	sipe_digest_hmac_sha1_start,
+	sipe_digest_hmac_sha1_update,
+	sipe_digest_hmac_sha1_end,
+	sipe_digest_hmac_sha1_destroy
+};
+
 static gboolean check_cipher_suite(struct tls_internal_state *state)
 {
 	struct tls_parsed_integer *cipher_suite = g_hash_table_lookup(state->data,
@@ -1258,7 +1265,7 @@ static gboolean check_cipher_suite(struct tls_internal_state *state)
 	case TLS_RSA_EXPORT_WITH_RC4_40_MD5:
 		state->mac_length       = SIPE_DIGEST_HMAC_MD5_LENGTH;
 		state->key_length       = 40 / 8;
-		state->mac_func         = sipe_digest_hmac_md5;
+		state->mac              = &tls_mac_md5;
 		state->stream_cipher    = TRUE;
 		label_mac               = "MD5";
 		label_cipher            = "RC4 stream";
@@ -1268,7 +1275,7 @@ static gboolean check_cipher_suite(struct tls_internal_state *state)
 	case TLS_RSA_WITH_RC4_128_MD5:
 		state->mac_length       = SIPE_DIGEST_HMAC_MD5_LENGTH;
 		state->key_length       = 128 / 8;
-		state->mac_func         = sipe_digest_hmac_md5;
+		state->mac              = &tls_mac_md5;
 		state->stream_cipher    = TRUE;
 		label_mac               = "MD5";
 		label_cipher            = "RC4 stream";
@@ -1278,7 +1285,7 @@ static gboolean check_cipher_suite(struct tls_internal_state *state)
 	case TLS_RSA_WITH_RC4_128_SHA:
 		state->mac_length       = SIPE_DIGEST_HMAC_SHA1_LENGTH;
 		state->key_length       = 128 / 8;
-		state->mac_func         = sipe_digest_hmac_sha1;
+		state->mac              = &tls_mac_sha1;
 		state->stream_cipher    = TRUE;
 		label_mac               = "SHA-1";
 		label_cipher            = "RC4 stream";
@@ -1288,7 +1295,7 @@ static gboolean check_cipher_suite(struct tls_internal_state *state)
 	case TLS_RSA_WITH_AES_128_CBC_SHA:
 		state->mac_length       = SIPE_DIGEST_HMAC_SHA1_LENGTH;
 		state->key_length       = 128 / 8;
-		state->mac_func         = sipe_digest_hmac_sha1;
+		state->mac              = &tls_mac_sha1;
 		state->stream_cipher    = FALSE;
 		label_mac               = "SHA-1";
 		label_cipher            = "AES-CBC block";
@@ -1298,7 +1305,7 @@ static gboolean check_cipher_suite(struct tls_internal_state *state)
 	case TLS_RSA_WITH_AES_256_CBC_SHA:
 		state->mac_length       = SIPE_DIGEST_HMAC_SHA1_LENGTH;
 		state->key_length       = 256 / 8;
-		state->mac_func         = sipe_digest_hmac_sha1;
+		state->mac              = &tls_mac_sha1;
 		state->stream_cipher    = FALSE;
 		label_mac               = "SHA-1";
 		label_cipher            = "AES-CBC block";
@@ -1393,6 +1400,10 @@ static void tls_calculate_secrets(struct tls_internal_state *state)
 	state->client_write_secret     = state->key_block + 2 * state->mac_length;
 	state->server_write_secret     = state->key_block + 2 * state->mac_length + state->key_length;
 
+	/* initialize MAC context, reused for every record */
+	state->mac_context = state->mac->start(state->client_write_mac_secret,
+					       state->mac_length);
+
 	/* initialize stream cipher context */
 	if (state->stream_cipher) {
 		state->cipher_context = sipe_crypt_tls_start(state->client_write_secret,
@@ -1474,22 +1485,21 @@ static guchar *tls_pkcs1_public_padding(SIPE_UNUSED_PARAMETER struct tls_interna
 	return(pad_buffer);
 }
 
-static struct tls_compiled_message *tls_client_key_exchange(struct tls_internal_state *state)
+static gboolean tls_client_key_exchange(struct tls_internal_state *state)
 {
 	struct tls_parsed_array *server_random;
 	struct tls_parsed_array *server_certificate;
 	struct ClientKeyExchange_host *exchange;
 	gsize server_certificate_length;
 	guchar *padded;
-	struct tls_compiled_message *msg;
 
 	/* check for required data fields */
 	if (!check_cipher_suite(state))
-		return(NULL);
+		return(FALSE);
 	server_random = g_hash_table_lookup(state->data, "Random");
 	if (!server_random) {
 		SIPE_DEBUG_ERROR_NOFORMAT("tls_client_key_exchange: no server random");
-		return(NULL);
+		return(FALSE);
 	}
 	server_certificate = g_hash_table_lookup(state->data, "Certificate");
 	/* Server Certificate is VECTOR_MAX24 of VECTOR_MAX24s */
@@ -1536,7 +1546,7 @@ static struct tls_compiled_message *tls_client_key_exchange(struct tls_internal_
 					  server_certificate_length);
 	if (!padded) {
 		SIPE_DEBUG_ERROR_NOFORMAT("tls_client_key_exchange: padding of pre-master secret failed");
-		return(NULL);
+		return(FALSE);
 	}
 	exchange = g_malloc0(sizeof(struct ClientKeyExchange_host) +
 			     server_certificate_length);
@@ -1548,7 +1558,7 @@ static struct tls_compiled_message *tls_client_key_exchange(struct tls_internal_
 		SIPE_DEBUG_ERROR_NOFORMAT("tls_client_key_exchange: encryption of pre-master secret failed");
 		g_free(exchange);
 		g_free(padded);
-		return(NULL);
+		return(FALSE);
 	}
 	g_free(padded);
 
@@ -1558,17 +1568,16 @@ static struct tls_compiled_message *tls_client_key_exchange(struct tls_internal_
 		      server_certificate_length);
 #endif
 
-	msg = compile_handshake_msg(state, &ClientKeyExchange_m, exchange,
-				    sizeof(struct ClientKeyExchange_host) + server_certificate_length);
+	compile_handshake_msg(state, &ClientKeyExchange_m, exchange,
+			      sizeof(struct ClientKeyExchange_host) + server_certificate_length);
 	g_free(exchange);
 
-	return(msg);
+	return(TRUE);
 }
 
-static struct tls_compiled_message *tls_certificate_verify(struct tls_internal_state *state)
+static gboolean tls_certificate_verify(struct tls_internal_state *state)
 {
 	struct CertificateVerify_host *verify;
-	struct tls_compiled_message *msg;
 	guchar *digests = g_malloc(SIPE_DIGEST_MD5_LENGTH + SIPE_DIGEST_SHA1_LENGTH);
 	guchar *signature;
 	gsize length;
@@ -1585,7 +1594,7 @@ static struct tls_compiled_message *tls_certificate_verify(struct tls_internal_s
 	g_free(digests);
 	if (!signature) {
 		SIPE_DEBUG_ERROR_NOFORMAT("tls_certificate_verify: signing of handshake digests failed");
-		return(NULL);
+		return(FALSE);
 	}
 
 	/* CertificateVerify */
@@ -1595,18 +1604,17 @@ static struct tls_compiled_message *tls_certificate_verify(struct tls_internal_s
 	memcpy(verify->signature.placeholder, signature, length);
 	g_free(signature);
 
-	msg = compile_handshake_msg(state, &CertificateVerify_m, verify,
-				    sizeof(struct CertificateVerify_host) + length);
+	compile_handshake_msg(state, &CertificateVerify_m, verify,
+			      sizeof(struct CertificateVerify_host) + length);
 	g_free(verify);
 
-	return(msg);
+	return(TRUE);
 }
 
-static struct tls_compiled_message *tls_client_finished(struct tls_internal_state *state)
+static void tls_client_finished(struct tls_internal_state *state)
 {
 	guchar *digests = g_malloc(SIPE_DIGEST_MD5_LENGTH + SIPE_DIGEST_SHA1_LENGTH);
 	guchar *verify;
-	struct tls_compiled_message *cmsg;
 	struct Finished_host msg;
 
 	/* calculate digests */
@@ -1630,9 +1638,7 @@ static struct tls_compiled_message *tls_client_finished(struct tls_internal_stat
 	memcpy(msg.verify.verify, verify, TLS_ARRAY_VERIFY_LENGTH);
 	g_free(verify);
 
-	cmsg = compile_handshake_msg(state, &Finished_m, &msg, sizeof(msg));
-
-	return(cmsg);
+	compile_handshake_msg(state, &Finished_m, &msg, sizeof(msg));
 }
 
 /*
@@ -1662,7 +1668,7 @@ static gboolean tls_client_hello(struct tls_internal_state *state)
 		  }
 		}
 	};
-	struct tls_compiled_message *cmsg;
+	gsize record;
 
 	/* First 4 bytes of client_random is the current timestamp */
 	sipe_tls_fill_random(&state->client_random,
@@ -1671,9 +1677,9 @@ static gboolean tls_client_hello(struct tls_internal_state *state)
 	memcpy(msg.random.random, state->client_random.buffer,
 	       TLS_ARRAY_RANDOM_LENGTH);
 
-	cmsg = compile_handshake_msg(state, &ClientHello_m, &msg, sizeof(msg));
-        compile_tls_record(state, cmsg, NULL);
-	g_free(cmsg);
+	record = tls_record_start(state, TLS_RECORD_TYPE_HANDSHAKE);
+	compile_handshake_msg(state, &ClientHello_m, &msg, sizeof(msg));
+	compile_tls_record(state, record);
 
 	if (sipe_backend_debug_enabled())
 		state->debug = g_string_new("");
@@ -1684,69 +1690,38 @@ static gboolean tls_client_hello(struct tls_internal_state *state)
 
 static gboolean tls_server_hello(struct tls_internal_state *state)
 {
-	struct tls_compiled_message *certificate = NULL;
-	struct tls_compiled_message *exchange    = NULL;
-	struct tls_compiled_message *verify      = NULL;
-	struct tls_compiled_message *finished    = NULL;
 	gboolean success = FALSE;
+	gsize record;
 
 	if (!tls_record_parse(state, TRUE, TLS_HANDSHAKE_TYPE_SERVER_HELLO))
 		return(FALSE);
 
-	if (((certificate = tls_client_certificate(state))  != NULL) &&
-	    ((exchange    = tls_client_key_exchange(state)) != NULL) &&
-	    ((verify      = tls_certificate_verify(state))  != NULL) &&
-	    ((finished    = tls_client_finished(state))     != NULL)) {
-
-		/* Part 1 */
-		compile_tls_record(state, certificate, exchange, verify, NULL);
+	/* Part 1 */
+	record = tls_record_start(state, TLS_RECORD_TYPE_HANDSHAKE);
+	if (tls_client_certificate(state)  &&
+	    tls_client_key_exchange(state) &&
+	    tls_certificate_verify(state)) {
+		compile_tls_record(state, record);
 
 		success = tls_record_parse(state, FALSE,  0);
 		if (success) {
-			guchar *part1      = state->common.out_buffer;
-			gsize part1_length = state->common.out_length;
-			guchar *part3;
-			gsize part3_length;
-			guchar *merged;
-			gsize length;
-			/* ChangeCipherSpec is always the same */
-			static const guchar part2[] = {
-				TLS_RECORD_TYPE_CHANGE_CIPHER_SPEC,
-				(TLS_PROTOCOL_VERSION_1_0 >> 8) & 0xFF,
-				TLS_PROTOCOL_VERSION_1_0 & 0xFF,
-				0x00, 0x01, /* length: 1 byte        */
-				0x01        /* change_cipher_spec(1) */
-			};
-
-			state->common.out_buffer = NULL;
+			/* Part 2 - ChangeCipherSpec is always the same */
+			record = tls_record_start(state, TLS_RECORD_TYPE_CHANGE_CIPHER_SPEC);
+			*tls_out_reserve(state, 1) = 0x01; /* change_cipher_spec(1) */
+			state->common.out_length++;
+			compile_tls_record(state, record);
 
 			/* Part 3 - this is the first encrypted record */
-			compile_encrypted_tls_record(state, finished);
-			part3        = state->common.out_buffer;
-			part3_length = state->common.out_length;
-
-				/* merge TLS records */
-			length = part1_length + sizeof(part2) + part3_length;
-			merged = g_malloc(length);
-
-			memcpy(merged,                                part1, part1_length);
-			memcpy(merged + part1_length,                 part2, sizeof(part2));
-			memcpy(merged + part1_length + sizeof(part2), part3, part3_length);
-			g_free(part3);
-			g_free(part1);
-
-			/* replace output buffer with merged message */
-			state->common.out_buffer = merged;
-			state->common.out_length = length;
+			record = tls_record_start(state, TLS_RECORD_TYPE_HANDSHAKE);
+			tls_client_finished(state);
+			compile_encrypted_tls_record(state, record);
 
 			state->state = TLS_HANDSHAKE_STATE_FINISHED;
 		}
 	}
 
-	g_free(finished);
-	g_free(verify);
-	g_free(exchange);
-	g_free(certificate);
+	if (!success)
+		tls_out_discard(state);
 	free_parse_data(state);
 
 	return(success);
@@ -1843,7 +1818,10 @@ gboolean sipe_tls_next(struct sipe_tls_state *state)
 	if (!state)
 		return(FALSE);
 
-	state->out_buffer = NULL;
+	/* previous output buffer is owned by the caller */
+	state->out_buffer  = NULL;
+	state->out_length  = 0;
+	internal->out_size = 0;
 
 	switch (internal->state) {
 	case TLS_HANDSHAKE_STATE_START:
@@ -1898,6 +1876,8 @@ void sipe_tls_free(struct sipe_tls_state *state)
 		sipe_tls_free_random(&internal->pre_master_secret);
 		sipe_tls_free_random(&internal->client_random);
 		sipe_tls_free_random(&internal->server_random);
+		if (internal->mac_context)
+			internal->mac->destroy(internal->mac_context);
 		if (internal->cipher_context)
 			sipe_crypt_tls_destroy(internal->cipher_context);
 		if (internal->md5_context)
@@ -49,6 +49,7 @@
 #include "sipe-group.h"
 #include "sipe-http.h"
 #include "sipe-nls.h"
+#include "sipe-snapshot.h"
 #include "sipe-subscriptions.h"
 #include "sipe-ucs.h"
 #include "sipe-utils.h"
@@ -123,7 +124,7 @@ static void sipe_ucs_http_response(struct sipe_core_private *sipe_private,
 	data->request = NULL;
 
 	if ((status == SIPE_HTTP_STATUS_OK) && body) {
-		sipe_xml *xml = sipe_xml_parse(body, strlen(body));
+		sipe_xml *xml = sipe_xml_parse_arena(body, strlen(body));
 		const sipe_xml *soap_body = sipe_xml_child(xml, "Body");
 		/* Callback: success */
 		(*data->cb)(sipe_private,
@@ -187,6 +188,7 @@ static void sipe_ucs_next_request(struct sipe_core_private *sipe_private)
 			sipe_core_email_authentication(sipe_private,
 						       request);
 			sipe_http_request_allow_redirect(request);
+			sipe_http_request_compression(request);
 			sipe_http_request_ready(request);
 
 			break;
@@ -701,8 +703,14 @@ static void sipe_ucs_get_im_item_list_response(struct sipe_core_private *sipe_pr
 		if (SIPE_CORE_PRIVATE_FLAG_IS(SUBSCRIBED_BUDDIES)) {
 			sipe_group_update_start(sipe_private);
 			sipe_buddy_update_start(sipe_private);
-		} else
+		} else {
+			/* buddies & groups from snapshot not in this list will be removed */
+			if (SIPE_CORE_PRIVATE_FLAG_IS(SNAPSHOT)) {
+				sipe_group_update_start(sipe_private);
+				sipe_buddy_update_start(sipe_private);
+			}
 			sipe_backend_buddy_list_processing_start(SIPE_CORE_PUBLIC);
+		}
 
 		for (persona_node = sipe_xml_child(node, "Personas/Persona");
 		     persona_node;
@@ -772,10 +780,16 @@ static void sipe_ucs_get_im_item_list_response(struct sipe_core_private *sipe_pr
 			sipe_buddy_update_finish(sipe_private);
 			sipe_group_update_finish(sipe_private);
 		} else {
+			if (SIPE_CORE_PRIVATE_FLAG_IS(SNAPSHOT)) {
+				sipe_buddy_update_finish(sipe_private);
+				sipe_group_update_finish(sipe_private);
+				SIPE_CORE_PRIVATE_FLAG_UNSET(SNAPSHOT);
+			}
 			sipe_buddy_cleanup_local_list(sipe_private);
 			sipe_backend_buddy_list_processing_finish(SIPE_CORE_PUBLIC);
 			sipe_subscribe_presence_initial(sipe_private);
 		}
+		sipe_snapshot_save(sipe_private);
 	} else if (sipe_private->ucs) {
 		SIPE_DEBUG_ERROR_NOFORMAT("sipe_ucs_get_im_item_list_response: query failed, contact list operations will not work!");
 		ucs_init_failure(sipe_private);
@@ -343,6 +343,25 @@ sipe_strcase_equal(const gchar *left, const gchar *right)
 	        (left != NULL && right != NULL && g_ascii_strcasecmp(left, right) == 0));
 }
 
+/* djb2 over the lower case characters */
+guint
+sipe_utils_strcase_hash(gconstpointer key)
+{
+	const gchar *p = key;
+	guint hash = 5381;
+
+	while (*p)
+		hash = (hash << 5) + hash + g_ascii_tolower(*p++);
+
+	return(hash);
+}
+
+gboolean
+sipe_utils_strcase_key_equal(gconstpointer a, gconstpointer b)
+{
+	return(g_ascii_strcasecmp(a, b) == 0);
+}
+
 time_t
 sipe_utils_str_to_time(const gchar *timestamp)
 {
@@ -419,6 +438,89 @@ sipe_utils_time_to_str(time_t timestamp)
 	return(g_strdup(""));
 }
 
+/*
+ * Days since 1970-01-01 for a date in the proleptic Gregorian calendar
+ *
+ * Reference: http://howardhinnant.github.io/date_algorithms.html
+ */
+static gint64 days_from_civil(gint64 year, guint month, guint day)
+{
+	gint64 era;
+	guint year_of_era;
+	guint day_of_year;
+	guint day_of_era;
+
+	if (month <= 2)
+		year--;
+	era         = (year >= 0 ? year : year - 399) / 400;
+	year_of_era = (guint) (year - era * 400);
+	day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	day_of_era  = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+
+	return(era * 146097 + (gint64) day_of_era - 719468);
+}
+
+void sipe_utils_gmtime(time_t timestamp, struct tm *tm)
+{
+	gint64 days    = (gint64) timestamp / 86400;
+	gint64 seconds = (gint64) timestamp % 86400;
+	gint64 era;
+	gint64 year;
+	guint day_of_era;
+	guint year_of_era;
+	guint day_of_year;
+	guint month_index;
+	guint month;
+
+	if (seconds < 0) {
+		seconds += 86400;
+		days--;
+	}
+
+	/* inverse of days_from_civil() */
+	era         = (days + 719468 >= 0 ? days + 719468 : days + 719468 - 146096) / 146097;
+	day_of_era  = (guint) (days + 719468 - era * 146097);
+	year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+	day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+	month_index = (5 * day_of_year + 2) / 153;
+	month       = month_index < 10 ? month_index + 3 : month_index - 9;
+	year        = (gint64) year_of_era + era * 400 + (month <= 2 ? 1 : 0);
+
+	memset(tm, 0, sizeof(struct tm));
+	tm->tm_year = (int) (year - 1900);
+	tm->tm_mon  = month - 1;
+	tm->tm_mday = day_of_year - (153 * month_index + 2) / 5 + 1;
+	tm->tm_hour = seconds / 3600;
+	tm->tm_min  = (seconds / 60) % 60;
+	tm->tm_sec  = seconds % 60;
+	/* 1970-01-01 was a Thursday */
+	tm->tm_wday = (int) (((days % 7) + 11) % 7);
+	tm->tm_yday = (int) (days - days_from_civil(year, 1, 1));
+}
+
+time_t sipe_utils_timegm(struct tm *tm)
+{
+	gint64 year  = (gint64) tm->tm_year + 1900 + tm->tm_mon / 12;
+	int month    = tm->tm_mon % 12;
+	gint64 timestamp;
+
+	if (month < 0) {
+		month += 12;
+		year--;
+	}
+
+	/* day, hour, minute & second overflow is just linear */
+	timestamp = (days_from_civil(year, month + 1, 1) + tm->tm_mday - 1) * 86400 +
+		(gint64) tm->tm_hour * 3600 +
+		(gint64) tm->tm_min  * 60 +
+		tm->tm_sec;
+
+	/* normalize fields, like mktime(3) */
+	sipe_utils_gmtime((time_t) timestamp, tm);
+
+	return((time_t) timestamp);
+}
+
 const gchar *sipe_utils_time_to_debug_str(const struct tm *tm)
 {
 	gchar *buffer = asctime(tm);
@@ -584,8 +686,78 @@ void sipe_utils_shrink_buffer(struct sipe_transport_connection *conn,
 			      const gchar *unread)
 {
 	conn->buffer_used -= unread - conn->buffer;
-	/* string terminator is not included in buffer_used */
-	memmove(conn->buffer, unread, conn->buffer_used + 1);
+	if (conn->buffer_used) {
+		/* string terminator is already in place */
+		conn->buffer = (gchar *) unread;
+	} else {
+		/* buffer is empty -> restart at the beginning */
+		conn->buffer    = conn->buffer_memory;
+		conn->buffer[0] = '\0';
+	}
+}
+
+#define INPUT_BUFFER_MINIMUM 4096
+
+gchar *sipe_core_transport_input_buffer(struct sipe_transport_connection *conn,
+					gsize *length)
+{
+	gsize offset    = conn->buffer_memory ? conn->buffer - conn->buffer_memory : 0;
+	/* minus 1 for the string terminator */
+	gsize available = conn->buffer_length ?
+		conn->buffer_length - offset - conn->buffer_used - 1 :
+		0;
+
+	if (available < INPUT_BUFFER_MINIMUM) {
+
+		/* more than half of the buffer consumed -> compact */
+		if (offset > conn->buffer_length / 2) {
+			memmove(conn->buffer_memory,
+				conn->buffer,
+				conn->buffer_used + 1);
+			conn->buffer = conn->buffer_memory;
+			available   += offset;
+			offset       = 0;
+		}
+
+		/* still too small -> grow geometrically */
+		if (available < INPUT_BUFFER_MINIMUM) {
+			gsize needed     = offset + conn->buffer_used + 1 + INPUT_BUFFER_MINIMUM;
+			gsize new_length = MAX(conn->buffer_length, INPUT_BUFFER_MINIMUM);
+
+			while (new_length < needed)
+				new_length *= 2;
+
+			conn->buffer_memory = g_realloc(conn->buffer_memory,
+							new_length);
+			conn->buffer        = conn->buffer_memory + offset;
+			if (conn->buffer_length == 0)
+				conn->buffer[0] = '\0';
+			conn->buffer_length = new_length;
+			available           = new_length - offset - conn->buffer_used - 1;
+
+			SIPE_DEBUG_INFO("sipe_core_transport_input_buffer: new buffer length %" G_GSIZE_FORMAT,
+					new_length);
+		}
+	}
+
+	*length = available;
+	return(conn->buffer + conn->buffer_used);
+}
+
+void sipe_core_transport_input_received(struct sipe_transport_connection *conn,
+					gsize length)
+{
+	conn->buffer_used += length;
+	conn->buffer[conn->buffer_used] = '\0';
+}
+
+void sipe_core_transport_input_free(struct sipe_transport_connection *conn)
+{
+	g_free(conn->buffer_memory);
+	conn->buffer_memory = NULL;
+	conn->buffer        = NULL;
+	conn->buffer_used   = 0;
+	conn->buffer_length = 0;
 }
 
 gboolean sipe_utils_ip_is_private(const char *ip)
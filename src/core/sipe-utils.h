@@ -281,6 +281,17 @@ gboolean sipe_strequal(const gchar *left, const gchar *right);
  */
 gboolean sipe_strcase_equal(const gchar *left, const gchar *right);
 
+/**
+ * Hash and equality functions for hash tables with case insensitive
+ * string keys, e.g. for @c g_hash_table_new()
+ *
+ * @param key string key
+ *
+ * @return hash value over the ASCII lower case key
+ */
+guint sipe_utils_strcase_hash(gconstpointer key);
+gboolean sipe_utils_strcase_key_equal(gconstpointer a, gconstpointer b);
+
 /**
  * Parses a timestamp in ISO8601 format and returns a time_t.
  * Assumes UTC if no timezone specified
@@ -303,6 +314,29 @@ sipe_utils_str_to_time(const gchar *timestamp);
 gchar *
 sipe_utils_time_to_str(time_t timestamp);
 
+/**
+ * Converts Epoch time_t to struct tm in UTC, like gmtime_r(3)
+ *
+ * Doesn't depend on the TZ environment variable or the C library.
+ *
+ * @param timestamp Epoch time
+ * @param tm        result
+ */
+void sipe_utils_gmtime(time_t timestamp, struct tm *tm);
+
+/**
+ * Converts struct tm in UTC to Epoch time_t, like timegm(3)
+ *
+ * Doesn't depend on the TZ environment variable or the C library.
+ * Fields outside their normal range are allowed, e.g. a day of month
+ * of 32. @c tm will be normalized and @c tm_wday/tm_yday will be set.
+ *
+ * @param tm broken-down UTC time
+ *
+ * @return Epoch time
+ */
+time_t sipe_utils_timegm(struct tm *tm);
+
 /**
  * Converts struct tm to human readable string
  *
@@ -417,8 +451,10 @@ gchar *sipe_utils_str_replace(const gchar *string,
 /**
  * Remove read characters from transport buffer
  *
+ * This only advances the read position, i.e. no data is copied.
+ *
  * @param conn   the transport connection
- * @param unread pointer to the first character in the buffer
+ * @param unread pointer to the first unread character in the buffer
  */
 void sipe_utils_shrink_buffer(struct sipe_transport_connection *conn,
 			      const gchar *unread);
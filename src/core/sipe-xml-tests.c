@@ -27,6 +27,9 @@
 #include <string.h>
 #include <stdarg.h>
 #include <time.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
 
 #include <glib.h>
 
@@ -76,10 +79,11 @@ char *sipe_get_epid(SIPE_UNUSED_PARAMETER const char *self_sip_uri,
 static guint succeeded = 0;
 static guint failed    = 0;
 static const gchar *teststring;
+static sipe_xml *(*parse_function)(const gchar *string, gsize length) = sipe_xml_parse;
 
 static sipe_xml *assert_parse(const gchar *s, gboolean ok)
 {
-	sipe_xml *xml = sipe_xml_parse(s, s ? strlen(s) : 0);
+	sipe_xml *xml = (*parse_function)(s, s ? strlen(s) : 0);
 
 	teststring = s ? s : "(nil)";
 
@@ -227,6 +231,233 @@ static void assert_raw(const gchar *raw,
 }
 
 
+/* streaming parser */
+static void stream_start(SIPE_UNUSED_PARAMETER sipe_xml_stream *stream,
+			 const gchar **attributes,
+			 gpointer user_data)
+{
+	GString *log = user_data;
+
+	g_string_append_c(log, '<');
+	while (*attributes) {
+		g_string_append_printf(log, "%s=%s;", attributes[0], attributes[1]);
+		attributes += 2;
+	}
+}
+
+static void stream_end(SIPE_UNUSED_PARAMETER sipe_xml_stream *stream,
+		       const gchar *text,
+		       gsize length,
+		       gpointer user_data)
+{
+	g_string_append_printf(user_data, ">%s(%" G_GSIZE_FORMAT ")", text, length);
+}
+
+static void stream_tree(SIPE_UNUSED_PARAMETER sipe_xml_stream *stream,
+			const sipe_xml *node,
+			gpointer user_data)
+{
+	gchar *string = sipe_xml_stringify(node);
+	g_string_append_printf(user_data, "[%s]", string);
+	g_free(string);
+}
+
+static void stream_stop(sipe_xml_stream *stream,
+			SIPE_UNUSED_PARAMETER const gchar **attributes,
+			SIPE_UNUSED_PARAMETER gpointer user_data)
+{
+	sipe_xml_stream_stop(stream);
+}
+
+static void assert_stream(const gchar *s,
+			  const struct sipe_xml_stream_handler *handlers,
+			  gboolean ok,
+			  const gchar *expected)
+{
+	GString *log = g_string_new("");
+	gboolean result = sipe_xml_stream_parse(s, s ? strlen(s) : 0,
+						handlers, log);
+
+	if ((ok == result) && sipe_strequal(log->str, expected)) {
+		succeeded++;
+	} else {
+		printf("[%s]\nXML stream FAILED: %d '%s' expected: '%s'\n",
+		       s ? s : "(nil)", result, log->str, expected);
+		failed++;
+	}
+	g_string_free(log, TRUE);
+}
+
+/* compare DOM and streaming parser on a presence document */
+struct stream_compare {
+	guint availability;
+	guint notes;
+};
+
+static void compare_availability(SIPE_UNUSED_PARAMETER sipe_xml_stream *stream,
+				 const gchar *text,
+				 SIPE_UNUSED_PARAMETER gsize length,
+				 gpointer user_data)
+{
+	((struct stream_compare *) user_data)->availability += atoi(text);
+}
+
+static void compare_note(SIPE_UNUSED_PARAMETER sipe_xml_stream *stream,
+			 SIPE_UNUSED_PARAMETER const gchar *text,
+			 gsize length,
+			 gpointer user_data)
+{
+	((struct stream_compare *) user_data)->notes += length;
+}
+
+static const struct sipe_xml_stream_handler compare_handlers[] = {
+	{ "categories/category/state/availability", NULL, compare_availability, NULL },
+	{ "categories/category/note/body",           NULL, compare_note,         NULL },
+	{ NULL, NULL, NULL, NULL }
+};
+
+static void compare_dom(sipe_xml *(*parse)(const gchar *string, gsize length),
+			GString *document,
+			guint iterations,
+			struct stream_compare *result)
+{
+	guint i;
+
+	for (i = 0; i < iterations; i++) {
+		sipe_xml *xml = (*parse)(document->str, document->len);
+		const sipe_xml *category;
+
+		for (category = sipe_xml_child(xml, "category");
+		     category;
+		     category = sipe_xml_twin(category)) {
+			gchar *data = sipe_xml_data(sipe_xml_child(category, "state/availability"));
+			if (data)
+				result->availability += atoi(data);
+			g_free(data);
+			data = sipe_xml_data(sipe_xml_child(category, "note/body"));
+			if (data)
+				result->notes += strlen(data);
+			g_free(data);
+		}
+		sipe_xml_free(xml);
+	}
+}
+
+/* heap in use, for the parser memory comparison in benchmark mode */
+static gssize heap_in_use(void)
+{
+#if defined(__GLIBC__) && ((__GLIBC__ > 2) || ((__GLIBC__ == 2) && (__GLIBC_MINOR__ >= 33)))
+	return(mallinfo2().uordblks);
+#else
+	return(-1);
+#endif
+}
+
+static gssize stream_heap_peak = 0;
+
+static void compare_heap_peak(SIPE_UNUSED_PARAMETER sipe_xml_stream *stream,
+			      SIPE_UNUSED_PARAMETER const gchar **attributes,
+			      SIPE_UNUSED_PARAMETER gpointer user_data)
+{
+	gssize used = heap_in_use();
+	if (used > stream_heap_peak)
+		stream_heap_peak = used;
+}
+
+static const struct sipe_xml_stream_handler heap_handlers[] = {
+	{ "categories/category", compare_heap_peak, NULL, NULL },
+	{ NULL, NULL, NULL, NULL }
+};
+
+/* memory held by a parsed document or by the streaming parser state */
+static void compare_dom_stream_memory(GString *document)
+{
+	gssize before = heap_in_use();
+	gssize dom, arena;
+	sipe_xml *xml;
+
+	if (before < 0) {
+		printf("XML DOM/arena/stream memory: not supported on this platform\n");
+		return;
+	}
+
+	xml   = sipe_xml_parse(document->str, document->len);
+	dom   = heap_in_use() - before;
+	sipe_xml_free(xml);
+
+	before = heap_in_use();
+	xml    = sipe_xml_parse_arena(document->str, document->len);
+	arena  = heap_in_use() - before;
+	sipe_xml_free(xml);
+
+	before = stream_heap_peak = heap_in_use();
+	sipe_xml_stream_parse(document->str, document->len,
+			      heap_handlers, NULL);
+
+	printf("XML DOM/arena/stream memory: DOM %" G_GSSIZE_FORMAT " arena %" G_GSSIZE_FORMAT " stream %" G_GSSIZE_FORMAT " bytes\n",
+	       dom, arena, stream_heap_peak - before);
+}
+
+static void compare_dom_stream(guint categories, guint iterations,
+			       gboolean benchmark)
+{
+	GString *document = g_string_new("<categories xmlns=\"http://schemas.microsoft.com/2006/09/sip/categories\" uri=\"sip:user@company.com\">");
+	struct stream_compare dom    = { 0, 0 };
+	struct stream_compare arena  = { 0, 0 };
+	struct stream_compare stream = { 0, 0 };
+	GTimer *timer = g_timer_new();
+	gdouble dom_time, arena_time, stream_time;
+	guint i;
+
+	for (i = 0; i < categories; i++)
+		g_string_append_printf(document,
+				       "<category name=\"state\" instance=\"%u\" publishTime=\"2019-01-01T00:00:00Z\">"
+				       "<state xsi:type=\"aggregateState\" lastActive=\"2019-01-01T00:00:00Z\" xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\">"
+				       "<availability>%u</availability><activity token=\"in-a-meeting\"/><device>Computer</device>"
+				       "</state></category>"
+				       "<category name=\"note\" instance=\"%u\" publishTime=\"2019-01-01T00:00:00Z\">"
+				       "<note><body type=\"personal\" uri=\"\">Note number %u</body></note>"
+				       "</category>",
+				       i, 3500 + i, i, i);
+	g_string_append(document, "</categories>");
+
+	g_timer_start(timer);
+	compare_dom(sipe_xml_parse, document, iterations, &dom);
+	dom_time = g_timer_elapsed(timer, NULL);
+
+	g_timer_start(timer);
+	compare_dom(sipe_xml_parse_arena, document, iterations, &arena);
+	arena_time = g_timer_elapsed(timer, NULL);
+
+	g_timer_start(timer);
+	for (i = 0; i < iterations; i++)
+		sipe_xml_stream_parse(document->str, document->len,
+				      compare_handlers, &stream);
+	stream_time = g_timer_elapsed(timer, NULL);
+
+	if ((dom.availability == stream.availability) &&
+	    (dom.notes == stream.notes) &&
+	    (dom.availability == arena.availability) &&
+	    (dom.notes == arena.notes)) {
+		succeeded++;
+	} else {
+		printf("XML DOM/arena/stream compare FAILED: %u/%u/%u %u/%u/%u\n",
+		       dom.availability, arena.availability, stream.availability,
+		       dom.notes, arena.notes, stream.notes);
+		failed++;
+	}
+
+	if (benchmark) {
+		printf("XML DOM/arena/stream compare: %u categories, %u iterations, %" G_GSIZE_FORMAT " bytes: DOM %.3fs arena %.3fs stream %.3fs\n",
+		       2 * categories, iterations, document->len,
+		       dom_time, arena_time, stream_time);
+		compare_dom_stream_memory(document);
+	}
+
+	g_timer_destroy(timer);
+	g_string_free(document, TRUE);
+}
+
 /* memory leak check */
 static gsize allocated = 0;
 
@@ -270,8 +501,10 @@ static GMemVTable memory_leak_check = {
 	NULL,
 };
 
-int main(SIPE_UNUSED_PARAMETER int argc, SIPE_UNUSED_PARAMETER char **argv)
+int main(int argc, char **argv)
 {
+	/* parser timing & memory comparison: sipe_xml_tests --benchmark */
+	gboolean benchmark = (argc > 1) && (strcmp(argv[1], "--benchmark") == 0);
 	sipe_xml *xml;
 	const sipe_xml *child1, *child2;
 
@@ -441,6 +674,88 @@ int main(SIPE_UNUSED_PARAMETER int argc, SIPE_UNUSED_PARAMETER char **argv)
 	xml = assert_parse("<a a=\"1\" a=\"2\"></a>", FALSE);
 	sipe_xml_free(xml);
 
+	/* arena parser */
+	parse_function = sipe_xml_parse_arena;
+
+	xml = assert_parse(NULL, FALSE);
+	xml = assert_parse("", FALSE);
+
+	xml = assert_parse("<test a=\"1\" B=\"x&amp;y\">a<child>b<inner>c</inner></child><child>d</child>e</test>", TRUE);
+	assert_name(xml, "test");
+	assert_data(xml, "ae");
+	assert_attribute(xml, "a", "1");
+	assert_attribute(xml, "A", "1");
+	assert_attribute(xml, "b", "x&y");
+	assert_attribute(xml, "c", NULL);
+	assert_attribute(xml, "inner", NULL);
+	assert_int_attribute(xml, "a", 1, 0);
+	child1 = assert_child(xml, "child/inner", TRUE);
+	assert_name(child1, "inner");
+	assert_data(child1, "c");
+	child1 = assert_child(xml, "child/unknown", FALSE);
+	child1 = assert_child(xml, "unknown/inner", FALSE);
+	child1 = assert_child(xml, "chil/inner", FALSE);
+	child1 = assert_child(xml, "child/inne", FALSE);
+	child1 = assert_child(xml, "childx/inner", FALSE);
+	child1 = assert_child(xml, "inner", FALSE);
+	child1 = assert_child(xml, "child", TRUE);
+	assert_data(child1, "b");
+	child2 = sipe_xml_twin(child1);
+	assert_data(child2, "d");
+	child2 = sipe_xml_twin(child2);
+	assert_data(child2, NULL);
+	assert_stringify(xml, 1, "<test a=\"1\" B=\"x&y\">ae<child>b<inner>c</inner></child><child>d</child></test>");
+	sipe_xml_free(xml);
+
+	xml = assert_parse("<m:row m:uri=\"sip:\" xmlns:m=\"http://one\"><m:data>x</m:data></m:row>", TRUE);
+	assert_name(xml, "row");
+	assert_attribute(xml, "uri", "sip:");
+	child1 = assert_child(xml, "data", TRUE);
+	assert_data(child1, "x");
+	sipe_xml_free(xml);
+
+	xml = assert_parse("<test>", FALSE);
+	xml = assert_parse("<a a=\"1\" a=\"2\"></a>", FALSE);
+
+	parse_function = sipe_xml_parse;
+
+	/* streaming parser */
+	{
+		static const struct sipe_xml_stream_handler handlers[] = {
+			{ "test",             stream_start, stream_end, NULL        },
+			{ "test/child/inner", stream_start, stream_end, NULL        },
+			{ "test/tree",        stream_start, stream_end, stream_tree },
+			{ NULL,               NULL,         NULL,       NULL        }
+		};
+		static const struct sipe_xml_stream_handler stop_handlers[] = {
+			{ "test/child",       stream_stop,  NULL,       NULL        },
+			{ "test/child/inner", stream_start, stream_end, NULL        },
+			{ NULL,               NULL,         NULL,       NULL        }
+		};
+
+		assert_stream(NULL, handlers, FALSE, "");
+		assert_stream("", handlers, FALSE, "");
+		assert_stream("<test/>", handlers, TRUE, "<>(0)");
+		assert_stream("<other>a</other>", handlers, TRUE, "");
+		assert_stream("<test a=\"1\" ns:B=\"x&amp;y\">a<child>b<inner c=\"2\">c</inner></child>d</test>",
+			      handlers, TRUE, "<a=1;B=x&y;<c=2;>c(1)>ad(2)");
+		assert_stream("<ns:test><ns:child><inner>a</inner><inner>b</inner></ns:child><other><inner>c</inner></other></ns:test>",
+			      handlers, TRUE, "<<>a(1)<>b(1)>(0)");
+		assert_stream("<test><tree a=\"1\">x<inner>y</inner></tree></test>",
+			      handlers, TRUE, "<[<tree a=\"1\">x<inner>y</inner></tree>]>(0)");
+		assert_stream("<test><child><inner>a</inner></child></test>",
+			      stop_handlers, TRUE, "");
+		assert_stream("<test><child><inner>a</inner></child>",
+			      handlers, FALSE, "<<>a(1)");
+		assert_stream("<test><tree><inner>",
+			      handlers, FALSE, "<");
+
+		if (benchmark)
+			compare_dom_stream(500, 20, TRUE);
+		else
+			compare_dom_stream(50, 1, FALSE);
+	}
+
 	/* XML raw extract */
 	assert_raw("<tag>data</tag>",        "tag",     FALSE, "data");
 	assert_raw("<tag>data</tag>",        "tag",     TRUE,  "<tag>data</tag>");
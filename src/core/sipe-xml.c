@@ -46,11 +46,39 @@ struct _sipe_xml {
 	sipe_xml *last;
 	GString *data;
 	GHashTable *attributes;
+
+	/* only for nodes allocated from an arena, see sipe_xml_parse_arena() */
+	struct _sipe_xml_arena *arena;
+	const gchar **attribute_list; /* interned name/value pairs */
+	gchar *text;
+	gsize text_length;
+};
+
+/*
+ * Arena: nodes, names, text and attribute lists are allocated from
+ * chunks of memory which are released together.
+ *
+ * Element names and attribute names are interned, i.e. names can be
+ * compared by pointer. Attribute names are compared case insensitive.
+ */
+#define SIPE_XML_ARENA_CHUNK_SIZE 8192
+
+struct _sipe_xml_arena_chunk {
+	struct _sipe_xml_arena_chunk *next;
+};
+
+struct _sipe_xml_arena {
+	struct _sipe_xml_arena_chunk *chunks;
+	gchar *free;
+	gsize available;
+	GHashTable *names;      /* element names              */
+	GHashTable *attributes; /* attribute names (caseless) */
 };
 
 struct _parser_data {
 	sipe_xml *root;
 	sipe_xml *current;
+	struct _sipe_xml_arena *arena; /* NULL: allocate from heap */
 	gboolean error;
 };
 
@@ -64,20 +92,133 @@ static guint sipe_ascii_strdown_hash(gconstpointer key)
 	return(bucket);
 }
 
+static struct _sipe_xml_arena *sipe_xml_arena_new(void)
+{
+	struct _sipe_xml_arena *arena = g_new0(struct _sipe_xml_arena, 1);
+	arena->names      = g_hash_table_new(g_str_hash, g_str_equal);
+	/* attribute names are compared case insensitive */
+	arena->attributes = g_hash_table_new(sipe_utils_strcase_hash,
+					     sipe_utils_strcase_key_equal);
+	return(arena);
+}
+
+static void sipe_xml_arena_free(struct _sipe_xml_arena *arena)
+{
+	struct _sipe_xml_arena_chunk *chunk = arena->chunks;
+
+	while (chunk) {
+		struct _sipe_xml_arena_chunk *next = chunk->next;
+		g_free(chunk);
+		chunk = next;
+	}
+	g_hash_table_destroy(arena->attributes);
+	g_hash_table_destroy(arena->names);
+	g_free(arena);
+}
+
+static gpointer sipe_xml_arena_alloc(struct _sipe_xml_arena *arena, gsize size)
+{
+	gpointer memory;
+
+	/* keep pointer alignment for all allocations */
+	size = (size + sizeof(gpointer) - 1) & ~(sizeof(gpointer) - 1);
+
+	if (size > arena->available) {
+		gsize chunk_size = MAX(size, SIPE_XML_ARENA_CHUNK_SIZE);
+		/* chunk header is padded to pointer alignment too */
+		gsize header = (sizeof(struct _sipe_xml_arena_chunk) + sizeof(gpointer) - 1) &
+			~(sizeof(gpointer) - 1);
+		struct _sipe_xml_arena_chunk *chunk = g_malloc(header + chunk_size);
+
+		chunk->next      = arena->chunks;
+		arena->chunks    = chunk;
+		arena->free      = (gchar *) chunk + header;
+		arena->available = chunk_size;
+	}
+
+	memory = arena->free;
+	arena->free      += size;
+	arena->available -= size;
+	return(memory);
+}
+
+static gchar *sipe_xml_arena_strndup(struct _sipe_xml_arena *arena,
+				     const gchar *string,
+				     gsize length)
+{
+	gchar *copy = sipe_xml_arena_alloc(arena, length + 1);
+	memcpy(copy, string, length);
+	copy[length] = '\0';
+	return(copy);
+}
+
+static const gchar *sipe_xml_arena_intern(struct _sipe_xml_arena *arena,
+					  GHashTable *table,
+					  const gchar *name)
+{
+	const gchar *interned = g_hash_table_lookup(table, name);
+
+	if (!interned) {
+		gchar *copy = sipe_xml_arena_strndup(arena, name, strlen(name));
+		g_hash_table_insert(table, copy, copy);
+		interned = copy;
+	}
+
+	return(interned);
+}
+
+static void sipe_xml_arena_append(struct _sipe_xml_arena *arena,
+				  sipe_xml *node,
+				  const gchar *text,
+				  gsize length)
+{
+	gsize old_size = (node->text_length + 1 + sizeof(gpointer) - 1) &
+		~(sizeof(gpointer) - 1);
+	gsize new_size = (node->text_length + length + 1 + sizeof(gpointer) - 1) &
+		~(sizeof(gpointer) - 1);
+
+	if (node->text &&
+	    (node->text + old_size == arena->free) &&
+	    (new_size - old_size <= arena->available)) {
+		/* text is the most recent allocation: grow it in place */
+		arena->free      += new_size - old_size;
+		arena->available -= new_size - old_size;
+	} else {
+		gchar *copy = sipe_xml_arena_alloc(arena, new_size);
+		if (node->text)
+			memcpy(copy, node->text, node->text_length);
+		node->text = copy;
+	}
+
+	memcpy(node->text + node->text_length, text, length);
+	node->text_length += length;
+	node->text[node->text_length] = '\0';
+}
+
 static void callback_start_element(void *user_data, const xmlChar *name, const xmlChar **attrs)
 {
 	struct _parser_data *pd = user_data;
+	struct _sipe_xml_arena *arena = pd->arena;
 	const char *tmp;
 	sipe_xml *node;
 
 	if (!name || pd->error) return;
 
-	node = g_new0(sipe_xml, 1);
-
 	if ((tmp = strchr((char *)name, ':')) != NULL) {
 		name = (xmlChar *)tmp + 1;
 	}
-	node->name = g_strdup((gchar *)name);
+
+	if (arena) {
+		node = sipe_xml_arena_alloc(arena, sizeof(sipe_xml));
+		memset(node, 0, sizeof(sipe_xml));
+		node->arena = arena;
+		node->name  = (gchar *) sipe_xml_arena_intern(arena,
+							      arena->names,
+							      (const gchar *) name);
+	} else {
+		node = g_new0(sipe_xml, 1);
+		node->name = g_strdup((gchar *)name);
+	}
 
 	if (!pd->root) {
 		pd->root = node;
@@ -93,7 +234,40 @@ static void callback_start_element(void *user_data, const xmlChar *name, const x
 		current->last = node;
 	}
 
-	if (attrs) {
+	if (attrs && arena) {
+		const xmlChar **attr = attrs;
+		const gchar **list;
+		guint count = 0;
+
+		while (*attr) {
+			attr += 2;
+			count++;
+		}
+
+		node->attribute_list = list = sipe_xml_arena_alloc(arena,
+								   (2 * count + 1) * sizeof(gchar *));
+		while (*attrs) {
+			const gchar *key   = (const gchar *) *attrs++;
+			const gchar *value = (const gchar *) *attrs++;
+			gchar *decoded;
+
+			if ((tmp = strchr(key, ':')) != NULL) {
+				key = tmp + 1;
+			}
+			*list++ = sipe_xml_arena_intern(arena,
+							arena->attributes,
+							key);
+
+			/* see below */
+			decoded = sipe_utils_str_replace(value, "&#38;", "&");
+			*list++ = sipe_xml_arena_strndup(arena,
+							 decoded,
+							 strlen(decoded));
+			g_free(decoded);
+		}
+		*list = NULL;
+
+	} else if (attrs) {
 		const xmlChar *key;
 
 		node->attributes = g_hash_table_new_full(sipe_ascii_strdown_hash,
@@ -132,6 +306,10 @@ static void callback_characters(void *user_data, const xmlChar *text, int text_l
 	if (!pd->current || pd->error || !text || !text_len) return;
 
 	node = pd->current;
+	if (node->arena) {
+		sipe_xml_arena_append(node->arena, node, (const gchar *) text, text_len);
+		return;
+	}
 	if (node->data)
 		node->data = g_string_append_len(node->data, (gchar *)text, text_len);
 	else
@@ -232,12 +410,45 @@ sipe_xml *sipe_xml_parse(const gchar *string, gsize length)
 	return result;
 }
 
+sipe_xml *sipe_xml_parse_arena(const gchar *string, gsize length)
+{
+	sipe_xml *result = NULL;
+
+	if (string && length) {
+		struct _parser_data *pd = g_new0(struct _parser_data, 1);
+		struct _sipe_xml_arena *arena = sipe_xml_arena_new();
+
+		pd->arena = arena;
+		if (xmlSAXUserParseMemory(&parser, pd, string, length))
+			pd->error = TRUE;
+
+		if (pd->error || !pd->root) {
+			sipe_xml_arena_free(arena);
+		} else {
+			result = pd->root;
+		}
+
+		g_free(pd);
+	}
+
+	return result;
+}
+
 void sipe_xml_free(sipe_xml *node)
 {
 	sipe_xml *child;
 
 	if (!node) return;
 
+	/* arena trees are released in one go */
+	if (node->arena) {
+		if (node->parent == NULL)
+			sipe_xml_arena_free(node->arena);
+		else
+			SIPE_DEBUG_ERROR_NOFORMAT("sipe_xml_free: partial delete attempt on arena tree ignored");
+		return;
+	}
+
 	/* we don't support partial tree deletion */
 	if (node->parent != NULL) {
 		SIPE_DEBUG_ERROR_NOFORMAT("sipe_xml_free: partial delete attempt! Expect crash or memory leaks...");
@@ -274,13 +485,20 @@ static void sipe_xml_stringify_node(GString *s, const sipe_xml *node)
 		g_hash_table_foreach(node->attributes,
 				     (GHFunc) sipe_xml_stringify_attribute,
 				     s);
+	} else if (node->attribute_list) {
+		const gchar **attr = node->attribute_list;
+		while (*attr) {
+			g_string_append_printf(s, " %s=\"%s\"", attr[0], attr[1]);
+			attr += 2;
+		}
 	}
 
-	if (node->data || node->first) {
+	if (node->data || node->text || node->first) {
 		const sipe_xml *child;
 
 		g_string_append_printf(s, ">%s",
-				       node->data ? node->data->str : "");
+				       node->data ? node->data->str :
+				       node->text ? node->text : "");
 
 		for (child = node->first; child; child = child->sibling)
 			sipe_xml_stringify_node(s, child);
@@ -309,6 +527,27 @@ const sipe_xml *sipe_xml_child(const sipe_xml *parent, const gchar *name)
 
 	if (!parent || !name) return NULL;
 
+	if (parent->arena) {
+		/* compare path elements in place, i.e. without copies */
+		const gchar *start = name;
+
+		child = parent;
+		while (child) {
+			const gchar *end = strchr(start, '/');
+			gsize length = end ? (gsize) (end - start) : strlen(start);
+
+			for (child = child->first; child; child = child->sibling)
+				if ((strncmp(child->name, start, length) == 0) &&
+				    (child->name[length] == '\0'))
+					break;
+
+			if (!end) break;
+			start = end + 1;
+		}
+
+		return child;
+	}
+
 	/* 0: child name */
 	/* 1: trailing path (optional) */
 	names = g_strsplit(name, "/", 2);
@@ -332,6 +571,13 @@ const sipe_xml *sipe_xml_twin(const sipe_xml *node)
 
 	if (!node) return NULL;
 
+	if (node->arena) {
+		for (sibling = node->sibling; sibling; sibling = sibling->sibling)
+			if (node->name == sibling->name)
+				return sibling;
+		return NULL;
+	}
+
 	for (sibling = node->sibling; sibling; sibling = sibling->sibling) {
 		if (sipe_strequal(node->name, sibling->name))
 			return sibling;
@@ -346,7 +592,22 @@ const gchar *sipe_xml_name(const sipe_xml *node)
 
 const gchar *sipe_xml_attribute(const sipe_xml *node, const gchar *attr)
 {
-	if (!node || !attr || !node->attributes) return NULL;
+	if (!node || !attr) return NULL;
+
+	if (node->attribute_list) {
+		const gchar **list = node->attribute_list;
+		const gchar *interned = g_hash_table_lookup(node->arena->attributes,
+							    attr);
+		if (!interned) return NULL;
+		while (*list) {
+			if (list[0] == interned)
+				return(list[1]);
+			list += 2;
+		}
+		return NULL;
+	}
+
+	if (!node->attributes) return NULL;
 	return(g_hash_table_lookup(node->attributes, attr));
 }
 
@@ -359,7 +620,9 @@ guint sipe_xml_int_attribute(const sipe_xml *node, const gchar *attr,
 
 gchar *sipe_xml_data(const sipe_xml *node)
 {
-	if (!node || !node->data || !node->data->str) return NULL;
+	if (!node) return NULL;
+	if (node->text) return g_strndup(node->text, node->text_length);
+	if (!node->data || !node->data->str) return NULL;
 	return g_strdup(node->data->str);
 }
 
@@ -395,6 +658,270 @@ void sipe_xml_dump(const sipe_xml *node, const gchar *path)
 }
 #endif
 
+/*
+ * Streaming XML parser
+ */
+
+struct _stream_element {
+	const struct sipe_xml_stream_handler *handler;
+	gsize path_length;      /* path length before this element       */
+	gsize text_offset;      /* start of element text in text buffer   */
+	gboolean inside;        /* handlers may match descendant elements */
+};
+
+struct _sipe_xml_stream {
+	/* MUST BE FIRST: error callbacks & subtree for tree handlers */
+	struct _parser_data tree;
+	guint tree_depth;
+
+	const struct sipe_xml_stream_handler *handlers;
+	gpointer user_data;
+	GString *path;
+	GArray *elements;       /* struct _stream_element */
+	GString *text;
+	GPtrArray *attributes;  /* NULL terminated name/value list */
+	GSList *decoded;        /* attribute values with &amp; decoded */
+	gboolean stopped;
+};
+
+static void stream_start_element(void *user_data, const xmlChar *name, const xmlChar **attrs)
+{
+	sipe_xml_stream *stream = user_data;
+	struct _stream_element element, *parent;
+	const struct sipe_xml_stream_handler *handler;
+	const gchar *tmp;
+
+	if (!name || stream->tree.error || stream->stopped) return;
+
+	/* collecting subtree for tree handler */
+	if (stream->tree_depth) {
+		callback_start_element(&stream->tree, name, attrs);
+		stream->tree_depth++;
+		return;
+	}
+
+	parent = stream->elements->len ?
+		&g_array_index(stream->elements,
+			       struct _stream_element,
+			       stream->elements->len - 1) :
+		NULL;
+	element.handler     = NULL;
+	element.path_length = stream->path->len;
+	element.text_offset = stream->text->len;
+	element.inside      = FALSE;
+
+	tmp = strchr((const gchar *) name, ':');
+	if (stream->path->len)
+		g_string_append_c(stream->path, '/');
+	g_string_append(stream->path, tmp ? tmp + 1 : (const gchar *) name);
+
+	/* skip handler lookup if no handler matches below parent */
+	if (!parent || parent->inside) {
+		gsize length = stream->path->len;
+
+		for (handler = stream->handlers; handler->path; handler++) {
+			if (strncmp(handler->path, stream->path->str, length) == 0) {
+				if (handler->path[length] == '\0')
+					element.handler = handler;
+				else if (handler->path[length] == '/')
+					element.inside = TRUE;
+			}
+		}
+	}
+	g_array_append_val(stream->elements, element);
+
+	handler = element.handler;
+	if (!handler) return;
+
+	if (handler->tree) {
+		callback_start_element(&stream->tree, name, attrs);
+		stream->tree_depth = 1;
+	} else if (handler->start) {
+		GPtrArray *attributes = stream->attributes;
+
+		g_ptr_array_set_size(attributes, 0);
+		if (attrs) {
+			const xmlChar *key;
+
+			while ((key = *attrs++) != NULL) {
+				const gchar *value = (const gchar *) *attrs++;
+
+				if ((tmp = strchr((const gchar *) key, ':')) != NULL)
+					key = (const xmlChar *) tmp + 1;
+
+				/* see callback_start_element() */
+				if (strstr(value, "&#38;")) {
+					gchar *decoded = sipe_utils_str_replace(value, "&#38;", "&");
+					stream->decoded = g_slist_prepend(stream->decoded,
+									  decoded);
+					value = decoded;
+				}
+
+				g_ptr_array_add(attributes, (gpointer) key);
+				g_ptr_array_add(attributes, (gpointer) value);
+			}
+		}
+		g_ptr_array_add(attributes, NULL);
+
+		(*handler->start)(stream,
+				  (const gchar **) attributes->pdata,
+				  stream->user_data);
+
+		sipe_utils_slist_free_full(stream->decoded, g_free);
+		stream->decoded = NULL;
+	}
+}
+
+static void stream_end_element(void *user_data, const xmlChar *name)
+{
+	sipe_xml_stream *stream = user_data;
+	const struct _stream_element *element;
+	const struct sipe_xml_stream_handler *handler;
+
+	if (!name || stream->tree.error || stream->stopped ||
+	    !stream->elements->len) return;
+
+	if (stream->tree_depth) {
+		callback_end_element(&stream->tree, name);
+		if (--stream->tree_depth) return;
+	}
+
+	element = &g_array_index(stream->elements,
+				 struct _stream_element,
+				 stream->elements->len - 1);
+	handler = element->handler;
+
+	if (handler) {
+		if (handler->tree) {
+			(*handler->tree)(stream,
+					 stream->tree.root,
+					 stream->user_data);
+			sipe_xml_free(stream->tree.root);
+			stream->tree.root    = NULL;
+			stream->tree.current = NULL;
+		} else if (handler->end) {
+			(*handler->end)(stream,
+					stream->text->str + element->text_offset,
+					stream->text->len - element->text_offset,
+					stream->user_data);
+		}
+	}
+
+	g_string_truncate(stream->text, element->text_offset);
+	g_string_truncate(stream->path, element->path_length);
+	g_array_set_size(stream->elements, stream->elements->len - 1);
+}
+
+static void stream_characters(void *user_data, const xmlChar *text, int text_len)
+{
+	sipe_xml_stream *stream = user_data;
+	const struct _stream_element *element;
+
+	if (stream->tree.error || stream->stopped || !text || !text_len)
+		return;
+
+	if (stream->tree_depth) {
+		callback_characters(&stream->tree, text, text_len);
+		return;
+	}
+
+	/* only collect text for elements with end handler */
+	if (!stream->elements->len) return;
+	element = &g_array_index(stream->elements,
+				 struct _stream_element,
+				 stream->elements->len - 1);
+	if (element->handler && element->handler->end)
+		g_string_append_len(stream->text, (const gchar *) text, text_len);
+}
+
+/* API doesn't accept const data structure */
+static xmlSAXHandler stream_parser = {
+	NULL,                   /* internalSubset */
+	NULL,                   /* isStandalone */
+	NULL,                   /* hasInternalSubset */
+	NULL,                   /* hasExternalSubset */
+	NULL,                   /* resolveEntity */
+	NULL,                   /* getEntity */
+	NULL,                   /* entityDecl */
+	NULL,                   /* notationDecl */
+	NULL,                   /* attributeDecl */
+	NULL,                   /* elementDecl */
+	NULL,                   /* unparsedEntityDecl */
+	NULL,                   /* setDocumentLocator */
+	NULL,                   /* startDocument */
+	NULL,                   /* endDocument */
+	stream_start_element,   /* startElement */
+	stream_end_element,     /* endElement   */
+	NULL,                   /* reference */
+	stream_characters,      /* characters */
+	NULL,                   /* ignorableWhitespace */
+	NULL,                   /* processingInstruction */
+	NULL,                   /* comment */
+	NULL,                   /* warning */
+	callback_error,         /* error */
+	NULL,                   /* fatalError */
+	NULL,                   /* getParameterEntity */
+	NULL,                   /* cdataBlock */
+	NULL,                   /* externalSubset */
+	XML_SAX2_MAGIC,         /* initialized */
+	NULL,                   /* _private */
+	NULL,                   /* startElementNs */
+	NULL,                   /* endElementNs   */
+	callback_serror,        /* serror */
+};
+
+gboolean sipe_xml_stream_parse(const gchar *string, gsize length,
+			       const struct sipe_xml_stream_handler *handlers,
+			       gpointer user_data)
+{
+	sipe_xml_stream *stream;
+	gboolean result;
+
+	if (!string || !length || !handlers) return(FALSE);
+
+	stream = g_new0(sipe_xml_stream, 1);
+	stream->handlers   = handlers;
+	stream->user_data  = user_data;
+	stream->path       = g_string_new(NULL);
+	stream->elements   = g_array_new(FALSE, FALSE,
+					 sizeof(struct _stream_element));
+	stream->text       = g_string_new(NULL);
+	stream->attributes = g_ptr_array_new();
+
+	if (xmlSAXUserParseMemory(&stream_parser, stream, string, length))
+		stream->tree.error = TRUE;
+	result = !stream->tree.error;
+
+	/* parser error or stop during subtree collection */
+	sipe_xml_free(stream->tree.root);
+	g_ptr_array_free(stream->attributes, TRUE);
+	g_string_free(stream->text, TRUE);
+	g_array_free(stream->elements, TRUE);
+	g_string_free(stream->path, TRUE);
+	g_free(stream);
+
+	return(result);
+}
+
+void sipe_xml_stream_stop(sipe_xml_stream *stream)
+{
+	stream->stopped = TRUE;
+}
+
+const gchar *sipe_xml_stream_attribute(const gchar **attributes,
+				       const gchar *attr)
+{
+	if (!attributes || !attr) return(NULL);
+
+	while (*attributes) {
+		if (sipe_strcase_equal(attributes[0], attr))
+			return(attributes[1]);
+		attributes += 2;
+	}
+
+	return(NULL);
+}
+
 /*
  * Other XML convenience functions not based on libpurple xmlnode.c
  */
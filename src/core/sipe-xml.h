@@ -32,6 +32,19 @@ typedef struct _sipe_xml sipe_xml;
  */
 sipe_xml *sipe_xml_parse(const gchar *string, gsize length);
 
+/**
+ * Parse XML from a string into a tree allocated from a single memory
+ * arena. Element and attribute names are interned, so lookups on large
+ * documents don't need string compares. The tree is read-only and is
+ * released in one go by @c sipe_xml_free() on the root node.
+ *
+ * @param string String with the XML to be parsed.
+ * @param length Length of the string.
+ *
+ * @return Parsed XML information. Must be @c sipe_xml_free()'d.
+ */
+sipe_xml *sipe_xml_parse_arena(const gchar *string, gsize length);
+
 /**
  * Free XML information.
  *
@@ -117,6 +130,100 @@ gchar *sipe_xml_data(const sipe_xml *node);
  */
 void sipe_xml_dump(const sipe_xml *node, const gchar *path);
 
+/* Streaming XML parser */
+
+typedef struct _sipe_xml_stream sipe_xml_stream;
+
+/**
+ * Called when an element matching the handler path starts.
+ *
+ * @param stream     Stream parser state
+ * @param attributes @c NULL terminated list of name/value pairs. Names
+ *                   have their namespace prefix removed. Only valid
+ *                   during the callback.
+ * @param user_data  User data passed to @c sipe_xml_stream_parse()
+ */
+typedef void (*sipe_xml_stream_start)(sipe_xml_stream *stream,
+				      const gchar **attributes,
+				      gpointer user_data);
+
+/**
+ * Called when an element matching the handler path ends.
+ *
+ * @param stream    Stream parser state
+ * @param text      Text content of the element, zero terminated.
+ *                  Only valid during the callback.
+ * @param length    Length of the text content
+ * @param user_data User data passed to @c sipe_xml_stream_parse()
+ */
+typedef void (*sipe_xml_stream_end)(sipe_xml_stream *stream,
+				    const gchar *text,
+				    gsize length,
+				    gpointer user_data);
+
+/**
+ * Called with the complete subtree of an element matching the handler
+ * path, i.e. the same information @c sipe_xml_parse() would return for
+ * it. Useful when a small part of a large document needs more complex
+ * processing.
+ *
+ * @param stream    Stream parser state
+ * @param node      Subtree. Only valid during the callback.
+ * @param user_data User data passed to @c sipe_xml_stream_parse()
+ */
+typedef void (*sipe_xml_stream_tree)(sipe_xml_stream *stream,
+				     const sipe_xml *node,
+				     gpointer user_data);
+
+/**
+ * Handler for elements of a streamed XML document
+ *
+ * @c path is the absolute path of the element, including the root
+ * element, without namespace prefixes, e.g. "categories/category/state".
+ * If @c tree is set then @c start and @c end are ignored.
+ */
+struct sipe_xml_stream_handler {
+	const gchar *path;
+	sipe_xml_stream_start start;
+	sipe_xml_stream_end end;
+	sipe_xml_stream_tree tree;
+};
+
+/**
+ * Parse XML from a string without building the document tree. Handlers
+ * are called while the document is parsed, i.e. on a parser error
+ * handlers for the first part of the document may already have been
+ * called.
+ *
+ * @param string    String with the XML to be parsed.
+ * @param length    Length of the string.
+ * @param handlers  Array of handlers terminated by an entry with @c NULL path.
+ * @param user_data Passed to the handlers.
+ *
+ * @return @c FALSE if the XML could not be parsed.
+ */
+gboolean sipe_xml_stream_parse(const gchar *string, gsize length,
+			       const struct sipe_xml_stream_handler *handlers,
+			       gpointer user_data);
+
+/**
+ * Stop calling handlers for the rest of the document.
+ *
+ * @param stream Stream parser state
+ */
+void sipe_xml_stream_stop(sipe_xml_stream *stream);
+
+/**
+ * Gets an attribute from an attribute list passed to a start handler.
+ *
+ * @param attributes Attribute list
+ * @param attr       The attribute to get (case insensitive).
+ *
+ * @return The value of the attribute or @c NULL.
+ */
+const gchar *sipe_xml_stream_attribute(const gchar **attributes,
+				       const gchar *attr);
+
 /* Other XML convenience functions */
 
 /**
@@ -51,43 +51,103 @@ struct sipmsg *sipmsg_parse_msg(const gchar *msg) {
 	return smsg;
 }
 
-struct sipmsg *sipmsg_parse_header(const gchar *header) {
-	struct sipmsg *msg = g_new0(struct sipmsg,1);
-	gchar **lines = g_strsplit(header,"\r\n",0);
-	gchar **parts;
-	const gchar *contentlength;
-	if(!lines[0]) {
-		g_strfreev(lines);
-		g_free(msg);
-		return NULL;
-	}
-	parts = g_strsplit(lines[0], " ", 3);
-	if(!parts[0] || !parts[1] || !parts[2]) {
-		g_strfreev(parts);
-		g_strfreev(lines);
-		g_free(msg);
-		return NULL;
-	}
-	if(strstr(parts[0],"SIP") || strstr(parts[0],"HTTP")) { /* numeric response */
-		msg->responsestr = g_strdup(parts[2]);
-		msg->response = strtol(parts[1],NULL,10);
+/* header slice: offsets and lengths relative to header block */
+struct sipmsg_header_slice {
+	guint name;
+	guint name_length;
+	guint value;
+	guint value_length;
+};
+
+/*
+ * Allocated as one block:
+ *
+ *   struct sipmsg_header_index
+ *   struct sipmsg_header_slice[<number of header lines>]
+ *   gchar                      [<header length + 1>]
+ */
+struct sipmsg_header_index {
+	const gchar *block;
+	struct sipmsg_header_slice *slices;
+	guint count;
+	gint known[SIPMSG_HEADER_MAX]; /* first slice for header or -1 */
+};
+
+#define SIPMSG_KNOWN_HEADER(name) { name, sizeof(name) - 1 }
+static const struct {
+	const gchar *name;
+	gsize length;
+} known_headers[SIPMSG_HEADER_MAX] = {
+	SIPMSG_KNOWN_HEADER("Call-ID"),
+	SIPMSG_KNOWN_HEADER("CSeq"),
+	SIPMSG_KNOWN_HEADER("From"),
+	SIPMSG_KNOWN_HEADER("To"),
+	SIPMSG_KNOWN_HEADER("Via"),
+	SIPMSG_KNOWN_HEADER("Contact"),
+	SIPMSG_KNOWN_HEADER("Event"),
+	SIPMSG_KNOWN_HEADER("Expires"),
+	SIPMSG_KNOWN_HEADER("Content-Type"),
+	SIPMSG_KNOWN_HEADER("Content-Length"),
+	SIPMSG_KNOWN_HEADER("Transfer-Encoding"),
+	SIPMSG_KNOWN_HEADER("Subscription-State"),
+	SIPMSG_KNOWN_HEADER("Authentication-Info"),
+	SIPMSG_KNOWN_HEADER("WWW-Authenticate"),
+	SIPMSG_KNOWN_HEADER("Proxy-Authenticate"),
+	SIPMSG_KNOWN_HEADER("ms-diagnostics"),
+	SIPMSG_KNOWN_HEADER("ms-diagnostics-public"),
+	SIPMSG_KNOWN_HEADER("Record-Route"),
+	SIPMSG_KNOWN_HEADER("Supported"),
+	SIPMSG_KNOWN_HEADER("Warning"),
+};
+
+static gint sipmsg_known_header_id(const gchar *name, gsize length)
+{
+	guint id;
+
+	for (id = 0; id < SIPMSG_HEADER_MAX; id++)
+		if ((known_headers[id].length == length) &&
+		    !g_ascii_strncasecmp(known_headers[id].name, name, length))
+			return(id);
+
+	return(-1);
+}
+
+/* "<method> <target> SIP/2.0" or "SIP/2.0 <code> <reason>" */
+static gboolean sipmsg_parse_start_line(struct sipmsg *msg,
+					const gchar *line,
+					gsize length)
+{
+	const gchar *end   = line + length;
+	const gchar *first = memchr(line, ' ', length);
+	const gchar *second;
+
+	if (!first)
+		return(FALSE);
+	second = memchr(first + 1, ' ', end - first - 1);
+	if (!second)
+		return(FALSE);
+
+	if (g_strstr_len(line, first - line, "SIP") ||
+	    g_strstr_len(line, first - line, "HTTP")) { /* numeric response */
+		msg->responsestr = g_strndup(second + 1, end - second - 1);
+		msg->response = strtol(first + 1, NULL, 10);
 	} else { /* request */
-		msg->method = g_strdup(parts[0]);
-		msg->target = g_strdup(parts[1]);
+		msg->method = g_strndup(line, first - line);
+		msg->target = g_strndup(first + 1, second - first - 1);
 		msg->response = 0;
 	}
-	g_strfreev(parts);
-	if (sipe_utils_parse_lines(&msg->headers, lines + 1, ":") == FALSE) {
-		g_strfreev(lines);
-		sipmsg_free(msg);
-		return NULL;
-	}
-	g_strfreev(lines);
-	contentlength = sipmsg_find_header(msg, "Content-Length");
+
+	return(TRUE);
+}
+
+static struct sipmsg *sipmsg_parse_header_finish(struct sipmsg *msg)
+{
+	gchar **parts;
+	const gchar *contentlength = sipmsg_find_known_header(msg, SIPMSG_HEADER_CONTENT_LENGTH);
 	if (contentlength) {
 		msg->bodylen = strtol(contentlength,NULL,10);
 	} else {
-		const gchar *tmp = sipmsg_find_header(msg, "Transfer-Encoding");
+		const gchar *tmp = sipmsg_find_known_header(msg, SIPMSG_HEADER_TRANSFER_ENCODING);
 		if (tmp && sipe_strcase_equal(tmp, "chunked")) {
 			msg->bodylen = SIPMSG_BODYLEN_CHUNKED;
 		} else {
@@ -122,8 +182,244 @@ struct sipmsg *sipmsg_parse_header(const gchar *header) {
 	return msg;
 }
 
+
+struct sipmsg *sipmsg_parse_header(const gchar *header) {
+	struct sipmsg *msg = g_new0(struct sipmsg,1);
+	gchar **lines = g_strsplit(header,"\r\n",0);
+	if(!lines[0] ||
+	   !sipmsg_parse_start_line(msg, lines[0], strlen(lines[0]))) {
+		g_strfreev(lines);
+		sipmsg_free(msg);
+		return NULL;
+	}
+	if (sipe_utils_parse_lines(&msg->headers, lines + 1, ":") == FALSE) {
+		g_strfreev(lines);
+		sipmsg_free(msg);
+		return NULL;
+	}
+	g_strfreev(lines);
+	return(sipmsg_parse_header_finish(msg));
+}
+
+struct sipmsg *sipmsg_parse_header_indexed(const gchar *header)
+{
+	struct sipmsg *msg;
+	struct sipmsg_header_index *index;
+	gsize length         = strlen(header);
+	const gchar *eol     = strstr(header, "\r\n");
+	gsize start_length   = eol ? (gsize) (eol - header) : length;
+	guint lines          = 1;
+	const gchar *tmp     = header;
+	gchar *block;
+	gchar *end;
+	gchar *r;
+	gchar *w;
+	guint i;
+
+	msg = g_new0(struct sipmsg, 1);
+	if (!sipmsg_parse_start_line(msg, header, start_length)) {
+		sipmsg_free(msg);
+		return(NULL);
+	}
+
+	/* number of lines is upper limit for number of headers */
+	while ((tmp = strchr(tmp, '\n')) != NULL) {
+		lines++;
+		tmp++;
+	}
+
+	/* single allocation for index, slices and copy of header block */
+	index = g_malloc(sizeof(struct sipmsg_header_index) +
+			 lines * sizeof(struct sipmsg_header_slice) +
+			 length + 1);
+	index->slices = (struct sipmsg_header_slice *) (index + 1);
+	index->block  = block = (gchar *) (index->slices + lines);
+	index->count  = 0;
+	for (i = 0; i < SIPMSG_HEADER_MAX; i++)
+		index->known[i] = -1;
+	memcpy(block, header, length + 1);
+	msg->header_index = index;
+
+	/*
+	 * Split header lines in place. Names and values are zero terminated
+	 * and folded lines are joined. The write position "w" never passes
+	 * the read position "r", i.e. unprocessed data is never overwritten.
+	 */
+	end = block + length;
+	r   = w = block + start_length + (eol ? 2 : 0);
+	while (r < end) {
+		struct sipmsg_header_slice *slice;
+		gchar *colon;
+		gint id;
+
+		eol = strstr(r, "\r\n");
+		if (!eol)
+			eol = end;
+
+		/* same as sipe_utils_parse_lines(): short line ends header */
+		if (eol - r <= 2)
+			break;
+
+		colon = memchr(r, ':', eol - r);
+		if (!colon) {
+			sipmsg_free(msg);
+			return(NULL);
+		}
+
+		slice = index->slices + index->count;
+		slice->name        = w - block;
+		slice->name_length = colon - r;
+		memmove(w, r, slice->name_length);
+		w += slice->name_length;
+		*w++ = '\0';
+
+		r = colon + 1;
+		while (*r == ' ' || *r == '\t')
+			r++;
+		slice->value = w - block;
+		memmove(w, r, eol - r);
+		w += eol - r;
+		r  = (eol < end) ? (gchar *) eol + 2 : end;
+
+		/* folded header: join with continuation lines */
+		while ((r < end) && (*r == ' ' || *r == '\t')) {
+			while (*r == ' ' || *r == '\t')
+				r++;
+			eol = strstr(r, "\r\n");
+			if (!eol)
+				eol = end;
+			*w++ = ' ';
+			memmove(w, r, eol - r);
+			w += eol - r;
+			r  = (eol < end) ? (gchar *) eol + 2 : end;
+		}
+		slice->value_length = w - block - slice->value;
+		*w++ = '\0';
+
+		id = sipmsg_known_header_id(block + slice->name,
+					    slice->name_length);
+		if ((id >= 0) && (index->known[id] < 0))
+			index->known[id] = index->count;
+		index->count++;
+	}
+
+	return(sipmsg_parse_header_finish(msg));
+}
+
+/*
+ * Removed headers are only marked as such, i.e. pointers returned by
+ * sipmsg_find_*() for the other headers stay valid until sipmsg_free().
+ */
+#define SIPMSG_HEADER_SLICE_REMOVED G_MAXUINT
+
+static gboolean sipmsg_header_slice_match(const struct sipmsg_header_index *index,
+					  const struct sipmsg_header_slice *slice,
+					  const gchar *name,
+					  gsize length)
+{
+	// OCS2005 can send the same header in either all caps or mixed case
+	return((slice->name != SIPMSG_HEADER_SLICE_REMOVED) &&
+	       (slice->name_length == length) &&
+	       !g_ascii_strncasecmp(index->block + slice->name,
+				    name,
+				    length));
+}
+
+static void sipmsg_header_slice_remove(struct sipmsg_header_index *index,
+				       guint i)
+{
+	struct sipmsg_header_slice *slice = index->slices + i;
+	gint id = sipmsg_known_header_id(index->block + slice->name,
+					 slice->name_length);
+
+	slice->name = SIPMSG_HEADER_SLICE_REMOVED;
+
+	/* next instance, if any, becomes the first one */
+	if ((id >= 0) && (index->known[id] == (gint) i)) {
+		index->known[id] = -1;
+		while (++i < index->count)
+			if (sipmsg_header_slice_match(index,
+						      index->slices + i,
+						      known_headers[id].name,
+						      known_headers[id].length)) {
+				index->known[id] = i;
+				break;
+			}
+	}
+}
+
+void sipmsg_header_iter_init(struct sipmsg_header_iter *iter,
+			     const struct sipmsg *msg)
+{
+	iter->msg   = msg;
+	iter->slice = 0;
+	iter->entry = msg->headers;
+}
+
+gboolean sipmsg_header_iter_next(struct sipmsg_header_iter *iter,
+				 const gchar **name,
+				 const gchar **value)
+{
+	const struct sipmsg_header_index *index = iter->msg->header_index;
+
+	while (index && (iter->slice < index->count)) {
+		const struct sipmsg_header_slice *slice = index->slices + iter->slice++;
+		if (slice->name != SIPMSG_HEADER_SLICE_REMOVED) {
+			*name  = index->block + slice->name;
+			*value = index->block + slice->value;
+			return(TRUE);
+		}
+	}
+
+	if (iter->entry) {
+		const struct sipnameval *elem = iter->entry->data;
+		*name       = elem->name;
+		*value      = elem->value;
+		iter->entry = g_slist_next(iter->entry);
+		return(TRUE);
+	}
+
+	return(FALSE);
+}
+
+struct sipmsg *sipmsg_new_request(const gchar *method, const gchar *target)
+{
+	struct sipmsg *msg = g_new0(struct sipmsg, 1);
+
+	msg->method = g_strdup(method);
+	msg->target = g_strdup(target);
+
+	return(msg);
+}
+
+gboolean sipmsg_add_headers_now(struct sipmsg *msg, const gchar *headers)
+{
+	gchar **lines = g_strsplit(headers, "\r\n", 0);
+	gboolean result = sipe_utils_parse_lines(&msg->headers, lines, ":");
+	g_strfreev(lines);
+	msg->headers_tail = NULL;
+
+	return(result);
+}
+
+void sipmsg_set_body(struct sipmsg *msg, const gchar *body)
+{
+	gsize length = body ? strlen(body) : 0;
+	gchar *tmp   = g_strdup_printf("%" G_GSIZE_FORMAT, length);
+
+	sipmsg_add_header_now(msg, "Content-Length", tmp);
+	g_free(tmp);
+
+	g_free(msg->body);
+	msg->body    = g_strdup(body ? body : "");
+	msg->bodylen = length;
+}
+
 struct sipmsg *sipmsg_copy(const struct sipmsg *other) {
 	struct sipmsg *msg = g_new0(struct sipmsg, 1);
+	struct sipmsg_header_iter iter;
+	const gchar *name;
+	const gchar *value;
 	GSList *list;
 
 	msg->response		= other->response;
@@ -131,12 +427,9 @@ struct sipmsg *sipmsg_copy(const struct sipmsg *other) {
 	msg->method		= g_strdup(other->method);
 	msg->target		= g_strdup(other->target);
 
-	list = other->headers;
-	while(list) {
-		struct sipnameval *elem = list->data;
-		sipmsg_add_header_now(msg, elem->name, elem->value);
-		list = list->next;
-	}
+	sipmsg_header_iter_init(&iter, other);
+	while (sipmsg_header_iter_next(&iter, &name, &value))
+		sipmsg_add_header_now(msg, name, value);
 
 	list = other->new_headers;
 	while(list) {
@@ -155,9 +448,20 @@ struct sipmsg *sipmsg_copy(const struct sipmsg *other) {
 }
 
 char *sipmsg_to_string(const struct sipmsg *msg) {
-	GSList *cur;
-	GString *outstr = g_string_new("");
-	struct sipnameval *elem;
+	struct sipmsg_header_iter iter;
+	const gchar *name;
+	const gchar *value;
+	const gchar *body = msg->bodylen ? msg->body : "";
+	/* start line + empty line + body */
+	gsize length = (msg->method ? strlen(msg->method) : 0) +
+		(msg->target ? strlen(msg->target) : 0) + 32 + strlen(body);
+	GString *outstr;
+
+	/* allocate output buffer only once */
+	sipmsg_header_iter_init(&iter, msg);
+	while (sipmsg_header_iter_next(&iter, &name, &value))
+		length += strlen(name) + strlen(value) + 4;
+	outstr = g_string_sized_new(length);
 
 	if(msg->response)
 		g_string_append_printf(outstr, "SIP/2.0 %d Unknown\r\n",
@@ -166,24 +470,41 @@ char *sipmsg_to_string(const struct sipmsg *msg) {
 		g_string_append_printf(outstr, "%s %s SIP/2.0\r\n",
 			msg->method, msg->target);
 
-	cur = msg->headers;
-	while(cur) {
-		elem = cur->data;
+	sipmsg_header_iter_init(&iter, msg);
+	while (sipmsg_header_iter_next(&iter, &name, &value)) {
                 /*Todo: remove the LFCR in a good way*/
-                /*if(sipe_strequal(elem->name,"Proxy-Authorization"))
-                  g_string_append_printf(outstr, "%s: %s", elem->name,
-			elem->value);
+                /*if(sipe_strequal(name,"Proxy-Authorization"))
+                  g_string_append_printf(outstr, "%s: %s", name,
+			value);
                 else     */
-		   g_string_append_printf(outstr, "%s: %s\r\n", elem->name,
-			elem->value);
-		cur = g_slist_next(cur);
+		g_string_append(outstr, name);
+		g_string_append_len(outstr, ": ", 2);
+		g_string_append(outstr, value);
+		g_string_append_len(outstr, "\r\n", 2);
 	}
 
-	g_string_append_printf(outstr, "\r\n%s", msg->bodylen ? msg->body : "");
+	g_string_append_len(outstr, "\r\n", 2);
+	g_string_append(outstr, body);
 
 	return g_string_free(outstr, FALSE);
 }
 
+/* constant time append, the tail is only searched after list changes */
+static void sipmsg_headers_append(struct sipmsg *msg,
+				  struct sipnameval *element)
+{
+	GSList *entry = g_slist_alloc();
+
+	entry->data = element;
+	if (!msg->headers_tail)
+		msg->headers_tail = g_slist_last(msg->headers);
+	if (msg->headers_tail)
+		msg->headers_tail->next = entry;
+	else
+		msg->headers = entry;
+	msg->headers_tail = entry;
+}
+
 /**
  * Adds header to current message headers
  */
@@ -199,7 +520,7 @@ void sipmsg_add_header_now(struct sipmsg *msg, const gchar *name, const gchar *v
 
 	element->name = g_strdup(name);
 	element->value = g_strdup(value);
-	msg->headers = g_slist_append(msg->headers, element);
+	sipmsg_headers_append(msg, element);
 }
 
 /**
@@ -222,29 +543,50 @@ void sipmsg_add_header(struct sipmsg *msg, const gchar *name, const gchar *value
 /**
  * Removes header if it's not in keepers array
  */
+static gboolean sipmsg_header_keeper(const gchar *name, gsize length,
+				     const gchar *keepers[])
+{
+	int i;
+
+	for (i = 0; keepers[i]; i++)
+		if ((strlen(keepers[i]) == length) &&
+		    !g_ascii_strncasecmp(name, keepers[i], length))
+			return(TRUE);
+
+	return(FALSE);
+}
+
 void sipmsg_strip_headers(struct sipmsg *msg, const gchar *keepers[]) {
+	struct sipmsg_header_index *index = msg->header_index;
 	GSList *entry;
 	struct sipnameval *elem;
 
-	entry = msg->headers;
-	while(entry) {
-		int i = 0;
-		gboolean keeper = FALSE;
+	if (index) {
+		guint i;
 
-		elem = entry->data;
-		while (keepers[i]) {
-			if (!g_ascii_strcasecmp(elem->name, keepers[i])) {
-				keeper = TRUE;
-				break;
+		for (i = 0; i < index->count; i++) {
+			const struct sipmsg_header_slice *slice = index->slices + i;
+
+			if ((slice->name != SIPMSG_HEADER_SLICE_REMOVED) &&
+			    !sipmsg_header_keeper(index->block + slice->name,
+						  slice->name_length,
+						  keepers)) {
+				SIPE_DEBUG_INFO("sipmsg_strip_headers: removing %s",
+						index->block + slice->name);
+				sipmsg_header_slice_remove(index, i);
 			}
-			i++;
 		}
+	}
 
-		if (!keeper) {
+	entry = msg->headers;
+	while(entry) {
+		elem = entry->data;
+		if (!sipmsg_header_keeper(elem->name, strlen(elem->name), keepers)) {
 			GSList *to_delete = entry;
 			SIPE_DEBUG_INFO("sipmsg_strip_headers: removing %s", elem->name);
 			entry = g_slist_next(entry);
 			msg->headers = g_slist_delete_link(msg->headers, to_delete);
+			msg->headers_tail = NULL;
 			g_free(elem->name);
 			g_free(elem->value);
 			g_free(elem);
@@ -258,16 +600,19 @@ void sipmsg_strip_headers(struct sipmsg *msg, const gchar *keepers[]) {
  * Merges newly added headers to message
  */
 void sipmsg_merge_new_headers(struct sipmsg *msg) {
-	while(msg->new_headers) {
-		msg->headers = g_slist_append(msg->headers, msg->new_headers->data);
-		msg->new_headers = g_slist_remove(msg->new_headers, msg->new_headers->data);
-	}
+	GSList *entry;
+
+	for (entry = msg->new_headers; entry; entry = entry->next)
+		sipmsg_headers_append(msg, entry->data);
+	g_slist_free(msg->new_headers);
+	msg->new_headers = NULL;
 }
 
 void sipmsg_free(struct sipmsg *msg) {
 	if (msg) {
 		sipe_utils_nameval_free(msg->headers);
 		sipe_utils_nameval_free(msg->new_headers);
+		g_free(msg->header_index);
 		g_free(msg->signature);
 		g_free(msg->rand);
 		g_free(msg->num);
@@ -280,13 +625,31 @@ void sipmsg_free(struct sipmsg *msg) {
 }
 
 void sipmsg_remove_header_now(struct sipmsg *msg, const gchar *name) {
+	struct sipmsg_header_index *index = msg->header_index;
 	struct sipnameval *elem;
-	GSList *tmp = msg->headers;
+	GSList *tmp;
+
+	if (index) {
+		gsize length = strlen(name);
+		guint i;
+
+		for (i = 0; i < index->count; i++)
+			if (sipmsg_header_slice_match(index,
+						      index->slices + i,
+						      name,
+						      length)) {
+				sipmsg_header_slice_remove(index, i);
+				return;
+			}
+	}
+
+	tmp = msg->headers;
 	while(tmp) {
 		elem = tmp->data;
 		// OCS2005 can send the same header in either all caps or mixed case
 		if (sipe_strcase_equal(elem->name, name)) {
 			msg->headers = g_slist_remove(msg->headers, elem);
+			msg->headers_tail = NULL;
 			g_free(elem->name);
 			g_free(elem->value);
 			g_free(elem);
@@ -297,11 +660,38 @@ void sipmsg_remove_header_now(struct sipmsg *msg, const gchar *name) {
 	return;
 }
 
+const gchar *sipmsg_find_known_header(const struct sipmsg *msg,
+				      enum sipmsg_header_id id) {
+	const struct sipmsg_header_index *index = msg->header_index;
+
+	if (index && (index->known[id] >= 0))
+		return(index->block + index->slices[index->known[id]].value);
+
+	return(sipe_utils_nameval_find(msg->headers, known_headers[id].name));
+}
+
 const gchar *sipmsg_find_header(const struct sipmsg *msg, const gchar *name) {
-	return sipe_utils_nameval_find_instance (msg->headers, name, 0);
+	gint id = sipmsg_known_header_id(name, strlen(name));
+	if (id >= 0)
+		return(sipmsg_find_known_header(msg, id));
+	return sipmsg_find_header_instance(msg, name, 0);
 }
 
 const gchar *sipmsg_find_header_instance(const struct sipmsg *msg, const gchar *name, int which) {
+	const struct sipmsg_header_index *index = msg->header_index;
+
+	if (index) {
+		gsize length = strlen(name);
+		guint i;
+
+		for (i = 0; i < index->count; i++) {
+			const struct sipmsg_header_slice *slice = index->slices + i;
+			if (sipmsg_header_slice_match(index, slice, name, length) &&
+			    (which-- == 0))
+				return(index->block + slice->value);
+		}
+	}
+
 	return sipe_utils_nameval_find_instance(msg->headers, name, which);
 }
 
@@ -436,8 +826,9 @@ void sipmsg_parse_p_asserted_identity(const gchar *header, gchar **sip_uri,
  */
 
 const gchar *sipmsg_find_auth_header(struct sipmsg *msg, const gchar *name) {
-	GSList *tmp;
-	struct sipnameval *elem;
+	struct sipmsg_header_iter iter;
+	const gchar *header;
+	const gchar *value;
 	int name_len;
 
 	if (!name) {
@@ -446,20 +837,16 @@ const gchar *sipmsg_find_auth_header(struct sipmsg *msg, const gchar *name) {
 	}
 
 	name_len = strlen(name);
-	tmp = msg->headers;
-	while(tmp) {
-		elem = tmp->data;
-		/* SIPE_DEBUG_INFO("Current header: %s", elem->value); */
-		if (elem && elem->name &&
-		    (sipe_strcase_equal(elem->name,"WWW-Authenticate") ||
-		     sipe_strcase_equal(elem->name,"Authentication-Info")) ) {
-			if (!g_ascii_strncasecmp((gchar *)elem->value, name, name_len)) {
-				/* SIPE_DEBUG_INFO("elem->value: %s", elem->value); */
-				return elem->value;
+	sipmsg_header_iter_init(&iter, msg);
+	while (sipmsg_header_iter_next(&iter, &header, &value)) {
+		/* SIPE_DEBUG_INFO("Current header: %s", value); */
+		if (sipe_strcase_equal(header,"WWW-Authenticate") ||
+		    sipe_strcase_equal(header,"Authentication-Info")) {
+			if (!g_ascii_strncasecmp(value, name, name_len)) {
+				/* SIPE_DEBUG_INFO("value: %s", value); */
+				return value;
 			}
 		}
-		/* SIPE_DEBUG_INFO_NOFORMAT("moving to next header"); */
-		tmp = g_slist_next(tmp);
 	}
 	SIPE_DEBUG_INFO("sipmsg_find_auth_header: '%s' not found", name);
 	return NULL;
@@ -696,7 +1083,7 @@ sipmsg_parse_warning(struct sipmsg *msg, gchar **reason)
 	 * Example header:
 	 * Warning: 310 lcs.microsoft.com "You are currently not using the recommended version of the client"
 	 */
-	const gchar *hdr = sipmsg_find_header(msg, "Warning");
+	const gchar *hdr = sipmsg_find_known_header(msg, SIPMSG_HEADER_WARNING);
 	int code = -1;
 
 	if (reason)
@@ -722,31 +1109,31 @@ sipmsg_parse_warning(struct sipmsg *msg, gchar **reason)
 }
 
 const gchar *sipmsg_find_call_id_header(const struct sipmsg *msg) {
-	return(sipmsg_find_header(msg, "Call-ID"));
+	return(sipmsg_find_known_header(msg, SIPMSG_HEADER_CALL_ID));
 }
 
 const gchar *sipmsg_find_content_type_header(const struct sipmsg *msg) {
-	return(sipmsg_find_header(msg, "Content-Type"));
+	return(sipmsg_find_known_header(msg, SIPMSG_HEADER_CONTENT_TYPE));
 }
 
 const gchar *sipmsg_find_cseq_header(const struct sipmsg *msg) {
-	return(sipmsg_find_header(msg, "CSeq"));
+	return(sipmsg_find_known_header(msg, SIPMSG_HEADER_CSEQ));
 }
 
 const gchar *sipmsg_find_event_header(const struct sipmsg *msg) {
-	return(sipmsg_find_header(msg, "Event"));
+	return(sipmsg_find_known_header(msg, SIPMSG_HEADER_EVENT));
 }
 
 const gchar *sipmsg_find_expires_header(const struct sipmsg *msg) {
-	return(sipmsg_find_header(msg, "Expires"));
+	return(sipmsg_find_known_header(msg, SIPMSG_HEADER_EXPIRES));
 }
 
 const gchar *sipmsg_find_from_header(const struct sipmsg *msg) {
-	return(sipmsg_find_header(msg, "From"));
+	return(sipmsg_find_known_header(msg, SIPMSG_HEADER_FROM));
 }
 
 const gchar *sipmsg_find_to_header(const struct sipmsg *msg) {
-	return(sipmsg_find_header(msg, "To"));
+	return(sipmsg_find_known_header(msg, SIPMSG_HEADER_TO));
 }
 
 gchar *sipmsg_parse_address_from_header(const struct sipmsg *msg,
@@ -31,12 +31,44 @@
 #define SIPMSG_RESPONSE_FATAL_ERROR -1
 #define SIPMSG_BODYLEN_CHUNKED      -1
 
+/* Well-known headers: constant time lookup for indexed messages */
+enum sipmsg_header_id {
+	SIPMSG_HEADER_CALL_ID = 0,
+	SIPMSG_HEADER_CSEQ,
+	SIPMSG_HEADER_FROM,
+	SIPMSG_HEADER_TO,
+	SIPMSG_HEADER_VIA,
+	SIPMSG_HEADER_CONTACT,
+	SIPMSG_HEADER_EVENT,
+	SIPMSG_HEADER_EXPIRES,
+	SIPMSG_HEADER_CONTENT_TYPE,
+	SIPMSG_HEADER_CONTENT_LENGTH,
+	SIPMSG_HEADER_TRANSFER_ENCODING,
+	SIPMSG_HEADER_SUBSCRIPTION_STATE,
+	SIPMSG_HEADER_AUTHENTICATION_INFO,
+	SIPMSG_HEADER_WWW_AUTHENTICATE,
+	SIPMSG_HEADER_PROXY_AUTHENTICATE,
+	SIPMSG_HEADER_MS_DIAGNOSTICS,
+	SIPMSG_HEADER_MS_DIAGNOSTICS_PUBLIC,
+	SIPMSG_HEADER_RECORD_ROUTE,
+	SIPMSG_HEADER_SUPPORTED,
+	SIPMSG_HEADER_WARNING,
+	SIPMSG_HEADER_MAX /* must be last */
+};
+
+struct sipmsg_header_index;
+
 struct sipmsg {
 	int response; /* 0 means request, otherwise response code */
 	gchar *responsestr;
 	gchar *method;
 	gchar *target;
+	/* headers received by sipmsg_parse_header_indexed() */
+	struct sipmsg_header_index *header_index;
+	/* headers as list of sipnameval, i.e. all headers for a message
+	   without index or those added after sipmsg_parse_header_indexed() */
 	GSList *headers;
+	GSList *headers_tail; /* last entry of headers, NULL if unknown */
 	GSList *new_headers;
 	int bodylen;
 	gchar *body;
@@ -51,8 +83,87 @@ struct sipendpoint {
 };
 
 
+/* Iterator over all headers of a message, see sipmsg_header_iter_next() */
+struct sipmsg_header_iter {
+	const struct sipmsg *msg;
+	guint slice;
+	const GSList *entry;
+};
+
 struct sipmsg *sipmsg_parse_msg(const gchar *msg);
 struct sipmsg *sipmsg_parse_header(const gchar *header);
+
+/**
+ * Parse SIP message header without splitting it into separate strings
+ *
+ * The header block is copied once and the headers are recorded as slices
+ * into that copy. Well-known headers (@c sipmsg_header_id) are found in
+ * constant time. All sipmsg_find_*() functions work as for messages
+ * returned by @c sipmsg_parse_header(). Removed headers are only marked
+ * as such, i.e. the strings returned by sipmsg_find_*() for the remaining
+ * headers stay valid until @c sipmsg_free().
+ *
+ * @param header (in) SIP message header, i.e. everything before the
+ *                    empty line
+ *
+ * @return SIP message or @c NULL on parse failure
+ */
+struct sipmsg *sipmsg_parse_header_indexed(const gchar *header);
+
+/**
+ * Iterate over all headers of a SIP message in message order
+ *
+ * @param iter  (in) iterator to initialize
+ * @param msg   (in) SIP message
+ */
+void sipmsg_header_iter_init(struct sipmsg_header_iter *iter,
+			     const struct sipmsg *msg);
+
+/**
+ * Get next header from iterator
+ *
+ * @param iter  (in)  iterator initialized by @c sipmsg_header_iter_init()
+ * @param name  (out) header name
+ * @param value (out) header value
+ *
+ * @return @c FALSE if there are no more headers
+ */
+gboolean sipmsg_header_iter_next(struct sipmsg_header_iter *iter,
+				 const gchar **name,
+				 const gchar **value);
+
+/**
+ * Create SIP request message without parsing it from a string
+ *
+ * Add headers with @c sipmsg_add_header_now() or
+ * @c sipmsg_add_headers_now() in message order and finish it with
+ * @c sipmsg_set_body().
+ *
+ * @param method (in) request method, e.g. "SUBSCRIBE"
+ * @param target (in) request URI
+ *
+ * @return SIP message. Must be freed with @c sipmsg_free()
+ */
+struct sipmsg *sipmsg_new_request(const gchar *method, const gchar *target);
+
+/**
+ * Add preformatted headers to SIP message
+ *
+ * @param msg     (in) SIP message
+ * @param headers (in) header lines, e.g. "Event: presence\r\nExpires: 0\r\n"
+ *
+ * @return @c FALSE if any of the header lines has incorrect format
+ */
+gboolean sipmsg_add_headers_now(struct sipmsg *msg, const gchar *headers);
+
+/**
+ * Set SIP message body and add Content-Length header
+ *
+ * @param msg  (in) SIP message
+ * @param body (in) message body (may be @c NULL)
+ */
+void sipmsg_set_body(struct sipmsg *msg, const gchar *body);
+
 struct sipmsg *sipmsg_copy(const struct sipmsg *other);
 void sipmsg_add_header_now(struct sipmsg *msg, const gchar *name, const gchar *value);
 void sipmsg_add_header(struct sipmsg *msg, const gchar *name, const gchar *value);
@@ -86,6 +197,7 @@ GSList *sipmsg_parse_endpoints_header(const gchar *header);
 void sipmsg_parse_p_asserted_identity(const gchar *header, gchar **sip_uri,
 				      gchar **tel_uri);
 const gchar *sipmsg_find_header(const struct sipmsg *msg, const gchar *name);
+const gchar *sipmsg_find_known_header(const struct sipmsg *msg, enum sipmsg_header_id id);
 const gchar *sipmsg_find_header_instance(const struct sipmsg *msg, const gchar *name, int which);
 gchar *sipmsg_find_part_of_header(const char *hdr, const char * before, const char * after, const char * def);
 const gchar *sipmsg_find_auth_header(struct sipmsg *msg, const gchar *name);
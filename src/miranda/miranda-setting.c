@@ -49,7 +49,8 @@ static const gchar * const setting_name[SIPE_SETTING_LAST] = {
 	"password",       /* SIPE_SETTING_EMAIL_PASSWORD */
 	"groupchat_user", /* SIPE_SETTING_GROUPCHAT_USER */
 	"NOTDEFINED",     /* SIPE_SETTING_RDP_CLIENT     */
-	"useragent"       /* SIPE_SETTING_USER_AGENT     */
+	"useragent",      /* SIPE_SETTING_USER_AGENT     */
+	"NOTDEFINED"      /* SIPE_SETTING_SCHEDULE_SLACK */
 };
 
 const gchar *sipe_backend_setting(struct sipe_core_public *sipe_public,
@@ -37,7 +37,6 @@
 #define MIRANDA_TRANSPORT ((struct sipe_transport_miranda *) conn)
 #define SIPE_TRANSPORT_CONNECTION ((struct sipe_transport_connection *) transport)
 
-#define BUFFER_SIZE_INCREMENT 4096
 
 struct sipe_transport_miranda {
 	/* public part shared with core */
@@ -95,19 +94,14 @@ miranda_sipe_input_cb(gpointer data,
 	}
 
 	do {
-		/* Increase input buffer size as needed */
-		if (conn->buffer_length < conn->buffer_used + BUFFER_SIZE_INCREMENT) {
-			conn->buffer_length += BUFFER_SIZE_INCREMENT;
-			conn->buffer = g_realloc(conn->buffer, conn->buffer_length);
-			SIPE_DEBUG_INFO("miranda_sipe_input_cb: new buffer length %" G_GSIZE_FORMAT,
-					conn->buffer_length);
-		}
+		/* Input buffer grows as needed */
+		gsize space;
+		gchar *buffer = sipe_core_transport_input_buffer(conn, &space);
 
 		/* Try to read as much as there is space left in the buffer */
-		/* minus 1 for the string terminator */
-		readlen = conn->buffer_length - conn->buffer_used - 1;
+		readlen = space;
 
-		len = Netlib_Recv(transport->fd, conn->buffer + conn->buffer_used, readlen, MSG_NODUMP);
+		len = Netlib_Recv(transport->fd, buffer, readlen, MSG_NODUMP);
 
 		if (len == SOCKET_ERROR) {
 			SIPE_DEBUG_INFO("miranda_sipe_input_cb: read error");
@@ -123,13 +117,12 @@ miranda_sipe_input_cb(gpointer data,
 			return;
 		}
 
-		conn->buffer_used += len;
+		sipe_core_transport_input_received(conn, len);
 		firstread = FALSE;
 
 	/* Equivalence indicates that there is possibly more data to read */
 	} while (len == readlen);
 
-	conn->buffer[conn->buffer_used] = '\0';
 	UNLOCK;
 
 	transport->hDoneEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
@@ -194,7 +187,7 @@ void sipe_backend_transport_disconnect(struct sipe_transport_connection *conn)
 	if (transport->inputhandler)
 		sipe_miranda_input_remove(transport->inputhandler);
 
-	g_free(transport->public.buffer);
+	sipe_core_transport_input_free(SIPE_TRANSPORT_CONNECTION);
 	g_free(transport);
 }
 
@@ -892,6 +892,9 @@ GList * sipe_purple_account_options()
 	option = purple_account_option_string_new(_("User Agent"), "useragent", "");
 	options = g_list_append(options, option);
 
+	option = purple_account_option_string_new(_("Timer coalescing window in milliseconds\n(leave empty for default)"), "schedule_slack", "");
+	options = g_list_append(options, option);
+
 	option = purple_account_option_list_new(_("Authentication scheme"), "authentication", NULL);
 	purple_account_option_add_list_item(option, _("Auto"), "auto");
 	purple_account_option_add_list_item(option, _("NTLM"), "ntlm");
@@ -94,7 +94,6 @@ struct sipe_transport_purple {
 #define PURPLE_TRANSPORT ((struct sipe_transport_purple *) conn)
 #define SIPE_TRANSPORT_CONNECTION ((struct sipe_transport_connection *) transport)
 
-#define BUFFER_SIZE_INCREMENT 4096
 #define FLUSH_MAX_RETRIES 5
 
 
@@ -112,23 +111,18 @@ static void transport_common_input(struct sipe_transport_purple *transport)
 
 	/* Read all available data from the connection */
 	do {
-		/* Increase input buffer size as needed */
-		if (conn->buffer_length < conn->buffer_used + BUFFER_SIZE_INCREMENT) {
-			conn->buffer_length += BUFFER_SIZE_INCREMENT;
-			conn->buffer = g_realloc(conn->buffer, conn->buffer_length);
-			SIPE_DEBUG_INFO("transport_input_common: new buffer length %" G_GSIZE_FORMAT,
-					conn->buffer_length);
-		}
+		/* Input buffer grows as needed */
+		gsize space;
+		gchar *buffer = sipe_core_transport_input_buffer(conn, &space);
 
 		/* Try to read as much as there is space left in the buffer */
-		/* minus 1 for the string terminator */
-		readlen = conn->buffer_length - conn->buffer_used - 1;
+		readlen = space;
 		len = transport->gsc ?
 			(gssize) purple_ssl_read(transport->gsc,
-						 conn->buffer + conn->buffer_used,
+						 buffer,
 						 readlen) :
 			read(transport->socket,
-			     conn->buffer + conn->buffer_used,
+			     buffer,
 			     readlen);
 
 		if (len < 0 && errno == EAGAIN) {
@@ -158,13 +152,12 @@ static void transport_common_input(struct sipe_transport_purple *transport)
 			return;
 		}
 
-		conn->buffer_used += len;
+		sipe_core_transport_input_received(conn, len);
 		firstread = FALSE;
 
 	/* Equivalence indicates that there is possibly more data to read */
 	} while (len == readlen);
 
-	conn->buffer[conn->buffer_used] = '\0';
         transport->input(conn);
 }
 
@@ -430,7 +423,7 @@ void sipe_backend_transport_disconnect(struct sipe_transport_connection *conn)
 #else
 		purple_circ_buffer_destroy(transport->transmit_buffer);
 #endif
-	g_free(transport->public.buffer);
+	sipe_core_transport_input_free(SIPE_TRANSPORT_CONNECTION);
 
 	/* defer deletion of transport data structure to idle callback */
 	transport->is_valid = FALSE;